@@ -0,0 +1,95 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_BENCHMARK_COMMON_SEEN
+#define CUPT_BENCHMARK_COMMON_SEEN
+
+// helpers shared by the benchmark programs
+
+#include <chrono>
+#include <functional>
+
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cupt/common.hpp>
+
+inline double getSecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+// runs the function in a child process, so that every measurement gets its
+// own peak memory (in KiB); returns the report of the function, "failed" if it
+// threw or the reason why the child died
+inline std::string runInChild(const std::function< std::string () >& function, long* peakMemory)
+{
+	using namespace cupt;
+
+	int fds[2];
+	if (pipe(fds) == -1)
+	{
+		fatal2e("unable to create a pipe");
+	}
+	auto pid = fork();
+	if (pid == -1)
+	{
+		fatal2e("unable to fork");
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		string report;
+		try
+		{
+			report = function();
+		}
+		catch (Exception&)
+		{
+			report = "failed";
+		}
+		if (write(fds[1], report.c_str(), report.size()) == -1) {}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	string report;
+	char buffer[256];
+	ssize_t readCount;
+	while ((readCount = read(fds[0], buffer, sizeof(buffer))) > 0)
+	{
+		report.append(buffer, readCount);
+	}
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) == -1)
+	{
+		fatal2e("unable to wait for the child process");
+	}
+	if (report.empty())
+	{
+		report = WIFSIGNALED(status) ? format2("killed by the signal %d", WTERMSIG(status)) : "crashed";
+	}
+	*peakMemory = usage.ru_maxrss;
+	return report;
+}
+
+#endif
+
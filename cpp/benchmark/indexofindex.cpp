@@ -0,0 +1,241 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+/* compares the ways of getting the record offsets and names of Packages,
+   Sources and Translation lists: parsing the whole list, reading the old
+   text '.index0' file and reading the binary '.index1' file; the lists are
+   not modified, all index files are made in a temporary directory */
+
+#include <clocale>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <unistd.h>
+
+#include <cupt/file.hpp>
+
+#include <internal/filesystem.hpp>
+#include <internal/indexofindex.hpp>
+
+#include "common.hpp"
+
+using namespace cupt;
+using namespace cupt::internal;
+
+class List
+{
+	bool p_isTranslation;
+	string p_path;
+	size_t p_recordCount;
+	size_t p_providesCount;
+ public:
+	List(const string& originalPath, const string& temporaryDirectory)
+		: p_isTranslation(originalPath.find("_i18n_Translation-") != string::npos),
+		p_path(temporaryDirectory + '/' + fs::filename(originalPath))
+	{
+		char* realPath = realpath(originalPath.c_str(), nullptr);
+		if (!realPath)
+		{
+			fatal2e("unable to resolve the path '%s'", originalPath);
+		}
+		auto symlinkResult = symlink(realPath, p_path.c_str());
+		free(realPath);
+		if (symlinkResult == -1)
+		{
+			fatal2e("unable to create a symlink '%s'", p_path);
+		}
+	}
+	~List()
+	{
+		ioi::removeIndexOfIndex(p_path);
+		unlink(getLegacyPath().c_str());
+		unlink(p_path.c_str());
+	}
+
+	const string& getPath() const
+	{
+		return p_path;
+	}
+	string getLegacyPath() const
+	{
+		return p_path + ".index0";
+	}
+	size_t getRecordCount() const
+	{
+		return p_recordCount;
+	}
+
+	// goes through all records by the freshest available way
+	void process(const std::function< void (uint32_t, const string&) >& recordCallback,
+			const std::function< void (const char*, const char*) >& providesCallback)
+	{
+		p_recordCount = 0;
+		p_providesCount = 0;
+		uint32_t offset;
+		string indexString;
+		ioi::Record record = { &offset, &indexString };
+		auto mainCallback = [this, &offset, &indexString, &recordCallback]()
+		{
+			++p_recordCount;
+			recordCallback(offset, indexString);
+		};
+		if (p_isTranslation)
+		{
+			ioi::tr::Callbacks callbacks;
+			callbacks.main = mainCallback;
+			ioi::tr::processIndex(p_path, callbacks, record);
+		}
+		else
+		{
+			ioi::ps::Callbacks callbacks;
+			callbacks.main = mainCallback;
+			callbacks.provides = [this, &providesCallback](const char* begin, const char* end)
+			{
+				++p_providesCount;
+				providesCallback(begin, end);
+			};
+			ioi::ps::processIndex(p_path, callbacks, record);
+		}
+	}
+	void load()
+	{
+		process([](uint32_t, const string&) {}, [](const char*, const char*) {});
+	}
+
+	// the format which cupt used before '.index1', only readers of it are left
+	void generateLegacy()
+	{
+		string temporaryPath = getLegacyPath() + ".new";
+		{
+			RequiredFile file(temporaryPath, "w");
+			uint32_t previousOffset = 0;
+			bool isFirstRecord = true;
+			auto recordCallback = [&file, &previousOffset, &isFirstRecord](uint32_t offset, const string& indexString)
+			{
+				if (!isFirstRecord) file.put("\n");
+				isFirstRecord = false;
+				file.put(format2("%x", offset - previousOffset));
+				file.put("\0", 1);
+				file.put(indexString);
+				file.put("\n");
+				previousOffset = offset;
+			};
+			auto providesCallback = [&file](const char* begin, const char* end)
+			{
+				file.put("p");
+				file.put(begin, end - begin);
+				file.put("\n");
+			};
+			process(recordCallback, providesCallback);
+		}
+		fs::move(temporaryPath, getLegacyPath());
+	}
+	void generate()
+	{
+		string temporaryPath = ioi::getIndexOfIndexPath(p_path) + ".new";
+		if (p_isTranslation)
+		{
+			ioi::tr::generate(p_path, temporaryPath);
+		}
+		else
+		{
+			ioi::ps::generate(p_path, temporaryPath);
+		}
+	}
+};
+
+double measureLoad(List& list, size_t loadCount)
+{
+	list.load(); // warming the page cache up
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < loadCount; ++i)
+	{
+		list.load();
+	}
+	return getSecondsSince(start) / loadCount;
+}
+
+void run(const string& path, const string& temporaryDirectory, size_t loadCount)
+{
+	List list(path, temporaryDirectory);
+
+	auto fullSeconds = measureLoad(list, loadCount);
+
+	list.generateLegacy();
+	auto legacySeconds = measureLoad(list, loadCount);
+	auto legacySize = fs::fileSize(list.getLegacyPath());
+
+	list.generate(); // is preferred to '.index0' as being fresh too
+	auto binarySeconds = measureLoad(list, loadCount);
+	auto binarySize = fs::fileSize(ioi::getIndexOfIndexPath(list.getPath()));
+
+	cout << format2("%s: %zu records, mean of %zu loads: full parse %.2f ms, "
+			".index0 %.2f ms (%zu bytes), .index1 %.2f ms (%zu bytes)",
+			path, list.getRecordCount(), loadCount, fullSeconds * 1000,
+			legacySeconds * 1000, legacySize, binarySeconds * 1000, binarySize) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+	cupt::messageFd = STDERR_FILENO;
+
+	size_t loadCount = 10;
+	vector< string > paths;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+		{
+			loadCount = atoi(argv[++i]);
+		}
+		else
+		{
+			paths.push_back(argv[i]);
+		}
+	}
+	if (paths.empty() || !loadCount)
+	{
+		cout << format2("Usage: %s [-n <number of loads>] <Packages, Sources or Translation list>...", argv[0]) << endl;
+		return 1;
+	}
+
+	char temporaryDirectoryTemplate[] = "/tmp/cupt-ioi-benchmark.XXXXXX";
+	if (!mkdtemp(temporaryDirectoryTemplate))
+	{
+		cout << "unable to create a temporary directory" << endl;
+		return 1;
+	}
+	int result = 0;
+	try
+	{
+		for (const auto& path: paths)
+		{
+			run(path, temporaryDirectoryTemplate, loadCount);
+		}
+	}
+	catch (Exception&)
+	{
+		result = 1;
+	}
+	rmdir(temporaryDirectoryTemplate);
+	return result;
+}
@@ -0,0 +1,610 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+/* replays resolver problems dumped by 'cupt::resolver::problem-dump-directory'
+   or given as CUDF documents, each in a separate process, and reports the
+   time, the number of expanded solutions, the peak memory and the score of
+   the solution found */
+
+#include <clocale>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cupt/config.hpp>
+#include <cupt/cache.hpp>
+#include <cupt/cache/binarypackage.hpp>
+#include <cupt/file.hpp>
+#include <cupt/system/resolvers/native.hpp>
+#include <cupt/system/resolvers/sat.hpp>
+
+#include "common.hpp"
+
+using namespace cupt;
+using namespace cupt::system;
+
+typedef map< string, string > Stanza;
+
+string trim(const string& s)
+{
+	auto begin = s.find_first_not_of(" \t");
+	if (begin == string::npos)
+	{
+		return string();
+	}
+	return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+vector< string > splitAndTrim(char delimiter, const string& s)
+{
+	vector< string > result;
+	size_t position = 0;
+	while (true)
+	{
+		auto delimiterPosition = s.find(delimiter, position);
+		auto part = trim(s.substr(position, delimiterPosition - position));
+		if (!part.empty())
+		{
+			result.push_back(part);
+		}
+		if (delimiterPosition == string::npos)
+		{
+			return result;
+		}
+		position = delimiterPosition + 1;
+	}
+}
+
+// control file and CUDF stanzas, a line starting with a space continues the previous field
+vector< Stanza > readStanzas(const string& path)
+{
+	vector< Stanza > result(1);
+	string lastFieldName;
+	RequiredFile file(path, "r");
+	string line;
+	while (!file.getLine(line).eof())
+	{
+		if (line.empty())
+		{
+			if (!result.back().empty())
+			{
+				result.emplace_back();
+			}
+		}
+		else if (line[0] == '#')
+		{
+			continue;
+		}
+		else if (line[0] == ' ' || line[0] == '\t')
+		{
+			if (lastFieldName.empty())
+			{
+				fatal2("a continuation line without a field in '%s'", path);
+			}
+			result.back()[lastFieldName] += ' ' + trim(line);
+		}
+		else
+		{
+			auto colonPosition = line.find(':');
+			if (colonPosition == string::npos)
+			{
+				fatal2("no field name in the line '%s' in '%s'", line, path);
+			}
+			lastFieldName = line.substr(0, colonPosition);
+			result.back()[lastFieldName] = trim(line.substr(colonPosition + 1));
+		}
+	}
+	if (result.back().empty())
+	{
+		result.pop_back();
+	}
+	return result;
+}
+
+string getField(const Stanza& stanza, const string& name)
+{
+	auto it = stanza.find(name);
+	return it != stanza.end() ? it->second : string();
+}
+
+void writeFile(const string& path, const string& content)
+{
+	auto slashPosition = path.rfind('/');
+	if (slashPosition != string::npos)
+	{
+		auto result = std::system(format2("mkdir -p '%s'", path.substr(0, slashPosition)).c_str());
+		if (result != 0)
+		{
+			fatal2("unable to create the directory for '%s'", path);
+		}
+	}
+	RequiredFile file(path, "w");
+	if (!content.empty())
+	{
+		file.put(content);
+	}
+}
+
+namespace cudf {
+
+// Debian package names are lowercase and have only few special characters
+string getPackageName(const string& cudfName)
+{
+	string result;
+	for (char c: cudfName)
+	{
+		if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '-')
+		{
+			result += c;
+		}
+		else
+		{
+			result += format2("+%02x", (unsigned char)c);
+		}
+	}
+	if (result.size() < 2 || !isalnum(result[0]))
+	{
+		result.insert(0, "0");
+	}
+	return result;
+}
+
+struct VersionedPackage
+{
+	string name;
+	string operation; // empty if any version
+	string version;
+};
+
+VersionedPackage parseVersionedPackage(const string& input)
+{
+	static const char* const operations[] = { "!=", ">=", "<=", "=", ">", "<" };
+
+	VersionedPackage result;
+	for (auto operation: operations)
+	{
+		auto position = input.find(operation);
+		if (position != string::npos)
+		{
+			result.name = getPackageName(trim(input.substr(0, position)));
+			result.operation = operation;
+			result.version = trim(input.substr(position + strlen(operation)));
+			return result;
+		}
+	}
+	result.name = getPackageName(trim(input));
+	return result;
+}
+
+// Debian relations have no '!=', it becomes two relations: in an alternative
+// list they are alternatives, in a conflict list both are conflicts
+vector< string > getRelations(const VersionedPackage& vp)
+{
+	if (vp.operation.empty())
+	{
+		return { vp.name };
+	}
+	else if (vp.operation == "!=")
+	{
+		return { format2("%s (<< %s)", vp.name, vp.version), format2("%s (>> %s)", vp.name, vp.version) };
+	}
+	string operation = vp.operation;
+	if (operation == ">" || operation == "<")
+	{
+		operation += operation;
+	}
+	return { format2("%s (%s %s)", vp.name, operation, vp.version) };
+}
+
+string convertAlternatives(const string& input)
+{
+	vector< string > result;
+	for (const auto& item: splitAndTrim('|', input))
+	{
+		auto relations = getRelations(parseVersionedPackage(item));
+		result.insert(result.end(), relations.begin(), relations.end());
+	}
+	return join(" | ", result);
+}
+
+string convertFormula(const string& input)
+{
+	vector< string > result;
+	for (const auto& alternatives: splitAndTrim(',', input))
+	{
+		if (alternatives == "true!")
+		{
+			continue;
+		}
+		else if (alternatives == "false!")
+		{
+			result.push_back("0+21false"); // a package which never exists
+		}
+		else
+		{
+			result.push_back(convertAlternatives(alternatives));
+		}
+	}
+	return join(", ", result);
+}
+
+string convertConflicts(const string& input)
+{
+	vector< string > result;
+	for (const auto& item: splitAndTrim(',', input))
+	{
+		auto relations = getRelations(parseVersionedPackage(item));
+		result.insert(result.end(), relations.begin(), relations.end());
+	}
+	return join(", ", result);
+}
+
+string convertProvides(const string& input)
+{
+	vector< string > result;
+	for (const auto& item: splitAndTrim(',', input))
+	{
+		result.push_back(parseVersionedPackage(item).name); // no versioned provides
+	}
+	return join(", ", result);
+}
+
+string getRequest(const string& type, const string& relation)
+{
+	return format2("Request: %s\nRelation: %s\nImportance: must\nAutomatic: no\nAnnotation: %s '%s'\n\n",
+			type, relation, type, relation);
+}
+
+/* writes a root directory with a single release having all CUDF packages, the
+   installed ones in the dpkg status, and the CUDF request; 'keep' properties
+   and upgrade requests become requests to keep at least the installed version */
+void convert(const string& path, const string& root, const string& architecture)
+{
+	string packages;
+	string status;
+	string requests;
+	map< string, string > installedVersions;
+
+	for (const auto& stanza: readStanzas(path))
+	{
+		if (stanza.count("preamble"))
+		{
+			continue;
+		}
+		else if (stanza.count("request"))
+		{
+			for (const auto& item: splitAndTrim(',', getField(stanza, "install")))
+			{
+				requests += getRequest("satisfy", convertAlternatives(item));
+			}
+			for (const auto& item: splitAndTrim(',', getField(stanza, "remove")))
+			{
+				requests += getRequest("unsatisfy", convertAlternatives(item));
+			}
+			for (const auto& item: splitAndTrim(',', getField(stanza, "upgrade")))
+			{
+				auto vp = parseVersionedPackage(item);
+				requests += getRequest("satisfy", convertAlternatives(item));
+				auto installedIt = installedVersions.find(vp.name);
+				if (installedIt != installedVersions.end())
+				{
+					requests += getRequest("satisfy", format2("%s (>= %s)", vp.name, installedIt->second));
+				}
+			}
+			continue;
+		}
+
+		auto name = getPackageName(getField(stanza, "package"));
+		auto version = getField(stanza, "version");
+		if (name.empty() || version.empty())
+		{
+			fatal2("a CUDF stanza without a package name or a version in '%s'", path);
+		}
+
+		string record = format2("Package: %s\nVersion: %s\nArchitecture: all\n", name, version);
+		auto addRelations = [&record](const char* debianField, const string& value)
+		{
+			if (!value.empty())
+			{
+				record += format2("%s: %s\n", debianField, value);
+			}
+		};
+		addRelations("Depends", convertFormula(getField(stanza, "depends")));
+		addRelations("Conflicts", convertConflicts(getField(stanza, "conflicts")));
+		addRelations("Provides", convertProvides(getField(stanza, "provides")));
+
+		packages += record + format2("Filename: pool/%s_%s_all.deb\nSize: 0\n"
+				"MD5sum: d41d8cd98f00b204e9800998ecf8427e\nDescription: CUDF package\n\n", name, version);
+		if (getField(stanza, "installed") == "true")
+		{
+			status += format2("Package: %s\nStatus: install ok installed\n", name) +
+					record.substr(record.find('\n') + 1) + "Description: CUDF package\n\n";
+			installedVersions[name] = version;
+
+			auto keep = getField(stanza, "keep");
+			if (keep == "version")
+			{
+				requests += getRequest("satisfy", format2("%s (= %s)", name, version));
+			}
+			else if (keep == "package")
+			{
+				requests += getRequest("satisfy", name);
+			}
+		}
+	}
+
+	auto listsPrefix = root + "/var/lib/cupt/lists/file____cudf_dists_cudf";
+	writeFile(root + "/etc/apt/sources.list", "deb file:///cudf cudf main\n");
+	writeFile(listsPrefix + "_Release", format2("Origin: CUDF\nLabel: CUDF\nSuite: cudf\n"
+			"Codename: cudf\nArchitectures: %s all\nComponents: main\n", architecture));
+	writeFile(listsPrefix + "_main_binary-" + architecture + "_Packages", packages);
+	writeFile(root + "/var/lib/dpkg/status", status);
+	writeFile(root + "/var/lib/apt/extended_states", string());
+	writeFile(root + "/request", requests);
+}
+
+}
+
+void setRoot(Config& config, const string& root)
+{
+	config.setScalar("dir", root);
+	config.setScalar("cupt::directory", root);
+	config.setScalar("dir::state::status", root + "/var/lib/dpkg/status");
+	config.setScalar("gpgv::trustedkeyring", root + "/var/lib/cupt/trusted.gpg");
+}
+
+// reads what 'config-dump' prints; list values are added to the ones of this host
+void readConfigDump(Config& config, const string& path)
+{
+	RequiredFile file(path, "r");
+	string line;
+	while (!file.getLine(line).eof())
+	{
+		auto spacePosition = line.find(' ');
+		if (spacePosition == string::npos)
+		{
+			fatal2("wrong configuration line '%s'", line);
+		}
+		auto name = line.substr(0, spacePosition);
+		auto value = line.substr(spacePosition + 1);
+		if (value == "{};")
+		{
+			continue;
+		}
+		else if (value.size() >= 8 && value.compare(0, 3, "{ \"") == 0 &&
+				value.compare(value.size() - 5, 5, "\"; };") == 0)
+		{
+			config.setList(name, value.substr(3, value.size() - 8));
+		}
+		else if (value.size() >= 3 && value[0] == '"' &&
+				value.compare(value.size() - 2, 2, "\";") == 0)
+		{
+			config.setScalar(name, value.substr(1, value.size() - 3));
+		}
+		else
+		{
+			fatal2("wrong configuration line '%s'", line);
+		}
+	}
+}
+
+Resolver::RequestImportance getImportance(const string& input)
+{
+	if (input == "must")
+	{
+		return Resolver::RequestImportance::Must;
+	}
+	else if (input == "try")
+	{
+		return Resolver::RequestImportance::Try;
+	}
+	else if (input == "wish")
+	{
+		return Resolver::RequestImportance::Wish;
+	}
+	else
+	{
+		return std::stoul(input);
+	}
+}
+
+void applyRequests(Resolver& resolver, const string& path)
+{
+	for (const auto& stanza: readStanzas(path))
+	{
+		auto type = getField(stanza, "Request");
+		bool automatic = (getField(stanza, "Automatic") == "yes");
+		if (type == "upgrade")
+		{
+			resolver.upgrade();
+		}
+		else if (type == "satisfy" || type == "unsatisfy")
+		{
+			resolver.satisfyRelationExpression(RelationExpression(getField(stanza, "Relation")),
+					type == "unsatisfy", getField(stanza, "Annotation"),
+					getImportance(getField(stanza, "Importance")), automatic);
+		}
+		else if (type == "set-automatic")
+		{
+			resolver.setAutomaticallyInstalledFlag(getField(stanza, "Package"), automatic);
+		}
+		else
+		{
+			fatal2("wrong request type '%s' in '%s'", type, path);
+		}
+	}
+}
+
+// runs in a child process, returns the report
+string replay(const Config& hostConfig, const string& root, const vector< pair< string, string > >& options)
+{
+	shared_ptr< Config > config(new Config(hostConfig));
+	auto configPath = root + "/etc/cupt/cupt.conf";
+	struct stat st;
+	if (stat(configPath.c_str(), &st) == 0)
+	{
+		readConfigDump(*config, configPath);
+	}
+	setRoot(*config, root);
+	for (const auto& option: options)
+	{
+		config->setScalar(option.first, option.second);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	shared_ptr< const Cache > cache(new Cache(config, false, true, true));
+	auto cacheSeconds = getSecondsSince(start);
+
+	std::unique_ptr< Resolver > resolver;
+	std::function< NativeResolver::Statistics () > getStatistics;
+	auto backend = config->getString("cupt::resolver::backend");
+	if (backend == "native")
+	{
+		auto nativeResolver = new NativeResolver(config, cache);
+		resolver.reset(nativeResolver);
+		getStatistics = [nativeResolver]() { return nativeResolver->getStatistics(); };
+	}
+	else if (backend == "sat")
+	{
+		auto satResolver = new SatResolver(config, cache);
+		resolver.reset(satResolver);
+		getStatistics = [satResolver]() { return satResolver->getStatistics(); };
+	}
+	else
+	{
+		fatal2("wrong resolver backend '%s'", backend);
+	}
+	applyRequests(*resolver, root + "/request");
+
+	start = std::chrono::steady_clock::now();
+	size_t changeCount = 0;
+	auto callback = [&cache, &changeCount](const Resolver::Offer& offer)
+	{
+		for (const auto& item: offer.suggestedPackages)
+		{
+			auto package = cache->getBinaryPackage(item.first);
+			if (item.second.version != (package ? package->getInstalledVersion() : nullptr))
+			{
+				++changeCount;
+			}
+		}
+		return Resolver::UserAnswer::Accept;
+	};
+	bool resolved = resolver->resolve(callback);
+	auto resolveSeconds = getSecondsSince(start);
+
+	auto statistics = getStatistics();
+	string result = format2("cache %.2f s, resolving %.2f s, %zu solutions expanded",
+			cacheSeconds, resolveSeconds, statistics.expandedSolutionCount);
+	if (resolved)
+	{
+		result += format2(", score %zd, %zu packages changed", statistics.proposedScore, changeCount);
+	}
+	else
+	{
+		result += ", no solution";
+	}
+	return result;
+}
+
+bool isDirectory(const string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void run(const Config& hostConfig, const string& problem, const vector< pair< string, string > >& options)
+{
+	string root = problem;
+	bool isTemporary = false;
+	if (!isDirectory(problem))
+	{
+		char rootTemplate[] = "/tmp/cupt-resolver-benchmark.XXXXXX";
+		if (!mkdtemp(rootTemplate))
+		{
+			fatal2e("unable to create a temporary directory");
+		}
+		root = rootTemplate;
+		isTemporary = true;
+		cudf::convert(problem, root, hostConfig.getString("apt::architecture"));
+	}
+
+	long peakMemory;
+	auto report = runInChild([&hostConfig, &root, &options]() { return replay(hostConfig, root, options); },
+			&peakMemory);
+	cout << format2("%s: %s, peak memory %ld KiB", problem, report, peakMemory) << endl;
+
+	if (isTemporary)
+	{
+		if (std::system(format2("rm -rf '%s'", root).c_str()) != 0)
+		{
+			warn2("unable to remove the directory '%s'", root);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+	cupt::messageFd = STDERR_FILENO;
+
+	vector< pair< string, string > > options;
+	vector< string > problems;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-o") && i+1 < argc)
+		{
+			string option = argv[++i];
+			auto equalPosition = option.find('=');
+			if (equalPosition == string::npos)
+			{
+				cout << format2("wrong option '%s', expected 'name=value'", option) << endl;
+				return 1;
+			}
+			options.push_back({ option.substr(0, equalPosition), option.substr(equalPosition + 1) });
+		}
+		else
+		{
+			problems.push_back(argv[i]);
+		}
+	}
+	if (problems.empty())
+	{
+		cout << format2("Usage: %s [-o <option>=<value>]... <problem directory or CUDF file>...", argv[0]) << endl;
+		return 1;
+	}
+
+	try
+	{
+		Config config;
+		for (const auto& problem: problems)
+		{
+			run(config, problem, options);
+		}
+	}
+	catch (Exception&)
+	{
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,297 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+/* compares the ways of keeping the package entries of resolver solutions:
+   the sorted vectors of initial, master and added entries which solutions
+   used before, and the structurally shared PersistentMap used now; both run
+   the same resolver-like workload (fork a kept solution, change a few
+   packages, look entries up, keep a bounded number of solutions), each in a
+   separate process, and the time and the peak memory are reported */
+
+#include <clocale>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <internal/nativeresolver/persistentmap.hpp>
+
+#include "common.hpp"
+
+using namespace cupt;
+using namespace cupt::internal;
+
+struct Parameters
+{
+	size_t packageCount;
+	size_t versionsPerPackage;
+	size_t keptSolutionCount;
+	size_t expansionCount;
+	size_t changesPerExpansion;
+	size_t lookupsPerExpansion;
+};
+
+// of the size of the resolver's package entry
+struct Entry
+{
+	uint64_t data[8];
+};
+typedef shared_ptr< const Entry > SPE;
+
+// how solutions kept their entries before: the entries of the initial
+// solution, the entries of the master solution shared by some descendants,
+// and the own sorted entries, which are copied to every child; a child
+// becomes a new master once its line diverged enough
+class VectorState
+{
+	typedef pair< uint32_t, SPE > Item;
+	struct Map
+	{
+		vector< Item > items;
+		mutable std::atomic< size_t > forkedCount;
+
+		Map()
+			: forkedCount(0)
+		{}
+		const Item* find(uint32_t key) const
+		{
+			auto it = std::lower_bound(items.begin(), items.end(), key,
+					[](const Item& item, uint32_t key) { return item.first < key; });
+			return (it != items.end() && it->first == key) ? &*it : nullptr;
+		}
+	};
+
+	shared_ptr< const Map > p_initial;
+	shared_ptr< const Map > p_master;
+	shared_ptr< Map > p_added;
+
+	// the later map overrides the earlier one
+	static void p_merge(const vector< Item >& earlier, const vector< Item >& later, vector< Item >* result)
+	{
+		auto less = [](const Item& left, const Item& right) { return left.first < right.first; };
+		std::set_union(later.begin(), later.end(), earlier.begin(), earlier.end(),
+				std::back_inserter(*result), less);
+	}
+ public:
+	VectorState()
+		: p_added(new Map)
+	{}
+
+	void fork(const VectorState& parent)
+	{
+		p_added.reset(new Map);
+		if (!parent.p_initial)
+		{
+			p_initial = parent.p_added;
+		}
+		else
+		{
+			p_initial = parent.p_initial;
+			if (!parent.p_master)
+			{
+				p_master = parent.p_added;
+			}
+			else
+			{
+				auto& forkedCount = parent.p_master->forkedCount;
+				auto addedCount = parent.p_added->items.size();
+				if (forkedCount.fetch_add(addedCount) + addedCount > parent.p_master->items.size())
+				{
+					forkedCount = 0;
+					p_added->items.reserve(addedCount + parent.p_master->items.size());
+					p_merge(parent.p_master->items, parent.p_added->items, &p_added->items);
+				}
+				else
+				{
+					p_master = parent.p_master;
+					p_added->items = parent.p_added->items;
+				}
+			}
+		}
+	}
+
+	const Entry* find(uint32_t key) const
+	{
+		for (const Map* map: { (const Map*)p_added.get(), p_master.get(), p_initial.get() })
+		{
+			if (map)
+			{
+				if (auto item = map->find(key))
+				{
+					return item->second.get();
+				}
+			}
+		}
+		return nullptr;
+	}
+	void set(uint32_t key, const SPE& entry)
+	{
+		auto& items = p_added->items;
+		auto it = std::lower_bound(items.begin(), items.end(), key,
+				[](const Item& item, uint32_t key) { return item.first < key; });
+		if (it != items.end() && it->first == key)
+		{
+			it->second = entry;
+		}
+		else
+		{
+			items.insert(it, { key, entry });
+		}
+	}
+	void erase(uint32_t key)
+	{
+		set(key, SPE()); // an empty entry masks the inherited one
+	}
+};
+
+class PersistentState
+{
+	PersistentMap< pair< uint32_t, SPE > > p_entries;
+ public:
+	void fork(const PersistentState& parent)
+	{
+		p_entries = parent.p_entries;
+	}
+	const Entry* find(uint32_t key) const
+	{
+		auto value = p_entries.find(key);
+		return value ? value->second.get() : nullptr;
+	}
+	void set(uint32_t key, const SPE& entry)
+	{
+		p_entries.set(key, { key, entry });
+	}
+	void erase(uint32_t key)
+	{
+		p_entries.erase(key);
+	}
+};
+
+// element ids of a package are adjacent, the first version is installed
+template < typename StateT >
+size_t runWorkload(const Parameters& parameters)
+{
+	std::mt19937 random(1);
+	auto getRandom = [&random](size_t limit) { return std::uniform_int_distribution< size_t >(0, limit-1)(random); };
+	auto entry = std::make_shared< const Entry >(Entry());
+
+	vector< shared_ptr< StateT > > solutions;
+	vector< vector< uint32_t > > chosenVersions; // by solution
+	{
+		shared_ptr< StateT > initialSolution(new StateT);
+		vector< uint32_t > initialVersions(parameters.packageCount, 0);
+		for (size_t package = 0; package < parameters.packageCount; ++package)
+		{
+			initialSolution->set(package * parameters.versionsPerPackage, entry);
+		}
+		// the first expansion of the resolver, so that every solution has the initial entries
+		shared_ptr< StateT > solution(new StateT);
+		solution->fork(*initialSolution);
+		solutions.push_back(solution);
+		chosenVersions.push_back(initialVersions);
+	}
+
+	size_t foundCount = 0;
+	for (size_t expansion = 0; expansion < parameters.expansionCount; ++expansion)
+	{
+		// the resolver mostly continues the best and so the youngest solutions
+		auto parentIndex = solutions.size() - 1 - std::min(getRandom(8), solutions.size() - 1);
+		shared_ptr< StateT > solution(new StateT);
+		solution->fork(*solutions[parentIndex]);
+		auto versions = chosenVersions[parentIndex];
+
+		for (size_t i = 0; i < parameters.changesPerExpansion; ++i)
+		{
+			auto package = getRandom(parameters.packageCount);
+			auto oldKey = package * parameters.versionsPerPackage + versions[package];
+			versions[package] = getRandom(parameters.versionsPerPackage);
+			auto newKey = package * parameters.versionsPerPackage + versions[package];
+			if (newKey != oldKey)
+			{
+				solution->set(newKey, entry);
+				solution->erase(oldKey);
+			}
+		}
+		for (size_t i = 0; i < parameters.lookupsPerExpansion; ++i)
+		{
+			foundCount += bool(solution->find(getRandom(parameters.packageCount * parameters.versionsPerPackage)));
+		}
+
+		solutions.push_back(solution);
+		chosenVersions.push_back(std::move(versions));
+		if (solutions.size() > parameters.keptSolutionCount)
+		{
+			auto droppedIndex = getRandom(solutions.size() - 1);
+			solutions.erase(solutions.begin() + droppedIndex);
+			chosenVersions.erase(chosenVersions.begin() + droppedIndex);
+		}
+	}
+	return foundCount;
+}
+
+template < typename StateT >
+void run(const char* name, const Parameters& parameters)
+{
+	long peakMemory;
+	auto report = runInChild([&parameters]()
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto foundCount = runWorkload< StateT >(parameters);
+		auto seconds = getSecondsSince(start);
+		return format2("%.2f s, %.0f expansions/s, %zu entries found",
+				seconds, parameters.expansionCount / seconds, foundCount);
+	}, &peakMemory);
+	cout << format2("%s: %s, peak memory %ld KiB", name, report, peakMemory) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	Parameters parameters = { 1000, 4, 512, 200000, 2, 40 };
+	for (int i = 1; i < argc; ++i)
+	{
+		size_t* target = nullptr;
+		if (!strcmp(argv[i], "-p")) target = &parameters.packageCount;
+		else if (!strcmp(argv[i], "-v")) target = &parameters.versionsPerPackage;
+		else if (!strcmp(argv[i], "-k")) target = &parameters.keptSolutionCount;
+		else if (!strcmp(argv[i], "-e")) target = &parameters.expansionCount;
+		else if (!strcmp(argv[i], "-c")) target = &parameters.changesPerExpansion;
+		else if (!strcmp(argv[i], "-l")) target = &parameters.lookupsPerExpansion;
+
+		if (!target || i+1 == argc || !(*target = atoi(argv[++i])))
+		{
+			cout << format2("Usage: %s [-p <packages>] [-v <versions per package>] "
+					"[-k <kept solutions>] [-e <expansions>] [-c <changes per expansion>] "
+					"[-l <lookups per expansion>]", argv[0]) << endl;
+			return 1;
+		}
+	}
+
+	cout << format2("%zu packages, %zu versions each, %zu kept solutions, %zu expansions, "
+			"%zu changes and %zu lookups per expansion",
+			parameters.packageCount, parameters.versionsPerPackage, parameters.keptSolutionCount,
+			parameters.expansionCount, parameters.changesPerExpansion, parameters.lookupsPerExpansion) << endl;
+	run< VectorState >("sorted vectors (before)", parameters);
+	run< PersistentState >("persistent map (now)", parameters);
+	return 0;
+}
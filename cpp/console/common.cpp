@@ -15,8 +15,17 @@
 *   Free Software Foundation, Inc.,                                       *
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
+#include <cstdio>
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
 #include "common.hpp"
 
+#include <cupt/file.hpp>
+#include <cupt/hashsums.hpp>
 #include <cupt/system/state.hpp>
 #include <cupt/cache/binarypackage.hpp>
 #include <cupt/cache/sourcepackage.hpp>
@@ -27,6 +36,78 @@ bool isPackageInstalled(const Cache& cache, const string& packageName)
 	return (installedInfo && installedInfo->status != system::State::InstalledRecord::Status::ConfigFiles);
 }
 
+namespace {
+
+const char reverseDependsIndexPrefix[] = "reverse-depends_";
+
+struct
+{
+	string directory;
+	string statusPath;
+} reverseDependsIndexStorage;
+
+void addFileStampToFingerprint(string* fingerprint, const string& path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0)
+	{
+		*fingerprint += format2("%s %zu %ld.%09ld\n", path, (size_t)st.st_size,
+				(long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+	}
+}
+
+// changes whenever the set of the indexes or any of them, or the system
+// state changes
+string getIndexesFingerprint(const Cache& cache)
+{
+	string result = cache.getSystemState()->getArchitecture() + '\n';
+	result += format2("%zu %zu\n", cache.getBinaryReleaseData().size(), cache.getSourceReleaseData().size());
+	for (const auto& entry: cache.getIndexEntries())
+	{
+		result += format2("%d %s %s %s", (int)entry.category, entry.uri, entry.distribution, entry.component);
+		for (const auto& option: entry.options)
+		{
+			result += format2(" %s=%s", option.first, option.second);
+		}
+		result += '\n';
+	}
+
+	vector< string > listPaths;
+	if (auto directory = opendir(reverseDependsIndexStorage.directory.c_str()))
+	{
+		while (auto entry = readdir(directory))
+		{
+			string name = entry->d_name;
+			auto endsWith = [&name](const string& suffix)
+			{
+				return name.size() >= suffix.size() &&
+						name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+			};
+			if (endsWith("_Packages") || endsWith("_Sources"))
+			{
+				listPaths.push_back(reverseDependsIndexStorage.directory + '/' + name);
+			}
+		}
+		closedir(directory);
+	}
+	std::sort(listPaths.begin(), listPaths.end());
+	for (const auto& path: listPaths)
+	{
+		addFileStampToFingerprint(&result, path);
+	}
+	addFileStampToFingerprint(&result, reverseDependsIndexStorage.statusPath);
+
+	return HashSums::getHashOfString(HashSums::MD5, result);
+}
+
+}
+
+void setReverseDependsIndexStorage(const Config& config)
+{
+	reverseDependsIndexStorage.directory = config.getPath("cupt::directory::state::lists");
+	reverseDependsIndexStorage.statusPath = config.getPath("dir::state::status");
+}
+
 template < typename VersionT >
 ReverseDependsIndex< VersionT >::ReverseDependsIndex(const Cache& cache)
 	: __cache(cache), __architecture(cache.getSystemState()->getArchitecture())
@@ -38,7 +119,12 @@ void ReverseDependsIndex< VersionT >::add(RelationTypeT relationType)
 	auto insertResult = __data.insert({ relationType, {} });
 	if (insertResult.second)
 	{
-		__add(relationType, &insertResult.first->second);
+		auto storage = &insertResult.first->second;
+		if (!__load(relationType, storage))
+		{
+			__add(relationType, storage);
+			__save(relationType, *storage);
+		}
 	}
 }
 
@@ -50,16 +136,113 @@ template<> struct TraitsPlus< BinaryVersion >
 	static Range< Cache::PackageNameIterator > getPackageNames(const Cache& cache) { return cache.getBinaryPackageNames(); };
 	static const BinaryPackage* getPackage(const Cache& cache, const string& packageName)
 	{ return cache.getBinaryPackage(packageName); }
+	static const char* getKind() { return "binary"; }
 };
 template<> struct TraitsPlus< SourceVersion >
 {
 	static Range< Cache::PackageNameIterator > getPackageNames(const Cache& cache) { return cache.getSourcePackageNames(); };
 	static const SourcePackage* getPackage(const Cache& cache, const string& packageName)
 	{ return cache.getSourcePackage(packageName); };
+	static const char* getKind() { return "source"; }
 };
 
 }
 
+template < typename VersionT >
+string ReverseDependsIndex< VersionT >::__get_storage_path(RelationTypeT relationType) const
+{
+	return format2("%s/%s%s_%s", reverseDependsIndexStorage.directory, reverseDependsIndexPrefix,
+			TraitsPlus< VersionT >::getKind(), VersionT::RelationTypes::rawStrings[relationType]);
+}
+
+// the format is a fingerprint line, a line with the number of records and
+// the records, lines '<satisfying package name> <package name>...'; a file
+// with less records or an unfinished line is not used
+template < typename VersionT >
+bool ReverseDependsIndex< VersionT >::__load(RelationTypeT relationType, PerRelationType* storage)
+{
+	if (reverseDependsIndexStorage.directory.empty())
+	{
+		return false;
+	}
+	if (__fingerprint.empty())
+	{
+		__fingerprint = getIndexesFingerprint(__cache);
+	}
+
+	string openError;
+	File file(__get_storage_path(relationType), "rm", openError);
+	if (!openError.empty())
+	{
+		return false;
+	}
+
+	string line;
+	if (file.getLine(line).eof() || line != __fingerprint)
+	{
+		return false;
+	}
+	size_t recordCount;
+	if (file.getLine(line).eof() || sscanf(line.c_str(), "%zu", &recordCount) != 1)
+	{
+		return false;
+	}
+
+	size_t readCount = 0;
+	const char* buffer;
+	size_t size;
+	while (file.rawGetLine(buffer, size), size > 0)
+	{
+		auto end = buffer + size;
+		if (*(end-1) != '\n')
+		{
+			break; // unfinished
+		}
+		--end;
+		++readCount;
+		auto nameEnd = std::find(buffer, end, ' ');
+		auto& packageNames = (*storage)[string(buffer, nameEnd)];
+		while (nameEnd != end)
+		{
+			auto nameBegin = nameEnd + 1;
+			nameEnd = std::find(nameBegin, end, ' ');
+			packageNames.push_back(string(nameBegin, nameEnd));
+		}
+	}
+	if (readCount != recordCount)
+	{
+		storage->clear();
+		return false;
+	}
+	return true;
+}
+
+template < typename VersionT >
+void ReverseDependsIndex< VersionT >::__save(RelationTypeT relationType, const PerRelationType& storage)
+{
+	if (reverseDependsIndexStorage.directory.empty())
+	{
+		return;
+	}
+
+	// failing is not an error, the lists directory may be not writable for this user
+	writeFileAtomically(__get_storage_path(relationType), [this, &storage](File& file)
+	{
+		file.put(__fingerprint);
+		file.put(format2("\n%zu\n", storage.size()));
+		for (const auto& record: storage)
+		{
+			file.put(record.first);
+			for (const string& packageName: record.second)
+			{
+				file.put(" ", 1);
+				file.put(packageName);
+			}
+			file.put("\n", 1);
+		}
+	});
+}
+
 template < typename VersionT >
 const RelationLine& ReverseDependsIndex< VersionT >::__getRelationLine(const RelationLine& rl) const
 {
@@ -93,7 +276,7 @@ void ReverseDependsIndex< VersionT >::__add(RelationTypeT relationType, PerRelat
 					const string& satisfyingPackageName = satisfyingVersion->packageName;
 					if (usedKeys.insert(satisfyingPackageName).second)
 					{
-						(*storage)[satisfyingPackageName].push_back(package);
+						(*storage)[satisfyingPackageName].push_back(packageName);
 					}
 				}
 			}
@@ -113,9 +296,10 @@ void ReverseDependsIndex< VersionT >::foreachReverseDependency(
 	auto packageCandidatesIt = storage.find(version->packageName);
 	if (packageCandidatesIt != storage.end())
 	{
-		const auto& packageCandidates = packageCandidatesIt->second;
-		for (auto packageCandidate: packageCandidates)
+		for (const string& packageCandidateName: packageCandidatesIt->second)
 		{
+			auto packageCandidate = TraitsPlus< VersionT >::getPackage(__cache, packageCandidateName);
+			if (!packageCandidate) continue;
 			for (const auto& candidateVersion: *packageCandidate)
 			{
 				auto&& relationLine = __getRelationLine(candidateVersion->relations[relationType]);
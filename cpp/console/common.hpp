@@ -23,6 +23,7 @@
 using std::unordered_map;
 #include <list>
 using std::list;
+#include <functional>
 
 #include <cupt/common.hpp>
 #include <cupt/config.hpp>
@@ -54,13 +55,18 @@ class ReverseDependsIndex
 	typedef typename VT::PackageT PackageT;
 	typedef typename VT::RelationTypeT RelationTypeT;
 
-	typedef unordered_map< string, list< const PackageT* > > PerRelationType;
+	// satisfying package name -> names of packages which have relations to it
+	typedef unordered_map< string, vector< string > > PerRelationType;
 
 	const Cache& __cache;
 	map< RelationTypeT, PerRelationType > __data;
 	const string __architecture;
+	string __fingerprint;
 
 	void __add(RelationTypeT relationType, PerRelationType*);
+	string __get_storage_path(RelationTypeT) const;
+	bool __load(RelationTypeT, PerRelationType*);
+	void __save(RelationTypeT, const PerRelationType&);
 	const RelationLine& __getRelationLine(const RelationLine&) const;
 	RelationLine __getRelationLine(const ArchitecturedRelationLine&) const;
  public:
@@ -72,6 +78,9 @@ class ReverseDependsIndex
 			const std::function< void (const VersionT*, const RelationExpression&) > callback);
 };
 
+// reverse dependency indexes are kept next to the lists specified by this config
+void setReverseDependsIndexStorage(const Config&);
+
 bool isPackageInstalled(const Cache&, const string& packageName);
 
 
@@ -35,6 +35,7 @@ using std::endl;
 #include <cupt/system/state.hpp>
 #include <cupt/system/resolver.hpp>
 #include <cupt/system/resolvers/native.hpp>
+#include <cupt/system/resolvers/sat.hpp>
 #include <cupt/system/snapshots.hpp>
 #include <cupt/file.hpp>
 #include <cupt/system/worker.hpp>
@@ -1420,7 +1421,20 @@ Resolver* getResolver(const shared_ptr< const Config >& config,
 		fatal2(__("using an external resolver is not supported now"));
 	}
 
-	return new NativeResolver(config, cache);
+	auto backend = config->getString("cupt::resolver::backend");
+	if (backend == "native")
+	{
+		return new NativeResolver(config, cache);
+	}
+	else if (backend == "sat")
+	{
+		return new SatResolver(config, cache);
+	}
+	else
+	{
+		fatal2(__("wrong resolver backend '%s'"), backend);
+		return nullptr; // unreachable
+	}
 }
 
 void queryAndProcessAdditionalPackageExpressions(ManagePackagesContext& mpc)
@@ -363,6 +363,7 @@ shared_ptr< const Cache > Context::getCache(
 		try
 		{
 			__cache.reset(new Cache(__config, useSource, useBinary, useInstalled));
+			setReverseDependsIndexStorage(*__config);
 		}
 		catch (Exception&)
 		{
@@ -16,6 +16,12 @@
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
 #include <cstring>
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <boost/lexical_cast.hpp>
 using boost::lexical_cast;
@@ -24,6 +30,7 @@ using boost::lexical_cast;
 
 #include <cupt/config.hpp>
 #include <cupt/file.hpp>
+#include <cupt/hashsums.hpp>
 #include <cupt/download/method.hpp>
 #include <cupt/download/uri.hpp>
 
@@ -97,6 +104,22 @@ class CurlWrapper
 	{
 		return curl_easy_perform(__handle);
 	}
+	CURL* getHandle() const
+	{
+		return __handle;
+	}
+	long getResponseCode() const
+	{
+		long value = 0;
+		curl_easy_getinfo(__handle, CURLINFO_RESPONSE_CODE, &value);
+		return value;
+	}
+	long getNewConnectionCount() const // during the last transfer
+	{
+		long value = 0;
+		curl_easy_getinfo(__handle, CURLINFO_NUM_CONNECTS, &value);
+		return value;
+	}
 	string getError() const
 	{
 		return string(__error_buffer);
@@ -109,6 +132,7 @@ class CurlWrapper
 
 string* fileWriteErrorPtr;
 File* filePtr;
+Hasher* hasherPtr;
 CurlWrapper* curlPtr;
 const std::function< void (const vector< string >&) >* callbackPtr;
 ssize_t* totalBytesPtr;
@@ -134,6 +158,7 @@ extern "C"
 			*fileWriteErrorPtr = e.what();
 			return 0;
 		}
+		hasherPtr->process((const char*)data, size);
 
 		static bool firstChunk = true;
 		if (firstChunk)
@@ -157,6 +182,37 @@ extern "C"
 
 class CurlMethod: public cupt::download::Method
 {
+ public:
+	static void setUriOptions(CurlWrapper& curl, const Config& config, const download::Uri& uri)
+	{
+		curl.setOption(CURLOPT_URL, string(uri), "uri");
+		auto downloadLimit = getIntegerAcquireSuboptionForUri(config, uri, "dl-limit");
+		if (downloadLimit)
+		{
+			curl.setLargeOption(CURLOPT_MAX_RECV_SPEED_LARGE, downloadLimit*1024, "upper speed limit");
+		}
+		auto proxy = getAcquireSuboptionForUri(config, uri, "proxy");
+		if (proxy == "DIRECT")
+		{
+			curl.setOption(CURLOPT_PROXY, "", "proxy");
+		}
+		else if (!proxy.empty())
+		{
+			curl.setOption(CURLOPT_PROXY, proxy, "proxy");
+		}
+		if (uri.getProtocol() == "http" && config.getBool("acquire::http::allowredirect"))
+		{
+			curl.setOption(CURLOPT_FOLLOWLOCATION, 1, "follow-location");
+		}
+		auto timeout = getIntegerAcquireSuboptionForUri(config, uri, "timeout");
+		if (timeout)
+		{
+			curl.setOption(CURLOPT_CONNECTTIMEOUT, timeout, "connect timeout");
+			curl.setOption(CURLOPT_LOW_SPEED_LIMIT, 1, "low speed limit");
+			curl.setOption(CURLOPT_LOW_SPEED_TIME, timeout, "low speed timeout");
+		}
+	}
+ private:
 	string perform(const Config& config, const download::Uri& uri,
 			const string& targetPath, const std::function< void (const vector< string >&) >& callback)
 	{
@@ -167,40 +223,24 @@ class CurlMethod: public cupt::download::Method
 			// occasionally, give them several tries to finish the download
 			auto transientErrorsLeft = config.getInteger("acquire::retries");
 
-			{ // setting options
-				curl.setOption(CURLOPT_URL, string(uri), "uri");
-				auto downloadLimit = getIntegerAcquireSuboptionForUri(config, uri, "dl-limit");
-				if (downloadLimit)
-				{
-					curl.setLargeOption(CURLOPT_MAX_RECV_SPEED_LARGE, downloadLimit*1024, "upper speed limit");
-				}
-				auto proxy = getAcquireSuboptionForUri(config, uri, "proxy");
-				if (proxy == "DIRECT")
-				{
-					curl.setOption(CURLOPT_PROXY, "", "proxy");
-				}
-				else if (!proxy.empty())
-				{
-					curl.setOption(CURLOPT_PROXY, proxy, "proxy");
-				}
-				if (uri.getProtocol() == "http" && config.getBool("acquire::http::allowredirect"))
-				{
-					curl.setOption(CURLOPT_FOLLOWLOCATION, 1, "follow-location");
-				}
-				auto timeout = getIntegerAcquireSuboptionForUri(config, uri, "timeout");
-				if (timeout)
+			setUriOptions(curl, config, uri);
+			curl.setOption(CURLOPT_WRITEFUNCTION, (void*)&curlWriteFunction, "write function");
+
+			std::unique_ptr< RequiredFile > file;
+			Hasher hasher;
+			auto openFile = [&file, &hasher, &targetPath]()
+			{
+				file.reset(new RequiredFile(targetPath, "a"));
+				hasher.reset();
+				if (file->tell())
 				{
-					curl.setOption(CURLOPT_CONNECTTIMEOUT, timeout, "connect timeout");
-					curl.setOption(CURLOPT_LOW_SPEED_LIMIT, 1, "low speed limit");
-					curl.setOption(CURLOPT_LOW_SPEED_TIME, timeout, "low speed timeout");
+					hasher.processFile(targetPath);
 				}
-				curl.setOption(CURLOPT_WRITEFUNCTION, (void*)&curlWriteFunction, "write function");
-			}
-
-			RequiredFile file(targetPath, "a");
+			};
+			openFile();
 
 			start:
-			ssize_t totalBytes = file.tell();
+			ssize_t totalBytes = file->tell();
 			callback(vector< string > { "downloading",
 					lexical_cast< string >(totalBytes), lexical_cast< string >(0)});
 			curl.setOption(CURLOPT_RESUME_FROM, totalBytes, "resume from");
@@ -209,7 +249,8 @@ class CurlMethod: public cupt::download::Method
 
 			{
 				fileWriteErrorPtr = &fileWriteError;
-				filePtr = &file;
+				filePtr = file.get();
+				hasherPtr = &hasher;
 				curlPtr = &curl;
 				callbackPtr = &callback;
 				totalBytesPtr = &totalBytes;
@@ -223,6 +264,9 @@ class CurlMethod: public cupt::download::Method
 			}
 			else if (performResult == CURLE_OK)
 			{
+				auto hashSums = hasher.getResult();
+				callback(vector< string > { "hash-sums",
+						hashSums[HashSums::MD5], hashSums[HashSums::SHA1], hashSums[HashSums::SHA256] });
 				return string(); // all went ok
 			}
 			else if (performResult == CURLE_PARTIAL_FILE)
@@ -251,10 +295,12 @@ class CurlMethod: public cupt::download::Method
 					{
 						debug2("range command failed, need to restart from beginning while downloading '%s'", string(uri));
 					}
+					file.reset();
 					if (unlink(targetPath.c_str()) == -1)
 					{
 						return format2e(__("unable to remove target file for re-downloading"));
 					}
+					openFile(); // the old data is neither in the file nor in the hash sums now
 					goto start;
 				}
 
@@ -268,6 +314,709 @@ class CurlMethod: public cupt::download::Method
 	}
 };
 
+extern "C"
+{
+	size_t curlMultiWriteFunction(void* data, size_t size, size_t nmemb, void* transferPtr);
+	size_t curlSegmentWriteFunction(void* data, size_t size, size_t nmemb, void* segmentPtr);
+}
+
+/* all transfers are driven by one curl multi handle in the process of the
+   caller; the per-transfer logic is the same as of CurlMethod::perform
+
+   the multi handle keeps the connections of finished transfers open for the
+   next transfers to the same host, up to the number of simultaneous
+   downloads; TLS sessions are shared as well, so that even new connections
+   to a known host skip the full handshake
+
+   big files may be downloaded by several byte ranges (segments) at once,
+   which are written to their places in the file as they come; a segment
+   which fails is continued from another source */
+class CurlMultiMethod: public cupt::download::MultiMethod
+{
+ public:
+	struct Transfer
+	{
+		string uri;
+		string targetPath;
+		CurlWrapper curl;
+		std::unique_ptr< RequiredFile > file;
+		Hasher hasher;
+		Callback callback;
+		FinishCallback finishCallback;
+		ssize_t totalBytes;
+		bool firstChunk;
+		string fileWriteError;
+		ssize_t transientErrorsLeft;
+		bool debugging;
+		bool aborted;
+		string abortReason;
+
+		size_t write(const char* data, size_t size)
+		{
+			if (aborted)
+			{
+				return 0;
+			}
+			if (!size)
+			{
+				return size; // empty file
+			}
+
+			try
+			{
+				file->put(data, size);
+			}
+			catch (Exception& e)
+			{
+				fileWriteError = e.what();
+				return 0;
+			}
+			hasher.process(data, size);
+
+			if (firstChunk)
+			{
+				firstChunk = false;
+				auto expectedSize = curl.getExpectedDownloadSize();
+				if (expectedSize > 0)
+				{
+					callback(vector< string >{ "expected-size",
+							lexical_cast< string >(expectedSize + totalBytes) });
+					if (aborted) // by the callback
+					{
+						return 0;
+					}
+				}
+			}
+
+			totalBytes += size;
+			callback(vector< string >{ "downloading",
+					lexical_cast< string >(totalBytes), lexical_cast< string >(size) });
+
+			return aborted ? 0 : size;
+		}
+	};
+	struct SegmentedDownload;
+	struct Segment
+	{
+		SegmentedDownload* download;
+		std::unique_ptr< CurlWrapper > curl; // a new one for every source tried
+		size_t sourceIndex;
+		size_t position; // of the next byte to receive
+		size_t end;
+		size_t attemptsLeft;
+		bool responseChecked;
+		bool rangesUnsupported;
+		string error;
+
+		size_t write(const char* data, size_t size);
+	};
+	struct SegmentedDownload
+	{
+		string uri;
+		string targetPath;
+		const Config* config;
+		vector< download::Uri > sources; // the first one is 'uri'
+		vector< bool > badSources; // the ones which ignore byte ranges
+		int fd;
+		size_t size;
+		size_t totalBytes;
+		Callback callback;
+		FinishCallback finishCallback;
+		bool debugging;
+		bool aborted;
+		string abortReason;
+		vector< std::unique_ptr< Segment > > segments; // unfinished ones
+	};
+ private:
+	CURLM* p_handle;
+	CURLSH* p_shareHandle;
+	std::map< string, std::unique_ptr< Transfer > > p_transfers; // uri -> transfer
+	std::map< string, std::unique_ptr< SegmentedDownload > > p_segmentedDownloads; // uri -> download
+	std::map< CURL*, Segment* > p_runningSegments;
+	size_t p_completedCount;
+	size_t p_reusedConnectionCount;
+	vector< pair< FinishCallback, string > > p_pendingResults;
+	bool p_busy; // curl or a callback is running, transfers cannot be removed
+
+	void p_check(CURLMcode code, const char* functionName)
+	{
+		if (code != CURLM_OK)
+		{
+			fatal2(__("%s failed: %s"), functionName, curl_multi_strerror(code));
+		}
+	}
+	void p_configurePool(const Config& config)
+	{
+		// the connection pool, it is bounded by the transfers running at once anyway
+		auto maxConnectionCount = config.getInteger("cupt::downloader::max-simultaneous-downloads");
+		p_check(curl_multi_setopt(p_handle, CURLMOPT_MAXCONNECTS, long(maxConnectionCount)),
+				"curl_multi_setopt");
+		p_check(curl_multi_setopt(p_handle, CURLMOPT_MAX_HOST_CONNECTIONS, long(maxConnectionCount)),
+				"curl_multi_setopt");
+	}
+	void p_setupHandle(CurlWrapper& curl, const Config& config, const download::Uri& uri,
+			void* writeFunction, void* writeData)
+	{
+		curl.setOption(CURLOPT_SHARE, (void*)p_shareHandle, "share handle");
+		CurlMethod::setUriOptions(curl, config, uri);
+		curl.setOption(CURLOPT_WRITEFUNCTION, writeFunction, "write function");
+		curl.setOption(CURLOPT_WRITEDATA, writeData, "write data");
+		curl.setOption(CURLOPT_PRIVATE, writeData, "private data");
+	}
+	void p_start(Transfer& transfer)
+	{
+		if (!transfer.file)
+		{
+			transfer.file.reset(new RequiredFile(transfer.targetPath, "a"));
+			transfer.hasher.reset();
+			if (transfer.file->tell())
+			{
+				transfer.hasher.processFile(transfer.targetPath);
+			}
+		}
+		transfer.totalBytes = transfer.file->tell();
+		transfer.firstChunk = true;
+		p_busy = true;
+		transfer.callback(vector< string > { "downloading",
+				lexical_cast< string >(transfer.totalBytes), lexical_cast< string >(0)});
+		p_busy = false;
+		if (transfer.aborted)
+		{
+			return p_finish(transfer.uri, transfer.abortReason);
+		}
+		transfer.curl.setOption(CURLOPT_RESUME_FROM, transfer.totalBytes, "resume from");
+		p_check(curl_multi_add_handle(p_handle, transfer.curl.getHandle()), "curl_multi_add_handle");
+	}
+	void p_finish(const string& uri, const string& result)
+	{
+		auto it = p_transfers.find(uri);
+		p_check(curl_multi_remove_handle(p_handle, it->second->curl.getHandle()), "curl_multi_remove_handle");
+		p_pendingResults.push_back({ it->second->finishCallback, result });
+		p_transfers.erase(it);
+	}
+	void p_reportConnection(const CurlWrapper& curl, const string& uri, bool debugging)
+	{
+		++p_completedCount;
+		bool reused = !curl.getNewConnectionCount();
+		if (reused)
+		{
+			++p_reusedConnectionCount;
+		}
+		if (debugging)
+		{
+			debug2("%s a connection for '%s' (%zu of %zu transfers reused one)",
+					reused ? "reused" : "opened", uri,
+					p_reusedConnectionCount, p_completedCount);
+		}
+	}
+	void p_processResult(Transfer& transfer, CURLcode performResult)
+	{
+		p_reportConnection(transfer.curl, transfer.uri, transfer.debugging);
+		if (transfer.aborted)
+		{
+			return p_finish(transfer.uri, transfer.abortReason);
+		}
+		else if (!transfer.fileWriteError.empty())
+		{
+			return p_finish(transfer.uri, transfer.fileWriteError);
+		}
+		else if (performResult == CURLE_OK)
+		{
+			auto hashSums = transfer.hasher.getResult();
+			p_busy = true;
+			transfer.callback(vector< string > { "hash-sums",
+					hashSums[HashSums::MD5], hashSums[HashSums::SHA1], hashSums[HashSums::SHA256] });
+			p_busy = false;
+			return p_finish(transfer.uri, transfer.aborted ? transfer.abortReason : string());
+		}
+		else if (performResult == CURLE_PARTIAL_FILE)
+		{
+			// partial data? no problem, we might request it
+			return p_finish(transfer.uri, string());
+		}
+
+		// transient errors handling
+		if (performResult == CURLE_RECV_ERROR && transfer.transientErrorsLeft)
+		{
+			if (transfer.debugging)
+			{
+				debug2("transient error while downloading '%s'", transfer.uri);
+			}
+			--transfer.transientErrorsLeft;
+		}
+		else if (performResult == CURLE_RANGE_ERROR)
+		{
+			if (transfer.debugging)
+			{
+				debug2("range command failed, need to restart from beginning while downloading '%s'", transfer.uri);
+			}
+			transfer.file.reset();
+			if (unlink(transfer.targetPath.c_str()) == -1)
+			{
+				return p_finish(transfer.uri, format2e(__("unable to remove target file for re-downloading")));
+			}
+		}
+		else
+		{
+			return p_finish(transfer.uri, transfer.curl.getError());
+		}
+
+		p_check(curl_multi_remove_handle(p_handle, transfer.curl.getHandle()), "curl_multi_remove_handle");
+		try
+		{
+			p_start(transfer);
+		}
+		catch (Exception& e)
+		{
+			p_finish(transfer.uri, format2(__("download method error: %s"), e.what()));
+		}
+	}
+	void p_startSegment(Segment& segment)
+	{
+		const auto& download = *segment.download;
+		segment.curl.reset(new CurlWrapper);
+		segment.responseChecked = false;
+		segment.rangesUnsupported = false;
+		segment.error.clear();
+		p_setupHandle(*segment.curl, *download.config, download.sources[segment.sourceIndex],
+				(void*)&curlSegmentWriteFunction, (void*)&segment);
+		segment.curl->setOption(CURLOPT_RANGE,
+				format2("%zu-%zu", segment.position, segment.end - 1), "range");
+		p_check(curl_multi_add_handle(p_handle, segment.curl->getHandle()), "curl_multi_add_handle");
+		p_runningSegments[segment.curl->getHandle()] = &segment;
+	}
+	void p_stopSegment(Segment& segment)
+	{
+		if (segment.curl && p_runningSegments.erase(segment.curl->getHandle()))
+		{
+			p_check(curl_multi_remove_handle(p_handle, segment.curl->getHandle()), "curl_multi_remove_handle");
+		}
+	}
+	void p_finishSegmented(const string& uri, const string& result)
+	{
+		auto it = p_segmentedDownloads.find(uri);
+		auto& download = *it->second;
+		for (const auto& segment: download.segments)
+		{
+			p_stopSegment(*segment);
+		}
+		close(download.fd);
+		p_pendingResults.push_back({ download.finishCallback, result });
+		p_segmentedDownloads.erase(it);
+	}
+	void p_downloadAsWhole(const string uri) // a copy, the download is destroyed meanwhile
+	{
+		auto it = p_segmentedDownloads.find(uri);
+		auto& download = *it->second;
+		if (download.debugging)
+		{
+			debug2("no source of '%s' supports byte ranges, downloading it as a whole", uri);
+		}
+		for (const auto& segment: download.segments)
+		{
+			p_stopSegment(*segment);
+		}
+		// the received segments are scattered over the file
+		if (ftruncate(download.fd, 0) == -1)
+		{
+			return p_finishSegmented(uri, format2e(__("unable to truncate the file '%s'"), download.targetPath));
+		}
+		close(download.fd);
+
+		const auto& config = *download.config;
+		auto targetPath = download.targetPath;
+		auto callback = download.callback;
+		auto finishCallback = download.finishCallback;
+		p_segmentedDownloads.erase(it);
+		start(config, uri, targetPath, callback, finishCallback);
+	}
+	void p_processSegmentResult(Segment& segment, CURLcode performResult)
+	{
+		auto& download = *segment.download;
+		p_reportConnection(*segment.curl, download.uri, download.debugging);
+		p_stopSegment(segment);
+		if (download.aborted)
+		{
+			return p_finishSegmented(download.uri, download.abortReason);
+		}
+		else if (performResult == CURLE_OK && segment.position == segment.end)
+		{
+			auto& segments = download.segments;
+			segments.erase(std::find_if(segments.begin(), segments.end(),
+					[&segment](const std::unique_ptr< Segment >& item) { return item.get() == &segment; }));
+			if (segments.empty())
+			{
+				p_finishSegmented(download.uri, string());
+			}
+			return;
+		}
+
+		string error;
+		if (!segment.error.empty())
+		{
+			error = segment.error;
+		}
+		else if (performResult == CURLE_OK)
+		{
+			error = __("the server sent less than requested");
+		}
+		else
+		{
+			error = segment.curl->getError();
+		}
+		if (download.debugging)
+		{
+			debug2("the range %zu-%zu of '%s' from '%s' failed: %s", segment.position, segment.end - 1,
+					download.uri, string(download.sources[segment.sourceIndex]), error);
+		}
+
+		if (segment.rangesUnsupported)
+		{
+			download.badSources[segment.sourceIndex] = true;
+			if (std::find(download.badSources.begin(), download.badSources.end(), false) == download.badSources.end())
+			{
+				return p_downloadAsWhole(download.uri);
+			}
+		}
+		if (!segment.attemptsLeft)
+		{
+			return p_finishSegmented(download.uri, error);
+		}
+		--segment.attemptsLeft;
+
+		// the received part is kept, the rest is requested from the next source
+		do
+		{
+			segment.sourceIndex = (segment.sourceIndex + 1) % download.sources.size();
+		} while (download.badSources[segment.sourceIndex]);
+		try
+		{
+			p_startSegment(segment);
+		}
+		catch (Exception& e)
+		{
+			p_finishSegmented(download.uri, format2(__("download method error: %s"), e.what()));
+		}
+	}
+	void p_perform()
+	{
+		int runningCount;
+		p_busy = true;
+		auto performCode = curl_multi_perform(p_handle, &runningCount);
+		p_busy = false;
+		p_check(performCode, "curl_multi_perform");
+
+		CURLMsg* message;
+		int messagesLeft;
+		while ((message = curl_multi_info_read(p_handle, &messagesLeft)))
+		{
+			if (message->msg != CURLMSG_DONE)
+			{
+				continue;
+			}
+			auto segmentIt = p_runningSegments.find(message->easy_handle);
+			if (segmentIt != p_runningSegments.end())
+			{
+				p_processSegmentResult(*segmentIt->second, message->data.result);
+				continue;
+			}
+			char* transferPtr;
+			curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transferPtr);
+			p_processResult(*reinterpret_cast< Transfer* >(transferPtr), message->data.result);
+		}
+
+		// the ones aborted meanwhile but not finished by curl
+		for (auto it = p_transfers.begin(); it != p_transfers.end();)
+		{
+			auto& transfer = *((it++)->second);
+			if (transfer.aborted)
+			{
+				p_finish(transfer.uri, transfer.abortReason);
+			}
+		}
+		for (auto it = p_segmentedDownloads.begin(); it != p_segmentedDownloads.end();)
+		{
+			auto& download = *((it++)->second);
+			if (download.aborted)
+			{
+				p_finishSegmented(download.uri, download.abortReason);
+			}
+		}
+	}
+ public:
+	CurlMultiMethod()
+		: p_completedCount(0), p_reusedConnectionCount(0), p_busy(false)
+	{
+		p_handle = curl_multi_init();
+		if (!p_handle)
+		{
+			fatal2(__("unable to create a Curl multi handle"));
+		}
+		p_shareHandle = curl_share_init();
+		if (!p_shareHandle)
+		{
+			fatal2(__("unable to create a Curl share handle"));
+		}
+		auto shareCode = curl_share_setopt(p_shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		if (shareCode != CURLSHE_OK)
+		{
+			fatal2(__("%s failed: %s"), "curl_share_setopt", curl_share_strerror(shareCode));
+		}
+	}
+	~CurlMultiMethod()
+	{
+		for (const auto& record: p_transfers)
+		{
+			curl_multi_remove_handle(p_handle, record.second->curl.getHandle());
+		}
+		p_transfers.clear();
+		for (const auto& record: p_runningSegments)
+		{
+			curl_multi_remove_handle(p_handle, record.first);
+		}
+		for (const auto& record: p_segmentedDownloads)
+		{
+			close(record.second->fd);
+		}
+		p_segmentedDownloads.clear();
+		curl_multi_cleanup(p_handle);
+		curl_share_cleanup(p_shareHandle);
+	}
+
+	void start(const Config& config, const download::Uri& uri, const string& targetPath,
+			const Callback& callback, const FinishCallback& finishCallback)
+	{
+		std::unique_ptr< Transfer > transfer(new Transfer);
+		transfer->uri = string(uri);
+		transfer->targetPath = targetPath;
+		transfer->callback = callback;
+		transfer->finishCallback = finishCallback;
+		transfer->transientErrorsLeft = config.getInteger("acquire::retries");
+		transfer->debugging = config.getBool("debug::downloader");
+		transfer->aborted = false;
+		try
+		{
+			p_configurePool(config);
+			p_setupHandle(transfer->curl, config, uri,
+					(void*)&curlMultiWriteFunction, (void*)transfer.get());
+		}
+		catch (Exception& e)
+		{
+			p_pendingResults.push_back({ finishCallback, format2(__("download method error: %s"), e.what()) });
+			return;
+		}
+
+		auto& transferRef = *transfer;
+		p_transfers[transferRef.uri] = std::move(transfer);
+		try
+		{
+			p_start(transferRef);
+		}
+		catch (Exception& e)
+		{
+			p_finish(transferRef.uri, format2(__("download method error: %s"), e.what()));
+		}
+	}
+
+	void startSegmented(const Config& config, const download::Uri& uri,
+			const vector< download::Uri >& mirrorUris, size_t size, const string& targetPath,
+			const Callback& callback, const FinishCallback& finishCallback)
+	{
+		std::unique_ptr< SegmentedDownload > download(new SegmentedDownload);
+		download->uri = string(uri);
+		download->targetPath = targetPath;
+		download->config = &config;
+		download->sources.push_back(uri);
+		download->sources.insert(download->sources.end(), mirrorUris.begin(), mirrorUris.end());
+		download->badSources.assign(download->sources.size(), false);
+		download->size = size;
+		download->totalBytes = 0;
+		download->callback = callback;
+		download->finishCallback = finishCallback;
+		download->debugging = config.getBool("debug::downloader");
+		download->aborted = false;
+
+		// a partial file may have holes left by an interrupted segmented
+		// download, so it is never resumed
+		download->fd = open(targetPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (download->fd == -1)
+		{
+			p_pendingResults.push_back({ finishCallback, format2e(__("unable to open the file '%s'"), targetPath) });
+			return;
+		}
+
+		auto& downloadRef = *download;
+		p_segmentedDownloads[downloadRef.uri] = std::move(download);
+		p_busy = true;
+		callback(vector< string > { "downloading", "0", "0" });
+		p_busy = false;
+		if (downloadRef.aborted)
+		{
+			return p_finishSegmented(downloadRef.uri, downloadRef.abortReason);
+		}
+
+		try
+		{
+			p_configurePool(config);
+			auto segmentCount = std::min(size,
+					(size_t)std::max(config.getInteger("cupt::downloader::segmented-downloads::segment-count"), ssize_t(1)));
+			auto sourceCount = downloadRef.sources.size();
+			if (downloadRef.debugging)
+			{
+				debug2("downloading '%s' by %zu byte ranges from %zu sources",
+						downloadRef.uri, segmentCount, sourceCount);
+			}
+			for (size_t i = 0; i < segmentCount; ++i)
+			{
+				std::unique_ptr< Segment > segment(new Segment);
+				segment->download = &downloadRef;
+				segment->sourceIndex = i % sourceCount;
+				segment->position = size * i / segmentCount;
+				segment->end = size * (i+1) / segmentCount;
+				segment->attemptsLeft = sourceCount + config.getInteger("acquire::retries");
+				auto& segmentRef = *segment;
+				downloadRef.segments.push_back(std::move(segment));
+				p_startSegment(segmentRef);
+			}
+		}
+		catch (Exception& e)
+		{
+			p_finishSegmented(downloadRef.uri, format2(__("download method error: %s"), e.what()));
+		}
+	}
+
+	void abort(const string& uri, const string& reason)
+	{
+		auto transferIt = p_transfers.find(uri);
+		auto segmentedIt = p_segmentedDownloads.find(uri);
+		if (p_busy)
+		{
+			// will be finished once curl leaves it
+			if (transferIt != p_transfers.end())
+			{
+				transferIt->second->aborted = true;
+				transferIt->second->abortReason = reason;
+			}
+			if (segmentedIt != p_segmentedDownloads.end())
+			{
+				segmentedIt->second->aborted = true;
+				segmentedIt->second->abortReason = reason;
+			}
+		}
+		else if (transferIt != p_transfers.end())
+		{
+			p_finish(uri, reason);
+		}
+		else if (segmentedIt != p_segmentedDownloads.end())
+		{
+			p_finishSegmented(uri, reason);
+		}
+	}
+
+	int poll(pollfd* fds, size_t count, int timeout)
+	{
+		p_perform();
+		if (!p_pendingResults.empty())
+		{
+			timeout = 0; // the caller has something to do already
+		}
+		else if (timeout < 0 || timeout > maxWaitTime)
+		{
+			timeout = maxWaitTime;
+		}
+
+		vector< curl_waitfd > waitFds(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			waitFds[i].fd = fds[i].fd;
+			waitFds[i].events = fds[i].events;
+			waitFds[i].revents = 0;
+		}
+		int eventCount;
+		p_check(curl_multi_wait(p_handle, waitFds.data(), count, timeout, &eventCount), "curl_multi_wait");
+		int result = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			fds[i].revents = waitFds[i].revents;
+			if (fds[i].revents)
+			{
+				++result;
+			}
+		}
+		p_perform();
+
+		auto pendingResults = std::move(p_pendingResults);
+		p_pendingResults.clear();
+		for (const auto& pendingResult: pendingResults)
+		{
+			pendingResult.first(pendingResult.second);
+		}
+		return result;
+	}
+
+	static const int maxWaitTime = 1000; // ms
+};
+
+size_t CurlMultiMethod::Segment::write(const char* data, size_t size)
+{
+	auto& parent = *download;
+	if (parent.aborted)
+	{
+		return 0;
+	}
+	if (!responseChecked)
+	{
+		responseChecked = true;
+		// http servers are free to ignore the range and send the whole file
+		auto protocol = parent.sources[sourceIndex].getProtocol();
+		if ((protocol == "http" || protocol == "https") && curl->getResponseCode() != 206)
+		{
+			rangesUnsupported = true;
+			error = __("the server does not support byte ranges");
+			return 0;
+		}
+	}
+	if (size > end - position)
+	{
+		error = __("the server sent more than requested");
+		return 0;
+	}
+
+	for (size_t written = 0; written < size;)
+	{
+		auto writeResult = pwrite(parent.fd, data + written, size - written, position + written);
+		if (writeResult == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			error = format2e(__("unable to write to the file '%s'"), parent.targetPath);
+			return 0;
+		}
+		written += writeResult;
+	}
+	position += size;
+
+	parent.totalBytes += size;
+	parent.callback(vector< string >{ "downloading",
+			lexical_cast< string >(parent.totalBytes), lexical_cast< string >(size) });
+
+	return parent.aborted ? 0 : size;
+}
+
+extern "C"
+{
+	size_t curlMultiWriteFunction(void* data, size_t size, size_t nmemb, void* transferPtr)
+	{
+		return static_cast< CurlMultiMethod::Transfer* >(transferPtr)->write((const char*)data, size * nmemb);
+	}
+	size_t curlSegmentWriteFunction(void* data, size_t size, size_t nmemb, void* segmentPtr)
+	{
+		return static_cast< CurlMultiMethod::Segment* >(segmentPtr)->write((const char*)data, size * nmemb);
+	}
+}
+
 }
 
 extern "C"
@@ -276,4 +1025,8 @@ extern "C"
 	{
 		return new cupt::CurlMethod();
 	}
+	cupt::download::MultiMethod* constructMulti()
+	{
+		return new cupt::CurlMultiMethod();
+	}
 }
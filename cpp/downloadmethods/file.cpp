@@ -26,6 +26,7 @@ using boost::lexical_cast;
 #include <cupt/download/method.hpp>
 #include <cupt/download/uri.hpp>
 #include <cupt/file.hpp>
+#include <cupt/hashsums.hpp>
 
 namespace cupt {
 
@@ -45,6 +46,12 @@ class FileMethod: public download::Method
 		callback(vector< string > { "downloading",
 				lexical_cast< string >(totalBytes), lexical_cast< string >(0)});
 
+		Hasher hasher;
+		if (totalBytes)
+		{
+			hasher.processFile(targetPath);
+		}
+
 		{ // determing the size
 			struct stat st;
 			if (::stat(sourcePath.c_str(), &st) == -1)
@@ -59,12 +66,17 @@ class FileMethod: public download::Method
 			while (auto rawBuffer = sourceFile.getBlock(4096))
 			{
 				targetFile.put(rawBuffer.data, rawBuffer.size);
+				hasher.process(rawBuffer.data, rawBuffer.size);
 				totalBytes += rawBuffer.size;
 				callback(vector< string > { "downloading",
 						lexical_cast< string >(totalBytes), lexical_cast< string >(rawBuffer.size)});
 			}
 		}
 
+		auto hashSums = hasher.getResult();
+		callback(vector< string > { "hash-sums",
+				hashSums[HashSums::MD5], hashSums[HashSums::SHA1], hashSums[HashSums::SHA256] });
+
 		return string();
 	}
 	string perform(const Config&, const download::Uri& uri,
@@ -32,6 +32,7 @@ namespace cupt {
 namespace internal {
 
 struct CacheImpl;
+class NativeResolverImpl;
 
 }
 
@@ -88,6 +89,7 @@ class CUPT_API Cache
 
  private:
 	internal::CacheImpl* __impl;
+	friend class internal::NativeResolverImpl;
 	Cache(const Cache&);
 	Cache& operator=(const Cache&);
  public:
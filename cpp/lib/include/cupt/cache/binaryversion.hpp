@@ -20,6 +20,8 @@
 
 /// @file
 
+#include <atomic>
+
 #include <cupt/hashsums.hpp>
 #include <cupt/cache/version.hpp>
 #include <cupt/cache/relation.hpp>
@@ -38,12 +40,46 @@ struct CUPT_API BinaryVersion: public Version
 		static const string strings[]; ///< string values of corresponding types
 		static const char* rawStrings[]; ///< lower-case, unlocalized string values of corresponding types
 	};
+	/// relation lines of all relation types
+	/**
+	 * Relation fields are only checked for syntax errors while the version
+	 * is parsed and are turned into relation lines on the first access to
+	 * them. Their raw text is freed once all of them are turned. Accessing is
+	 * thread-safe.
+	 */
+	class CUPT_API RelationLines
+	{
+		mutable string p_raw;
+		uint32_t p_bounds[RelationTypes::Count][2];
+		mutable std::atomic< uint32_t > p_parsedMask;
+		mutable RelationLine p_lines[RelationTypes::Count];
+
+		RelationLines(const RelationLines&);
+		RelationLines& operator=(const RelationLines&);
+	 public:
+		/// constructor
+		RelationLines();
+		/// gets a relation line
+		/**
+		 * @param type relation type, see RelationTypes
+		 * @return parsed relation line of the type @a type
+		 */
+		const RelationLine& operator[](size_t type) const;
+		/// operator ==
+		/**
+		 * @return @c true if relation lines of all types are equal, @c false otherwise
+		 */
+		bool operator==(const RelationLines&) const;
+		/// @cond
+		void setRaw(size_t type, const char* begin, const char* end);
+		/// @endcond
+	};
 	string architecture; ///< binary architecture
 	uint32_t installedSize; ///< approximate size of unpacked file content in bytes
 	string sourcePackageName; ///< source package name
 	string sourceVersionString; ///< source version string
 	bool essential; ///< has version 'essential' flag?
-	RelationLine relations[RelationTypes::Count]; ///< relations with other binary versions
+	RelationLines relations; ///< relations with other binary versions
 	vector< string > provides; ///< array of virtual package names
 	string description;
 	string descriptionHash; ///< MD5 hash sum value of the full description
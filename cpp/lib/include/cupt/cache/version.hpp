@@ -105,6 +105,9 @@ struct CUPT_API Version
 
 	/// @cond
 	string getCodenameAndComponentString(const string&) const;
+	// versions parsed by a cache are placed in its arena
+	static void* operator new(size_t);
+	static void operator delete(void*);
 	/// @endcond
 };
 
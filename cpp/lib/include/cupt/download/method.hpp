@@ -22,6 +22,8 @@
 
 #include <functional>
 
+#include <poll.h>
+
 #include <cupt/common.hpp>
 #include <cupt/fwd.hpp>
 
@@ -70,13 +72,82 @@ class CUPT_API Method
 	 *
 	 * @par Allowed callback sequences:
 	 * @c downloading @a total_downloaded_bytes @a size_of_last_fetched_piece @n
-	 * @c expected-size @a expected_file_size
+	 * @c expected-size @a expected_file_size @n
+	 * @c hash-sums @a md5 @a sha1 @a sha256 - optional, of the whole target
+	 * file, computed while writing it
 	 */
 	virtual string perform(const Config& config, const Uri& uri,
 			const string& targetPath, const std::function< void (const vector< string >&) >& callback) = 0;
 	virtual ~Method() {}
 };
 
+/// base class of download methods which run many transfers in the calling process
+/**
+ * Unlike @ref Method, which blocks until the download is done, the transfers
+ * are only started by @ref start and proceed while the caller's event loop
+ * waits in @ref poll.
+ */
+class CUPT_API MultiMethod
+{
+ protected:
+	MultiMethod();
+ public:
+	typedef std::function< void (const vector< string >&) > Callback;
+	typedef std::function< void (const string&) > FinishCallback;
+
+	/// starts downloading @a uri to @a targetPath
+	/**
+	 * @param config
+	 * @param uri
+	 * @param targetPath path to download to
+	 * @param callback receives the same messages as the callback of @ref Method::perform
+	 * @param finishCallback receives the result of the download, an empty
+	 * string or an error message; it is called only from @ref poll, and no
+	 * callbacks are called for @a uri after it
+	 */
+	virtual void start(const Config& config, const Uri& uri, const string& targetPath,
+			const Callback& callback, const FinishCallback& finishCallback) = 0;
+	/// same as @ref start, but downloads the file by several byte ranges at once
+	/**
+	 * The ranges may be fetched from @a uri as well as from any of @a mirrorUris,
+	 * all of which must point to the same file of the size @a size. The
+	 * default implementation just calls @ref start.
+	 *
+	 * @param config
+	 * @param uri
+	 * @param mirrorUris
+	 * @param size
+	 * @param targetPath
+	 * @param callback
+	 * @param finishCallback
+	 */
+	virtual void startSegmented(const Config& config, const Uri& uri, const vector< Uri >& mirrorUris,
+			size_t size, const string& targetPath, const Callback& callback,
+			const FinishCallback& finishCallback);
+	/// stops downloading @a uri
+	/**
+	 * The finish callback of @a uri is called with @a reason on the next
+	 * @ref poll. Does nothing if the download is finished already. May be
+	 * called from the callbacks.
+	 *
+	 * @param uri
+	 * @param reason
+	 */
+	virtual void abort(const string& uri, const string& reason) = 0;
+	/// waits like @c poll(2) for @a fds, proceeding with the transfers meanwhile
+	/**
+	 * May return before @a timeout expires when no file descriptor is ready,
+	 * to let the caller process the messages from the callbacks.
+	 *
+	 * @param fds
+	 * @param count number of elements in @a fds
+	 * @param timeout in milliseconds, negative means infinite
+	 * @return number of the elements of @a fds with non-zero @c revents
+	 */
+	virtual int poll(pollfd* fds, size_t count, int timeout) = 0;
+	virtual ~MultiMethod() {}
+};
+
 }
 }
 
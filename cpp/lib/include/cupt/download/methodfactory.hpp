@@ -52,6 +52,15 @@ class CUPT_API MethodFactory
 	 * @param uri
 	 */
 	Method* getDownloadMethodForUri(const Uri& uri) const;
+	/// gets in-process download method for @a uri
+	/**
+	 * @param uri
+	 * @return the @ref MultiMethod counterpart of the method which would be
+	 * selected for @a uri, or @c NULL if that method has no such counterpart;
+	 * the object is owned by the factory and is shared between all URIs of
+	 * that method
+	 */
+	MultiMethod* getMultiMethodForUri(const Uri& uri) const;
 };
 
 }
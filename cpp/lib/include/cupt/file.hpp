@@ -57,7 +57,9 @@ class CUPT_API File
 	 * @param path path to file or shell command, see @a mode
 	 * @param mode any value, accepted as @a mode in @c fopen(3); or @c "pr" /
 	 *   @c "pw" - special values to treat @a path as shell pipe with an opened
-	 *   handle for reading / writing, respectively
+	 *   handle for reading / writing, respectively; an additional character
+	 *   @c 'm' in the reading mode makes a regular file read through a memory
+	 *   mapping, returned buffers then point directly into it
 	 * @param [out] error if open fails, human readable error will be placed here
 	 */
 	File(const string& path, const char* mode, string& error);
@@ -152,6 +154,12 @@ class CUPT_API RequiredFile: public File
 	RequiredFile(const string& path, const char* mode);
 };
 
+// passes a uniquely named temporary file in the directory of @a path to
+// @a writer and then renames it to @a path, so that concurrent readers and
+// writers see either the old or a complete new file; returns false if the
+// file could not be written, e.g. the directory is not writable
+CUPT_API bool writeFileAtomically(const string& path, const std::function< void (File&) >& writer);
+
 } // namespace
 
 /// @endcond
@@ -48,6 +48,7 @@ namespace download {
 
 class Manager;
 class Method;
+class MultiMethod;
 class Uri;
 class Progress;
 class ConsoleProgress;
@@ -59,6 +60,7 @@ namespace system {
 class State;
 class Resolver;
 class NativeResolver;
+class SatResolver;
 class Worker;
 class Snapshots;
 
@@ -24,6 +24,12 @@
 
 namespace cupt {
 
+namespace internal {
+
+class HasherImpl;
+
+}
+
 /// hash sums
 class CUPT_API HashSums
 {
@@ -74,6 +80,41 @@ class CUPT_API HashSums
 	static string getHashOfString(const Type& type, const string& pattern);
 };
 
+/// computes hash sums of several types in one pass over the data
+class CUPT_API Hasher
+{
+	internal::HasherImpl* __impl;
+	Hasher(const Hasher&) = delete;
+ public:
+	/// constructor, for the hash sums of all types
+	Hasher();
+	/// constructor, for the hash sums of types which are not empty in @a pattern
+	/**
+	 * @param pattern
+	 */
+	explicit Hasher(const HashSums& pattern);
+	/// destructor
+	~Hasher();
+	/// adds a piece of the data
+	/**
+	 * @param data
+	 * @param size
+	 */
+	void process(const char* data, size_t size);
+	/// adds the content of a file
+	/**
+	 * @param path path to a file
+	 */
+	void processFile(const string& path);
+	/// forgets all the data added
+	void reset();
+	/// gets the hash sums of the data added
+	/**
+	 * No data can be added after this, until @ref reset.
+	 */
+	HashSums getResult() const;
+};
+
 }
 
 #endif
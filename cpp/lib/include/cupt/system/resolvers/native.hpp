@@ -39,6 +39,14 @@ class CUPT_API NativeResolver: public Resolver
 	internal::NativeResolverImpl* __impl;
 
  public:
+	/// counters of the last @ref resolve call
+	struct Statistics
+	{
+		size_t expandedSolutionCount; ///< the number of partial solutions expanded
+		size_t proposedSolutionCount; ///< the number of solutions passed to the callback
+		ssize_t proposedScore; ///< the score of the last solution passed to the callback
+	};
+
 	/// constructor
 	NativeResolver(const shared_ptr< const Config >&, const shared_ptr< const Cache >&);
 
@@ -47,6 +55,7 @@ class CUPT_API NativeResolver: public Resolver
 	void setAutomaticallyInstalledFlag(const string&, bool);
 
 	bool resolve(Resolver::CallbackType);
+	const Statistics& getStatistics() const;
 
 	~NativeResolver();
 };
@@ -0,0 +1,68 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_SYSTEM_RESOLVERS_SAT
+#define CUPT_SYSTEM_RESOLVERS_SAT
+
+/// @file
+
+#include <cupt/system/resolver.hpp>
+#include <cupt/system/resolvers/native.hpp>
+#include <cupt/cache/relation.hpp>
+
+namespace cupt {
+
+namespace internal {
+
+class NativeResolverImpl;
+
+}
+
+namespace system {
+
+/// problem resolver which encodes the problem as a SAT instance
+/**
+ * Accepts the same requests as NativeResolver and proposes the solutions in
+ * the same form, but searches them by a built-in CDCL solver: the proposed
+ * solution has the best score possible, the next solutions (if the previous
+ * was declined) are the best ones which don't have all the changes of any
+ * declined solution.
+ */
+class CUPT_API SatResolver: public Resolver
+{
+	internal::NativeResolverImpl* __impl;
+
+ public:
+	/// constructor
+	SatResolver(const shared_ptr< const Config >&, const shared_ptr< const Cache >&);
+
+	void satisfyRelationExpression(const RelationExpression&, bool, const string&, RequestImportance, bool);
+	void upgrade();
+	void setAutomaticallyInstalledFlag(const string&, bool);
+
+	bool resolve(Resolver::CallbackType);
+	/// same as NativeResolver::getStatistics, the expanded solutions are the models found
+	const NativeResolver::Statistics& getStatistics() const;
+
+	~SatResolver();
+};
+
+}
+}
+
+#endif
+
@@ -144,12 +144,12 @@ static Range< Cache::PackageNameIterator > getPrePackagesRange(const PrePackageM
 
 Range< Cache::PackageNameIterator > Cache::getBinaryPackageNames() const
 {
-	return getPrePackagesRange(__impl->preBinaryPackages);
+	return getPrePackagesRange(__impl->getPrePackagesWithAllNames(IndexEntry::Binary));
 }
 
 Range< Cache::PackageNameIterator > Cache::getSourcePackageNames() const
 {
-	return getPrePackagesRange(__impl->preSourcePackages);
+	return getPrePackagesRange(__impl->getPrePackagesWithAllNames(IndexEntry::Source));
 }
 
 const BinaryPackage* Cache::getBinaryPackage(const string& packageName) const
@@ -15,10 +15,13 @@
 *   Free Software Foundation, Inc.,                                       *
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
+#include <mutex>
+
 #include <cupt/cache/binaryversion.hpp>
 #include <cupt/cache/releaseinfo.hpp>
 
 #include <internal/common.hpp>
+#include <internal/parse.hpp>
 
 namespace cupt {
 namespace cache {
@@ -38,6 +41,73 @@ bool BinaryVersion::areHashesEqual(const Version* other) const
 	return file.hashSums.match(o->file.hashSums);
 }
 
+namespace {
+
+std::mutex relationParseMutex;
+
+}
+
+BinaryVersion::RelationLines::RelationLines()
+	: p_bounds(), p_parsedMask(0)
+{}
+
+void BinaryVersion::RelationLines::setRaw(size_t type, const char* begin, const char* end)
+{
+	// a malformed field should reject the version right now, not its later readers
+	internal::parse::checkRelationLine(begin, end);
+
+	p_bounds[type][0] = p_raw.size();
+	p_raw.append(begin, end);
+	p_bounds[type][1] = p_raw.size();
+	p_lines[type].clear();
+	p_parsedMask.fetch_and(~(uint32_t(1) << type), std::memory_order_relaxed);
+}
+
+const RelationLine& BinaryVersion::RelationLines::operator[](size_t type) const
+{
+	const uint32_t bit = uint32_t(1) << type;
+	if (p_parsedMask.load(std::memory_order_acquire) & bit)
+	{
+		return p_lines[type];
+	}
+	if (p_bounds[type][0] == p_bounds[type][1])
+	{
+		return p_lines[type]; // no such field, stays empty
+	}
+
+	std::lock_guard< std::mutex > lock(relationParseMutex);
+	if (!(p_parsedMask.load(std::memory_order_relaxed) & bit))
+	{
+		auto data = p_raw.data();
+		p_lines[type] = RelationLine(std::make_pair(data + p_bounds[type][0], data + p_bounds[type][1]));
+		auto parsedMask = p_parsedMask.fetch_or(bit, std::memory_order_release) | bit;
+
+		// the raw text is only read under the lock, so it can go once every
+		// present field is parsed
+		for (size_t otherType = 0; otherType < RelationTypes::Count; ++otherType)
+		{
+			if (p_bounds[otherType][0] != p_bounds[otherType][1] && !(parsedMask & (uint32_t(1) << otherType)))
+			{
+				return p_lines[type];
+			}
+		}
+		string().swap(p_raw);
+	}
+	return p_lines[type];
+}
+
+bool BinaryVersion::RelationLines::operator==(const RelationLines& other) const
+{
+	for (size_t type = 0; type < RelationTypes::Count; ++type)
+	{
+		if (!((*this)[type] == other[type]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 const string BinaryVersion::RelationTypes::strings[] = {
 	N__("Pre-Depends"), N__("Depends"), N__("Recommends"), N__("Suggests"),
 	N__("Enhances"), N__("Conflicts"), N__("Breaks"), N__("Replaces")
@@ -26,8 +26,12 @@
 namespace cupt {
 namespace cache {
 
-bool Relation::__parse_versioned_info(const char* current, const char* end)
+namespace {
+
+bool parseVersionedInfo(const char* current, const char* end,
+		Relation::Types::Type& relationType, const char*& versionStringBegin, const char*& versionStringEnd)
 {
+	typedef Relation::Types Types;
 	// parse relation
 	if (current == end || current+1 == end /* version should at least have one character */)
 	{
@@ -86,7 +90,8 @@ bool Relation::__parse_versioned_info(const char* current, const char* end)
 	{
 		++current;
 	}
-	const char* versionStringEnd = current+1;
+	versionStringBegin = current;
+	versionStringEnd = current+1;
 	while (versionStringEnd != end && *versionStringEnd != ')' && *versionStringEnd != ' ')
 	{
 		++versionStringEnd;
@@ -95,8 +100,6 @@ bool Relation::__parse_versioned_info(const char* current, const char* end)
 	{
 		return false; // at least ')' after version string should be
 	}
-	versionString.assign(current, versionStringEnd);
-	checkVersionString(versionString);
 
 	current = versionStringEnd;
 	while (current != end && *current == ' ')
@@ -115,6 +118,21 @@ bool Relation::__parse_versioned_info(const char* current, const char* end)
 	return (current == end);
 }
 
+}
+
+bool Relation::__parse_versioned_info(const char* current, const char* end)
+{
+	const char* versionStringBegin;
+	const char* versionStringEnd;
+	if (!parseVersionedInfo(current, end, relationType, versionStringBegin, versionStringEnd))
+	{
+		return false;
+	}
+	versionString.assign(versionStringBegin, versionStringEnd);
+	checkVersionString(versionString);
+	return true;
+}
+
 void Relation::__init(const char* start, const char* end)
 {
 	const char* current;
@@ -453,3 +471,49 @@ DEFINE_RELATION_LINE_CLASS(ArchitecturedRelationLine, ArchitecturedRelationExpre
 }
 }
 
+namespace cupt {
+
+// kind of HACK: I want to use this function, but don't want to create a header for it
+bool __check_version_string(const string& input,
+		bool& underscoresPresent, char& firstUpstreamCharacter);
+
+namespace internal {
+namespace parse {
+
+void checkRelationLine(const char* begin, const char* end)
+{
+	auto checkRelation = [](const char* start, const char* end)
+	{
+		const char* current;
+		consumePackageName(start, end, current);
+		bool ok = (current != start);
+		while (ok && current != end && *current == ' ')
+		{
+			++current;
+		}
+		if (ok && current != end && *current == '(')
+		{
+			cache::Relation::Types::Type relationType;
+			const char* versionStringBegin;
+			const char* versionStringEnd;
+			bool underscoresPresent;
+			char firstUpstreamCharacter;
+			ok = cache::parseVersionedInfo(current+1, end, relationType, versionStringBegin, versionStringEnd) &&
+					__check_version_string(string(versionStringBegin, versionStringEnd),
+							underscoresPresent, firstUpstreamCharacter);
+		}
+		if (!ok)
+		{
+			cache::Relation(std::make_pair(start, end)); // throws the proper error
+		}
+	};
+	auto checkRelationExpression = [&checkRelation](const char* begin, const char* end)
+	{
+		processSpaceCharSpaceDelimitedStrings(begin, end, '|', checkRelation);
+	};
+	processSpaceCharSpaceDelimitedStrings(begin, end, ',', checkRelationExpression);
+}
+
+}
+}
+}
@@ -17,11 +17,13 @@
 **************************************************************************/
 
 #include <set>
+#include <cstddef>
 
 #include <cupt/cache/version.hpp>
 #include <cupt/cache/releaseinfo.hpp>
 
 #include <internal/common.hpp>
+#include <internal/arena.hpp>
 
 namespace cupt {
 namespace cache {
@@ -32,6 +34,41 @@ bool Version::parseRelations = true;
 bool Version::parseInfoOnly = true;
 bool Version::parseOthers = false;
 
+namespace {
+
+// every version is prefixed with the arena it was allocated in, or nullptr
+const size_t allocationHeaderSize = alignof(std::max_align_t);
+static_assert(allocationHeaderSize >= sizeof(internal::Arena*), "allocation header is too small");
+
+}
+
+void* Version::operator new(size_t size)
+{
+	auto arena = internal::Arena::getCurrent();
+	size += allocationHeaderSize;
+	auto memory = static_cast< char* >(arena ? arena->allocate(size) : ::operator new(size));
+	*reinterpret_cast< internal::Arena** >(memory) = arena;
+	return memory + allocationHeaderSize;
+}
+
+void Version::operator delete(void* pointer)
+{
+	if (!pointer)
+	{
+		return;
+	}
+	auto memory = static_cast< char* >(pointer) - allocationHeaderSize;
+	auto arena = *reinterpret_cast< internal::Arena** >(memory);
+	if (arena)
+	{
+		arena->release();
+	}
+	else
+	{
+		::operator delete(memory);
+	}
+}
+
 Version::Version()
 	: others(NULL)
 {}
@@ -128,6 +128,7 @@ void ConfigImpl::initializeVariables()
 		// Cupt vars
 		{ "cupt::cache::limit-releases::by-archive::type", "none" },
 		{ "cupt::cache::limit-releases::by-codename::type", "none" },
+		{ "cupt::cache::loader-threads", "0" },
 		{ "cupt::cache::pin::addendums::downgrade", "-10000" },
 		{ "cupt::cache::pin::addendums::hold", "1000000" },
 		{ "cupt::cache::pin::addendums::not-automatic", "-4000" },
@@ -154,7 +155,11 @@ void ConfigImpl::initializeVariables()
 		{ "cupt::directory::log", "var/log/cupt.log" },
 		{ "cupt::directory::state", "var/lib/cupt" },
 		{ "cupt::directory::state::lists", "lists" },
+		{ "cupt::directory::state::mirror-statistics", "mirror-statistics" },
 		{ "cupt::directory::state::snapshots", "snapshots" },
+		{ "cupt::directory::state::status-index", "status.index" },
+		{ "cupt::downloader::adaptive-mirror-selection", "yes" },
+		{ "cupt::downloader::engine", "processes" },
 		{ "cupt::downloader::max-simultaneous-downloads", "2" },
 		{ "cupt::downloader::protocols::file::priority", "300" },
 		{ "cupt::downloader::protocols::copy::priority", "250" },
@@ -171,6 +176,8 @@ void ConfigImpl::initializeVariables()
 		{ "cupt::downloader::protocols::https::methods::wget::priority", "80" },
 		{ "cupt::downloader::protocols::http::methods::wget::priority", "80" },
 		{ "cupt::downloader::protocols::ftp::methods::wget::priority", "80" },
+		{ "cupt::downloader::segmented-downloads::min-size", "16384" },
+		{ "cupt::downloader::segmented-downloads::segment-count", "4" },
 		{ "cupt::languages::indexes", "environment,en" },
 		{ "cupt::update::check-release-files", "yes" },
 		{ "cupt::update::compression-types::gz::priority", "100" },
@@ -181,12 +188,22 @@ void ConfigImpl::initializeVariables()
 		{ "cupt::update::generate-index-of-index", "yes" },
 		{ "cupt::update::use-index-diffs", "yes" },
 		{ "cupt::resolver::auto-remove", "yes" },
+		{ "cupt::resolver::backend", "native" },
+		{ "cupt::resolver::conflict-learning", "no" },
+		{ "cupt::resolver::drop-duplicate-states", "no" },
+		{ "cupt::resolver::expansion-batch-size", "1" },
 		{ "cupt::resolver::external-command", "" },
 		{ "cupt::resolver::keep-recommends", "yes" },
 		{ "cupt::resolver::keep-suggests", "no" },
+		{ "cupt::resolver::max-memory", "0" },
 		{ "cupt::resolver::max-solution-count", "512" },
+		{ "cupt::resolver::max-steps", "0" },
+		{ "cupt::resolver::max-time", "0" },
 		{ "cupt::resolver::no-remove", "no" },
+		{ "cupt::resolver::problem-dump-directory", "" },
+		{ "cupt::resolver::sat::max-improvement-conflicts", "20000" },
 		{ "cupt::resolver::synchronize-by-source-versions", "none" },
+		{ "cupt::resolver::threads", "0" },
 		{ "cupt::resolver::track-reasons", "no" },
 		{ "cupt::resolver::type", "fair" },
 		{ "cupt::resolver::score::new", "-5" },
@@ -212,6 +229,7 @@ void ConfigImpl::initializeVariables()
 		{ "cupt::worker::purge", "no" },
 		{ "cupt::worker::simulate", "no" },
 		{ "cupt::worker::use-locks", "yes" },
+		{ "debug::cache", "no" },
 		{ "debug::downloader", "no" },
 		{ "debug::logger", "no" },
 		{ "debug::resolver", "no" },
@@ -334,15 +352,15 @@ void ConfigImpl::readConfigs(Config* config)
 		return string(value.begin() + 1, value.end() - 1);
 	};
 
-	static auto regularHandler = [&config](const string& name, const string& value)
+	auto regularHandler = [&config](const string& name, const string& value)
 	{
 		config->setScalar(name, unquoteValue(value));
 	};
-	static auto listHandler = [&config](const string& name, const string& value)
+	auto listHandler = [&config](const string& name, const string& value)
 	{
 		config->setList(name, unquoteValue(value));
 	};
-	static auto clearHandler = [this](const string& name, const string& /* no value */)
+	auto clearHandler = [this](const string& name, const string& /* no value */)
 	{
 		const sregex nameRegex = sregex::compile(name);
 		smatch m;
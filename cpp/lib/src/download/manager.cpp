@@ -16,6 +16,7 @@
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <sstream>
 #include <queue>
@@ -33,6 +34,7 @@
 #include <sys/un.h>
 
 #include <cupt/config.hpp>
+#include <cupt/hashsums.hpp>
 #include <cupt/download/manager.hpp>
 #include <cupt/download/uri.hpp>
 #include <cupt/download/progress.hpp>
@@ -40,6 +42,8 @@
 #include <cupt/download/methodfactory.hpp>
 
 #include <internal/common.hpp>
+#include <internal/freshhashsums.hpp>
+#include <internal/mirrorstatistics.hpp>
 #include <internal/pipe.hpp>
 
 namespace cupt {
@@ -64,6 +68,7 @@ using boost::lexical_cast;
 using std::make_pair;
 
 typedef queue< vector< string > > MessageQueue;
+typedef std::chrono::steady_clock Clock;
 
 static void sendRawSocketMessage(int socket, const string& compactedMessage)
 {
@@ -148,6 +153,8 @@ class ManagerImpl
 	shared_ptr< Pipe > parentPipe;
 	pid_t workerPid;
 	MethodFactory methodFactory;
+	bool p_inProcessTransfers;
+	std::unique_ptr< MirrorStatistics > p_mirrorStatistics; // NULL if not used
 
 	// worker data
 	map< string, string > done; // uri -> result
@@ -155,10 +162,16 @@ class ManagerImpl
 	{
 		int waiterSocket;
 		vector< int > secondaryWaiterSockets;
-		pid_t performerPid;
+		pid_t performerPid; // 0 if downloaded by p_multiMethod
 		shared_ptr< Pipe > performerPipe;
 		string targetPath;
+		Clock::time_point startTime;
+		Clock::time_point firstByteTime;
+		size_t receivedSize;
+		bool segmented; // fetched from several sources at once
+		vector< string > hashSums; // computed by the method, if any
 	};
+	MultiMethod* p_multiMethod; // the one which runs the in-process transfers
 	map< string, ActiveDownloadInfo > activeDownloads; // uri -> info
 	struct OnHoldRecord
 	{
@@ -168,6 +181,7 @@ class ManagerImpl
 	};
 	queue< OnHoldRecord > onHold;
 	map< string, size_t > sizes;
+	map< string, vector< string > > mirrorUris; // uri -> other uris of the same file
 
 	void finishDuplicatedDownload(int, const string&, const string&);
 	void finishPendingDownloads(const string&, const ActiveDownloadInfo&, const string&, bool);
@@ -178,8 +192,11 @@ class ManagerImpl
 	void killPerformerBecauseOfWrongSize(MessageQueue&, const string& uri,
 			const string& actionName, const string& errorString);
 	void terminateDownloadProcesses();
-	void startNewDownload(const string& uri, const string& targetPath, int waiterSocket, bool debugging);
+	void startNewDownload(MessageQueue&, const string& uri, const string& targetPath,
+			int waiterSocket, bool debugging);
+	bool p_startInProcessDownload(MessageQueue&, const string& uri, const string& targetPath, bool debugging);
 	void setDownloadSize(const string& uri, size_t size);
+	vector< Uri > getSegmentMirrors(MultiMethod*, const string& uri);
 	void forwardToProgress(const string&, const string&, const string&);
 	InputMessage pollAllInput(MessageQueue& workerQueue,
 			const vector< int >& persistentSockets, set< int >& clientSockets,
@@ -197,13 +214,33 @@ class ManagerImpl
 };
 
 ManagerImpl::ManagerImpl(const shared_ptr< const Config >& config_, const shared_ptr< Progress >& progress_)
-	: config(config_), progress(progress_), methodFactory(*config_)
+	: config(config_), progress(progress_), methodFactory(*config_),
+	p_inProcessTransfers(false), p_multiMethod(NULL)
 {
 	if (config->getBool("cupt::worker::simulate"))
 	{
 		return;
 	}
 
+	auto engine = config->getString("cupt::downloader::engine");
+	if (engine == "processes")
+	{
+		p_inProcessTransfers = false;
+	}
+	else if (engine == "event-loop")
+	{
+		p_inProcessTransfers = true;
+	}
+	else
+	{
+		fatal2(__("wrong download engine '%s'"), engine);
+	}
+
+	if (config->getBool("cupt::downloader::adaptive-mirror-selection"))
+	{
+		p_mirrorStatistics.reset(new MirrorStatistics(*config));
+	}
+
 	// getting a file path for main socket
 	auto temporaryName = tempnam(NULL, "cupt");
 	if (temporaryName)
@@ -316,6 +353,10 @@ void ManagerImpl::terminateDownloadProcesses()
 	FORIT(activeDownloadIt, activeDownloads)
 	{
 		auto pid = activeDownloadIt->second.performerPid;
+		if (!pid)
+		{
+			continue; // will die together with this process
+		}
 		if (kill(pid, SIGTERM) == -1)
 		{
 			if (errno != ESRCH)
@@ -348,11 +389,33 @@ void ManagerImpl::processPreliminaryResult(MessageQueue& workerQueue,
 		fatal2i("download manager: received preliminary result for unexistent download, uri '%s'", uri);
 	}
 	ActiveDownloadInfo& downloadInfo = downloadInfoIt->second;
-	sendSocketMessage(downloadInfo.waiterSocket,
-			vector< string > { uri, result, lexical_cast< string >(isDuplicatedDownload) });
+	vector< string > resultMessage = { uri, result, lexical_cast< string >(isDuplicatedDownload) };
+	if (result.empty())
+	{
+		resultMessage.insert(resultMessage.end(), downloadInfo.hashSums.begin(), downloadInfo.hashSums.end());
+	}
+	sendSocketMessage(downloadInfo.waiterSocket, resultMessage);
+
+	if (p_mirrorStatistics && !downloadInfo.segmented)
+	{
+		auto getSeconds = [](Clock::duration duration)
+		{
+			return std::chrono::duration< double >(duration).count();
+		};
+		if (!result.empty())
+		{
+			p_mirrorStatistics->addFailure(uri);
+		}
+		else if (downloadInfo.receivedSize)
+		{
+			p_mirrorStatistics->add(uri, downloadInfo.receivedSize,
+					getSeconds(downloadInfo.firstByteTime - downloadInfo.startTime),
+					getSeconds(Clock::now() - downloadInfo.firstByteTime));
+		}
+	}
 
 	// cleanup after child
-	if (waitpid(downloadInfo.performerPid, NULL, 0) == -1)
+	if (downloadInfo.performerPid && waitpid(downloadInfo.performerPid, NULL, 0) == -1)
 	{
 		fatal2e(__("waitpid on the performer process failed"));
 	}
@@ -434,13 +497,21 @@ void ManagerImpl::killPerformerBecauseOfWrongSize(MessageQueue& workerQueue,
 				actionName, uri);
 	}
 	ActiveDownloadInfo& downloadInfo = downloadInfoIt->second;
-	// rest in peace, young process
-	if (kill(downloadInfo.performerPid, SIGTERM) == -1)
+	if (!downloadInfo.performerPid)
 	{
-		fatal2e(__("unable to kill the process %u"), downloadInfo.performerPid);
+		// it will report the error by itself
+		p_multiMethod->abort(uri, errorString);
+	}
+	else
+	{
+		// rest in peace, young process
+		if (kill(downloadInfo.performerPid, SIGTERM) == -1)
+		{
+			fatal2e(__("unable to kill the process %u"), downloadInfo.performerPid);
+		}
+		// process it as failed
+		workerQueue.push({ "done", uri, errorString });
 	}
-	// process it as failed
-	workerQueue.push({ "done", uri, errorString });
 
 	const string& path = downloadInfo.targetPath;
 	if (unlink(path.c_str()) == -1)
@@ -460,7 +531,19 @@ void ManagerImpl::processProgressMessage(MessageQueue& workerQueue, const vector
 	const string& actionName = params[1];
 
 	auto downloadSizeIt = sizes.find(uri);
-	if (actionName == "expected-size" && downloadSizeIt != sizes.end())
+	if (actionName == "hash-sums")
+	{
+		if (params.size() != 2 + HashSums::Count)
+		{
+			fatal2i("download manager: wrong parameter count for 'progress' message, 'hash-sums' submessage");
+		}
+		auto downloadInfoIt = activeDownloads.find(uri);
+		if (downloadInfoIt != activeDownloads.end())
+		{
+			downloadInfoIt->second.hashSums.assign(params.begin() + 2, params.end());
+		}
+	}
+	else if (actionName == "expected-size" && downloadSizeIt != sizes.end())
 	{
 		// ok, we knew what size we should get, and the method has reported its variant
 		// now compare them strictly
@@ -495,6 +578,20 @@ void ManagerImpl::processProgressMessage(MessageQueue& workerQueue, const vector
 				return;
 			}
 		}
+		if (actionName == "downloading" && params.size() == 4)
+		{
+			auto downloadInfoIt = activeDownloads.find(uri);
+			auto pieceSize = lexical_cast< size_t >(params[3]);
+			if (downloadInfoIt != activeDownloads.end() && pieceSize)
+			{
+				auto& downloadInfo = downloadInfoIt->second;
+				if (!downloadInfo.receivedSize)
+				{
+					downloadInfo.firstByteTime = Clock::now();
+				}
+				downloadInfo.receivedSize += pieceSize;
+			}
+		}
 		// update progress
 		progress->progress(params);
 	}
@@ -551,11 +648,85 @@ void ManagerImpl::proceedDownload(MessageQueue& workerQueue, const vector< strin
 	}
 
 	// there is a space for new download, start it
-	startNewDownload(uri, params[1], waiterSocket, debugging);
+	startNewDownload(workerQueue, uri, params[1], waiterSocket, debugging);
 }
 
-void ManagerImpl::startNewDownload(const string& uri, const string& targetPath,
-		int waiterSocket, bool debugging)
+bool ManagerImpl::p_startInProcessDownload(MessageQueue& workerQueue,
+		const string& uri, const string& targetPath, bool debugging)
+{
+	MultiMethod* multiMethod;
+	try
+	{
+		multiMethod = methodFactory.getMultiMethodForUri(uri);
+	}
+	catch (Exception&)
+	{
+		return false; // the performer will report the error
+	}
+	if (!multiMethod || (p_multiMethod && multiMethod != p_multiMethod))
+	{
+		return false; // only one of them can be polled
+	}
+	p_multiMethod = multiMethod;
+
+	if (debugging)
+	{
+		debug2("downloading '%s' in the worker process", uri);
+	}
+	// progress messages are processed at once, so that a wrong size stops
+	// the transfer before the next piece of data
+	processProgressMessage(workerQueue, { uri, "start" });
+	auto callback = [this, &workerQueue, uri](const vector< string >& params)
+	{
+		vector< string > message = { uri };
+		message.insert(message.end(), params.begin(), params.end());
+		processProgressMessage(workerQueue, message);
+	};
+	auto finishCallback = [&workerQueue, uri](const string& result)
+	{
+		workerQueue.push({ "done", uri, result });
+	};
+
+	auto sizeIt = sizes.find(uri);
+	auto minSegmentedSize = config->getInteger("cupt::downloader::segmented-downloads::min-size");
+	if (minSegmentedSize && sizeIt != sizes.end() && sizeIt->second >= (size_t)minSegmentedSize * 1024)
+	{
+		activeDownloads[uri].segmented = true;
+		multiMethod->startSegmented(*config, uri, getSegmentMirrors(multiMethod, uri),
+				sizeIt->second, targetPath, callback, finishCallback);
+	}
+	else
+	{
+		multiMethod->start(*config, uri, targetPath, callback, finishCallback);
+	}
+	return true;
+}
+
+vector< Uri > ManagerImpl::getSegmentMirrors(MultiMethod* multiMethod, const string& uri)
+{
+	vector< Uri > result;
+	auto it = mirrorUris.find(uri);
+	if (it == mirrorUris.end())
+	{
+		return result;
+	}
+	for (const string& mirrorUri: it->second)
+	{
+		try
+		{
+			if (methodFactory.getMultiMethodForUri(mirrorUri) == multiMethod)
+			{
+				result.push_back(mirrorUri);
+			}
+		}
+		catch (Exception&)
+		{} // not usable, the performer of the mirror would report it if needed
+	}
+	return result;
+}
+
+void ManagerImpl::startNewDownload(MessageQueue& workerQueue, const string& uri,
+		const string& targetPath, int waiterSocket, bool debugging)
 {
 	if (debugging)
 	{
@@ -564,6 +735,15 @@ void ManagerImpl::startNewDownload(const string& uri, const string& targetPath,
 	ActiveDownloadInfo& downloadInfo = activeDownloads[uri]; // new element
 	downloadInfo.targetPath = targetPath;
 	downloadInfo.waiterSocket = waiterSocket;
+	downloadInfo.startTime = Clock::now();
+	downloadInfo.receivedSize = 0;
+	downloadInfo.segmented = false;
+
+	if (p_inProcessTransfers && p_startInProcessDownload(workerQueue, uri, targetPath, debugging))
+	{
+		downloadInfo.performerPid = 0;
+		return;
+	}
 
 	shared_ptr< Pipe > performerPipe(new Pipe("performer"));
 
@@ -661,16 +841,35 @@ InputMessage ManagerImpl::pollAllInput(MessageQueue& workerQueue,
 
 	do_poll:
 	int waitParam = (exitFlag ? 0 /* immediately */ : -1 /* infinite */);
-	auto pollResult = poll(&pollInput[0], pollInput.size(), waitParam);
-	if (pollResult == -1)
+	if (p_multiMethod)
 	{
-		if (errno == EINTR)
+		// the in-process transfers may push messages to the queue meanwhile
+		auto pollResult = p_multiMethod->poll(&pollInput[0], pollInput.size(), waitParam);
+		if (!pollResult)
 		{
-			goto do_poll;
+			if (!workerQueue.empty())
+			{
+				return pollAllInput(workerQueue, persistentSockets, clientSockets, exitFlag, debugging);
+			}
+			if (!exitFlag)
+			{
+				goto do_poll;
+			}
 		}
-		else
+	}
+	else
+	{
+		auto pollResult = poll(&pollInput[0], pollInput.size(), waitParam);
+		if (pollResult == -1)
 		{
-			fatal2e(__("unable to poll worker loop sockets"));
+			if (errno == EINTR)
+			{
+				goto do_poll;
+			}
+			else
+			{
+				fatal2e(__("unable to poll worker loop sockets"));
+			}
 		}
 	}
 
@@ -825,6 +1024,14 @@ void ManagerImpl::worker()
 			const size_t size = lexical_cast< size_t >(params[1]);
 			setDownloadSize(uri, size);
 		}
+		else if (command == "set-mirror-uris")
+		{
+			if (params.size() < 2) // uri, mirror uris...
+			{
+				fatal2i("download manager: wrong parameter count for 'set-mirror-uris' message");
+			}
+			mirrorUris[params[0]].assign(params.begin() + 1, params.end());
+		}
 		else if (command == "done")
 		{
 			// some query finished, we have preliminary result for it
@@ -871,6 +1078,10 @@ void ManagerImpl::worker()
 			fatal2i("download manager: invalid worker command '%s'", command);
 		}
 	}
+	if (p_mirrorStatistics)
+	{
+		p_mirrorStatistics->save();
+	}
 	// finishing progress
 	progress->progress(vector< string >{ "finish" });
 
@@ -908,20 +1119,37 @@ map< string, InnerDownloadElement > ManagerImpl::convertEntitiesToDownloads(
 		}
 		InnerDownloadElement& element = result[targetPath];
 
-		// sorting uris by protocols' priorities
-		vector< pair< Manager::ExtendedUri, int > > extendedPrioritizedUris;
+		// sorting uris by protocols' priorities, then by the measured speeds of the servers
+		struct PrioritizedUri
+		{
+			Manager::ExtendedUri extendedUri;
+			int priority;
+			double estimatedTime;
+		};
+		vector< PrioritizedUri > extendedPrioritizedUris;
+		bool exploring = p_mirrorStatistics && p_mirrorStatistics->explore();
 		for (const auto& extendedUri: entity.extendedUris)
 		{
-			extendedPrioritizedUris.push_back({extendedUri, getUriPriority(extendedUri.uri)});
+			double estimatedTime = 0;
+			if (p_mirrorStatistics)
+			{
+				estimatedTime = p_mirrorStatistics->estimateTime(extendedUri.uri,
+						entity.size != (size_t)-1 ? entity.size : 0, exploring);
+			}
+			extendedPrioritizedUris.push_back({ extendedUri, getUriPriority(extendedUri.uri), estimatedTime });
 		}
-		std::sort(extendedPrioritizedUris.begin(), extendedPrioritizedUris.end(), [this]
-				(const pair< Manager::ExtendedUri, int >& left, const pair< Manager::ExtendedUri, int >& right)
+		std::stable_sort(extendedPrioritizedUris.begin(), extendedPrioritizedUris.end(),
+				[](const PrioritizedUri& left, const PrioritizedUri& right)
 				{
-					return left.second > right.second;
+					if (left.priority != right.priority)
+					{
+						return left.priority > right.priority;
+					}
+					return left.estimatedTime < right.estimatedTime;
 				});
 		FORIT(it, extendedPrioritizedUris)
 		{
-			element.sortedExtendedUris.push(it->first);
+			element.sortedExtendedUris.push(it->extendedUri);
 		}
 
 		element.data = &entity;
@@ -975,6 +1203,16 @@ string ManagerImpl::download(const vector< DownloadEntity >& entities)
 			sendSocketMessage(sock,
 					vector< string >{ "set-download-size", uri, lexical_cast< string >(downloadElement.data->size) });
 		}
+		if (downloadElement.data->size != (size_t)-1 && !downloadElement.sortedExtendedUris.empty())
+		{
+			// the other URIs may serve the parts of the same file
+			vector< string > message = { "set-mirror-uris", uri };
+			for (auto otherUris = downloadElement.sortedExtendedUris; !otherUris.empty(); otherUris.pop())
+			{
+				message.push_back(otherUris.front().uri);
+			}
+			sendSocketMessage(sock, message);
+		}
 		if (!extendedUri.shortAlias.empty())
 		{
 			sendSocketMessage(sock, vector< string >{ "forward-to-progress", "set-short-alias", uri, extendedUri.shortAlias });
@@ -1002,7 +1240,7 @@ string ManagerImpl::download(const vector< DownloadEntity >& entities)
 	while (!waitedUriToTargetPath.empty())
 	{
 		auto params = receiveSocketMessage(sock);
-		if (params.size() != 3)
+		if (params.size() != 3 && params.size() != 3 + HashSums::Count)
 		{
 			fatal2i("download client: wrong parameter count for download result message");
 		}
@@ -1024,6 +1262,13 @@ string ManagerImpl::download(const vector< DownloadEntity >& entities)
 
 		if (errorString.empty() && !isDuplicatedDownload)
 		{
+			if (params.size() > 3)
+			{
+				// computed while downloading, the post-action needs not read the file for them
+				HashSums hashSums;
+				std::copy(params.begin() + 3, params.end(), hashSums.values);
+				rememberFreshHashSums(targetPath, hashSums);
+			}
 			// download seems to be done well, but we also have post-action specified
 			// but do this only if this file wasn't post-processed before
 			try
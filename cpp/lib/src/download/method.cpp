@@ -27,6 +27,16 @@ namespace download {
 Method::Method()
 {}
 
+MultiMethod::MultiMethod()
+{}
+
+void MultiMethod::startSegmented(const Config& config, const Uri& uri, const vector< Uri >&,
+		size_t, const string& targetPath, const Callback& callback,
+		const FinishCallback& finishCallback)
+{
+	start(config, uri, targetPath, callback, finishCallback);
+}
+
 string Method::getAcquireSuboptionForUri(const Config& config,
 		const Uri& uri, const string& suboptionName)
 {
@@ -18,9 +18,11 @@
 #include <dlfcn.h>
 
 #include <map>
+#include <memory>
 
 #include <cupt/config.hpp>
 #include <cupt/download/uri.hpp>
+#include <cupt/download/method.hpp>
 #include <cupt/download/methodfactory.hpp>
 
 #include <internal/filesystem.hpp>
@@ -34,16 +36,21 @@ using std::multimap;
 class MethodFactoryImpl
 {
 	typedef download::Method* (*MethodBuilder)();
+	typedef download::MultiMethod* (*MultiMethodBuilder)();
 	const Config& __config;
 	map< string, MethodBuilder > __method_builders;
+	map< string, MultiMethodBuilder > p_multiMethodBuilders;
+	mutable map< string, std::unique_ptr< download::MultiMethod > > p_multiMethods;
 	vector< void* > __dl_handles;
 
 	void __load_methods();
 	int __get_method_priority(const string& protocol, const string& methodName) const;
+	string p_selectMethodName(const download::Uri&) const;
  public:
 	MethodFactoryImpl(const Config&);
 	~MethodFactoryImpl();
 	download::Method* getDownloadMethodForUri(const download::Uri& uri) const;
+	download::MultiMethod* getMultiMethodForUri(const download::Uri& uri) const;
 };
 
 
@@ -55,6 +62,7 @@ MethodFactoryImpl::MethodFactoryImpl(const Config& config)
 
 MethodFactoryImpl::~MethodFactoryImpl()
 {
+	p_multiMethods.clear(); // their code is in the libraries
 	FORIT(dlHandleIt, __dl_handles)
 	{
 		if (dlclose(*dlHandleIt))
@@ -125,6 +133,16 @@ void MethodFactoryImpl::__load_methods()
 		}
 		__dl_handles.push_back(dlHandle);
 		__method_builders[methodName] = methodBuilder;
+		// optional one
+		auto multiMethodBuilder = reinterpret_cast< MultiMethodBuilder >(dlsym(dlHandle, "constructMulti"));
+		if (multiMethodBuilder)
+		{
+			p_multiMethodBuilders[methodName] = multiMethodBuilder;
+		}
+		else
+		{
+			dlerror(); // clearing the error
+		}
 		if (debugging)
 		{
 			debug2("loaded the download method '%s'", methodName);
@@ -132,7 +150,7 @@ void MethodFactoryImpl::__load_methods()
 	}
 }
 
-download::Method* MethodFactoryImpl::getDownloadMethodForUri(const download::Uri& uri) const
+string MethodFactoryImpl::p_selectMethodName(const download::Uri& uri) const
 {
 	auto protocol = uri.getProtocol();
 
@@ -171,11 +189,32 @@ download::Method* MethodFactoryImpl::getDownloadMethodForUri(const download::Uri
 			debug2("selected download handler '%s' for the uri '%s'", handlerName, (string)uri);
 		}
 
-		return (methodBuilderIt->second)();
+		return handlerName;
 	}
 
 	fatal2(__("no download handlers available for the protocol '%s'"), protocol);
-	return NULL; // unreachable
+	return string(); // unreachable
+}
+
+download::Method* MethodFactoryImpl::getDownloadMethodForUri(const download::Uri& uri) const
+{
+	return (__method_builders.find(p_selectMethodName(uri))->second)();
+}
+
+download::MultiMethod* MethodFactoryImpl::getMultiMethodForUri(const download::Uri& uri) const
+{
+	auto methodName = p_selectMethodName(uri);
+	auto builderIt = p_multiMethodBuilders.find(methodName);
+	if (builderIt == p_multiMethodBuilders.end())
+	{
+		return NULL;
+	}
+	auto& multiMethod = p_multiMethods[methodName];
+	if (!multiMethod)
+	{
+		multiMethod.reset((builderIt->second)());
+	}
+	return multiMethod.get();
 }
 
 int MethodFactoryImpl::__get_method_priority(const string& protocol, const string& methodName) const
@@ -205,6 +244,11 @@ Method* MethodFactory::getDownloadMethodForUri(const Uri& uri) const
 	return __impl->getDownloadMethodForUri(uri);
 }
 
+MultiMethod* MethodFactory::getMultiMethodForUri(const Uri& uri) const
+{
+	return __impl->getMultiMethodForUri(uri);
+}
+
 }
 }
 
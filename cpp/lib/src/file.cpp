@@ -19,6 +19,8 @@
 #include <cstring>
 
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -133,9 +135,16 @@ struct FileImpl
 	int fd;
 	off_t offset;
 	unique_ptr< StorageBuffer > readBuffer;
+	// the whole file when it's read through a memory mapping
+	const char* mapping;
+	size_t mappingSize;
+	bool randomAccessAdvised;
 
 	FileImpl(const string& path_, const char* mode, string& openError);
 	~FileImpl();
+	void mapFile(string& openError);
+	template < typename ChunkSeekerT >
+	size_t mappedReadUntil(const ChunkSeekerT&, const char**);
 	template < typename ChunkSeekerT >
 	size_t unbufferedReadUntil(const ChunkSeekerT&, const char**);
 	inline size_t getLineImpl(const char**);
@@ -146,7 +155,8 @@ struct FileImpl
 };
 
 FileImpl::FileImpl(const string& path_, const char* mode, string& openError)
-	: handle(NULL), path(path_), isPipe(false), eof(false), offset(0)
+	: handle(NULL), path(path_), isPipe(false), eof(false), offset(0),
+	mapping(nullptr), mappingSize(0), randomAccessAdvised(false)
 {
 	if (mode[0] == 'p')
 	{
@@ -185,12 +195,46 @@ FileImpl::FileImpl(const string& path_, const char* mode, string& openError)
 			}
 		}
 
-		readBuffer.reset(new StorageBuffer(fd, path));
+		if (!isPipe && strchr(mode, 'm'))
+		{
+			mapFile(openError);
+		}
+		if (!mapping)
+		{
+			readBuffer.reset(new StorageBuffer(fd, path));
+		}
 	}
 }
 
+void FileImpl::mapFile(string& openError)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		openError = format2e("unable to get file information");
+		return;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		return; // nothing to map, reading in the usual way
+	}
+
+	auto mapResult = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapResult == MAP_FAILED)
+	{
+		return; // reading in the usual way
+	}
+	mapping = static_cast< const char* >(mapResult);
+	mappingSize = st.st_size;
+	madvise(mapResult, mappingSize, MADV_SEQUENTIAL);
+}
+
 FileImpl::~FileImpl()
 {
+	if (mapping)
+	{
+		munmap(const_cast< char* >(mapping), mappingSize);
+	}
 	if (handle)
 	{
 		if (isPipe)
@@ -224,9 +268,36 @@ void FileImpl::assertFileOpened() const
 	}
 }
 
+template < typename ChunkSeekerT >
+size_t FileImpl::mappedReadUntil(const ChunkSeekerT& seeker, const char** bufferPtr)
+{
+	auto begin = mapping + offset;
+	size_t unscannedLength = mappingSize - offset;
+
+	auto delimiterPtr = seeker(begin, unscannedLength);
+	size_t readCount;
+	if (delimiterPtr)
+	{
+		readCount = delimiterPtr + 1 - begin;
+	}
+	else
+	{
+		readCount = unscannedLength;
+		eof = (readCount == 0);
+	}
+	*bufferPtr = begin;
+	offset += readCount;
+	return readCount;
+}
+
 template < typename ChunkSeekerT >
 size_t FileImpl::unbufferedReadUntil(const ChunkSeekerT& seeker, const char** bufferPtr)
 {
+	if (mapping)
+	{
+		return mappedReadUntil(seeker, bufferPtr);
+	}
+
 	auto& buffer = *readBuffer;
 
 	auto unscannedBegin = buffer.getDataBegin();
@@ -264,6 +335,18 @@ size_t FileImpl::unbufferedReadUntil(const ChunkSeekerT& seeker, const char** bu
 
 void FileImpl::seek(size_t newOffset)
 {
+	if (mapping)
+	{
+		if (!randomAccessAdvised)
+		{
+			// seeking files are read by records, not scanned
+			madvise(const_cast< char* >(mapping), mappingSize, MADV_RANDOM);
+			randomAccessAdvised = true;
+		}
+		offset = min(newOffset, mappingSize);
+		return;
+	}
+
 	if (newOffset > size_t(offset)) // possibly seekable ahead
 	{
 		size_t diff = newOffset - size_t(offset);
@@ -503,5 +586,35 @@ RequiredFile::RequiredFile(const string& path, const char* mode)
 	: File(openRequiredFile(path, mode))
 {}
 
+bool writeFileAtomically(const string& path, const std::function< void (File&) >& writer)
+{
+	string temporaryPath = path + ".XXXXXX";
+	int fd = mkstemp(&temporaryPath[0]);
+	if (fd == -1)
+	{
+		return false; // not writable, not a problem
+	}
+	fchmod(fd, 0644); // mkstemp() creates private files
+	close(fd);
+
+	try
+	{
+		{
+			RequiredFile file(temporaryPath, "w");
+			writer(file);
+		}
+		if (rename(temporaryPath.c_str(), path.c_str()) == -1)
+		{
+			fatal2e(__("unable to rename '%s' to '%s'"), temporaryPath, path);
+		}
+		return true;
+	}
+	catch (Exception&)
+	{
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+}
+
 } // namespace
 
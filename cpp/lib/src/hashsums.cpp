@@ -17,123 +17,178 @@
 **************************************************************************/
 #include <gcrypt.h>
 
+#include <memory>
 #include <mutex>
 
 #include <cupt/hashsums.hpp>
 #include <cupt/file.hpp>
 
+#include <internal/freshhashsums.hpp>
+
 namespace cupt {
 
 namespace {
 
-struct Source
+GCRY_THREAD_OPTION_PTHREAD_IMPL;
+
+bool initGcrypt()
 {
-	enum Type { File, Buffer };
-};
+	gcry_control (GCRYCTL_SET_THREAD_CBS, &gcry_threads_pthread);
+	gcry_check_version(NULL);
+	gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
+	gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+	return true;
+}
+
+std::once_flag gcryptInitFlag;
+
+int getGcryptAlgorithm(size_t hashType)
+{
+	switch (hashType)
+	{
+		case HashSums::MD5: return GCRY_MD_MD5;
+		case HashSums::SHA1: return GCRY_MD_SHA1;
+		case HashSums::SHA256: return GCRY_MD_SHA256;
+		default:
+			fatal2(__("unsupported hash type '%zu'"), hashType);
+			return 0; // unreachable
+	}
+}
+
+const char* hashTypeStrings[HashSums::Count] = { "md5", "sha1", "sha256" };
+
+}
 
-class GcryptHasher
+namespace internal {
+
+// one gcrypt handle digests the data by all enabled algorithms at once
+class HasherImpl
 {
 	gcry_md_hd_t __gcrypt_handle;
-	size_t __digest_size;
+	bool __enabled[HashSums::Count];
  public:
-	GcryptHasher(int gcryptAlgorithm)
+	HasherImpl(const HashSums* pattern) // NULL means all types
 	{
+		std::call_once(gcryptInitFlag, initGcrypt);
+
 		gcry_error_t gcryptError;
-		if ((gcryptError = gcry_md_open(&__gcrypt_handle, gcryptAlgorithm, 0)))
+		if ((gcryptError = gcry_md_open(&__gcrypt_handle, 0, 0)))
 		{
 			fatal2(__("unable to open a gcrypt hash handle: %s"), gcry_strerror(gcryptError));
 		}
-		__digest_size = gcry_md_get_algo_dlen(gcryptAlgorithm);
+		for (size_t type = 0; type < HashSums::Count; ++type)
+		{
+			__enabled[type] = !pattern || !pattern->values[type].empty();
+			if (__enabled[type] && (gcryptError = gcry_md_enable(__gcrypt_handle, getGcryptAlgorithm(type))))
+			{
+				gcry_md_close(__gcrypt_handle);
+				fatal2(__("unable to open a gcrypt hash handle: %s"), gcry_strerror(gcryptError));
+			}
+		}
 	}
 	void process(const char* buffer, size_t size)
 	{
 		gcry_md_write(__gcrypt_handle, buffer, size);
 	}
-	string getResult() const
+	void reset()
 	{
-		auto binaryResult = gcry_md_read(__gcrypt_handle, 0);
-		string result;
-
-		result.reserve(__digest_size * 2);
-		// converting to hexadecimal string
-		for (size_t i = 0; i < __digest_size; ++i)
+		gcry_md_reset(__gcrypt_handle);
+	}
+	HashSums getResult() const
+	{
+		HashSums result;
+		for (size_t type = 0; type < HashSums::Count; ++type)
 		{
-			static const char fourBitToHex[] = "0123456789abcdef";
-			unsigned int c = binaryResult[i];
-			result += fourBitToHex[c >> 4]; // high halfbit
-			result += fourBitToHex[c & 0xf]; // low halfbit
+			if (!__enabled[type])
+			{
+				continue;
+			}
+			auto gcryptAlgorithm = getGcryptAlgorithm(type);
+			auto binaryResult = gcry_md_read(__gcrypt_handle, gcryptAlgorithm);
+			auto digestSize = gcry_md_get_algo_dlen(gcryptAlgorithm);
+
+			string& value = result.values[type];
+			value.reserve(digestSize * 2);
+			// converting to hexadecimal string
+			for (size_t i = 0; i < digestSize; ++i)
+			{
+				static const char fourBitToHex[] = "0123456789abcdef";
+				unsigned int c = binaryResult[i];
+				value += fourBitToHex[c >> 4]; // high halfbit
+				value += fourBitToHex[c & 0xf]; // low halfbit
+			}
 		}
-
 		return result;
 	}
-	~GcryptHasher()
+	~HasherImpl()
 	{
 		gcry_md_close(__gcrypt_handle);
 	}
 };
 
-namespace {
+}
 
-GCRY_THREAD_OPTION_PTHREAD_IMPL;
+Hasher::Hasher()
+	: __impl(new internal::HasherImpl(NULL))
+{}
 
-bool initGcrypt()
+Hasher::Hasher(const HashSums& pattern)
+	: __impl(new internal::HasherImpl(&pattern))
+{}
+
+Hasher::~Hasher()
 {
-	gcry_control (GCRYCTL_SET_THREAD_CBS, &gcry_threads_pthread);
-	gcry_check_version(NULL);
-	gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
-	gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
-	return true;
+	delete __impl;
 }
 
-std::once_flag gcryptInitFlag;
-
+void Hasher::process(const char* data, size_t size)
+{
+	__impl->process(data, size);
 }
 
-string __get_hash(HashSums::Type hashType, Source::Type sourceType, const string& source)
+void Hasher::processFile(const string& path)
 {
-	std::call_once(gcryptInitFlag, initGcrypt);
-
-	int gcryptAlgorithm;
-	switch (hashType)
+	RequiredFile file(path, "r");
+	while (auto rawBuffer = file.getBlock(65536))
 	{
-		case HashSums::MD5: gcryptAlgorithm = GCRY_MD_MD5; break;
-		case HashSums::SHA1: gcryptAlgorithm = GCRY_MD_SHA1; break;
-		case HashSums::SHA256: gcryptAlgorithm = GCRY_MD_SHA256; break;
-		default:
-			gcryptAlgorithm = 0; // to not see 'maybe used uninitialized' warning
-			fatal2(__("unsupported hash type '%zu'"), size_t(hashType));
+		__impl->process(rawBuffer.data, rawBuffer.size);
 	}
+}
+
+void Hasher::reset()
+{
+	__impl->reset();
+}
 
-	string result;
+HashSums Hasher::getResult() const
+{
+	return __impl->getResult();
+}
+
+namespace {
+
+HashSums getHashSumsOfFile(const HashSums* pattern, const string& path)
+{
 	try
 	{
-		GcryptHasher gcryptHasher(gcryptAlgorithm);
-
-		if (sourceType == Source::File)
+		std::unique_ptr< Hasher > hasher(pattern ? new Hasher(*pattern) : new Hasher);
+		hasher->processFile(path);
+		return hasher->getResult();
+	}
+	catch (Exception&)
+	{
+		vector< string > typeStrings;
+		for (size_t type = 0; type < HashSums::Count; ++type)
 		{
-			RequiredFile file(source, "r");
-
-			while (auto rawBuffer = file.getBlock(8192))
+			if (!pattern || !pattern->values[type].empty())
 			{
-				gcryptHasher.process(rawBuffer.data, rawBuffer.size);
+				typeStrings.push_back(hashTypeStrings[type]);
 			}
 		}
-		else // string
-		{
-			gcryptHasher.process(source.c_str(), source.size());
-		}
-
-		result = gcryptHasher.getResult();
-	}
-	catch (Exception& e)
-	{
-		static string strings[HashSums::Count] = { "md5", "sha1", "sha256" };
-		string description = string(sourceType == Source::File ? "file" : "string") +
-				" '" + source + "'";
-		fatal2(__("unable to compute hash sums '%s' on '%s'"), strings[hashType], description);
+		fatal2(__("unable to compute hash sums '%s' on '%s'"), join(",", typeStrings),
+				string("file '") + path + "'");
+		return HashSums(); // unreachable
 	}
-
-	return result;
 }
 
 void __assert_not_empty(const HashSums* hashSums)
@@ -172,21 +227,24 @@ bool HashSums::verify(const string& path) const
 {
 	__assert_not_empty(this);
 
-	size_t sumsCount = 0;
-
+	// a freshly downloaded file may have its hash sums computed already
+	HashSums fileHashSums;
+	bool haveAllTypes = internal::recallFreshHashSums(path, fileHashSums);
 	for (size_t type = 0; type < Count; ++type)
 	{
-		if (values[type].empty())
+		if (!values[type].empty() && fileHashSums.values[type].empty())
 		{
-			// skip
-			continue;
+			haveAllTypes = false;
 		}
+	}
+	if (!haveAllTypes)
+	{
+		fileHashSums = getHashSumsOfFile(this, path);
+	}
 
-		++sumsCount;
-
-		string fileHashSum = __get_hash(static_cast<Type>(type), Source::File, path);
-
-		if (fileHashSum != values[type])
+	for (size_t type = 0; type < Count; ++type)
+	{
+		if (!values[type].empty() && fileHashSums.values[type] != values[type])
 		{
 			// wrong hash sum
 			return false;
@@ -198,10 +256,7 @@ bool HashSums::verify(const string& path) const
 
 void HashSums::fill(const string& path)
 {
-	for (size_t type = 0; type < Count; ++type)
-	{
-		values[type]= __get_hash(static_cast<Type>(type), Source::File, path);
-	}
+	*this = getHashSumsOfFile(NULL, path);
 }
 
 bool HashSums::match(const HashSums& other) const
@@ -230,8 +285,20 @@ bool HashSums::match(const HashSums& other) const
 
 string HashSums::getHashOfString(const Type& type, const string& pattern)
 {
-	return __get_hash(type, Source::Buffer, pattern);
+	HashSums typePattern;
+	typePattern[type] = "-"; // only the presence matters
+	try
+	{
+		Hasher hasher(typePattern);
+		hasher.process(pattern.c_str(), pattern.size());
+		return hasher.getResult()[type];
+	}
+	catch (Exception&)
+	{
+		fatal2(__("unable to compute hash sums '%s' on '%s'"), hashTypeStrings[type],
+				string("string '") + pattern + "'");
+		return string(); // unreachable
+	}
 }
 
 }
-
@@ -0,0 +1,104 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <cstddef>
+
+#include <internal/arena.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+const size_t alignment = alignof(std::max_align_t);
+const size_t blockSize = 64 * 1024;
+
+__thread Arena* currentArena = nullptr;
+
+}
+
+Arena::Arena()
+	: p_current(nullptr), p_left(0), p_statistics{ 0, 0, 0, 0, 0 }
+{}
+
+Arena::~Arena()
+{
+	for (char* block: p_blocks)
+	{
+		::operator delete(block);
+	}
+}
+
+void* Arena::allocate(size_t size)
+{
+	size = (size + alignment - 1) & ~(alignment - 1);
+	++p_statistics.allocationCount;
+	p_statistics.allocatedBytes += size;
+
+	if (size > p_left)
+	{
+		if (size > blockSize / 4)
+		{
+			// a dedicated block, keeping the current one for small objects
+			auto block = static_cast< char* >(::operator new(size));
+			p_blocks.push_back(block);
+			++p_statistics.blockCount;
+			p_statistics.reservedBytes += size;
+			return block;
+		}
+		p_current = static_cast< char* >(::operator new(blockSize));
+		p_left = blockSize;
+		p_blocks.push_back(p_current);
+		++p_statistics.blockCount;
+		p_statistics.reservedBytes += blockSize;
+	}
+
+	auto result = p_current;
+	p_current += size;
+	p_left -= size;
+	return result;
+}
+
+void Arena::release()
+{
+	++p_statistics.releaseCount;
+}
+
+const Arena::Statistics& Arena::getStatistics() const
+{
+	return p_statistics;
+}
+
+Arena* Arena::getCurrent()
+{
+	return currentArena;
+}
+
+Arena::Scope::Scope(Arena* arena)
+	: p_previous(currentArena)
+{
+	currentArena = arena;
+}
+
+Arena::Scope::~Scope()
+{
+	currentArena = p_previous;
+}
+
+}
+}
+
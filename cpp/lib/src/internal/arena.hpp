@@ -0,0 +1,69 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_ARENA_SEEN
+#define CUPT_INTERNAL_ARENA_SEEN
+
+#include <cupt/common.hpp>
+
+namespace cupt {
+namespace internal {
+
+// bump allocator which gives the memory back only all at once, on destruction;
+// not thread-safe, as the cache which owns it
+class Arena
+{
+	vector< char* > p_blocks;
+	char* p_current;
+	size_t p_left;
+ public:
+	struct Statistics
+	{
+		size_t allocationCount;
+		size_t allocatedBytes;
+		size_t releaseCount; // objects destroyed before the arena
+		size_t blockCount;
+		size_t reservedBytes;
+	};
+
+	Arena();
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t);
+	void release(); // only counted, the memory is reclaimed with the arena
+	const Statistics& getStatistics() const;
+
+	// arena used for allocations of the current thread, if any
+	static Arena* getCurrent();
+	class Scope
+	{
+		Arena* p_previous;
+	 public:
+		explicit Scope(Arena*);
+		~Scope();
+	};
+ private:
+	Statistics p_statistics;
+};
+
+}
+}
+
+#endif
+
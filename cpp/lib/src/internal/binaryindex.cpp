@@ -0,0 +1,725 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cupt/file.hpp>
+#include <cupt/cache/releaseinfo.hpp>
+
+#include <internal/common.hpp>
+#include <internal/filesystem.hpp>
+#include <internal/indexofindex.hpp>
+#include <internal/parse.hpp>
+
+#include <internal/binaryindex.hpp>
+
+namespace cupt {
+namespace internal {
+namespace binaryindex {
+
+using std::unordered_map;
+
+namespace {
+
+const char magic[8] = { 'c', 'u', 'p', 't', 'b', 'i', 'x', '\0' };
+const uint32_t formatVersion = 3;
+
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t packageCount;
+	uint32_t packagesOffset; // entries, sorted by package name
+	uint32_t recordOffsetsOffset; // uint32_t record offsets in the list
+	uint32_t recordOffsetCount;
+	uint32_t providesCount;
+	uint32_t providesOffset; // entries, sorted by virtual package name
+	uint32_t providerIdsOffset; // uint32_t package ids
+	uint32_t providerIdCount;
+	uint32_t releaseOffset;
+	uint32_t releaseSize;
+	uint32_t totalSize;
+};
+
+// both package and provides entries are: name offset, name size, offset of
+// the first item in the corresponding item array, item count
+const size_t entrySize = 4;
+
+time_t getFileModifyTime(const string& path)
+{
+	struct stat st;
+	auto error = stat(path.c_str(), &st);
+	if (error) return 0;
+	return st.st_mtime;
+}
+
+int compareNames(const Name& left, const string& right)
+{
+	auto result = memcmp(left.data, right.data(), std::min< size_t >(left.size, right.size()));
+	if (result) return result;
+	return (left.size < right.size()) ? -1 : (left.size > right.size());
+}
+
+const char* mapFile(const string& path, size_t size)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return nullptr;
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return (mapping == MAP_FAILED) ? nullptr : static_cast< const char* >(mapping);
+}
+
+const Header* getHeader(const char* data)
+{
+	return reinterpret_cast< const Header* >(data);
+}
+
+// checked once at opening, so that readers can follow all offsets and
+// sizes without bound checks
+bool isSane(const char* data, size_t size)
+{
+	if (size < sizeof(Header)) return false;
+
+	auto header = getHeader(data);
+	if (memcmp(header->magic, magic, sizeof(magic)) || header->version != formatVersion)
+	{
+		return false;
+	}
+	if (header->totalSize != size) return false;
+
+	auto fits = [size](uint64_t offset, uint64_t length)
+	{
+		return offset % sizeof(uint32_t) == 0 && offset + length <= size;
+	};
+	auto getUint32s = [data](uint32_t offset)
+	{
+		return reinterpret_cast< const uint32_t* >(data + offset);
+	};
+	auto areEntriesSane = [&fits, &getUint32s, size](uint32_t entriesOffset, uint32_t count, uint32_t itemCount)
+	{
+		if (!fits(entriesOffset, uint64_t(count) * entrySize * sizeof(uint32_t))) return false;
+		auto entries = getUint32s(entriesOffset);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto entry = entries + i * entrySize;
+			if (uint64_t(entry[0]) + entry[1] > size || uint64_t(entry[2]) + entry[3] > itemCount)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	if (!areEntriesSane(header->packagesOffset, header->packageCount, header->recordOffsetCount) ||
+			!areEntriesSane(header->providesOffset, header->providesCount, header->providerIdCount) ||
+			!fits(header->recordOffsetsOffset, uint64_t(header->recordOffsetCount) * sizeof(uint32_t)) ||
+			!fits(header->providerIdsOffset, uint64_t(header->providerIdCount) * sizeof(uint32_t)) ||
+			header->releaseOffset + uint64_t(header->releaseSize) > size)
+	{
+		return false;
+	}
+	// provider ids are used as package ids
+	auto providerIds = getUint32s(header->providerIdsOffset);
+	return std::all_of(providerIds, providerIds + header->providerIdCount,
+			[header](uint32_t id) { return id < header->packageCount; });
+}
+
+}
+
+Reader::Reader()
+	: p_data(NULL), p_size(0)
+{}
+
+Reader::~Reader()
+{
+	if (p_data)
+	{
+		munmap(const_cast< char* >(p_data), p_size);
+	}
+}
+
+bool Reader::open(const string& indexPath, const string& releasePath)
+{
+	auto path = getPath(indexPath);
+
+	struct stat st;
+	if (stat(path.c_str(), &st) == -1) return false;
+	auto indexModifyTime = getFileModifyTime(indexPath);
+	if (!indexModifyTime || st.st_mtime < indexModifyTime) return false;
+	if (!releasePath.empty() && st.st_mtime < getFileModifyTime(releasePath)) return false;
+
+	size_t size = st.st_size;
+	auto mapping = (size >= sizeof(Header)) ? mapFile(path, size) : nullptr;
+	if (!mapping) return false;
+
+	if (!isSane(mapping, size))
+	{
+		munmap(const_cast< char* >(mapping), size);
+		return false;
+	}
+
+	p_data = mapping;
+	p_size = size;
+	return true;
+}
+
+Name Reader::p_getName(const uint32_t* entry) const
+{
+	return Name { p_at(entry[0]), entry[1] };
+}
+
+const uint32_t* Reader::p_find(uint32_t entriesOffset, uint32_t count, const string& name) const
+{
+	auto entries = reinterpret_cast< const uint32_t* >(p_at(entriesOffset));
+
+	uint32_t left = 0;
+	uint32_t right = count;
+	while (left < right)
+	{
+		auto middle = left + (right - left) / 2;
+		auto entry = entries + middle * entrySize;
+		auto comparisonResult = compareNames(p_getName(entry), name);
+		if (comparisonResult == 0)
+		{
+			return entry;
+		}
+		else if (comparisonResult < 0)
+		{
+			left = middle + 1;
+		}
+		else
+		{
+			right = middle;
+		}
+	}
+	return nullptr;
+}
+
+uint32_t Reader::getPackageCount() const
+{
+	return getHeader(p_data)->packageCount;
+}
+
+Name Reader::getPackageName(uint32_t packageId) const
+{
+	auto entries = reinterpret_cast< const uint32_t* >(p_at(getHeader(p_data)->packagesOffset));
+	return p_getName(entries + packageId * entrySize);
+}
+
+bool Reader::getOffsets(const string& packageName, const uint32_t** begin, const uint32_t** end) const
+{
+	auto header = getHeader(p_data);
+	auto entry = p_find(header->packagesOffset, header->packageCount, packageName);
+	if (!entry) return false;
+
+	*begin = reinterpret_cast< const uint32_t* >(p_at(header->recordOffsetsOffset)) + entry[2];
+	*end = *begin + entry[3];
+	return true;
+}
+
+bool Reader::getProviders(const string& virtualPackageName, const uint32_t** begin, const uint32_t** end) const
+{
+	auto header = getHeader(p_data);
+	auto entry = p_find(header->providesOffset, header->providesCount, virtualPackageName);
+	if (!entry) return false;
+
+	*begin = reinterpret_cast< const uint32_t* >(p_at(header->providerIdsOffset)) + entry[2];
+	*end = *begin + entry[3];
+	return true;
+}
+
+namespace {
+
+void putUint32(string* output, uint32_t value)
+{
+	output->append(reinterpret_cast< const char* >(&value), sizeof(value));
+}
+
+void putString(string* output, const string& value)
+{
+	putUint32(output, value.size());
+	output->append(value);
+}
+
+void alignOutput(string* output)
+{
+	output->resize((output->size() + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t));
+}
+
+string serializeReleaseInfo(const cache::ReleaseInfo& releaseInfo, const string& keyringStamp)
+{
+	string result;
+	result += char(releaseInfo.verified);
+	result += char(releaseInfo.notAutomatic);
+	result += char(releaseInfo.butAutomaticUpgrades);
+	putString(&result, releaseInfo.version);
+	putString(&result, releaseInfo.description);
+	putString(&result, releaseInfo.vendor);
+	putString(&result, releaseInfo.label);
+	putString(&result, releaseInfo.archive);
+	putString(&result, releaseInfo.codename);
+	putString(&result, releaseInfo.date);
+	putString(&result, releaseInfo.validUntilDate);
+	putString(&result, join(" ", releaseInfo.architectures));
+	putString(&result, keyringStamp);
+	return result;
+}
+
+}
+
+void Reader::p_readReleaseInfo(cache::ReleaseInfo* releaseInfo, string* keyringStamp) const
+{
+	auto header = getHeader(p_data);
+	auto current = p_at(header->releaseOffset);
+	auto end = current + header->releaseSize;
+
+	auto getFlag = [&current, &end]() -> bool
+	{
+		if (current == end)
+		{
+			fatal2i("binary index: release info: unexpected end of data");
+		}
+		return *(current++);
+	};
+	auto getString = [&current, &end]() -> string
+	{
+		uint32_t size;
+		if (size_t(end - current) < sizeof(size))
+		{
+			fatal2i("binary index: release info: unexpected end of data");
+		}
+		memcpy(&size, current, sizeof(size));
+		current += sizeof(size);
+		if (size_t(end - current) < size)
+		{
+			fatal2i("binary index: release info: unexpected end of data");
+		}
+		string result(current, size);
+		current += size;
+		return result;
+	};
+
+	releaseInfo->verified = getFlag();
+	releaseInfo->notAutomatic = getFlag();
+	releaseInfo->butAutomaticUpgrades = getFlag();
+	releaseInfo->version = getString();
+	releaseInfo->description = getString();
+	releaseInfo->vendor = getString();
+	releaseInfo->label = getString();
+	releaseInfo->archive = getString();
+	releaseInfo->codename = getString();
+	releaseInfo->date = getString();
+	releaseInfo->validUntilDate = getString();
+	releaseInfo->architectures = split(' ', getString());
+	*keyringStamp = getString();
+}
+
+void Reader::fillReleaseInfo(cache::ReleaseInfo* releaseInfo) const
+{
+	string keyringStamp;
+	p_readReleaseInfo(releaseInfo, &keyringStamp);
+}
+
+string Reader::getKeyringStamp() const
+{
+	cache::ReleaseInfo releaseInfo;
+	string result;
+	p_readReleaseInfo(&releaseInfo, &result);
+	return result;
+}
+
+string getPath(const string& indexPath)
+{
+	return indexPath + ".cache" "0";
+}
+
+void remove(const string& indexPath)
+{
+	auto path = getPath(indexPath);
+	if (fs::fileExists(path))
+	{
+		if (unlink(path.c_str()) == -1)
+		{
+			fatal2e("unable to remove the file '%s'", path);
+		}
+	}
+}
+
+namespace {
+
+struct Item
+{
+	string name;
+	vector< uint32_t > values;
+};
+
+// sorts items by name and returns the map from old positions to new ones
+vector< uint32_t > sortItems(vector< Item >& items)
+{
+	vector< uint32_t > order(items.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&items](uint32_t left, uint32_t right)
+	{
+		return items[left].name < items[right].name;
+	});
+
+	vector< Item > sortedItems(items.size());
+	vector< uint32_t > newPositions(items.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		sortedItems[i] = std::move(items[order[i]]);
+		newPositions[order[i]] = i;
+	}
+	items.swap(sortedItems);
+
+	return newPositions;
+}
+
+}
+
+void generate(const string& indexPath, const string& temporaryPath,
+		const cache::ReleaseInfo& releaseInfo, const string& keyringStamp)
+{
+	vector< Item > packages;
+	vector< Item > provides;
+	{ // gathering
+		unordered_map< string, uint32_t > packageIds;
+		unordered_map< string, uint32_t > providesIds;
+
+		string packageName;
+		uint32_t offset;
+		uint32_t packageId = 0;
+		bool packageIsValid = false;
+
+		ioi::Record record = { &offset, &packageName };
+		ioi::ps::Callbacks callbacks;
+		callbacks.main = [&]()
+		{
+			packageIsValid = checkPackageName(packageName, false);
+			if (!packageIsValid)
+			{
+				warn2(__("discarding this package version from the index '%s'"), indexPath);
+				return;
+			}
+			auto insertResult = packageIds.insert({ packageName, packages.size() });
+			if (insertResult.second)
+			{
+				packages.push_back(Item { packageName, {} });
+			}
+			packageId = insertResult.first->second;
+			packages[packageId].values.push_back(offset);
+		};
+		callbacks.provides = [&](const char* begin, const char* end)
+		{
+			if (!packageIsValid) return;
+
+			auto callback = [&](const char* tokenBegin, const char* tokenEnd)
+			{
+				auto insertResult = providesIds.insert({ string(tokenBegin, tokenEnd), provides.size() });
+				if (insertResult.second)
+				{
+					provides.push_back(Item { insertResult.first->first, {} });
+				}
+				auto& providers = provides[insertResult.first->second].values;
+				if (std::find(providers.begin(), providers.end(), packageId) == providers.end())
+				{
+					providers.push_back(packageId);
+				}
+			};
+			parse::processSpaceCharSpaceDelimitedStrings(begin, end, ',', callback);
+		};
+
+		ioi::ps::processIndex(indexPath, callbacks, record);
+	}
+
+	auto newPackageIds = sortItems(packages);
+	sortItems(provides);
+	for (auto& item: provides)
+	{
+		for (auto& providerId: item.values)
+		{
+			providerId = newPackageIds[providerId];
+		}
+	}
+
+	Header header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = formatVersion;
+
+	string output(sizeof(header), '\0');
+	string strings;
+	auto putEntriesAndItems = [&output, &strings](const vector< Item >& items,
+			uint32_t* entriesOffset, uint32_t* itemsOffset, uint32_t* itemCountPtr)
+	{
+		*entriesOffset = output.size();
+		uint32_t itemCount = 0;
+		for (const auto& item: items)
+		{
+			putUint32(&output, strings.size()); // will be shifted later
+			putUint32(&output, item.name.size());
+			putUint32(&output, itemCount);
+			putUint32(&output, item.values.size());
+			strings += item.name;
+			itemCount += item.values.size();
+		}
+		*itemsOffset = output.size();
+		for (const auto& item: items)
+		{
+			for (auto value: item.values)
+			{
+				putUint32(&output, value);
+			}
+		}
+		*itemCountPtr = itemCount;
+	};
+	header.packageCount = packages.size();
+	putEntriesAndItems(packages, &header.packagesOffset, &header.recordOffsetsOffset, &header.recordOffsetCount);
+	header.providesCount = provides.size();
+	putEntriesAndItems(provides, &header.providesOffset, &header.providerIdsOffset, &header.providerIdCount);
+
+	{ // strings go after all fixed-size data, shifting name offsets
+		uint32_t stringsOffset = output.size();
+		auto shiftNameOffsets = [&output, stringsOffset](uint32_t entriesOffset, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				auto nameOffsetPtr = reinterpret_cast< uint32_t* >(
+						&output[entriesOffset + i * entrySize * sizeof(uint32_t)]);
+				*nameOffsetPtr += stringsOffset;
+			}
+		};
+		shiftNameOffsets(header.packagesOffset, header.packageCount);
+		shiftNameOffsets(header.providesOffset, header.providesCount);
+		output += strings;
+	}
+
+	alignOutput(&output);
+	header.releaseOffset = output.size();
+	output += serializeReleaseInfo(releaseInfo, keyringStamp);
+	header.releaseSize = output.size() - header.releaseOffset;
+
+	header.totalSize = output.size();
+	memcpy(&output[0], &header, sizeof(header));
+
+	{
+		RequiredFile file(temporaryPath, "w");
+		file.put(output);
+	}
+	if (!fs::move(temporaryPath, getPath(indexPath)))
+	{
+		fatal2e(__("unable to rename '%s' to '%s'"), temporaryPath, getPath(indexPath));
+	}
+}
+
+namespace {
+
+const char translationMagic[8] = { 'c', 'u', 'p', 't', 'b', 't', 'x', '\0' };
+
+struct TranslationHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t capacity; // a power of two
+	uint32_t slotsOffset;
+	uint32_t totalSize;
+};
+
+typedef TranslationTable::Slot Slot;
+const uint32_t emptySlotOffset = -1;
+
+uint32_t getSlotPosition(const DescriptionDigest& digest, uint32_t mask)
+{
+	uint32_t hash; // digests are uniformly distributed already
+	memcpy(&hash, digest.bytes, sizeof(hash));
+	return hash & mask;
+}
+
+// the first record with a given digest wins
+vector< Slot > buildSlots(const string& translationPath)
+{
+	vector< Slot > records;
+	{
+		string md5;
+		uint32_t offset;
+		ioi::Record ioiRecord = { &offset, &md5 };
+		ioi::tr::Callbacks callbacks;
+		callbacks.main = [&records, &md5, &offset]()
+		{
+			Slot slot;
+			if (parseDescriptionDigest(md5, &slot.digest))
+			{
+				slot.offset = offset;
+				records.push_back(slot);
+			}
+		};
+		ioi::tr::processIndex(translationPath, callbacks, ioiRecord);
+	}
+
+	uint32_t capacity = 16;
+	while (capacity < records.size() * 2)
+	{
+		capacity *= 2;
+	}
+	Slot emptySlot;
+	memset(&emptySlot, 0, sizeof(emptySlot));
+	emptySlot.offset = emptySlotOffset;
+	vector< Slot > slots(capacity, emptySlot);
+
+	auto mask = capacity - 1;
+	for (const auto& record: records)
+	{
+		auto position = getSlotPosition(record.digest, mask);
+		while (slots[position].offset != emptySlotOffset &&
+				memcmp(&slots[position].digest, &record.digest, sizeof(record.digest)))
+		{
+			position = (position + 1) & mask;
+		}
+		if (slots[position].offset == emptySlotOffset)
+		{
+			slots[position] = record;
+		}
+	}
+	return slots;
+}
+
+}
+
+bool parseDescriptionDigest(const string& hexString, DescriptionDigest* digest)
+{
+	if (hexString.size() != sizeof(digest->bytes) * 2) return false;
+
+	auto getNibble = [](char c) -> int
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	};
+	for (size_t i = 0; i < sizeof(digest->bytes); ++i)
+	{
+		auto high = getNibble(hexString[i*2]);
+		auto low = getNibble(hexString[i*2+1]);
+		if (high < 0 || low < 0) return false;
+		digest->bytes[i] = (high << 4) | low;
+	}
+	return true;
+}
+
+TranslationTable::TranslationTable()
+	: p_data(NULL), p_size(0), p_slots(NULL), p_mask(0)
+{}
+
+TranslationTable::~TranslationTable()
+{
+	if (p_data)
+	{
+		munmap(const_cast< char* >(p_data), p_size);
+	}
+}
+
+bool TranslationTable::open(const string& translationPath)
+{
+	auto path = getPath(translationPath);
+
+	struct stat st;
+	if (stat(path.c_str(), &st) == -1) return false;
+	auto translationModifyTime = getFileModifyTime(translationPath);
+	if (!translationModifyTime || st.st_mtime < translationModifyTime) return false;
+
+	size_t size = st.st_size;
+	auto mapping = (size >= sizeof(TranslationHeader)) ? mapFile(path, size) : nullptr;
+	if (!mapping) return false;
+
+	auto header = reinterpret_cast< const TranslationHeader* >(mapping);
+	bool isSane = !memcmp(header->magic, translationMagic, sizeof(translationMagic)) &&
+			header->version == formatVersion && header->totalSize == size &&
+			header->capacity && !(header->capacity & (header->capacity - 1)) &&
+			header->slotsOffset % sizeof(uint32_t) == 0 &&
+			header->slotsOffset + uint64_t(header->capacity) * sizeof(Slot) <= size;
+	if (!isSane)
+	{
+		munmap(const_cast< char* >(mapping), size);
+		return false;
+	}
+
+	p_data = mapping;
+	p_size = size;
+	p_slots = reinterpret_cast< const Slot* >(mapping + header->slotsOffset);
+	p_mask = header->capacity - 1;
+	return true;
+}
+
+void TranslationTable::build(const string& translationPath)
+{
+	p_ownSlots = buildSlots(translationPath);
+	p_slots = p_ownSlots.data();
+	p_mask = p_ownSlots.size() - 1;
+}
+
+bool TranslationTable::find(const DescriptionDigest& digest, uint32_t* offset) const
+{
+	if (!p_slots) return false;
+
+	auto position = getSlotPosition(digest, p_mask);
+	while (p_slots[position].offset != emptySlotOffset)
+	{
+		if (!memcmp(&p_slots[position].digest, &digest, sizeof(digest)))
+		{
+			*offset = p_slots[position].offset;
+			return true;
+		}
+		position = (position + 1) & p_mask;
+	}
+	return false;
+}
+
+void generateForTranslation(const string& translationPath, const string& temporaryPath)
+{
+	auto slots = buildSlots(translationPath);
+
+	TranslationHeader header;
+	memcpy(header.magic, translationMagic, sizeof(translationMagic));
+	header.version = formatVersion;
+	header.capacity = slots.size();
+	header.slotsOffset = sizeof(header);
+	header.totalSize = sizeof(header) + slots.size() * sizeof(Slot);
+
+	{
+		RequiredFile file(temporaryPath, "w");
+		file.put(reinterpret_cast< const char* >(&header), sizeof(header));
+		file.put(reinterpret_cast< const char* >(slots.data()), slots.size() * sizeof(Slot));
+	}
+	if (!fs::move(temporaryPath, getPath(translationPath)))
+	{
+		fatal2e(__("unable to rename '%s' to '%s'"), temporaryPath, getPath(translationPath));
+	}
+}
+
+}
+}
+}
+
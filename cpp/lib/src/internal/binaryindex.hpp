@@ -0,0 +1,121 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_BINARYINDEX_SEEN
+#define CUPT_INTERNAL_BINARYINDEX_SEEN
+
+#include <cupt/common.hpp>
+#include <cupt/fwd.hpp>
+
+namespace cupt {
+namespace internal {
+namespace binaryindex {
+
+// a memory-mappable digest of one Packages/Sources list: the name-sorted
+// table of packages with their record offsets, the reverse provides table
+// and the release information of the list; used instead of reading the list
+// or its index of index when it's not older than both of them
+
+struct Name
+{
+	const char* data;
+	uint32_t size;
+
+	string toString() const { return string(data, size); }
+};
+
+class Reader
+{
+	const char* p_data;
+	size_t p_size;
+
+	const char* p_at(uint32_t offset) const { return p_data + offset; }
+	Name p_getName(const uint32_t* entry) const;
+	const uint32_t* p_find(uint32_t entriesOffset, uint32_t count, const string&) const;
+	void p_readReleaseInfo(cache::ReleaseInfo*, string* keyringStamp) const;
+
+	Reader(const Reader&);
+	Reader& operator=(const Reader&);
+ public:
+	Reader();
+	~Reader();
+
+	// false if there is no usable binary index for the list at 'indexPath'
+	bool open(const string& indexPath, const string& releasePath);
+
+	uint32_t getPackageCount() const;
+	Name getPackageName(uint32_t packageId) const;
+	// returns false if the package is not present
+	bool getOffsets(const string& packageName, const uint32_t** begin, const uint32_t** end) const;
+	// ids of packages which provide the virtual package
+	bool getProviders(const string& virtualPackageName, const uint32_t** begin, const uint32_t** end) const;
+
+	void fillReleaseInfo(cache::ReleaseInfo*) const;
+	// the keyring the 'verified' flag of the release info was computed with,
+	// see cachefiles::getKeyringStamp
+	string getKeyringStamp() const;
+};
+
+// the binary MD5 digest of a full description, which keys translations
+struct DescriptionDigest
+{
+	unsigned char bytes[16];
+};
+bool parseDescriptionDigest(const string& hexString, DescriptionDigest*);
+
+// an open-addressing table from description digests to record offsets in a
+// Translation file; either mapped from the binary index of the file or, when
+// there is no usable one, built in memory
+class TranslationTable
+{
+ public:
+	struct Slot
+	{
+		DescriptionDigest digest;
+		uint32_t offset;
+	};
+ private:
+	const char* p_data;
+	size_t p_size;
+	vector< Slot > p_ownSlots;
+	const Slot* p_slots;
+	uint32_t p_mask;
+
+	TranslationTable(const TranslationTable&);
+	TranslationTable& operator=(const TranslationTable&);
+ public:
+	TranslationTable();
+	~TranslationTable();
+
+	// false if there is no usable binary index for the translation file
+	bool open(const string& translationPath);
+	void build(const string& translationPath);
+	bool find(const DescriptionDigest&, uint32_t* offset) const;
+};
+
+string getPath(const string& indexPath);
+void remove(const string& indexPath);
+void generate(const string& indexPath, const string& temporaryPath,
+		const cache::ReleaseInfo&, const string& keyringStamp);
+void generateForTranslation(const string& translationPath, const string& temporaryPath);
+
+}
+}
+}
+
+#endif
+
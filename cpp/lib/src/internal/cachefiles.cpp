@@ -18,6 +18,8 @@
 #include <clocale>
 #include <ctime>
 
+#include <sys/stat.h>
+
 #include <common/regex.hpp>
 
 #include <cupt/config.hpp>
@@ -410,6 +412,18 @@ bool openingForReadingSucceeds(const string& path, const string& fileType, bool
 
 }
 
+string getKeyringStamp(const Config& config)
+{
+	auto keyringPath = config.getString("gpgv::trustedkeyring");
+	struct stat st;
+	if (stat(keyringPath.c_str(), &st) == -1)
+	{
+		return string();
+	}
+	return format2("%s %llu %lld.%09ld", keyringPath, (unsigned long long)st.st_size,
+			(long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+}
+
 bool verifySignature(const Config& config, const string& path, const string& alias)
 {
 	auto debugging = config.getBool("debug::gpgv");
@@ -672,38 +686,42 @@ shared_ptr< cache::ReleaseInfo > getReleaseInfo(const Config& config,
 		fatal2(__("unable to parse the release '%s'"), alias);
 	}
 
-	{ // checking Valid-Until
-		if (!result->validUntilDate.empty())
+	checkReleaseValidity(config, *result, alias);
+
+	return result;
+}
+
+void checkReleaseValidity(const Config& config, const cache::ReleaseInfo& releaseInfo, const string& alias)
+{
+	// checking Valid-Until
+	if (!releaseInfo.validUntilDate.empty())
+	{
+		struct tm validUntilTm;
+		memset(&validUntilTm, 0, sizeof(validUntilTm));
+		struct tm currentTm;
+
+		auto oldTimeSpec = setlocale(LC_TIME, "C");
+		auto parseResult = strptime(releaseInfo.validUntilDate.c_str(), "%a, %d %b %Y %T UTC", &validUntilTm);
+		setlocale(LC_TIME, oldTimeSpec);
+		if (parseResult) // success
 		{
-			struct tm validUntilTm;
-			memset(&validUntilTm, 0, sizeof(validUntilTm));
-			struct tm currentTm;
-
-			auto oldTimeSpec = setlocale(LC_TIME, "C");
-			auto parseResult = strptime(result->validUntilDate.c_str(), "%a, %d %b %Y %T UTC", &validUntilTm);
-			setlocale(LC_TIME, oldTimeSpec);
-			if (parseResult) // success
-			{
-				time_t localTime = time(NULL);
-				gmtime_r(&localTime, &currentTm);
-				// sanely, we should use timegm() here, but it's not portable,
-				// so we use mktime() which is enough for comparing two UTC tm's
-				if (mktime(&currentTm) > mktime(&validUntilTm))
-				{
-					bool warnOnly = config.getBool("cupt::cache::release-file-expiration::ignore");
-					(warnOnly ? warn2< string, string > : fatal2< string, string >)
-							(__("the release '%s' has expired (expiry time '%s')"), alias, result->validUntilDate);
-				}
-			}
-			else
+			time_t localTime = time(NULL);
+			gmtime_r(&localTime, &currentTm);
+			// sanely, we should use timegm() here, but it's not portable,
+			// so we use mktime() which is enough for comparing two UTC tm's
+			if (mktime(&currentTm) > mktime(&validUntilTm))
 			{
-				warn2(__("unable to parse the expiry time '%s' in the release '%s'"),
-						result->validUntilDate, alias);
+				bool warnOnly = config.getBool("cupt::cache::release-file-expiration::ignore");
+				(warnOnly ? warn2< string, string > : fatal2< string, string >)
+						(__("the release '%s' has expired (expiry time '%s')"), alias, releaseInfo.validUntilDate);
 			}
 		}
+		else
+		{
+			warn2(__("unable to parse the expiry time '%s' in the release '%s'"),
+					releaseInfo.validUntilDate, alias);
+		}
 	}
-
-	return result;
 }
 
 }
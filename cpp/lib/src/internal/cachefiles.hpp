@@ -69,8 +69,12 @@ vector< LocalizationDownloadRecord3 > getDownloadInfoOfLocalizedDescriptions3(
 		const Config&, const IndexEntry&);
 
 bool verifySignature(const Config&, const string& path, const string& alias);
+// identifies the keyring used by verifySignature: its path, size and
+// modification time; empty if it does not exist
+string getKeyringStamp(const Config&);
 shared_ptr< cache::ReleaseInfo > getReleaseInfo(const Config&,
 		const string& path, const string& alias);
+void checkReleaseValidity(const Config&, const cache::ReleaseInfo&, const string& alias);
 
 }
 }
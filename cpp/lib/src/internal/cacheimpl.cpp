@@ -15,6 +15,9 @@
 *   Free Software Foundation, Inc.,                                       *
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
+#include <thread>
+#include <atomic>
+
 #include <common/regex.hpp>
 
 #include <cupt/config.hpp>
@@ -37,25 +40,33 @@
 #include <internal/cachefiles.hpp>
 #include <internal/indexofindex.hpp>
 #include <internal/versionparse.hpp>
+#include <internal/binaryindex.hpp>
 
 namespace cupt {
 namespace internal {
 
 CacheImpl::CacheImpl()
-	: __smatch_ptr(new smatch)
+	: binaryIndexNamesMerged(false), sourceIndexNamesMerged(false), __smatch_ptr(new smatch)
 {}
 
 CacheImpl::~CacheImpl()
 {
+	if (config && config->getBool("debug::cache"))
+	{
+		const auto& statistics = versionArena.getStatistics();
+		debug2("version arena: %zu allocations (%zu released early), %zu bytes in %zu blocks of %zu bytes total",
+				statistics.allocationCount, statistics.releaseCount, statistics.allocatedBytes,
+				statistics.blockCount, statistics.reservedBytes);
+	}
 	delete __smatch_ptr;
 }
 
-void CacheImpl::processProvides(const string* packageNamePtr,
-		const char* providesStringStart, const char* providesStringEnd)
+static void addProvides(unordered_map< string, vector< const string* > >& canProvide,
+		const string* packageNamePtr, const char* providesStringStart, const char* providesStringEnd)
 {
-	auto callback = [this, &packageNamePtr](const char* tokenBeginIt, const char* tokenEndIt)
+	auto callback = [&canProvide, &packageNamePtr](const char* tokenBeginIt, const char* tokenEndIt)
 	{
-		auto& sublist = this->canProvide[string(tokenBeginIt, tokenEndIt)];
+		auto& sublist = canProvide[string(tokenBeginIt, tokenEndIt)];
 		if (std::find(sublist.begin(), sublist.end(), packageNamePtr) == sublist.end())
 		{
 			sublist.push_back(packageNamePtr);
@@ -65,6 +76,12 @@ void CacheImpl::processProvides(const string* packageNamePtr,
 			providesStringStart, providesStringEnd, ',', callback);
 }
 
+void CacheImpl::processProvides(const string* packageNamePtr,
+		const char* providesStringStart, const char* providesStringEnd)
+{
+	addProvides(canProvide, packageNamePtr, providesStringStart, providesStringEnd);
+}
+
 Package* CacheImpl::newBinaryPackage() const
 {
 	return new BinaryPackage(binaryArchitecture.get());
@@ -75,7 +92,66 @@ Package* CacheImpl::newSourcePackage() const
 	return new SourcePackage(binaryArchitecture.get());
 }
 
-Package* CacheImpl::preparePackage(unordered_map< string, vector< PrePackageRecord > >& pre,
+const pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > >* CacheImpl::addIndexSlot(
+		IndexEntry::Type category, shared_ptr< const ReleaseInfo > releaseInfo,
+		shared_ptr< File > file, const binaryindex::Reader* binaryIndex)
+{
+	releaseInfoAndFileStorage.push_back(make_pair(releaseInfo, file));
+	auto releaseInfoAndFile = &*(releaseInfoAndFileStorage.rbegin());
+
+	auto& slots = (category == IndexEntry::Binary ? binaryIndexSlots : sourceIndexSlots);
+	slots.push_back(IndexSlot { releaseInfoAndFile, binaryIndex });
+
+	return releaseInfoAndFile;
+}
+
+// moves all pre-package records of the package to 'result', in the order of slots
+bool CacheImpl::gatherPrePackageRecords(PrePackageMap& pre, const vector< IndexSlot >& slots,
+		const string& packageName, vector< PrePackageRecord >* result) const
+{
+	auto preIt = pre.find(packageName);
+	bool found = (preIt != pre.end());
+	if (found)
+	{
+		result->swap(preIt->second);
+	}
+	if (binaryIndexStorage.empty())
+	{
+		return found;
+	}
+
+	vector< PrePackageRecord > preRecords;
+	preRecords.swap(*result);
+	auto preRecordIt = preRecords.begin();
+	for (const auto& slot: slots)
+	{
+		if (slot.binaryIndex)
+		{
+			const uint32_t* offsetIt;
+			const uint32_t* offsetEnd;
+			if (slot.binaryIndex->getOffsets(packageName, &offsetIt, &offsetEnd))
+			{
+				found = true;
+				for (; offsetIt != offsetEnd; ++offsetIt)
+				{
+					result->push_back(PrePackageRecord { *offsetIt, slot.releaseInfoAndFile });
+				}
+			}
+		}
+		else
+		{
+			while (preRecordIt != preRecords.end() && preRecordIt->releaseInfoAndFile == slot.releaseInfoAndFile)
+			{
+				result->push_back(*(preRecordIt++));
+			}
+		}
+	}
+	result->insert(result->end(), preRecordIt, preRecords.end());
+
+	return found;
+}
+
+Package* CacheImpl::preparePackage(PrePackageMap& pre, const vector< IndexSlot >& slots,
 		unordered_map< string, unique_ptr< Package > >& target, const string& packageName,
 		decltype(&CacheImpl::newBinaryPackage) packageBuilderMethod) const
 {
@@ -85,14 +161,15 @@ Package* CacheImpl::preparePackage(unordered_map< string, vector< PrePackageReco
 		return targetIt->second.get();
 	}
 
-	auto preIt = pre.find(packageName);
-	if (preIt != pre.end())
+	vector< PrePackageRecord > preRecords;
+	if (gatherPrePackageRecords(pre, slots, packageName, &preRecords))
 	{
 		auto& package = target[packageName];
 		package.reset( (this->*packageBuilderMethod)() );
 
-		vector< PrePackageRecord >& preRecord = preIt->second;
-		FORIT(preRecordIt, preRecord)
+		Arena::Scope arenaScope(&versionArena);
+
+		FORIT(preRecordIt, preRecords)
 		{
 			internal::VersionParseParameters versionInitParams;
 			versionInitParams.releaseInfo = preRecordIt->releaseInfoAndFile->first.get();
@@ -101,7 +178,6 @@ Package* CacheImpl::preparePackage(unordered_map< string, vector< PrePackageReco
 			versionInitParams.packageNamePtr = &packageName;
 			package->addEntry(versionInitParams);
 		}
-		preRecord.clear();
 		return package.get();
 	}
 	else
@@ -110,6 +186,63 @@ Package* CacheImpl::preparePackage(unordered_map< string, vector< PrePackageReco
 	}
 }
 
+const CacheImpl::PrePackageMap& CacheImpl::getPrePackagesWithAllNames(IndexEntry::Type category) const
+{
+	bool isBinary = (category == IndexEntry::Binary);
+	auto& pre = isBinary ? preBinaryPackages : preSourcePackages;
+	auto& namesMerged = isBinary ? binaryIndexNamesMerged : sourceIndexNamesMerged;
+	if (!namesMerged)
+	{
+		for (const auto& slot: (isBinary ? binaryIndexSlots : sourceIndexSlots))
+		{
+			if (!slot.binaryIndex) continue;
+
+			auto packageCount = slot.binaryIndex->getPackageCount();
+			for (uint32_t packageId = 0; packageId < packageCount; ++packageId)
+			{
+				pre[slot.binaryIndex->getPackageName(packageId).toString()];
+			}
+		}
+		namesMerged = true;
+	}
+	return pre;
+}
+
+vector< string > CacheImpl::getProviderNames(const string& virtualPackageName) const
+{
+	vector< string > result;
+
+	auto reverseProvidesIt = canProvide.find(virtualPackageName);
+	if (reverseProvidesIt != canProvide.end())
+	{
+		for (const string* packageNamePtr: reverseProvidesIt->second)
+		{
+			result.push_back(*packageNamePtr);
+		}
+	}
+
+	for (const auto& slot: binaryIndexSlots)
+	{
+		if (!slot.binaryIndex) continue;
+
+		const uint32_t* providerIt;
+		const uint32_t* providerEnd;
+		if (slot.binaryIndex->getProviders(virtualPackageName, &providerIt, &providerEnd))
+		{
+			for (; providerIt != providerEnd; ++providerIt)
+			{
+				auto packageName = slot.binaryIndex->getPackageName(*providerIt).toString();
+				if (std::find(result.begin(), result.end(), packageName) == result.end())
+				{
+					result.push_back(std::move(packageName));
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
 vector< const BinaryVersion* >
 CacheImpl::getSatisfyingVersionsNonCached(const Relation& relation) const
 {
@@ -140,31 +273,27 @@ CacheImpl::getSatisfyingVersionsNonCached(const Relation& relation) const
 	if (relation.relationType == Relation::Types::None)
 	{
 		// looking for reverse-provides
-		auto reverseProvidesIt = canProvide.find(packageName);
-		if (reverseProvidesIt != canProvide.end())
+		for (const string& providerName: getProviderNames(packageName))
 		{
-			for (const auto& it: reverseProvidesIt->second)
+			auto reverseProvidePackage = getBinaryPackage(providerName);
+			if (!reverseProvidePackage)
 			{
-				auto reverseProvidePackage = getBinaryPackage(*it);
-				if (!reverseProvidePackage)
+				continue;
+			}
+			for (auto version: *reverseProvidePackage)
+			{
+				if (version->isInstalled() &&
+						systemState->getInstalledInfo(version->packageName)->isBroken())
 				{
 					continue;
 				}
-				for (auto version: *reverseProvidePackage)
+				for (const auto& realProvidesPackageName: version->provides)
 				{
-					if (version->isInstalled() &&
-							systemState->getInstalledInfo(version->packageName)->isBroken())
-					{
-						continue;
-					}
-					for (const auto& realProvidesPackageName: version->provides)
+					if (realProvidesPackageName == packageName)
 					{
-						if (realProvidesPackageName == packageName)
-						{
-							// ok, this particular version does provide this virtual package
-							result.push_back(version);
-							break;
-						}
+						// ok, this particular version does provide this virtual package
+						result.push_back(version);
+						break;
 					}
 				}
 			}
@@ -176,14 +305,14 @@ CacheImpl::getSatisfyingVersionsNonCached(const Relation& relation) const
 
 const BinaryPackage* CacheImpl::getBinaryPackage(const string& packageName) const
 {
-	return static_cast< const BinaryPackage* >(preparePackage(
-			preBinaryPackages, binaryPackages, packageName, &CacheImpl::newBinaryPackage));
+	return static_cast< const BinaryPackage* >(preparePackage(preBinaryPackages,
+			binaryIndexSlots, binaryPackages, packageName, &CacheImpl::newBinaryPackage));
 }
 
 const SourcePackage* CacheImpl::getSourcePackage(const string& packageName) const
 {
-	return static_cast< const SourcePackage* >(preparePackage(
-			preSourcePackages, sourcePackages, packageName, &CacheImpl::newSourcePackage));
+	return static_cast< const SourcePackage* >(preparePackage(preSourcePackages,
+			sourceIndexSlots, sourcePackages, packageName, &CacheImpl::newSourcePackage));
 }
 
 void CacheImpl::parseSourcesLists()
@@ -428,9 +557,23 @@ class ReleaseLimits
 	}
 };
 
+size_t CacheImpl::getLoaderThreadCount(size_t jobCount) const
+{
+	auto result = config->getInteger("cupt::cache::loader-threads");
+	if (result <= 0)
+	{
+		result = std::thread::hardware_concurrency();
+	}
+	return std::max< size_t >(1, std::min< size_t >(result, jobCount));
+}
+
 void CacheImpl::processIndexEntries(bool useBinary, bool useSource)
 {
+	// release information is read and checked in the main thread to keep
+	// the order of messages, the lists themselves are loaded in parallel
 	ReleaseLimits releaseLimits(*config);
+	list< IndexLoadJob > jobStorage;
+	vector< IndexLoadJob* > jobs;
 	for (const auto& entry: indexEntries)
 	{
 		if (entry.category == IndexEntry::Binary && !useBinary)
@@ -442,7 +585,41 @@ void CacheImpl::processIndexEntries(bool useBinary, bool useSource)
 			continue;
 		}
 
-		processIndexEntry(entry, releaseLimits);
+		jobStorage.emplace_back();
+		if (prepareIndexEntry(entry, releaseLimits, &jobStorage.back()))
+		{
+			jobs.push_back(&jobStorage.back());
+		}
+		else
+		{
+			jobStorage.pop_back();
+		}
+	}
+
+	std::atomic< size_t > nextJobIndex(0);
+	auto loader = [&jobs, &nextJobIndex]()
+	{
+		size_t jobIndex;
+		while ((jobIndex = nextJobIndex++) < jobs.size())
+		{
+			loadIndexEntry(*jobs[jobIndex]);
+		}
+	};
+	vector< std::thread > threads;
+	auto threadCount = getLoaderThreadCount(jobs.size());
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(loader);
+	}
+	loader();
+	for (auto& thread: threads)
+	{
+		thread.join();
+	}
+
+	for (auto job: jobs)
+	{
+		mergeIndexEntry(*job);
 	}
 }
 
@@ -477,7 +654,33 @@ static bool getVerifiedBitForIndexEntry(const Cache::IndexEntry& entry,
 	}
 }
 
-shared_ptr< ReleaseInfo > CacheImpl::getReleaseInfo(const Config& config, const IndexEntry& indexEntry)
+static shared_ptr< ReleaseInfo > getReleaseInfoFromBinaryIndex(const Cache::IndexEntry& entry,
+		const Config& config, const string& path, const string& alias,
+		const binaryindex::Reader& binaryIndex)
+{
+	shared_ptr< ReleaseInfo > result(new ReleaseInfo);
+	binaryIndex.fillReleaseInfo(result.get());
+	cachefiles::checkReleaseValidity(config, *result, alias);
+
+	auto trustedOptionValue = getIndexEntryOptionValue(entry, "trusted");
+	if (trustedOptionValue.empty())
+	{
+		// the cached verification result is usable only with the very same keyring
+		auto keyringStamp = cachefiles::getKeyringStamp(config);
+		if (keyringStamp.empty() || keyringStamp != binaryIndex.getKeyringStamp())
+		{
+			result->verified = cachefiles::verifySignature(config, path, alias);
+		}
+	}
+	else
+	{
+		result->verified = getVerifiedBitForIndexEntry(entry, config, path, alias);
+	}
+	return result;
+}
+
+shared_ptr< ReleaseInfo > CacheImpl::getReleaseInfo(const Config& config, const IndexEntry& indexEntry,
+		const binaryindex::Reader* binaryIndex)
 {
 	auto path = cachefiles::getPathOfMasterReleaseLikeList(config, indexEntry);
 	auto insertResult = releaseInfoCache.insert({ path, {} });
@@ -489,6 +692,10 @@ shared_ptr< ReleaseInfo > CacheImpl::getReleaseInfo(const Config& config, const
 		{
 			warn2(__("no release file present for '%s'"), alias);
 		}
+		else if (binaryIndex)
+		{
+			cachedValue = getReleaseInfoFromBinaryIndex(indexEntry, config, path, alias, *binaryIndex);
+		}
 		else
 		{
 			cachedValue = cachefiles::getReleaseInfo(config, path, alias);
@@ -502,25 +709,39 @@ shared_ptr< ReleaseInfo > CacheImpl::getReleaseInfo(const Config& config, const
 	return shared_ptr< ReleaseInfo > (new ReleaseInfo(*cachedValue));
 }
 
-void CacheImpl::processIndexEntry(const IndexEntry& indexEntry,
-		const ReleaseLimits& releaseLimits)
+bool CacheImpl::prepareIndexEntry(const IndexEntry& indexEntry,
+		const ReleaseLimits& releaseLimits, IndexLoadJob* job)
 {
-	string indexFileToParse = cachefiles::getPathOfIndexList(*config, indexEntry);
-
-	string indexAlias = indexEntry.uri + ' ' + indexEntry.distribution + ' ' +
+	job->category = indexEntry.category;
+	job->path = cachefiles::getPathOfIndexList(*config, indexEntry);
+	job->alias = indexEntry.uri + ' ' + indexEntry.distribution + ' ' +
 			indexEntry.component + ' ' +
 			((indexEntry.category == IndexEntry::Binary) ? "(binary)" : "(source)");
+	job->parseList = false;
+	job->failed = false;
+
+	const binaryindex::Reader* binaryIndex = nullptr;
+	binaryIndexStorage.emplace_back();
+	if (binaryIndexStorage.back().open(job->path,
+				cachefiles::getPathOfMasterReleaseLikeList(*config, indexEntry)))
+	{
+		binaryIndex = &binaryIndexStorage.back();
+	}
+	else
+	{
+		binaryIndexStorage.pop_back();
+	}
 
 	shared_ptr< ReleaseInfo > releaseInfo;
 	try
 	{
-		releaseInfo = getReleaseInfo(*config, indexEntry);
+		releaseInfo = getReleaseInfo(*config, indexEntry, binaryIndex);
 		releaseInfo->component = indexEntry.component;
 		releaseInfo->baseUri = indexEntry.uri;
 
 		if (releaseLimits.isExcluded(*releaseInfo))
 		{
-			return;
+			return false;
 		}
 
 		if (indexEntry.category == IndexEntry::Binary)
@@ -532,62 +753,71 @@ void CacheImpl::processIndexEntry(const IndexEntry& indexEntry,
 			sourceReleaseData.push_back(releaseInfo);
 		}
 
-		processIndexFile(indexFileToParse, indexEntry.category, releaseInfo, indexAlias);
+		shared_ptr< File > file(new RequiredFile(job->path, "rm"));
+		job->prePackageRecord.releaseInfoAndFile =
+				addIndexSlot(indexEntry.category, releaseInfo, file, binaryIndex);
+		job->parseList = !binaryIndex;
 	}
 	catch (Exception&)
 	{
-		warn2(__("skipped the index '%s'"), indexAlias);
+		warn2(__("skipped the index '%s'"), job->alias);
 	}
 
 	if (releaseInfo && Version::parseInfoOnly) // description is info-only field
 	{
-		processTranslationFiles(indexEntry, indexAlias);
+		auto localizationRecords = cachefiles::getPathsOfLocalizedDescriptions(*config, indexEntry);
+		for (const auto& record: localizationRecords)
+		{
+			auto description = format2(__("'%s' descriptions localization"), record.first);
+			auto localizationAlias = format2(__("%s for '%s'"), description, job->alias);
+			job->translationPathsAndAliases.push_back({ record.second, localizationAlias });
+		}
 	}
+
+	return job->parseList || !job->translationPathsAndAliases.empty();
 }
 
-void CacheImpl::processTranslationFiles(const IndexEntry& indexEntry,
-		const string& indexAlias)
+void CacheImpl::loadIndexEntry(IndexLoadJob& job)
 {
-	auto process = [this](const string& path, const string& localizationAlias)
+	if (job.parseList)
 	{
+		try
+		{
+			processIndexFile(job);
+		}
+		catch (...)
+		{
+			job.failed = true;
+			job.prePackages.clear();
+			job.canProvide.clear();
+		}
+	}
+
+	for (const auto& record: job.translationPathsAndAliases)
+	{
+		const string& path = record.first;
+		const string& localizationAlias = record.second;
 		try
 		{
 			if (fs::fileExists(path))
 			{
-				processTranslationFile(path, localizationAlias);
+				processTranslationFile(job, path, localizationAlias);
 			}
 		}
 		catch (Exception&)
 		{
 			warn2(__("skipped the index '%s'"), localizationAlias);
 		}
-	};
-
-	auto localizationRecords = cachefiles::getPathsOfLocalizedDescriptions(*config, indexEntry);
-	for (const auto& record: localizationRecords)
-	{
-		auto description = format2(__("'%s' descriptions localization"), record.first);
-		auto localizationAlias = format2(__("%s for '%s'"), description, indexAlias);
-		process(record.second, localizationAlias);
 	}
 }
 
-void CacheImpl::processIndexFile(const string& path, IndexEntry::Type category,
-		shared_ptr< const ReleaseInfo > releaseInfo, const string& alias)
+void CacheImpl::processIndexFile(IndexLoadJob& job)
 {
-	auto& prePackagesStorage = (category == IndexEntry::Binary ?
-			preBinaryPackages : preSourcePackages);
-
-	shared_ptr< File > file(new RequiredFile(path, "r"));
-
-	releaseInfoAndFileStorage.push_back(make_pair(releaseInfo, file));
-	PrePackageRecord prePackageRecord;
-	prePackageRecord.releaseInfoAndFile = &*(releaseInfoAndFileStorage.rbegin());
-
 	try
 	{
 		string packageName;
 		const string* persistentPackageNamePtr;
+		PrePackageRecord prePackageRecord = job.prePackageRecord;
 
 		ioi::Record ioiRecord;
 		ioiRecord.offsetPtr = &prePackageRecord.offset;
@@ -595,7 +825,7 @@ void CacheImpl::processIndexFile(const string& path, IndexEntry::Type category,
 
 		ioi::ps::Callbacks callbacks;
 		callbacks.main =
-				[this, &packageName, &alias, &prePackagesStorage, &prePackageRecord, &persistentPackageNamePtr]()
+				[&job, &packageName, &prePackageRecord, &persistentPackageNamePtr]()
 				{
 					try
 					{
@@ -603,56 +833,95 @@ void CacheImpl::processIndexFile(const string& path, IndexEntry::Type category,
 					}
 					catch (Exception&)
 					{
-						warn2(__("discarding this package version from the index '%s'"), alias);
+						warn2(__("discarding this package version from the index '%s'"), job.alias);
 						return;
 					}
 
-					auto& prePackageRecords = prePackagesStorage[std::move(packageName)];
+					auto& prePackageRecords = job.prePackages[std::move(packageName)];
 					prePackageRecords.push_back(prePackageRecord);
 
 					persistentPackageNamePtr = (const string*)
 							((const char*)(&prePackageRecords) - offsetof(PrePackageMap::value_type, second));
 				};
 		callbacks.provides =
-				[this, &persistentPackageNamePtr](const char* begin, const char* end)
+				[&job, &persistentPackageNamePtr](const char* begin, const char* end)
 				{
-					processProvides(persistentPackageNamePtr, begin, end);
+					addProvides(job.canProvide, persistentPackageNamePtr, begin, end);
 				};
 
-		ioi::ps::processIndex(path, callbacks, ioiRecord);
+		ioi::ps::processIndex(job.path, callbacks, ioiRecord);
 	}
 	catch (Exception&)
 	{
-		fatal2(__("unable to parse the index '%s'"), alias);
+		fatal2(__("unable to parse the index '%s'"), job.alias);
 	}
 }
 
-void CacheImpl::processTranslationFile(const string& path, const string& alias)
+void CacheImpl::processTranslationFile(IndexLoadJob& job, const string& path, const string& alias)
 {
-	translationFileStorage.emplace_back(path, "r");
+	job.translationFiles.emplace_back(path, "rm");
+	job.translationTables.emplace_back();
 
-	File* file = &translationFileStorage.back();
-	try
+	auto& table = job.translationTables.back();
+	if (!table.open(path))
 	{
-		string md5;
-		TranslationPosition translationPosition;
-		translationPosition.file = file;
-
-		ioi::Record ioiRecord = { &translationPosition.offset, &md5 };
+		try
+		{
+			table.build(path);
+		}
+		catch(Exception&)
+		{
+			job.translationFiles.pop_back();
+			job.translationTables.pop_back();
+			fatal2(__("unable to parse the index '%s'"), alias);
+		}
+	}
+}
 
-		ioi::tr::Callbacks callbacks;
-		callbacks.main =
-				[this, &md5, &translationPosition]()
-				{
-					translations.insert({ std::move(md5), translationPosition });
-				};
+void CacheImpl::mergeIndexEntry(IndexLoadJob& job)
+{
+	if (job.failed)
+	{
+		warn2(__("skipped the index '%s'"), job.alias);
+	}
 
-		ioi::tr::processIndex(path, callbacks, ioiRecord);
+	auto& prePackagesStorage = (job.category == IndexEntry::Binary ?
+			preBinaryPackages : preSourcePackages);
+	if (prePackagesStorage.empty())
+	{
+		prePackagesStorage.swap(job.prePackages); // keeps provider pointers valid
 	}
-	catch(Exception&)
+	else
 	{
-		fatal2(__("unable to parse the index '%s'"), alias);
+		for (auto& item: job.prePackages)
+		{
+			auto& records = prePackagesStorage[item.first];
+			records.insert(records.end(), item.second.begin(), item.second.end());
+		}
 	}
+	for (const auto& item: job.canProvide)
+	{
+		auto& sublist = canProvide[item.first];
+		for (auto providerNamePtr: item.second)
+		{
+			auto persistentProviderNamePtr = &prePackagesStorage.find(*providerNamePtr)->first;
+			if (std::find(sublist.begin(), sublist.end(), persistentProviderNamePtr) == sublist.end())
+			{
+				sublist.push_back(persistentProviderNamePtr);
+			}
+		}
+	}
+	job.canProvide.clear();
+	job.prePackages.clear();
+
+	auto tableIt = job.translationTables.begin();
+	for (auto& file: job.translationFiles)
+	{
+		translations.push_back(TranslationSource { &file, &*tableIt });
+		++tableIt;
+	}
+	translationFileStorage.splice(translationFileStorage.end(), job.translationFiles);
+	translationTableStorage.splice(translationTableStorage.end(), job.translationTables);
 }
 
 void CacheImpl::parsePreferences()
@@ -720,12 +989,18 @@ string CacheImpl::getLocalizedDescription(const BinaryVersion* version) const
 			version->descriptionHash :
 			HashSums::getHashOfString(HashSums::MD5, version->description);
 
-	auto it = translations.find(sourceHash);
-	if (it != translations.end())
+	binaryindex::DescriptionDigest digest;
+	if (binaryindex::parseDescriptionDigest(sourceHash, &digest))
 	{
-		const TranslationPosition& position = it->second;
-		position.file->seek(position.offset);
-		return position.file->getRecord().chompAsRecord();
+		for (const auto& source: translations)
+		{
+			uint32_t offset;
+			if (source.table->find(digest, &offset))
+			{
+				source.file->seek(offset);
+				return source.file->getRecord().chompAsRecord();
+			}
+		}
 	}
 	return version->description;
 }
@@ -20,6 +20,8 @@
 
 #include <unordered_map>
 #include <list>
+#include <functional>
+#include <mutex>
 
 #include <boost/xpressive/xpressive_fwd.hpp>
 
@@ -27,11 +29,20 @@
 #include <cupt/fwd.hpp>
 #include <cupt/cache.hpp>
 
+#include <internal/arena.hpp>
+
 namespace cupt {
 namespace internal {
 
 class PinInfo;
 class ReleaseLimits;
+namespace binaryindex {
+class Reader;
+class TranslationTable;
+}
+namespace dependencygraph {
+class DependencyGraph;
+}
 
 using std::list;
 using std::unordered_map;
@@ -50,38 +61,76 @@ class CacheImpl
 		const pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > >* releaseInfoAndFile;
 	};
 	typedef unordered_map< string, vector< PrePackageRecord > > PrePackageMap;
+	// every loaded Packages/Sources list in the order of loading; records of a
+	// slot are either in the binary index or in the pre-package map
+	struct IndexSlot
+	{
+		const pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > >* releaseInfoAndFile;
+		const binaryindex::Reader* binaryIndex;
+	};
  private:
 	typedef Cache::IndexEntry IndexEntry;
 	typedef Cache::ExtendedInfo ExtendedInfo;
-	struct TranslationPosition
+	// a Translation file and the table of its records, looked up in the load order
+	struct TranslationSource
 	{
 		File* file;
-		uint32_t offset;
+		const binaryindex::TranslationTable* table;
+	};
+	typedef unordered_map< string, vector< const string* > > CanProvideMap;
+	// everything read from one index entry; lists are parsed by loader threads
+	// into the job's own maps which are merged afterwards in the source list order
+	struct IndexLoadJob
+	{
+		IndexEntry::Type category;
+		string path;
+		string alias;
+		PrePackageRecord prePackageRecord;
+		bool parseList;
+		bool failed;
+		PrePackageMap prePackages;
+		CanProvideMap canProvide;
+		vector< pair< string, string > > translationPathsAndAliases;
+		list< RequiredFile > translationFiles;
+		list< binaryindex::TranslationTable > translationTables;
 	};
 
-	unordered_map< string, vector< const string* > > canProvide;
+	// owns the memory of parsed versions, so declared before the packages
+	mutable Arena versionArena;
+	CanProvideMap canProvide;
 	mutable unordered_map< string, unique_ptr< Package > > binaryPackages;
 	mutable unordered_map< string, unique_ptr< Package > > sourcePackages;
-	unordered_map< string, TranslationPosition > translations;
+	vector< TranslationSource > translations;
 	mutable unordered_map< string, vector< const BinaryVersion* > > getSatisfyingVersionsCache;
 	shared_ptr< PinInfo > pinInfo;
 	mutable map< const Version*, ssize_t > pinCache;
 	map< string, shared_ptr< ReleaseInfo > > releaseInfoCache;
 	list< RequiredFile > translationFileStorage;
+	list< binaryindex::TranslationTable > translationTableStorage;
+	list< binaryindex::Reader > binaryIndexStorage;
+	vector< IndexSlot > binaryIndexSlots;
+	vector< IndexSlot > sourceIndexSlots;
+	mutable bool binaryIndexNamesMerged;
+	mutable bool sourceIndexNamesMerged;
 	smatch* __smatch_ptr;
 
 	Package* newSourcePackage() const;
 	Package* newBinaryPackage() const;
-	Package* preparePackage(unordered_map< string, vector< PrePackageRecord > >&,
+	bool gatherPrePackageRecords(PrePackageMap&, const vector< IndexSlot >&,
+			const string&, vector< PrePackageRecord >*) const;
+	Package* preparePackage(PrePackageMap&, const vector< IndexSlot >&,
 			unordered_map< string, unique_ptr< Package > >&, const string&,
 			decltype(&CacheImpl::newBinaryPackage)) const;
-	shared_ptr< ReleaseInfo > getReleaseInfo(const Config&, const IndexEntry&);
+	vector< string > getProviderNames(const string&) const;
+	shared_ptr< ReleaseInfo > getReleaseInfo(const Config&, const IndexEntry&,
+			const binaryindex::Reader*);
 	void parseSourceList(const string& path);
-	void processIndexEntry(const IndexEntry&, const ReleaseLimits&);
-	void processIndexFile(const string& path, IndexEntry::Type category,
-			shared_ptr< const ReleaseInfo >, const string&);
-	void processTranslationFiles(const IndexEntry&, const string&);
-	void processTranslationFile(const string& path, const string&);
+	bool prepareIndexEntry(const IndexEntry&, const ReleaseLimits&, IndexLoadJob*);
+	size_t getLoaderThreadCount(size_t) const;
+	static void loadIndexEntry(IndexLoadJob&);
+	static void processIndexFile(IndexLoadJob&);
+	static void processTranslationFile(IndexLoadJob&, const string& path, const string&);
+	void mergeIndexEntry(IndexLoadJob&);
 	vector< const BinaryVersion* > getSatisfyingVersionsNonCached(const Relation&) const;
 	vector< const BinaryVersion* > getSatisfyingVersionsNonCached(const RelationExpression&) const;
 	ssize_t computePin(const Version*, const BinaryPackage*) const;
@@ -97,9 +146,17 @@ class CacheImpl
 	list< pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > > >
 			releaseInfoAndFileStorage;
 	ExtendedInfo extendedInfo;
+	// the dependency graph left by the last native resolver on this cache,
+	// for the next one; it points to the versions, so it goes away first
+	mutable std::mutex spareDependencyGraphMutex;
+	mutable shared_ptr< dependencygraph::DependencyGraph > spareDependencyGraph;
 
 	CacheImpl();
 	~CacheImpl();
+	const pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > >* addIndexSlot(
+			IndexEntry::Type, shared_ptr< const ReleaseInfo >, shared_ptr< File >,
+			const binaryindex::Reader* = nullptr);
+	const PrePackageMap& getPrePackagesWithAllNames(IndexEntry::Type) const;
 	void parseSourcesLists();
 	void processIndexEntries(bool, bool);
 	void parsePreferences();
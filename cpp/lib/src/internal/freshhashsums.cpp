@@ -0,0 +1,97 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <map>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#include <cupt/hashsums.hpp>
+
+#include <internal/freshhashsums.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+struct FileIdentity
+{
+	dev_t device;
+	ino_t inode;
+	off_t size;
+	time_t modifySeconds;
+	long modifyNanoseconds;
+
+	bool operator==(const FileIdentity& other) const
+	{
+		return device == other.device && inode == other.inode && size == other.size &&
+				modifySeconds == other.modifySeconds && modifyNanoseconds == other.modifyNanoseconds;
+	}
+};
+
+bool getFileIdentity(const string& path, FileIdentity& identity)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) == -1)
+	{
+		return false;
+	}
+	identity.device = st.st_dev;
+	identity.inode = st.st_ino;
+	identity.size = st.st_size;
+	identity.modifySeconds = st.st_mtim.tv_sec;
+	identity.modifyNanoseconds = st.st_mtim.tv_nsec;
+	return true;
+}
+
+std::mutex recordsMutex;
+std::map< string, pair< FileIdentity, HashSums > > records;
+
+}
+
+void rememberFreshHashSums(const string& path, const HashSums& hashSums)
+{
+	FileIdentity identity;
+	if (!getFileIdentity(path, identity))
+	{
+		return;
+	}
+	std::lock_guard< std::mutex > guard(recordsMutex);
+	records[path] = { identity, hashSums };
+}
+
+bool recallFreshHashSums(const string& path, HashSums& hashSums)
+{
+	std::lock_guard< std::mutex > guard(recordsMutex);
+	auto it = records.find(path);
+	if (it == records.end())
+	{
+		return false;
+	}
+	FileIdentity identity;
+	if (!getFileIdentity(path, identity) || !(identity == it->second.first))
+	{
+		records.erase(it);
+		return false;
+	}
+	hashSums = it->second.second;
+	return true;
+}
+
+}
+}
@@ -20,10 +20,12 @@
 
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <vector>
 #include <queue>
 #include <algorithm>
+#include <numeric>
 
 #include <cupt/common.hpp>
 
@@ -36,6 +38,63 @@ using std::unordered_set;
 using std::queue;
 using std::priority_queue;
 
+// maps vertex pointers to values
+template < class PtrT, class ValueT >
+class PointerKeyedMap
+{
+	std::unordered_map< PtrT, ValueT > p_values;
+ public:
+	const ValueT* find(PtrT key) const
+	{
+		auto it = p_values.find(key);
+		return (it != p_values.end() ? &it->second : nullptr);
+	}
+	ValueT& operator[](PtrT key)
+	{
+		return p_values[key];
+	}
+	void erase(PtrT key)
+	{
+		p_values.erase(key);
+	}
+	void clear()
+	{
+		p_values.clear();
+	}
+};
+
+// maps vertices which have dense 'id' fields to values, by an array; values
+// of vertices never set are default-constructed
+template < class PtrT, class ValueT >
+class IdKeyedMap
+{
+	vector< ValueT > p_values;
+ public:
+	const ValueT* find(PtrT key) const
+	{
+		return (key->id < p_values.size() ? &p_values[key->id] : nullptr);
+	}
+	ValueT& operator[](PtrT key)
+	{
+		if (key->id >= p_values.size())
+		{
+			p_values.resize(key->id + 1);
+		}
+		return p_values[key->id];
+	}
+	void erase(PtrT key)
+	{
+		if (key->id < p_values.size())
+		{
+			p_values[key->id] = ValueT();
+		}
+	}
+	void clear()
+	{
+		vector< ValueT >().swap(p_values);
+	}
+};
+
 namespace {
 
 template< class T >
@@ -46,6 +105,8 @@ struct DefaultPointerTraits
 	{
 		return &vertex;
 	}
+	template < class ValueT >
+	using VertexMap = PointerKeyedMap< PointerType, ValueT >;
 };
 
 }
@@ -55,13 +116,62 @@ class Graph
 {
 	typedef typename PtrTraitsT< T >::PointerType PtrT;
  public:
-	typedef std::vector< PtrT > CessorListType; // type for {suc,prede}cessor lists
+	// read-only view of a {suc,prede}cessor list, valid until the list changes
+	class CessorListType
+	{
+		const PtrT* p_begin;
+		const PtrT* p_end;
+	 public:
+		typedef PtrT value_type;
+		typedef const PtrT* const_iterator;
+		typedef const_iterator iterator;
+
+		CessorListType()
+			: p_begin(nullptr), p_end(nullptr)
+		{}
+		CessorListType(const PtrT* begin, const PtrT* end)
+			: p_begin(begin), p_end(end)
+		{}
+		const_iterator begin() const { return p_begin; }
+		const_iterator end() const { return p_end; }
+		bool empty() const { return p_begin == p_end; }
+		size_t size() const { return p_end - p_begin; }
+	};
  private:
-	set< T > __vertices;
-	mutable map< PtrT, CessorListType > __predecessors;
-	mutable map< PtrT, CessorListType > __successors;
+	template < class ValueT >
+	using VertexMap = typename PtrTraitsT< T >::template VertexMap< ValueT >;
 
-	static const CessorListType __null_list;
+	// all {suc,prede}cessor lists back to back, the list of the vertex
+	// number N takes [offsets[N], offsets[N+1])
+	struct CompactLists
+	{
+		vector< uint32_t > offsets;
+		vector< PtrT > vertexPtrs;
+		vector< uint32_t > vertexIndexes;
+	};
+	// compressed sparse row form of the graph; vertices are numbered from 1 in
+	// the order of the vertex set, the number 0 is an empty row for pointers
+	// which are not vertices
+	struct CompactForm
+	{
+		vector< PtrT > vertexPtrs;
+		VertexMap< uint32_t > vertexIndexes;
+		CompactLists predecessors;
+		CompactLists successors;
+	};
+
+	set< T > __vertices;
+	VertexMap< vector< PtrT > > __predecessors;
+	VertexMap< vector< PtrT > > __successors;
+	shared_ptr< const CompactForm > p_compact_form; // only when frozen
+
+	static CessorListType p_get_view(const vector< PtrT >*);
+	static CessorListType p_get_view(const CompactLists&, uint32_t);
+	static uint32_t p_get_index(const CompactForm&, PtrT);
+	void p_compact_lists(const CompactForm&, const VertexMap< vector< PtrT > >&,
+			CompactLists&) const;
+	shared_ptr< const CompactForm > p_get_compact_form() const;
+	void p_assert_not_frozen() const;
 
  public:
 	const set< T >& getVertices() const;
@@ -69,8 +179,8 @@ class Graph
 
 	bool hasEdgeFromPointers(PtrT fromVertexPtr, PtrT toVertexPtr) const;
 
-	const CessorListType& getPredecessorsFromPointer(PtrT vertexPtr) const;
-	const CessorListType& getSuccessorsFromPointer(PtrT vertexPtr) const;
+	CessorListType getPredecessorsFromPointer(PtrT vertexPtr) const;
+	CessorListType getSuccessorsFromPointer(PtrT vertexPtr) const;
 
 
 	PtrT addVertex(const T& vertex);
@@ -78,6 +188,12 @@ class Graph
 
 	void addEdgeFromPointers(PtrT fromVertexPtr, PtrT toVertexPtr);
 	void deleteEdgeFromPointers(PtrT fromVertexPtr, PtrT toVertexPtr);
+	void clear();
+
+	// a frozen graph keeps its edges in the compact form and cannot be changed
+	void freeze();
+	void unfreeze();
+	bool isFrozen() const;
 
 	unordered_set< PtrT > getReachableFrom(const T& from) const;
 
@@ -87,9 +203,6 @@ class Graph
 			OutputIterator outputIterator) const;
 };
 
-template< class T, template < class X > class PtrTraitsT >
-const typename Graph< T, PtrTraitsT >::CessorListType Graph< T, PtrTraitsT >::__null_list;
-
 template< class T, template < class X > class PtrTraitsT >
 const set< T >& Graph< T, PtrTraitsT >::getVertices() const
 {
@@ -102,7 +215,7 @@ auto Graph< T, PtrTraitsT >::getEdges() const -> vector< pair< PtrT, PtrT > >
 	vector< pair< PtrT, PtrT > > result;
 	FORIT(vertexIt, __vertices)
 	{
-		PtrT vertexPtr = &*vertexIt;
+		PtrT vertexPtr = PtrTraitsT< T >::toPointer(*vertexIt);
 
 		const CessorListType& predecessors = getPredecessorsFromPointer(vertexPtr);
 		FORIT(predecessorPtrIt, predecessors)
@@ -114,9 +227,19 @@ auto Graph< T, PtrTraitsT >::getEdges() const -> vector< pair< PtrT, PtrT > >
 	return result;
 }
 
+template< class T, template < class X > class PtrTraitsT >
+void Graph< T, PtrTraitsT >::p_assert_not_frozen() const
+{
+	if (p_compact_form)
+	{
+		fatal2i("graph: changing a frozen graph");
+	}
+}
+
 template< class T, template < class X > class PtrTraitsT >
 auto Graph< T, PtrTraitsT >::addVertex(const T& vertex) -> PtrT
 {
+	p_assert_not_frozen();
 	return PtrTraitsT< T >::toPointer(*__vertices.insert(vertex).first);
 }
 
@@ -137,6 +260,7 @@ void __remove_from_cessors(ContainerT& cessors, const ElementT& vertexPtr)
 template< class T, template < class X > class PtrTraitsT >
 void Graph< T, PtrTraitsT >::deleteVertex(const T& vertex)
 {
+	p_assert_not_frozen();
 	// searching for vertex
 	auto it = __vertices.find(vertex);
 	if (it != __vertices.end())
@@ -179,6 +303,7 @@ bool Graph< T, PtrTraitsT >::hasEdgeFromPointers(PtrT fromVertexPtr, PtrT toVert
 template< class T, template < class X > class PtrTraitsT >
 void Graph< T, PtrTraitsT >::addEdgeFromPointers(PtrT fromVertexPtr, PtrT toVertexPtr)
 {
+	p_assert_not_frozen();
 	if (!hasEdgeFromPointers(fromVertexPtr, toVertexPtr))
 	{
 		__predecessors[toVertexPtr].push_back(fromVertexPtr);
@@ -189,87 +314,218 @@ void Graph< T, PtrTraitsT >::addEdgeFromPointers(PtrT fromVertexPtr, PtrT toVert
 template< class T, template < class X > class PtrTraitsT >
 void Graph< T, PtrTraitsT >::deleteEdgeFromPointers(PtrT fromVertexPtr, PtrT toVertexPtr)
 {
-	auto predecessorsIt = __predecessors.find(toVertexPtr);
-	auto successorsIt = __successors.find(fromVertexPtr);
-	if (predecessorsIt != __predecessors.end())
+	p_assert_not_frozen();
+	auto predecessorsPtr = __predecessors.find(toVertexPtr);
+	auto successorsPtr = __successors.find(fromVertexPtr);
+	if (predecessorsPtr && !predecessorsPtr->empty())
 	{
-		__remove_from_cessors(predecessorsIt->second, fromVertexPtr);
+		__remove_from_cessors(__predecessors[toVertexPtr], fromVertexPtr);
 	}
-	if (successorsIt != __successors.end())
+	if (successorsPtr && !successorsPtr->empty())
 	{
-		__remove_from_cessors(successorsIt->second, toVertexPtr);
+		__remove_from_cessors(__successors[fromVertexPtr], toVertexPtr);
 	}
 }
 
 template< class T, template < class X > class PtrTraitsT >
-const typename Graph< T, PtrTraitsT >::CessorListType& Graph< T, PtrTraitsT >::getPredecessorsFromPointer(PtrT vertexPtr) const
+void Graph< T, PtrTraitsT >::clear()
 {
-	auto it = __predecessors.find(vertexPtr);
-	return (it != __predecessors.end() ? it->second : __null_list);
+	__vertices.clear();
+	__predecessors.clear();
+	__successors.clear();
+	p_compact_form.reset();
 }
 
 template< class T, template < class X > class PtrTraitsT >
-const typename Graph< T, PtrTraitsT >::CessorListType& Graph< T, PtrTraitsT >::getSuccessorsFromPointer(PtrT vertexPtr) const
+auto Graph< T, PtrTraitsT >::p_get_view(const vector< PtrT >* list) -> CessorListType
 {
-	auto it = __successors.find(vertexPtr);
-	return (it != __successors.end() ? it->second : __null_list);
+	if (!list)
+	{
+		return CessorListType();
+	}
+	return CessorListType(list->data(), list->data() + list->size());
 }
 
-template< class T >
-void __dfs_visit(const Graph< T >& graph, const T* vertexPtr,
-		set< const T* >& seen, vector< const T* >& output)
+template< class T, template < class X > class PtrTraitsT >
+auto Graph< T, PtrTraitsT >::p_get_view(const CompactLists& lists, uint32_t index) -> CessorListType
+{
+	auto data = lists.vertexPtrs.data();
+	return CessorListType(data + lists.offsets[index], data + lists.offsets[index+1]);
+}
+
+template< class T, template < class X > class PtrTraitsT >
+uint32_t Graph< T, PtrTraitsT >::p_get_index(const CompactForm& compactForm, PtrT vertexPtr)
+{
+	auto indexPtr = compactForm.vertexIndexes.find(vertexPtr);
+	return (indexPtr ? *indexPtr : 0);
+}
+
+template< class T, template < class X > class PtrTraitsT >
+auto Graph< T, PtrTraitsT >::getPredecessorsFromPointer(PtrT vertexPtr) const -> CessorListType
+{
+	if (p_compact_form)
+	{
+		return p_get_view(p_compact_form->predecessors, p_get_index(*p_compact_form, vertexPtr));
+	}
+	return p_get_view(__predecessors.find(vertexPtr));
+}
+
+template< class T, template < class X > class PtrTraitsT >
+auto Graph< T, PtrTraitsT >::getSuccessorsFromPointer(PtrT vertexPtr) const -> CessorListType
+{
+	if (p_compact_form)
+	{
+		return p_get_view(p_compact_form->successors, p_get_index(*p_compact_form, vertexPtr));
+	}
+	return p_get_view(__successors.find(vertexPtr));
+}
+
+template< class T, template < class X > class PtrTraitsT >
+void Graph< T, PtrTraitsT >::p_compact_lists(const CompactForm& compactForm,
+		const VertexMap< vector< PtrT > >& lists, CompactLists& result) const
+{
+	auto vertexCount = compactForm.vertexPtrs.size();
+	result.offsets.reserve(vertexCount + 1);
+	result.offsets.push_back(0);
+	result.offsets.push_back(0); // the empty row
+	for (size_t index = 1; index < vertexCount; ++index)
+	{
+		auto listPtr = lists.find(compactForm.vertexPtrs[index]);
+		if (listPtr)
+		{
+			for (auto vertexPtr: *listPtr)
+			{
+				result.vertexPtrs.push_back(vertexPtr);
+				result.vertexIndexes.push_back(p_get_index(compactForm, vertexPtr));
+			}
+		}
+		result.offsets.push_back(result.vertexPtrs.size());
+	}
+}
+
+template< class T, template < class X > class PtrTraitsT >
+auto Graph< T, PtrTraitsT >::p_get_compact_form() const -> shared_ptr< const CompactForm >
 {
-	seen.insert(vertexPtr);
+	if (p_compact_form)
+	{
+		return p_compact_form;
+	}
 
-	const typename Graph< T >::CessorListType& successors = graph.getSuccessorsFromPointer(vertexPtr);
-	FORIT(toVertexIt, successors)
+	auto result = std::make_shared< CompactForm >();
+	result->vertexPtrs.reserve(__vertices.size() + 1);
+	result->vertexPtrs.push_back(PtrT());
+	FORIT(vertexIt, __vertices)
 	{
-		if (!seen.count(*toVertexIt))
+		auto vertexPtr = PtrTraitsT< T >::toPointer(*vertexIt);
+		result->vertexIndexes[vertexPtr] = result->vertexPtrs.size();
+		result->vertexPtrs.push_back(vertexPtr);
+	}
+	p_compact_lists(*result, __predecessors, result->predecessors);
+	p_compact_lists(*result, __successors, result->successors);
+
+	return result;
+}
+
+template< class T, template < class X > class PtrTraitsT >
+void Graph< T, PtrTraitsT >::freeze()
+{
+	if (!p_compact_form)
+	{
+		p_compact_form = p_get_compact_form();
+		__predecessors.clear();
+		__successors.clear();
+	}
+}
+
+template< class T, template < class X > class PtrTraitsT >
+void Graph< T, PtrTraitsT >::unfreeze()
+{
+	if (!p_compact_form)
+	{
+		return;
+	}
+	const auto& compactForm = *p_compact_form;
+	for (size_t index = 1; index < compactForm.vertexPtrs.size(); ++index)
+	{
+		auto vertexPtr = compactForm.vertexPtrs[index];
+		auto predecessors = p_get_view(compactForm.predecessors, index);
+		if (!predecessors.empty())
 		{
-			__dfs_visit(graph, *toVertexIt, seen, output);
+			__predecessors[vertexPtr].assign(predecessors.begin(), predecessors.end());
+		}
+		auto successors = p_get_view(compactForm.successors, index);
+		if (!successors.empty())
+		{
+			__successors[vertexPtr].assign(successors.begin(), successors.end());
 		}
 	}
+	p_compact_form.reset();
+}
 
-	output.push_back(vertexPtr);
+template< class T, template < class X > class PtrTraitsT >
+bool Graph< T, PtrTraitsT >::isFrozen() const
+{
+	return (bool)p_compact_form;
 }
 
-template < class T >
-vector< const T* > __dfs_mode1(const Graph< T >& graph)
+// the vertex numbers reachable from 'rows' row 'start' which were not seen
+// yet, in post-order
+inline void __dfs_visit(const vector< uint32_t >& offsets, const vector< uint32_t >& rows,
+		uint32_t start, vector< bool >& seen, vector< uint32_t >& output)
 {
-	vector< const T* > vertices;
+	// vertex number and the position of its next edge
+	vector< pair< uint32_t, uint32_t > > stack = { { start, offsets[start] } };
+	seen[start] = true;
 
-	FORIT(it, graph.getVertices())
+	while (!stack.empty())
 	{
-		vertices.push_back(&*it);
+		auto vertex = stack.back().first;
+		auto& position = stack.back().second;
+		if (position == offsets[vertex+1])
+		{
+			output.push_back(vertex);
+			stack.pop_back();
+			continue;
+		}
+		auto toVertex = rows[position++];
+		if (!seen[toVertex])
+		{
+			seen[toVertex] = true;
+			stack.push_back({ toVertex, offsets[toVertex] });
+		}
 	}
+}
 
-	set< const T* > seen;
-	vector< const T* > result;
+inline vector< uint32_t > __dfs_mode1(const vector< uint32_t >& offsets, const vector< uint32_t >& rows)
+{
+	auto vertexCount = offsets.size() - 1;
+	vector< bool > seen(vertexCount);
+	vector< uint32_t > result;
 
-	FORIT(vertexIt, vertices)
+	for (uint32_t vertex = 1; vertex < vertexCount; ++vertex)
 	{
-		if (!seen.count(*vertexIt))
+		if (!seen[vertex])
 		{
-			__dfs_visit(graph, *vertexIt, seen, result);
+			__dfs_visit(offsets, rows, vertex, seen, result);
 		}
 	}
 
 	return result;
 }
 
-template < class T >
-vector< vector< const T* > > __dfs_mode2(const Graph< T >& graph, const vector< const T* >& vertices)
+inline vector< vector< uint32_t > > __dfs_mode2(const vector< uint32_t >& offsets,
+		const vector< uint32_t >& rows, const vector< uint32_t >& vertices)
 {
-	set< const T* > seen;
-	vector< const T* > stronglyConnectedComponent;
+	vector< bool > seen(offsets.size() - 1);
+	vector< uint32_t > stronglyConnectedComponent;
 
-	vector< vector< const T* > > result; // topologically sorted vertices
+	vector< vector< uint32_t > > result; // topologically sorted vertices
 
 	FORIT(vertexIt, vertices)
 	{
-		if (!seen.count(*vertexIt))
+		if (!seen[*vertexIt])
 		{
-			__dfs_visit(graph, *vertexIt, seen, stronglyConnectedComponent);
+			__dfs_visit(offsets, rows, *vertexIt, seen, stronglyConnectedComponent);
 			result.push_back(std::move(stronglyConnectedComponent));
 			stronglyConnectedComponent.clear();
 		}
@@ -278,95 +534,100 @@ vector< vector< const T* > > __dfs_mode2(const Graph< T >& graph, const vector<
 	return result;
 }
 
-template < class T >
-Graph< vector< T > > __make_scc_graph(const Graph< T >& graph,
-		const vector< vector< const T* > >& scc)
+template < class T, class PtrT, class PriorityLess, class OutputIterator >
+void __topological_sort_with_priorities(const vector< vector< uint32_t > >& scc,
+		const vector< PtrT >& vertexPtrs, const vector< uint32_t >& offsets,
+		const vector< uint32_t >& rows,
+		std::function< void (const vector< T >&, bool) > callback,
+		OutputIterator outputIterator)
 {
-	Graph< vector< T > > result;
-
-	// indexing original vertices
-	map< const T*, const vector< T >* > vertexToComponent;
-	vector< const vector< T >* > sccVertexPtrs;
+	// components, ordered as they were vertices of a graph
+	set< vector< T > > components;
+	vector< const vector< T >* > componentPtrs;
+	vector< uint32_t > vertexComponents(vertexPtrs.size());
+	for (uint32_t componentIndex = 0; componentIndex < scc.size(); ++componentIndex)
 	{
-		FORIT(sccIt, scc)
+		// converting from vertex numbers to T
+		vector< T > component;
+		FORIT(vertexIt, scc[componentIndex])
 		{
-			// converting from (const T*) to T
-			vector< T > component;
-			FORIT(it, *sccIt)
-			{
-				component.push_back(**it);
-			}
-
-			auto componentPtr = result.addVertex(component);
-
-			FORIT(it, *sccIt)
-			{
-				vertexToComponent[*it] = componentPtr;
-			}
+			component.push_back(*vertexPtrs[*vertexIt]);
+			vertexComponents[*vertexIt] = componentIndex;
 		}
+		componentPtrs.push_back(&*components.insert(std::move(component)).first);
 	}
 
-	{ // go check all edges for cross-component ones
-		FORIT(vertexIt, graph.getVertices())
+	// cross-component edges, in the order of vertices and their successors
+	vector< vector< uint32_t > > componentSuccessors(scc.size());
+	vector< size_t > predecessorCounts(scc.size());
+	{
+		unordered_set< uint64_t > seenEdges;
+		for (uint32_t vertex = 1; vertex < vertexPtrs.size(); ++vertex)
 		{
-			const T* vertexPtr = &*vertexIt;
-			auto fromComponentPtr = vertexToComponent[vertexPtr];
-
-			const typename Graph< T >::CessorListType& successors = graph.getSuccessorsFromPointer(vertexPtr);
-			FORIT(successorPtrIt, successors)
+			auto fromComponent = vertexComponents[vertex];
+			for (auto position = offsets[vertex]; position != offsets[vertex+1]; ++position)
 			{
-				auto toComponentPtr = vertexToComponent[*successorPtrIt];
-				if (fromComponentPtr != toComponentPtr)
+				auto toComponent = vertexComponents[rows[position]];
+				if (fromComponent != toComponent &&
+						seenEdges.insert((uint64_t(fromComponent) << 32) | toComponent).second)
 				{
-					result.addEdgeFromPointers(fromComponentPtr, toComponentPtr); // cross-component edge
+					componentSuccessors[fromComponent].push_back(toComponent);
+					++predecessorCounts[toComponent];
 				}
 			}
 		}
 	}
 
-	return result;
-}
-
-template < class T, class PriorityLess, class OutputIterator >
-void __topological_sort_with_priorities(Graph< vector< T > >&& graph,
-		std::function< void (const vector< T >&, bool) > callback,
-		OutputIterator outputIterator)
-{
-	priority_queue< const vector< T >*, vector< const vector< T >* >, PriorityLess > haveNoPredecessors;
+	struct ComponentLess
+	{
+		const vector< const vector< T >* >& componentPtrs;
+		mutable PriorityLess priorityLess;
 
-	FORIT(vertexIt, graph.getVertices())
+		bool operator()(uint32_t left, uint32_t right) const
+		{
+			return priorityLess(componentPtrs[left], componentPtrs[right]);
+		}
+	};
+	priority_queue< uint32_t, vector< uint32_t >, ComponentLess > haveNoPredecessors(
+			ComponentLess{ componentPtrs, PriorityLess() });
+
+	vector< uint32_t > componentOrder(scc.size());
+	std::iota(componentOrder.begin(), componentOrder.end(), 0);
+	std::sort(componentOrder.begin(), componentOrder.end(),
+			[&componentPtrs](uint32_t left, uint32_t right)
+			{
+				return *componentPtrs[left] < *componentPtrs[right];
+			});
+	FORIT(componentIt, componentOrder)
 	{
-		auto vertexPtr = &*vertexIt;
-		if (graph.getPredecessorsFromPointer(vertexPtr).empty())
+		if (!predecessorCounts[*componentIt])
 		{
-			haveNoPredecessors.push(vertexPtr);
-			callback(*vertexPtr, false);
+			haveNoPredecessors.push(*componentIt);
+			callback(*componentPtrs[*componentIt], false);
 		}
 	}
 
+	size_t sortedCount = 0;
 	while (!haveNoPredecessors.empty())
 	{
-		auto vertexPtr = haveNoPredecessors.top();
+		auto component = haveNoPredecessors.top();
 		haveNoPredecessors.pop();
 
-		*outputIterator = *vertexPtr;
+		*outputIterator = *componentPtrs[component];
 		++outputIterator;
-		callback(*vertexPtr, true);
+		callback(*componentPtrs[component], true);
+		++sortedCount;
 
-		const typename Graph< vector< T > >::CessorListType successors =
-				graph.getSuccessorsFromPointer(vertexPtr); // list copy, yes
-		graph.deleteVertex(*vertexPtr);
-		FORIT(successorIt, successors)
+		FORIT(successorIt, componentSuccessors[component])
 		{
-			if (graph.getPredecessorsFromPointer(*successorIt).empty())
+			if (!--predecessorCounts[*successorIt])
 			{
 				haveNoPredecessors.push(*successorIt);
-				callback(**successorIt, false);
+				callback(*componentPtrs[*successorIt], false);
 			}
 		}
-
 	}
-	if (!graph.getVertices().empty())
+	if (sortedCount != scc.size())
 	{
 		fatal2("internal error: topologic sort of strongly connected components: cycle detected");
 	}
@@ -378,24 +639,23 @@ void Graph< T, PtrTraitsT >::topologicalSortOfStronglyConnectedComponents(
 		std::function< void (const vector< T >&, bool) > callback,
 		OutputIterator outputIterator) const
 {
-	auto vertices = __dfs_mode1(*this);
+	auto compactForm = p_get_compact_form();
+	const auto& successors = compactForm->successors;
+	const auto& predecessors = compactForm->predecessors;
 
-	// transposing the graph temporarily
-	__successors.swap(__predecessors);
+	auto vertices = __dfs_mode1(successors.offsets, successors.vertexIndexes);
 
 	std::reverse(vertices.begin(), vertices.end());
 
-	auto scc = __dfs_mode2(*this, vertices);
-
-	// transposing it to original state
-	__successors.swap(__predecessors);
+	// going through the transposed graph
+	auto scc = __dfs_mode2(predecessors.offsets, predecessors.vertexIndexes, vertices);
 
 	// now, it would be easy to return the result from __dfs_mode2, since it
 	// returns the strongly connected components in topological order already,
 	// but we want to take vertex priorities in the account so we need a
 	// strongly connected graph for it
-	__topological_sort_with_priorities< T, PriorityLess >(
-			__make_scc_graph(*this, scc), callback, outputIterator);
+	__topological_sort_with_priorities< T, PtrT, PriorityLess >(scc, compactForm->vertexPtrs,
+			successors.offsets, successors.vertexIndexes, callback, outputIterator);
 }
 
 template < class T, template < class X > class PtrTraitsT >
@@ -406,11 +666,45 @@ auto Graph< T, PtrTraitsT >::getReachableFrom(const T& from) const -> unordered_
 	{
 		return unordered_set< PtrT >();
 	}
+	auto fromPtr = PtrTraitsT< T >::toPointer(*it);
+
+	if (p_compact_form)
+	{
+		const auto& compactForm = *p_compact_form;
+		const auto& successors = compactForm.successors;
+
+		vector< bool > seen(compactForm.vertexPtrs.size());
+		auto fromIndex = p_get_index(compactForm, fromPtr);
+		vector< uint32_t > currentVertices = { fromIndex };
+		seen[fromIndex] = true;
+
+		unordered_set< PtrT > result = { fromPtr };
+
+		while (!currentVertices.empty())
+		{
+			auto vertex = currentVertices.back();
+			currentVertices.pop_back();
+
+			for (auto position = successors.offsets[vertex];
+					position != successors.offsets[vertex+1]; ++position)
+			{
+				auto successor = successors.vertexIndexes[position];
+				if (!seen[successor])
+				{
+					seen[successor] = true;
+					result.insert(compactForm.vertexPtrs[successor]);
+					currentVertices.push_back(successor); // non-seen yet vertex
+				}
+			}
+		}
+
+		return result;
+	}
 
 	queue< PtrT > currentVertices;
-	currentVertices.push(&*it);
+	currentVertices.push(fromPtr);
 
-	unordered_set< PtrT > result = { &*it };
+	unordered_set< PtrT > result = { fromPtr };
 
 	while (!currentVertices.empty())
 	{
@@ -20,10 +20,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
 #include <cupt/file.hpp>
 
 #include <internal/filesystem.hpp>
 #include <internal/tagparser.hpp>
+#include <internal/parse.hpp>
 
 #include <internal/indexofindex.hpp>
 
@@ -43,7 +48,7 @@ time_t getModifyTime(const string& path)
 
 void parsePackagesSourcesFullIndex(const string& path, const ps::Callbacks& callbacks, const Record& record)
 {
-	RequiredFile file(path, "r");
+	RequiredFile file(path, "rm");
 
 	uint32_t offset = 0;
 
@@ -88,7 +93,7 @@ void parsePackagesSourcesFullIndex(const string& path, const ps::Callbacks& call
 
 void parseTranslationFullIndex(const string& path, const tr::Callbacks& callbacks, const Record& record)
 {
-	RequiredFile file(path, "r");
+	RequiredFile file(path, "rm");
 
 	TagParser parser(&file);
 	TagParser::StringRange tagName, tagValue;
@@ -172,7 +177,7 @@ template< typename Callbacks, typename AdditionalLinesParser >
 void templatedParseIndexOfIndex(const string& path, const Callbacks& callbacks, const Record& record,
 		const AdditionalLinesParser& additionalLinesParser)
 {
-	RequiredFile file(path, "r");
+	RequiredFile file(path, "rm");
 
 	uint32_t absoluteOffset = 0;
 
@@ -230,67 +235,295 @@ void parseTranslationIndexOfIndex(const string& path, const tr::Callbacks& callb
 	templatedParseIndexOfIndex(path, callbacks, record, additionalLinesParser);
 }
 
-static const string indexPathSuffix = ".index" "0";
+// binary index of index, version 1:
+//  - header;
+//  - name table: offsets (uint32_t, one more than names) of names in the name blob;
+//  - name blob;
+//  - records: varint offset relative to the previous record, varint name id,
+//    and for Packages/Sources lists varint count of provided names followed by
+//    their varint name ids
+// all numbers are in the native byte order, the file is not portable
+namespace binary {
+
+const char magic[8] = "cuptioi";
+const uint32_t version = 1;
 
-void putUint2Hex(File& file, uint32_t value)
+struct Header
 {
-	char buf[sizeof(value)*2 + 1];
+	char magic[8];
+	uint32_t version;
+	uint32_t kind; // 'p' or 't'
+	uint32_t recordCount;
+	uint32_t nameCount;
+	uint32_t namesOffset;
+	uint32_t recordsOffset;
+	uint32_t totalSize;
+};
 
-	file.put(buf, sprintf(buf, "%x", value));
+uint32_t getUint32(const char* data)
+{
+	uint32_t result;
+	memcpy(&result, data, sizeof(result));
+	return result;
 }
 
-struct MainCallback
+class Cursor
 {
-	string indexString;
-	uint32_t previousOffset;
-	uint32_t offset;
-	bool isFirstRecord;
+	const char* p_current;
+	const char* p_end;
+ public:
+	Cursor(const char* begin, const char* end)
+		: p_current(begin), p_end(end)
+	{}
+	uint32_t getVarint()
+	{
+		uint32_t result = 0;
+		for (size_t shift = 0; shift < 32; shift += 7)
+		{
+			if (p_current == p_end)
+			{
+				fatal2i("ioi: binary: unexpected end of records");
+			}
+			uint8_t byte = *(p_current++);
+			result |= uint32_t(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+			{
+				return result;
+			}
+		}
+		fatal2i("ioi: binary: too long number");
+		return 0; // unreachable
+	}
+};
 
-	MainCallback()
-		: previousOffset(0)
-		, isFirstRecord(true)
+class NameTable
+{
+	const char* p_offsets;
+	const char* p_blob;
+	uint32_t p_blobSize;
+	uint32_t p_count;
+ public:
+	NameTable(const char* offsets, const char* blob, uint32_t blobSize, uint32_t count)
+		: p_offsets(offsets), p_blob(blob), p_blobSize(blobSize), p_count(count)
 	{}
+	pair< const char*, const char* > get(uint32_t id) const
+	{
+		if (id >= p_count)
+		{
+			fatal2i("ioi: binary: name id %u is out of range", id);
+		}
+		auto offset = p_offsets + id*sizeof(uint32_t);
+		auto begin = getUint32(offset);
+		auto end = getUint32(offset + sizeof(uint32_t));
+		if (begin > end || end > p_blobSize)
+		{
+			fatal2i("ioi: binary: name %u is out of range", id);
+		}
+		return { p_blob + begin, p_blob + end };
+	}
+};
+
+template< typename Callbacks, typename AdditionalFieldsParser >
+void templatedParse(const string& path, char kind, const Callbacks& callbacks, const Record& record,
+		const AdditionalFieldsParser& additionalFieldsParser)
+{
+	RequiredFile file(path, "rm");
+	auto data = file.getBlock(fs::fileSize(path));
+
+	Header header;
+	if (data.size < sizeof(header))
+	{
+		fatal2i("ioi: binary: too small file");
+	}
+	memcpy(&header, data.data, sizeof(header));
+	if (memcmp(header.magic, magic, sizeof(magic)) || header.version != version ||
+			header.kind != uint32_t(kind) || header.totalSize != data.size ||
+			header.namesOffset > header.recordsOffset || header.recordsOffset > data.size ||
+			sizeof(header) + (uint64_t(header.nameCount) + 1)*sizeof(uint32_t) > header.namesOffset)
+	{
+		fatal2i("ioi: binary: invalid header");
+	}
+
+	NameTable names(data.data + sizeof(header), data.data + header.namesOffset,
+			header.recordsOffset - header.namesOffset, header.nameCount);
+	Cursor cursor(data.data + header.recordsOffset, data.data + data.size);
 
-	void perform(File& file)
+	uint32_t absoluteOffset = 0;
+	for (uint32_t i = 0; i < header.recordCount; ++i)
 	{
-		if (!isFirstRecord) file.put("\n");
-		isFirstRecord = false;
+		absoluteOffset += cursor.getVarint();
+		*record.offsetPtr = absoluteOffset;
+		auto name = names.get(cursor.getVarint());
+		record.indexStringPtr->assign(name.first, name.second);
+		callbacks.main();
+
+		additionalFieldsParser(cursor, names);
+	}
+}
 
-		auto relativeOffset = offset - previousOffset;
-		putUint2Hex(file, relativeOffset);
-		file.put("\0", 1);
-		file.put(indexString);
-		file.put("\n");
+void putVarint(string* output, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*output += char((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	*output += char(value);
+}
 
-		previousOffset = offset;
+class Writer
+{
+	const char p_kind;
+	std::unordered_map< string, uint32_t > p_nameIds;
+	vector< const string* > p_names;
+	string p_records;
+	uint32_t p_recordCount;
+	uint32_t p_previousOffset;
+	vector< uint32_t > p_providedNameIds;
+
+	uint32_t p_getNameId(const char* begin, const char* end)
+	{
+		auto insertResult = p_nameIds.insert({ string(begin, end), p_names.size() });
+		if (insertResult.second)
+		{
+			p_names.push_back(&insertResult.first->first);
+		}
+		return insertResult.first->second;
+	}
+	void p_finishRecord()
+	{
+		if (p_recordCount && p_kind == field::provides)
+		{
+			putVarint(&p_records, p_providedNameIds.size());
+			for (auto id: p_providedNameIds)
+			{
+				putVarint(&p_records, id);
+			}
+		}
+		p_providedNameIds.clear();
+	}
+ public:
+	Writer(char kind)
+		: p_kind(kind), p_recordCount(0), p_previousOffset(0)
+	{}
+	void putRecord(uint32_t offset, const string& name)
+	{
+		p_finishRecord();
+		++p_recordCount;
+		putVarint(&p_records, offset - p_previousOffset);
+		p_previousOffset = offset;
+		putVarint(&p_records, p_getNameId(name.data(), name.data() + name.size()));
+	}
+	void putProvidedName(const char* begin, const char* end)
+	{
+		auto id = p_getNameId(begin, end);
+		if (std::find(p_providedNameIds.begin(), p_providedNameIds.end(), id) == p_providedNameIds.end())
+		{
+			p_providedNameIds.push_back(id);
+		}
+	}
+	void write(File& file)
+	{
+		p_finishRecord();
+
+		Header header;
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.kind = p_kind;
+		header.recordCount = p_recordCount;
+		header.nameCount = p_names.size();
+		header.namesOffset = sizeof(header) + (p_names.size() + 1)*sizeof(uint32_t);
+
+		string nameOffsets;
+		string nameBlob;
+		auto putNameOffset = [&nameOffsets, &nameBlob]()
+		{
+			uint32_t offset = nameBlob.size();
+			nameOffsets.append(reinterpret_cast< const char* >(&offset), sizeof(offset));
+		};
+		for (auto name: p_names)
+		{
+			putNameOffset();
+			nameBlob += *name;
+		}
+		putNameOffset();
+
+		header.recordsOffset = header.namesOffset + nameBlob.size();
+		header.totalSize = header.recordsOffset + p_records.size();
+
+		file.put(reinterpret_cast< const char* >(&header), sizeof(header));
+		file.put(nameOffsets);
+		file.put(nameBlob);
+		file.put(p_records);
 	}
 };
 
+}
+
+void parsePackagesSourcesBinaryIndexOfIndex(const string& path, const ps::Callbacks& callbacks, const Record& record)
+{
+	auto additionalFieldsParser = [&callbacks](binary::Cursor& cursor, const binary::NameTable& names)
+	{
+		auto providesCount = cursor.getVarint();
+		for (uint32_t i = 0; i < providesCount; ++i)
+		{
+			auto name = names.get(cursor.getVarint());
+			callbacks.provides(name.first, name.second);
+		}
+	};
+	binary::templatedParse(path, field::provides, callbacks, record, additionalFieldsParser);
+}
+
+void parseTranslationBinaryIndexOfIndex(const string& path, const tr::Callbacks& callbacks, const Record& record)
+{
+	auto additionalFieldsParser = [](binary::Cursor&, const binary::NameTable&) {};
+	binary::templatedParse(path, 't', callbacks, record, additionalFieldsParser);
+}
+
+static const string legacyIndexPathSuffix = ".index" "0";
+static const string indexPathSuffix = ".index" "1";
+
 template < typename CallbacksPreFiller, typename FullIndexParser >
-void templatedGenerate(const string& indexPath, const string& temporaryPath,
+void templatedGenerate(const string& indexPath, const string& temporaryPath, char kind,
 		const CallbacksPreFiller& callbacksPreFiller, FullIndexParser fullIndexParser)
 {
-	RequiredFile file(temporaryPath, "w");
-
-	auto callbacks = callbacksPreFiller(file);
-	MainCallback mainCallback;
-	callbacks.main = std::bind(&MainCallback::perform, std::ref(mainCallback), std::ref(file));
+	binary::Writer writer(kind);
 
-	fullIndexParser(indexPath, callbacks,
-			{ &mainCallback.offset, &mainCallback.indexString });
+	uint32_t offset;
+	string indexString;
+	auto callbacks = callbacksPreFiller(writer);
+	callbacks.main = [&writer, &offset, &indexString]()
+	{
+		writer.putRecord(offset, indexString);
+	};
+	fullIndexParser(indexPath, callbacks, { &offset, &indexString });
 
+	{
+		RequiredFile file(temporaryPath, "w");
+		writer.write(file);
+	}
 	fs::move(temporaryPath, getIndexOfIndexPath(indexPath));
 }
 
+bool isFreshIndexOfIndex(const string& ioiPath, const string& path)
+{
+	return fs::fileExists(ioiPath) && (getModifyTime(ioiPath) >= getModifyTime(path));
+}
+
 template< typename Callbacks, typename Parser >
 void templatedProcessIndex(const string& path, const Callbacks& callbacks, const Record& record,
-		Parser fullParser, Parser ioiParser)
+		Parser fullParser, Parser ioiParser, Parser legacyIoiParser)
 {
 	auto ioiPath = getIndexOfIndexPath(path);
-	if (fs::fileExists(ioiPath) && (getModifyTime(ioiPath) >= getModifyTime(path)))
+	auto legacyIoiPath = path + legacyIndexPathSuffix;
+	if (isFreshIndexOfIndex(ioiPath, path))
 	{
 		ioiParser(ioiPath, callbacks, record);
 	}
+	else if (isFreshIndexOfIndex(legacyIoiPath, path))
+	{
+		legacyIoiParser(legacyIoiPath, callbacks, record);
+	}
 	else
 	{
 		fullParser(path, callbacks, record);
@@ -306,12 +539,14 @@ string getIndexOfIndexPath(const string& path)
 
 void removeIndexOfIndex(const string& path)
 {
-	auto ioiPath = getIndexOfIndexPath(path);
-	if (fs::fileExists(ioiPath))
+	for (const string& ioiPath: { getIndexOfIndexPath(path), path + legacyIndexPathSuffix })
 	{
-		if (unlink(ioiPath.c_str()) == -1)
+		if (fs::fileExists(ioiPath))
 		{
-			fatal2e("unable to remove the file '%s'", ioiPath);
+			if (unlink(ioiPath.c_str()) == -1)
+			{
+				fatal2e("unable to remove the file '%s'", ioiPath);
+			}
 		}
 	}
 }
@@ -320,25 +555,28 @@ namespace ps {
 
 void processIndex(const string& path, const Callbacks& callbacks, const Record& record)
 {
-	templatedProcessIndex(path, callbacks, record,
-			parsePackagesSourcesFullIndex, parsePackagesSourcesIndexOfIndex);
+	templatedProcessIndex(path, callbacks, record, parsePackagesSourcesFullIndex,
+			parsePackagesSourcesBinaryIndexOfIndex, parsePackagesSourcesIndexOfIndex);
 }
 
 void generate(const string& indexPath, const string& temporaryPath)
 {
-	auto callbacksPreFiller = [](File& file)
+	auto callbacksPreFiller = [](binary::Writer& writer)
 	{
 		Callbacks callbacks;
 		callbacks.provides =
-				[&file](const char* begin, const char* end)
+				[&writer](const char* begin, const char* end)
 				{
-					file.put(&field::provides, 1);
-					file.put(begin, end - begin);
-					file.put("\n");
+					auto callback = [&writer](const char* nameBegin, const char* nameEnd)
+					{
+						writer.putProvidedName(nameBegin, nameEnd);
+					};
+					parse::processSpaceCharSpaceDelimitedStrings(begin, end, ',', callback);
 				};
 		return callbacks;
 	};
-	templatedGenerate(indexPath, temporaryPath, callbacksPreFiller, parsePackagesSourcesFullIndex);
+	templatedGenerate(indexPath, temporaryPath, field::provides,
+			callbacksPreFiller, parsePackagesSourcesFullIndex);
 }
 
 }
@@ -347,14 +585,14 @@ namespace tr {
 
 void processIndex(const string& path, const Callbacks& callbacks, const Record& record)
 {
-	templatedProcessIndex(path, callbacks, record,
-			parseTranslationFullIndex, parseTranslationIndexOfIndex);
+	templatedProcessIndex(path, callbacks, record, parseTranslationFullIndex,
+			parseTranslationBinaryIndexOfIndex, parseTranslationIndexOfIndex);
 }
 
 void generate(const string& indexPath, const string& temporaryPath)
 {
-	auto callbacksPreFiller = [](File&) { return Callbacks(); };
-	templatedGenerate(indexPath, temporaryPath, callbacksPreFiller, parseTranslationFullIndex);
+	auto callbacksPreFiller = [](binary::Writer&) { return Callbacks(); };
+	templatedGenerate(indexPath, temporaryPath, 't', callbacksPreFiller, parseTranslationFullIndex);
 }
 
 }
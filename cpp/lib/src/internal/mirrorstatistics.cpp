@@ -0,0 +1,231 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <ctime>
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+using boost::lexical_cast;
+
+#include <cupt/config.hpp>
+#include <cupt/file.hpp>
+#include <cupt/download/uri.hpp>
+
+#include <internal/common.hpp>
+#include <internal/mirrorstatistics.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+const double smoothingFactor = 0.3; // the weight of a new measurement
+const time_t maxRecordAge = 24*60*60; // the load of the servers changes over the day
+const size_t minThroughputSampleSize = 16*1024; // smaller downloads are mostly the latency
+const double failurePenalty = 120; // a failed try costs about a network timeout
+const double maxFailureRate = 0.95;
+const size_t explorationPeriod = 10; // one file in that many tries unmeasured servers first
+
+}
+
+MirrorStatistics::MirrorStatistics(const Config& config)
+	: p_path(config.getPath("cupt::directory::state::mirror-statistics")),
+	p_debugging(config.getBool("debug::downloader")), p_changed(false), p_fileCount(0)
+{
+	string openError;
+	File file(p_path, "r", openError);
+	if (!openError.empty())
+	{
+		return; // nothing is measured yet
+	}
+
+	auto now = time(NULL);
+	string line;
+	while (!file.getLine(line).eof())
+	{
+		auto fields = split(' ', line);
+		if (fields.size() != 4 && fields.size() != 5)
+		{
+			continue;
+		}
+		try
+		{
+			Record record;
+			record.latency = lexical_cast< double >(fields[1]);
+			record.throughput = lexical_cast< double >(fields[2]);
+			record.updateTime = lexical_cast< time_t >(fields[3]);
+			record.failureRate = (fields.size() == 5) ? lexical_cast< double >(fields[4]) : 0;
+			if (now - record.updateTime < maxRecordAge)
+			{
+				p_records[fields[0]] = record;
+			}
+		}
+		catch (boost::bad_lexical_cast&)
+		{} // just a lost measurement
+	}
+}
+
+string MirrorStatistics::p_getServer(const download::Uri& uri)
+{
+	if (uri.getHost().empty())
+	{
+		return string(); // a local file
+	}
+	// unlike the host, includes the port
+	auto server = uri.getOpaque();
+	server.erase(std::min(server.find('/'), server.size()));
+	auto credentialsEndPosition = server.rfind('@');
+	if (credentialsEndPosition != string::npos)
+	{
+		server.erase(0, credentialsEndPosition+1);
+	}
+	return uri.getProtocol() + "://" + server;
+}
+
+double MirrorStatistics::p_getSuccessTime(const Record& record, size_t size)
+{
+	double result = record.latency;
+	if (record.throughput)
+	{
+		result += size / record.throughput;
+	}
+	return result;
+}
+
+double MirrorStatistics::estimateTime(const download::Uri& uri, size_t size, bool exploring) const
+{
+	auto it = p_records.find(p_getServer(uri));
+	const Record* record = (it != p_records.end()) ? &it->second : NULL;
+
+	double result;
+	if (record && record->latency >= 0)
+	{
+		result = p_getSuccessTime(*record, size);
+	}
+	else if (!record && exploring)
+	{
+		return 0;
+	}
+	else
+	{
+		// a bit slower than any measured server
+		result = 0;
+		for (const auto& item: p_records)
+		{
+			if (item.second.latency >= 0)
+			{
+				result = std::max(result, p_getSuccessTime(item.second, size));
+			}
+		}
+		result += 1;
+	}
+
+	if (record && record->failureRate > 0)
+	{
+		// failed tries before a successful one
+		auto failureRate = std::min(record->failureRate, maxFailureRate);
+		result += failureRate / (1 - failureRate) * failurePenalty;
+	}
+	return result;
+}
+
+bool MirrorStatistics::explore()
+{
+	return (++p_fileCount % explorationPeriod == 0);
+}
+
+MirrorStatistics::Record& MirrorStatistics::p_getRecord(const string& server)
+{
+	auto insertResult = p_records.insert({ server, Record{ -1, 0, 0, 0 } });
+	Record& record = insertResult.first->second;
+	record.updateTime = time(NULL);
+	p_changed = true;
+	return record;
+}
+
+void MirrorStatistics::p_debugRecord(const string& server, const Record& record) const
+{
+	if (p_debugging)
+	{
+		debug2("server '%s': latency %.3f s, throughput %.0f B/s, failure rate %.2f",
+				server, record.latency, record.throughput, record.failureRate);
+	}
+}
+
+void MirrorStatistics::add(const download::Uri& uri, size_t size, double latency, double duration)
+{
+	auto server = p_getServer(uri);
+	if (server.empty())
+	{
+		return;
+	}
+	double throughput = (size >= minThroughputSampleSize && duration > 0) ? size / duration : 0;
+
+	Record& record = p_getRecord(server);
+	if (record.latency < 0)
+	{
+		record.latency = latency;
+	}
+	else
+	{
+		record.latency += smoothingFactor * (latency - record.latency);
+	}
+	if (!record.throughput)
+	{
+		record.throughput = throughput;
+	}
+	else if (throughput)
+	{
+		record.throughput += smoothingFactor * (throughput - record.throughput);
+	}
+	record.failureRate -= smoothingFactor * record.failureRate;
+
+	p_debugRecord(server, record);
+}
+
+void MirrorStatistics::addFailure(const download::Uri& uri)
+{
+	auto server = p_getServer(uri);
+	if (server.empty())
+	{
+		return;
+	}
+	Record& record = p_getRecord(server);
+	record.failureRate += smoothingFactor * (1 - record.failureRate);
+
+	p_debugRecord(server, record);
+}
+
+void MirrorStatistics::save() const
+{
+	if (!p_changed)
+	{
+		return;
+	}
+	// not writable is not a problem
+	writeFileAtomically(p_path, [this](File& file)
+	{
+		for (const auto& item: p_records)
+		{
+			file.put(format2("%s %f %f %lld %f\n", item.first, item.second.latency,
+					item.second.throughput, (long long)item.second.updateTime, item.second.failureRate));
+		}
+	});
+}
+
+}
+}
@@ -0,0 +1,65 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_MIRRORSTATISTICS_SEEN
+#define CUPT_INTERNAL_MIRRORSTATISTICS_SEEN
+
+#include <map>
+
+#include <cupt/fwd.hpp>
+
+namespace cupt {
+namespace internal {
+
+// download speeds of servers measured by earlier downloads, kept in a state
+// file between the runs
+class MirrorStatistics
+{
+ public:
+	MirrorStatistics(const Config&);
+	// seconds expected to download 'size' bytes from the server of 'uri';
+	// servers not measured recently come after the measured ones, unless
+	// 'exploring', then they come first
+	double estimateTime(const download::Uri& uri, size_t size, bool exploring) const;
+	// should the servers not measured recently be tried first for the next file?
+	bool explore();
+	void add(const download::Uri& uri, size_t size, double latency, double duration);
+	void addFailure(const download::Uri& uri);
+	void save() const;
+ private:
+	struct Record
+	{
+		double latency; // seconds to the first received byte, negative if nothing succeeded
+		double throughput; // bytes per second, 0 if unknown
+		double failureRate; // smoothed share of the failed downloads
+		time_t updateTime;
+	};
+	string p_path;
+	bool p_debugging;
+	bool p_changed;
+	size_t p_fileCount;
+	std::map< string, Record > p_records; // server -> record
+
+	static string p_getServer(const download::Uri&);
+	static double p_getSuccessTime(const Record&, size_t size);
+	Record& p_getRecord(const string& server);
+	void p_debugRecord(const string& server, const Record&) const;
+};
+}
+}
+
+#endif
@@ -0,0 +1,197 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include <internal/nametable.hpp>
+
+namespace cupt {
+namespace internal {
+namespace nametable {
+
+namespace {
+
+// names are published in blocks which are never moved, so reading a name
+// doesn't need the lock
+const size_t blockBits = 12;
+const size_t blockSize = size_t(1) << blockBits;
+const size_t maxBlockCount = size_t(1) << 12;
+
+// an open-addressing set of ids, keyed by the hash of their names; it is
+// only replaced, never changed in place except filling empty slots, so
+// lookups don't need the lock either
+struct Index
+{
+	size_t mask;
+	std::atomic< Id >* slots; // id+1, 0 for an empty slot
+
+	explicit Index(size_t capacity)
+		: mask(capacity-1), slots(new std::atomic< Id >[capacity])
+	{
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			slots[i].store(0, std::memory_order_relaxed);
+		}
+	}
+	~Index()
+	{
+		delete [] slots;
+	}
+};
+
+struct Table
+{
+	std::mutex mutex;
+	Id count;
+	std::atomic< Index* > index;
+	vector< Index* > oldIndexes; // may still be read by lookups
+	std::atomic< const string** > blocks[maxBlockCount];
+
+	Table()
+		: count(0), index(new Index(blockSize))
+	{
+		for (auto& block: blocks)
+		{
+			block = nullptr;
+		}
+	}
+	~Table()
+	{
+		for (Id id = 0; id < count; ++id)
+		{
+			delete &get(id);
+		}
+		for (auto& block: blocks)
+		{
+			delete [] block.load();
+		}
+		delete index.load();
+		for (auto oldIndex: oldIndexes)
+		{
+			delete oldIndex;
+		}
+	}
+};
+
+Table& getTable()
+{
+	static Table table;
+	return table;
+}
+
+size_t getHash(const string& name)
+{
+	return std::hash< string >()(name);
+}
+
+bool findInIndex(const Index& index, const string& name, size_t hash, Id* id)
+{
+	for (size_t position = hash & index.mask; ; position = (position+1) & index.mask)
+	{
+		auto value = index.slots[position].load(std::memory_order_acquire);
+		if (!value)
+		{
+			return false;
+		}
+		if (get(value-1) == name)
+		{
+			*id = value-1;
+			return true;
+		}
+	}
+}
+
+void putToIndex(Index* index, Id id, size_t hash)
+{
+	auto position = hash & index->mask;
+	while (index->slots[position].load(std::memory_order_relaxed))
+	{
+		position = (position+1) & index->mask;
+	}
+	index->slots[position].store(id+1, std::memory_order_release);
+}
+
+}
+
+bool find(const string& name, Id* id)
+{
+	return findInIndex(*getTable().index.load(std::memory_order_acquire), name, getHash(name), id);
+}
+
+Id intern(const string& name)
+{
+	Id result;
+	auto hash = getHash(name);
+	auto& table = getTable();
+	if (findInIndex(*table.index.load(std::memory_order_acquire), name, hash, &result))
+	{
+		return result;
+	}
+
+	std::lock_guard< std::mutex > guard(table.mutex);
+	auto index = table.index.load(std::memory_order_relaxed);
+	if (findInIndex(*index, name, hash, &result))
+	{
+		return result; // interned meanwhile
+	}
+
+	result = table.count;
+	auto blockIndex = result >> blockBits;
+	if (blockIndex >= maxBlockCount)
+	{
+		fatal2i("name table: too many names");
+	}
+	auto block = table.blocks[blockIndex].load();
+	if (!block)
+	{
+		block = new const string*[blockSize];
+		table.blocks[blockIndex] = block;
+	}
+	block[result & (blockSize-1)] = new string(name);
+	++table.count;
+
+	if (table.count * 2 > index->mask + 1)
+	{
+		// keeping the index at most half full
+		auto newIndex = new Index((index->mask + 1) * 2);
+		for (Id id = 0; id < result; ++id)
+		{
+			putToIndex(newIndex, id, getHash(get(id)));
+		}
+		putToIndex(newIndex, result, hash);
+		table.index.store(newIndex, std::memory_order_release);
+		table.oldIndexes.push_back(index);
+	}
+	else
+	{
+		putToIndex(index, result, hash);
+	}
+	return result;
+}
+
+const string& get(Id id)
+{
+	auto block = getTable().blocks[id >> blockBits].load();
+	return *block[id & (blockSize-1)];
+}
+
+}
+}
+}
+
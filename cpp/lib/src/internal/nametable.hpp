@@ -0,0 +1,88 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NAMETABLE_SEEN
+#define CUPT_INTERNAL_NAMETABLE_SEEN
+
+#include <algorithm>
+
+#include <cupt/common.hpp>
+
+namespace cupt {
+namespace internal {
+namespace nametable {
+
+// process-wide table of interned package names; every name gets a dense
+// id which stays valid for the whole life of the process
+
+typedef uint32_t Id;
+
+// thread-safe
+Id intern(const string&);
+// thread-safe and lock-free, doesn't add the name; false if the name was
+// never interned, so no id-keyed container can have it
+bool find(const string&, Id*);
+// thread-safe for ids obtained by the caller
+const string& get(Id);
+
+// an id-keyed replacement for map< string, T > which doesn't hash or compare
+// names on access
+template < typename T >
+class NameIdMap
+{
+	vector< T > p_values;
+	vector< bool > p_present;
+	vector< Id > p_ids;
+ public:
+	T& operator[](Id id)
+	{
+		if (id >= p_values.size())
+		{
+			p_values.resize(id+1);
+			p_present.resize(id+1);
+		}
+		if (!p_present[id])
+		{
+			p_present[id] = true;
+			p_ids.push_back(id);
+		}
+		return p_values[id];
+	}
+	const T* find(Id id) const
+	{
+		return (id < p_present.size() && p_present[id]) ? &p_values[id] : nullptr;
+	}
+	bool count(Id id) const
+	{
+		return find(id);
+	}
+	// present ids in the order of their names, like std::map iterates
+	vector< Id > getIdsSortedByName() const
+	{
+		auto result = p_ids;
+		std::sort(result.begin(), result.end(),
+				[](Id left, Id right) { return get(left) < get(right); });
+		return result;
+	}
+};
+
+}
+}
+}
+
+#endif
+
@@ -19,6 +19,7 @@
 using std::unordered_map;
 #include <list>
 using std::list;
+#include <deque>
 
 #include <cupt/config.hpp>
 #include <cupt/cache.hpp>
@@ -91,8 +92,9 @@ bool BasicVertex::asAuto() const
 	return true; // unreacahble
 }
 
-VersionVertex::VersionVertex(const map< string, forward_list< const Element* > >::iterator& it)
-	: __related_element_ptrs_it(it)
+VersionVertex::VersionVertex(nametable::Id packageNameId,
+		const forward_list< const Element* >* relatedElementPtrs)
+	: __package_name_id(packageNameId), __related_element_ptrs(relatedElementPtrs)
 {}
 
 string VersionVertex::toString() const
@@ -103,12 +105,12 @@ string VersionVertex::toString() const
 
 const forward_list< const Element* >* VersionVertex::getRelatedElements() const
 {
-	return &__related_element_ptrs_it->second;
+	return __related_element_ptrs;
 }
 
 const string& VersionVertex::getPackageName() const
 {
-	return __related_element_ptrs_it->first;
+	return nametable::get(__package_name_id);
 }
 
 string VersionVertex::toLocalizedString() const
@@ -357,17 +359,22 @@ struct UserRelationExpressionVertex: public BasicVertex
 
 bool __is_version_array_intersects_with_packages(
 		const vector< const BinaryVersion* >& versions,
-		const map< string, const BinaryVersion* >& oldPackages)
+		const OldPackages& oldPackages)
 {
 	for (const auto& version: versions)
 	{
-		auto oldPackageIt = oldPackages.find(version->packageName);
-		if (oldPackageIt == oldPackages.end())
+		nametable::Id packageNameId;
+		if (!nametable::find(version->packageName, &packageNameId))
+		{
+			continue; // no package of this name was ever installed
+		}
+		auto oldVersionPtr = oldPackages.find(packageNameId);
+		if (!oldVersionPtr)
 		{
 			continue;
 		}
 
-		if (version == oldPackageIt->second)
+		if (version == *oldVersionPtr)
 		{
 			return true;
 		}
@@ -393,11 +400,11 @@ bool __version_has_relation_expression(const BinaryVersion* version,
 }
 
 bool __is_soft_dependency_ignored(const Config& config,
-		const BinaryVersion* version,
+		nametable::Id packageNameId,
 		BinaryVersion::RelationTypes::Type dependencyType,
 		const RelationExpression& relationExpression,
 		const vector< const BinaryVersion* >& satisfyingVersions,
-		const map< string, const BinaryVersion* >& oldPackages)
+		const OldPackages& oldPackages)
 {
 	auto wasSatisfiedInPast = __is_version_array_intersects_with_packages(
 				satisfyingVersions, oldPackages);
@@ -421,10 +428,10 @@ bool __is_soft_dependency_ignored(const Config& config,
 		}
 	}
 
-	auto oldPackageIt = oldPackages.find(version->packageName);
-	if (oldPackageIt != oldPackages.end())
+	auto oldVersionPtr = oldPackages.find(packageNameId);
+	if (oldVersionPtr)
 	{
-		auto& oldVersion = oldPackageIt->second;
+		auto& oldVersion = *oldVersionPtr;
 		if (__version_has_relation_expression(oldVersion,
 			dependencyType, relationExpression))
 		{
@@ -484,17 +491,48 @@ vector< DependencyEntry > __get_dependency_groups(const Config& config)
 	return result;
 }
 
+// the values of the options which change the filled graph
+string __get_options_key(const Config& config)
+{
+	string result;
+	for (const char* optionName: { "apt::install-recommends", "apt::install-suggests",
+			"cupt::resolver::keep-recommends", "cupt::resolver::keep-suggests",
+			"cupt::resolver::no-remove", "debug::resolver" })
+	{
+		result += config.getBool(optionName) ? '1' : '0';
+	}
+	result += config.getString("cupt::resolver::synchronize-by-source-versions");
+	return result;
+}
+
 DependencyGraph::DependencyGraph(const Config& config, const Cache& cache)
-	: __config(config), __cache(cache)
+	: __config(&config), __cache(cache), p_optionsKey(__get_options_key(config)), p_frozen(false)
 {}
 
 DependencyGraph::~DependencyGraph()
+{
+	p_clear();
+}
+
+void DependencyGraph::p_clear()
 {
 	const set< const Element* >& vertices = this->getVertices();
 	FORIT(elementIt, vertices)
 	{
 		delete *elementIt;
 	}
+	this->clear();
+	__fill_helper.reset();
+}
+
+bool DependencyGraph::reuseWith(const Config& config)
+{
+	if (__get_options_key(config) != p_optionsKey)
+	{
+		return false;
+	}
+	__config = &config;
+	return true;
 }
 
 vector< string > __get_related_binary_package_names(const Cache& cache, const BinaryVersion* version)
@@ -558,14 +596,25 @@ short __get_synchronize_level(const Config& config)
 class DependencyGraph::FillHelper
 {
 	DependencyGraph& __dependency_graph;
-	const map< string, const BinaryVersion* >& __old_packages;
+	const OldPackages* __old_packages;
 	bool __debugging;
 
 	int __synchronize_level;
 	vector< DependencyEntry > __dependency_groups;
 
-	map< string, forward_list< const Element* > > __package_name_to_vertex_ptrs;
-	unordered_map< string, const VersionVertex* > __version_to_vertex_ptr;
+	struct PackageVertices
+	{
+		forward_list< const Element* > relatedElementPtrs;
+		bool emptyVertexIsKnown;
+		const VersionVertex* emptyVertexPtr;
+
+		PackageVertices()
+			: emptyVertexIsKnown(false), emptyVertexPtr(nullptr)
+		{}
+	};
+	// indexed by package name id, deque keeps elements in place when growing
+	std::deque< PackageVertices > __package_vertices;
+	unordered_map< const BinaryVersion*, const VersionVertex* > __version_to_vertex_ptr;
 	unordered_map< string, const Element* > __relation_expression_to_vertex_ptr;
 	unordered_map< string, map< string, const Element* > > __meta_anti_relation_expression_vertices;
 	unordered_map< string, list< pair< string, const Element* > > > __meta_synchronize_map;
@@ -573,45 +622,55 @@ class DependencyGraph::FillHelper
 
 	set< const Element* > __unfolded_elements;
 
-	bool __can_package_be_removed(const string& packageName) const
+	vector< const Element* > p_userRequestElementPtrs;
+	bool p_hasForcedVertices;
+
+	bool __can_package_be_removed(nametable::Id packageNameId) const
+	{
+		return !__dependency_graph.__config->getBool("cupt::resolver::no-remove") ||
+				!__old_packages->count(packageNameId) ||
+				__dependency_graph.__cache.isAutomaticallyInstalled(nametable::get(packageNameId));
+	}
+
+	PackageVertices& getPackageVertices(nametable::Id packageNameId)
 	{
-		return !__dependency_graph.__config.getBool("cupt::resolver::no-remove") ||
-				!__old_packages.count(packageName) ||
-				__dependency_graph.__cache.isAutomaticallyInstalled(packageName);
+		if (packageNameId >= __package_vertices.size())
+		{
+			__package_vertices.resize(packageNameId+1);
+		}
+		return __package_vertices[packageNameId];
 	}
 
  public:
-	FillHelper(DependencyGraph& dependencyGraph,
-			const map< string, const BinaryVersion* >& oldPackages)
+	FillHelper(DependencyGraph& dependencyGraph, const OldPackages& oldPackages)
 		: __dependency_graph(dependencyGraph)
-		, __old_packages(oldPackages)
-		, __debugging(__dependency_graph.__config.getBool("debug::resolver"))
+		, __old_packages(&oldPackages)
+		, __debugging(__dependency_graph.__config->getBool("debug::resolver"))
+		, p_hasForcedVertices(false)
 	{
-		__synchronize_level = __get_synchronize_level(__dependency_graph.__config);
-		__dependency_groups= __get_dependency_groups(__dependency_graph.__config);
+		__synchronize_level = __get_synchronize_level(*__dependency_graph.__config);
+		__dependency_groups= __get_dependency_groups(*__dependency_graph.__config);
 		p_dummyElementPtr = getVertexPtrForEmptyPackage("<user requests>");
 	}
 
-	const VersionVertex* getVertexPtr(const string& packageName, const BinaryVersion* version, bool overrideChecks = false)
+	const VersionVertex* getVertexPtr(nametable::Id packageNameId, const BinaryVersion* version, bool overrideChecks = false)
 	{
-		auto isVertexAllowed = [this, &packageName, &version]() -> bool
+		auto isVertexAllowed = [this, &packageNameId, &version]() -> bool
 		{
-			if (!version && !__can_package_be_removed(packageName))
+			if (!version && !__can_package_be_removed(packageNameId))
 			{
 				return false;
 			}
 
 			if (version)
 			{
-				for (const BasicVertex* bv: __package_name_to_vertex_ptrs[packageName])
+				for (const BasicVertex* bv: getPackageVertices(packageNameId).relatedElementPtrs)
 				{
 					auto existingVersion = (static_cast< const VersionVertex* >(bv))->version;
 					if (!existingVersion) continue;
 					if (versionstring::sameOriginal(version->versionString, existingVersion->versionString))
 					{
-						if (std::equal(version->relations,
-									version->relations + BinaryVersion::RelationTypes::Count,
-									existingVersion->relations))
+						if (version->relations == existingVersion->relations)
 						{
 							return false; // no reasons to allow this version dependency-wise
 						}
@@ -621,33 +680,57 @@ class DependencyGraph::FillHelper
 
 			return true;
 		};
-		auto makeVertex = [this, &packageName, &version]() -> const VersionVertex*
+		auto makeVertex = [this, &packageNameId, &version]() -> const VersionVertex*
 		{
-			auto relatedVertexPtrsIt = __package_name_to_vertex_ptrs.insert(
-					{ packageName, {} }).first;
-			auto vertexPtr(new VersionVertex(relatedVertexPtrsIt));
+			auto& relatedVertexPtrs = getPackageVertices(packageNameId).relatedElementPtrs;
+			auto vertexPtr(new VersionVertex(packageNameId, &relatedVertexPtrs));
 			vertexPtr->version = version;
 			__dependency_graph.addVertex(vertexPtr);
-			relatedVertexPtrsIt->second.push_front(vertexPtr);
+			relatedVertexPtrs.push_front(vertexPtr);
 			return vertexPtr;
 		};
 
-		string versionHashString = packageName;
-		versionHashString.append((const char*)&version, sizeof(version));
-		auto insertResult = __version_to_vertex_ptr.insert({ std::move(versionHashString), nullptr });
-		bool isNew = insertResult.second;
-		const VersionVertex** elementPtrPtr = &insertResult.first->second;
+		bool isNew;
+		const VersionVertex** elementPtrPtr;
+		if (version)
+		{
+			auto insertResult = __version_to_vertex_ptr.insert({ version, nullptr });
+			isNew = insertResult.second;
+			elementPtrPtr = &insertResult.first->second;
+		}
+		else
+		{
+			auto& packageVertices = getPackageVertices(packageNameId);
+			isNew = !packageVertices.emptyVertexIsKnown;
+			packageVertices.emptyVertexIsKnown = true;
+			elementPtrPtr = &packageVertices.emptyVertexPtr;
+		}
 
-		if ((isNew && isVertexAllowed()) || (overrideChecks && !*elementPtrPtr))
+		if (isNew && isVertexAllowed())
 		{
 			// needs new vertex
 			*elementPtrPtr = makeVertex();
 		}
+		else if (overrideChecks && !*elementPtrPtr)
+		{
+			*elementPtrPtr = makeVertex();
+			p_hasForcedVertices = true;
+		}
 		return *elementPtrPtr;
 	}
 
+	const VersionVertex* getVertexPtr(const string& packageName, const BinaryVersion* version, bool overrideChecks = false)
+	{
+		return getVertexPtr(nametable::intern(packageName), version, overrideChecks);
+	}
+
 	const VersionElement* getVertexPtr(const BinaryVersion* version, bool overrideChecks = false)
 	{
+		auto it = __version_to_vertex_ptr.find(version);
+		if (it != __version_to_vertex_ptr.end() && (it->second || !overrideChecks))
+		{
+			return it->second;
+		}
 		return getVertexPtr(version->packageName, version, overrideChecks);
 	}
 
@@ -679,6 +762,10 @@ class DependencyGraph::FillHelper
 	{
 		return getVertexPtr(packageName, nullptr);
 	}
+	const Element* getVertexPtrForEmptyPackage(nametable::Id packageNameId)
+	{
+		return getVertexPtr(packageNameId, nullptr);
+	}
 
  private:
 	void buildEdgesForAntiRelationExpression(
@@ -749,8 +836,7 @@ class DependencyGraph::FillHelper
 		}
 	}
 
-	void processForwardRelation(const BinaryVersion* version,
-			const Element* vertexPtr, const RelationExpression& relationExpression,
+	void processForwardRelation(const Element* vertexPtr, const RelationExpression& relationExpression,
 			BinaryVersion::RelationTypes::Type dependencyType)
 	{
 		vector< const BinaryVersion* > satisfyingVersions;
@@ -761,8 +847,9 @@ class DependencyGraph::FillHelper
 				dependencyType == BinaryVersion::RelationTypes::Suggests)
 		{
 			satisfyingVersions = __dependency_graph.__cache.getSatisfyingVersions(relationExpression);
-			if (__is_soft_dependency_ignored(__dependency_graph.__config, version, dependencyType,
-					relationExpression, satisfyingVersions, __old_packages))
+			auto packageNameId = static_cast< const VersionVertex* >(vertexPtr)->getPackageNameId();
+			if (__is_soft_dependency_ignored(*__dependency_graph.__config, packageNameId, dependencyType,
+					relationExpression, satisfyingVersions, *__old_packages))
 			{
 				if (__debugging)
 				{
@@ -864,27 +951,43 @@ class DependencyGraph::FillHelper
 	{
 		auto vertex = new CustomUnsatisfiedVertex(importance);
 		vertex->parent = parent;
+		p_userRequestElementPtrs.push_back(vertex);
 		return __dependency_graph.addVertex(vertex);
 	}
 
  public:
-	void unfoldElement(const Element* elementPtr)
+	static const BinaryVersion* getUnfoldableVersion(const Element* elementPtr)
 	{
-		if (!__unfolded_elements.insert(elementPtr).second)
-		{
-			return; // processed already
-		}
 		auto versionElementPtr = dynamic_cast< const VersionElement* >(elementPtr);
-		if (!versionElementPtr)
+		return versionElementPtr ? versionElementPtr->version : nullptr;
+	}
+
+	bool isUnfolded(const Element* elementPtr) const
+	{
+		return !getUnfoldableVersion(elementPtr) || __unfolded_elements.count(elementPtr);
+	}
+
+	// returns nullptr if the empty vertex is not decided yet
+	const VersionVertex* const* findVertexPtrForEmptyPackage(nametable::Id packageNameId) const
+	{
+		if (packageNameId >= __package_vertices.size())
 		{
-			return; // nothing to process
+			return nullptr;
 		}
+		const auto& packageVertices = __package_vertices[packageNameId];
+		return packageVertices.emptyVertexIsKnown ? &packageVertices.emptyVertexPtr : nullptr;
+	}
 
-		// persistent one
-		auto version = versionElementPtr->version;
+	void unfoldElement(const Element* elementPtr)
+	{
+		auto version = getUnfoldableVersion(elementPtr);
 		if (!version)
 		{
-			return;
+			return; // nothing to process
+		}
+		if (!__unfolded_elements.insert(elementPtr).second)
+		{
+			return; // processed already
 		}
 
 		for (const auto& dependencyGroup: __dependency_groups)
@@ -900,7 +1003,7 @@ class DependencyGraph::FillHelper
 				}
 				else
 				{
-					processForwardRelation(version, elementPtr, relationExpression, dependencyType);
+					processForwardRelation(elementPtr, relationExpression, dependencyType);
 				}
 			}
 		}
@@ -916,6 +1019,23 @@ class DependencyGraph::FillHelper
 		return p_dummyElementPtr;
 	}
 
+	// versions which are not allowed otherwise got vertices for user requests
+	bool hasForcedVertices() const
+	{
+		return p_hasForcedVertices;
+	}
+
+	void removeUserRequests(const OldPackages& oldPackages)
+	{
+		for (auto elementPtr: p_userRequestElementPtrs)
+		{
+			__dependency_graph.deleteVertex(elementPtr);
+			delete elementPtr;
+		}
+		p_userRequestElementPtrs.clear();
+		__old_packages = &oldPackages;
+	}
+
 	void addUserRelationExpression(const UserRelationExpression& ure)
 	{
 		const Element* unsatisfiedElement = nullptr;
@@ -924,6 +1044,7 @@ class DependencyGraph::FillHelper
 		{
 			auto vertex = new UserRelationExpressionVertex(ure);
 			__dependency_graph.addVertex(vertex);
+			p_userRequestElementPtrs.push_back(vertex);
 			addEdgeCustom(p_dummyElementPtr, vertex);
 			if (ure.importance != RequestImportance::Must)
 			{
@@ -959,56 +1080,88 @@ const shared_ptr< const PackageEntry >& getSharedPackageEntry(bool sticked)
 }
 
 vector< pair< const dg::Element*, shared_ptr< const PackageEntry > > > DependencyGraph::fill(
-		const map< string, const BinaryVersion* >& oldPackages,
-		const map< string, InitialPackageEntry >& initialPackages)
+		const OldPackages& oldPackages, const InitialPackages& initialPackages,
+		const vector< UserRelationExpression >& userRelationExpressions)
 {
-	__fill_helper.reset(new DependencyGraph::FillHelper(*this, oldPackages));
+	p_frozen = false;
+	if (__fill_helper && __fill_helper->hasForcedVertices())
+	{
+		p_clear(); // forced vertices are not for other requests
+	}
+	bool refilling = (bool)__fill_helper;
+	if (refilling)
+	{
+		__fill_helper->removeUserRequests(oldPackages);
+	}
+	else
+	{
+		__fill_helper.reset(new DependencyGraph::FillHelper(*this, oldPackages));
+	}
 
+	auto initialPackageNameIds = initialPackages.getIdsSortedByName();
 	{ // getting elements from initial packages
-		FORIT(it, initialPackages)
+		for (auto packageNameId: initialPackageNameIds)
 		{
-			const InitialPackageEntry& initialPackageEntry = it->second;
+			const InitialPackageEntry& initialPackageEntry = *initialPackages.find(packageNameId);
 			const auto& initialVersion = initialPackageEntry.version;
 
 			if (initialVersion)
 			{
 				__fill_helper->getVertexPtr(initialVersion);
 
-				const string& packageName = it->first;
-				auto package = __cache.getBinaryPackage(packageName);
+				auto package = __cache.getBinaryPackage(nametable::get(packageNameId));
 				for (auto version: *package)
 				{
 					__fill_helper->getVertexPtr(version);
 				}
 
-				__fill_helper->getVertexPtrForEmptyPackage(packageName); // also, empty one
+				__fill_helper->getVertexPtrForEmptyPackage(packageNameId); // also, empty one
 			}
 		}
 	}
 
-	return p_generateSolutionElements(initialPackages);
+	auto result = p_generateSolutionElements(initialPackages, initialPackageNameIds);
+
+	/* User relation expressions must be processed before any unfoldElement() calls
+	   to early override version checks (if needed) for all explicitly required versions. */
+	for (const auto& userRelationExpression: userRelationExpressions)
+	{
+		__fill_helper->addUserRelationExpression(userRelationExpression);
+	}
+	if (refilling && __fill_helper->hasForcedVertices())
+	{
+		// the elements unfolded before are not linked to the forced vertices
+		p_clear();
+		return fill(oldPackages, initialPackages, userRelationExpressions);
+	}
+
+	return result;
 }
 
 vector< pair< const dg::Element*, shared_ptr< const PackageEntry > > > DependencyGraph::p_generateSolutionElements(
-		const map< string, InitialPackageEntry >& initialPackages)
+		const InitialPackages& initialPackages, const vector< nametable::Id >& initialPackageNameIds)
 {
 	vector< pair< const Element*, shared_ptr< const PackageEntry > > > result;
-	for (const auto& it: initialPackages)
+	for (auto packageNameId: initialPackageNameIds)
 	{
-		auto elementPtr = __fill_helper->getVertexPtr(it.first, it.second.version);
+		auto elementPtr = __fill_helper->getVertexPtr(packageNameId,
+				initialPackages.find(packageNameId)->version);
 		result.push_back({ elementPtr, getSharedPackageEntry(false) });
 	}
 	result.emplace_back(__fill_helper->getDummyElementPtr(), getSharedPackageEntry(true));
 	return result;
 }
 
-void DependencyGraph::addUserRelationExpression(const UserRelationExpression& ure)
-{
-	__fill_helper->addUserRelationExpression(ure);
-}
-
 void DependencyGraph::unfoldElement(const Element* elementPtr)
 {
+	if (p_frozen)
+	{
+		if (!__fill_helper->isUnfolded(elementPtr))
+		{
+			throw DeferredChange{ DeferredChange::Unfold, elementPtr };
+		}
+		return;
+	}
 	__fill_helper->unfoldElement(elementPtr);
 }
 
@@ -1019,8 +1172,34 @@ const Element* DependencyGraph::getCorrespondingEmptyElement(const Element* elem
 	{
 		fatal2i("getting corresponding empty element for non-version vertex");
 	}
-	const string& packageName = versionVertex->getPackageName();
-	return __fill_helper->getVertexPtrForEmptyPackage(packageName);
+	if (p_frozen)
+	{
+		auto knownVertexPtrPtr = __fill_helper->findVertexPtrForEmptyPackage(versionVertex->getPackageNameId());
+		if (!knownVertexPtrPtr)
+		{
+			throw DeferredChange{ DeferredChange::EmptyElement, elementPtr };
+		}
+		return *knownVertexPtrPtr;
+	}
+	return __fill_helper->getVertexPtrForEmptyPackage(versionVertex->getPackageNameId());
+}
+
+void DependencyGraph::setFrozen(bool value)
+{
+	p_frozen = value;
+}
+
+void DependencyGraph::applyDeferredChange(const DeferredChange& change)
+{
+	switch (change.type)
+	{
+		case DeferredChange::Unfold:
+			unfoldElement(change.elementPtr);
+			break;
+		case DeferredChange::EmptyElement:
+			getCorrespondingEmptyElement(change.elementPtr);
+			break;
+	}
 }
 
 }
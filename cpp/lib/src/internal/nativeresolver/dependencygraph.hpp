@@ -31,6 +31,7 @@ using cupt::cache::BinaryVersion;
 using cupt::cache::RelationExpression;
 
 #include <internal/graph.hpp>
+#include <internal/nametable.hpp>
 
 namespace cupt {
 namespace internal {
@@ -46,6 +47,8 @@ struct InitialPackageEntry
 
 	InitialPackageEntry();
 };
+typedef nametable::NameIdMap< const BinaryVersion* > OldPackages;
+typedef nametable::NameIdMap< InitialPackageEntry > InitialPackages;
 struct UserRelationExpression
 {
 	RelationExpression expression;
@@ -83,13 +86,15 @@ struct BasicVertex
 struct VersionVertex: public BasicVertex
 {
  private:
-	const map< string, forward_list< const Element* > >::iterator __related_element_ptrs_it;
+	const nametable::Id __package_name_id;
+	const forward_list< const Element* >* const __related_element_ptrs;
  public:
 	const BinaryVersion* version;
 
-	VersionVertex(const map< string, forward_list< const Element* > >::iterator&);
+	VersionVertex(nametable::Id, const forward_list< const Element* >*);
 	string toString() const;
 	const forward_list< const Element* >* getRelatedElements() const;
+	nametable::Id getPackageNameId() const { return __package_name_id; }
 	const string& getPackageName() const;
 	string toLocalizedString() const;
 };
@@ -105,14 +110,26 @@ struct PointeredAlreadyTraits
 	{
 		return vertex;
 	}
+	template < class ValueT >
+	using VertexMap = IdKeyedMap< T, ValueT >; // by element ids
 };
 
 }
 
+// thrown by a frozen graph instead of changing itself
+struct DeferredChange
+{
+	enum Type { Unfold, EmptyElement };
+	Type type;
+	const Element* elementPtr;
+};
+
 class DependencyGraph: protected Graph< const Element*, PointeredAlreadyTraits >
 {
-	const Config& __config;
+	const Config* __config;
 	const Cache& __cache;
+	const string p_optionsKey;
+	bool p_frozen;
 
 	class FillHelper;
 	friend class FillHelper;
@@ -120,20 +137,28 @@ class DependencyGraph: protected Graph< const Element*, PointeredAlreadyTraits >
 	std::unique_ptr< FillHelper > __fill_helper;
 
 	vector< pair< const Element*, shared_ptr< const PackageEntry > > > p_generateSolutionElements(
-			const map< string, InitialPackageEntry >&);
+			const InitialPackages&, const vector< nametable::Id >&);
+	void p_clear();
  public:
 	typedef Graph< const Element*, PointeredAlreadyTraits > BaseT;
 
 	DependencyGraph(const Config& config, const Cache& cache);
 	~DependencyGraph();
+	/* a filled graph can be filled again for other user requests on the same
+	   cache: only the vertices of the previous requests are replaced, the
+	   unfolded part is kept */
 	vector< pair< const Element*, shared_ptr< const PackageEntry > > > fill(
-			const map< string, const BinaryVersion* >&,
-			const map< string, InitialPackageEntry >&);
-	void addUserRelationExpression(const UserRelationExpression&);
+			const OldPackages&, const InitialPackages&, const vector< UserRelationExpression >&);
+	// switches to the config if it has the same options the graph depends on
+	bool reuseWith(const Config&);
 
 	const Element* getCorrespondingEmptyElement(const Element*);
 	void unfoldElement(const Element*);
 
+	// a frozen graph can be read from several threads at once
+	void setFrozen(bool);
+	void applyDeferredChange(const DeferredChange&);
+
 	using BaseT::getSuccessorsFromPointer;
 	using BaseT::getPredecessorsFromPointer;
 	using BaseT::CessorListType;
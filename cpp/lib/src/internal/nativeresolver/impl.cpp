@@ -17,15 +17,29 @@
 **************************************************************************/
 
 #include <cmath>
+#include <cstdio>
 #include <queue>
+#include <unordered_set>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <chrono>
+
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <cupt/config.hpp>
 #include <cupt/cache.hpp>
 #include <cupt/cache/binarypackage.hpp>
+#include <cupt/file.hpp>
 #include <cupt/system/state.hpp>
 
+#include <internal/cacheimpl.hpp>
 #include <internal/nativeresolver/impl.hpp>
+#include <internal/nativeresolver/satproblem.hpp>
+#include <internal/nativeresolver/problemdump.hpp>
 #include <internal/graph.hpp>
 
 namespace cupt {
@@ -34,19 +48,53 @@ namespace internal {
 using std::queue;
 
 NativeResolverImpl::NativeResolverImpl(const shared_ptr< const Config >& config, const shared_ptr< const Cache >& cache)
-	: __config(config), __cache(cache), __score_manager(*config, cache), __auto_removal_possibility(*__config)
+	: __config(config), __cache(cache), __score_manager(*config, cache), __auto_removal_possibility(*__config),
+	p_upgradeRequested(false), p_statistics{ 0, 0, 0 }
 {
 	__import_installed_versions();
 }
 
+NativeResolverImpl::~NativeResolverImpl()
+{
+	__solution_storage.reset();
+	if (p_dependencyGraph)
+	{
+		// left to the next resolver on this cache, freed with the cache otherwise
+		auto cacheImpl = __cache->__impl;
+		std::lock_guard< std::mutex > guard(cacheImpl->spareDependencyGraphMutex);
+		cacheImpl->spareDependencyGraph = std::move(p_dependencyGraph);
+	}
+}
+
+void NativeResolverImpl::p_prepareSolutionStorage(Solution& initialSolution)
+{
+	__solution_storage.reset();
+	if (!p_dependencyGraph)
+	{
+		auto cacheImpl = __cache->__impl;
+		std::lock_guard< std::mutex > guard(cacheImpl->spareDependencyGraphMutex);
+		p_dependencyGraph = std::move(cacheImpl->spareDependencyGraph);
+	}
+	if (!p_dependencyGraph || !p_dependencyGraph->reuseWith(*__config))
+	{
+		p_dependencyGraph.reset(); // freeing the memory before building a new one
+		p_dependencyGraph.reset(new dg::DependencyGraph(*__config, *__cache));
+	}
+
+	__solution_storage.reset(new SolutionStorage(*p_dependencyGraph));
+	__solution_storage->prepareForResolving(initialSolution,
+			__old_packages, __initial_packages, p_userRelationExpressions);
+}
+
 void NativeResolverImpl::__import_installed_versions()
 {
 	auto versions = __cache->getInstalledVersions();
 	for (const auto& version: versions)
 	{
 		// just moving versions, don't try to install or remove some dependencies
-		__old_packages[version->packageName] = version;
-		__initial_packages[version->packageName].version = version;
+		auto packageNameId = nametable::intern(version->packageName);
+		__old_packages[packageNameId] = version;
+		__initial_packages[packageNameId].version = version;
 	}
 
 	__import_packages_to_reinstall();
@@ -65,7 +113,7 @@ void NativeResolverImpl::__import_packages_to_reinstall()
 		}
 
 		// this also involves creating new entry in __initial_packages
-		auto& targetVersion = __initial_packages[*packageNameIt].version;
+		auto& targetVersion = __initial_packages[nametable::intern(*packageNameIt)].version;
 		targetVersion = nullptr; // removed by default
 	}
 }
@@ -132,15 +180,16 @@ void NativeResolverImpl::satisfyRelationExpression(const RelationExpression& re,
 
 void NativeResolverImpl::upgrade()
 {
-	FORIT(it, __initial_packages)
+	p_upgradeRequested = true;
+	for (auto packageNameId: __initial_packages.getIdsSortedByName())
 	{
-		dg::InitialPackageEntry& initialPackageEntry = it->second;
+		dg::InitialPackageEntry& initialPackageEntry = __initial_packages[packageNameId];
 		if (!initialPackageEntry.version)
 		{
 			continue;
 		}
 
-		const string& packageName = it->first;
+		const string& packageName = nametable::get(packageNameId);
 		auto package = __cache->getBinaryPackage(packageName);
 
 		// if there is original version, then the preferred version should exist
@@ -196,21 +245,22 @@ SolutionContainer::iterator __full_chooser(SolutionContainer& solutions)
 	return __fair_chooser(solutions);
 }
 
-bool NativeResolverImpl::p_computeTargetAutoStatus(const string& packageName,
-		const Solution& solution, const dg::Element* elementPtr) const
+bool NativeResolverImpl::p_computeTargetAutoStatus(
+		const Solution& solution, const dg::VersionVertex* vertex) const
 {
+	const string& packageName = vertex->getPackageName();
 	auto overrideIt = __auto_status_overrides.find(packageName);
 	if (overrideIt != __auto_status_overrides.end())
 	{
 		return overrideIt->second;
 	}
 
-	if (__old_packages.count(packageName))
+	if (__old_packages.count(vertex->getPackageNameId()))
 	{
 		return __cache->isAutomaticallyInstalled(packageName);
 	}
 
-	auto packageEntryPtr = solution.getPackageEntry(elementPtr);
+	auto packageEntryPtr = solution.getPackageEntry(vertex);
 	if (!packageEntryPtr)
 	{
 		fatal2i("native resolver: new package does not have a package entry");
@@ -233,7 +283,6 @@ AutoRemovalPossibility::Allow NativeResolverImpl::p_isCandidateForAutoRemoval(
 		return Allow::No;
 	}
 
-	const string& packageName = versionVertex->getPackageName();
 	auto& version = versionVertex->version;
 
 	if (!version)
@@ -241,8 +290,9 @@ AutoRemovalPossibility::Allow NativeResolverImpl::p_isCandidateForAutoRemoval(
 		return Allow::No;
 	}
 
-	return __auto_removal_possibility.isAllowed(version, __old_packages.count(packageName),
-			p_computeTargetAutoStatus(packageName, solution, elementPtr));
+	return __auto_removal_possibility.isAllowed(version,
+			__old_packages.count(versionVertex->getPackageNameId()),
+			p_computeTargetAutoStatus(solution, versionVertex));
 }
 
 bool NativeResolverImpl::__clean_automatically_installed(Solution& solution)
@@ -327,6 +377,7 @@ bool NativeResolverImpl::__clean_automatically_installed(Solution& solution)
 	{ // looping through the candidates
 		bool debugging = __config->getBool("debug::resolver");
 
+		dependencyGraph.freeze();
 		auto reachableElementPtrPtrs = dependencyGraph.getReachableFrom(*mainVertexPtr);
 
 		FORIT(elementPtrIt, vertices)
@@ -400,7 +451,8 @@ void NativeResolverImpl::__pre_apply_action(const Solution& originalSolution,
 	solution.pendingAction = std::forward< unique_ptr< Action >&& >(actionToApply);
 }
 
-void NativeResolverImpl::__calculate_profits(vector< unique_ptr< Action > >& actions) const
+ScoreChange NativeResolverImpl::p_getProfit(const dg::Element* oldElementPtr,
+		const dg::Element* newElementPtr) const
 {
 	auto getVersion = [](const dg::Element* elementPtr) -> const BinaryVersion*
 	{
@@ -416,30 +468,32 @@ void NativeResolverImpl::__calculate_profits(vector< unique_ptr< Action > >& act
 		return versionVertex->version;
 	};
 
+	switch (newElementPtr->getUnsatisfiedType())
+	{
+		case dg::Unsatisfied::None:
+			return __score_manager.getVersionScoreChange(
+					getVersion(oldElementPtr), getVersion(newElementPtr));
+		case dg::Unsatisfied::Recommends:
+			return __score_manager.getUnsatisfiedRecommendsScoreChange();
+		case dg::Unsatisfied::Suggests:
+			return __score_manager.getUnsatisfiedSuggestsScoreChange();
+		case dg::Unsatisfied::Sync:
+			return __score_manager.getUnsatisfiedSynchronizationScoreChange();
+		case dg::Unsatisfied::Custom:
+			return __score_manager.getCustomUnsatisfiedScoreChange(newElementPtr->getUnsatisfiedImportance());
+	}
+	fatal2i("unknown unsatisfied type");
+	return ScoreChange(); // unreachable
+}
+
+void NativeResolverImpl::__calculate_profits(vector< unique_ptr< Action > >& actions) const
+{
 	size_t position = 0;
 	FORIT(actionIt, actions)
 	{
 		Action& action = **actionIt;
 
-		switch (action.newElementPtr->getUnsatisfiedType())
-		{
-			case dg::Unsatisfied::None:
-				action.profit = __score_manager.getVersionScoreChange(
-						getVersion(action.oldElementPtr), getVersion(action.newElementPtr));
-				break;
-			case dg::Unsatisfied::Recommends:
-				action.profit = __score_manager.getUnsatisfiedRecommendsScoreChange();
-				break;
-			case dg::Unsatisfied::Suggests:
-				action.profit = __score_manager.getUnsatisfiedSuggestsScoreChange();
-				break;
-			case dg::Unsatisfied::Sync:
-				action.profit = __score_manager.getUnsatisfiedSynchronizationScoreChange();
-				break;
-			case dg::Unsatisfied::Custom:
-				action.profit = __score_manager.getCustomUnsatisfiedScoreChange(action.newElementPtr->getUnsatisfiedImportance());
-				break;
-		}
+		action.profit = p_getProfit(action.oldElementPtr, action.newElementPtr);
 		action.profit.setPosition(position);
 		++position;
 	}
@@ -447,8 +501,20 @@ void NativeResolverImpl::__calculate_profits(vector< unique_ptr< Action > >& act
 
 void NativeResolverImpl::__pre_apply_actions_to_solution_tree(
 		std::function< void (const shared_ptr< Solution >&) > callback,
-		const shared_ptr< Solution >& currentSolution, vector< unique_ptr< Action > >& actions)
+		const shared_ptr< Solution >& currentSolution, vector< unique_ptr< Action > >& actions,
+		bool alwaysClone)
 {
+	if (p_learnConflicts)
+	{
+		// don't even clone solutions which can never be finished
+		auto hopelessIt = std::remove_if(actions.begin(), actions.end(),
+				[this, &currentSolution](const unique_ptr< Action >& action)
+				{
+					return p_nogoods.isHopeless(*currentSolution, *action);
+				});
+		actions.erase(hopelessIt, actions.end());
+	}
+
 	// sort them by "rank", from more good to more bad
 	std::stable_sort(actions.begin(), actions.end(),
 			[this](const unique_ptr< Action >& left, const unique_ptr< Action >& right) -> bool
@@ -458,7 +524,7 @@ void NativeResolverImpl::__pre_apply_actions_to_solution_tree(
 			});
 
 	// apply all the solutions by one
-	bool onlyOneAction = (actions.size() == 1);
+	bool onlyOneAction = (actions.size() == 1 && !alwaysClone);
 	auto oldSolutionId = currentSolution->id;
 	FORIT(actionIt, actions)
 	{
@@ -673,7 +739,7 @@ void NativeResolverImpl::__prepare_reject_requests(vector< unique_ptr< Action >
 }
 
 void NativeResolverImpl::__fillSuggestedPackageReasons(const Solution& solution,
-		const string& packageName, Resolver::SuggestedPackage& suggestedPackage,
+		nametable::Id packageNameId, Resolver::SuggestedPackage& suggestedPackage,
 		const dg::Element* elementPtr, map< const dg::Element*, size_t >& reasonProcessingCache) const
 {
 	static const shared_ptr< const Reason > userReason(new UserReason);
@@ -700,8 +766,8 @@ void NativeResolverImpl::__fillSuggestedPackageReasons(const Solution& solution,
 			__solution_storage->processReasonElements(solution, reasonProcessingCache,
 					introducedBy, elementPtr, std::cref(fillReasonElements));
 		}
-		auto initialPackageIt = __initial_packages.find(packageName);
-		if (initialPackageIt != __initial_packages.end() && initialPackageIt->second.modified)
+		auto initialPackageEntryPtr = __initial_packages.find(packageNameId);
+		if (initialPackageEntryPtr && initialPackageEntryPtr->modified)
 		{
 			suggestedPackage.reasons.push_back(userReason);
 		}
@@ -711,6 +777,9 @@ void NativeResolverImpl::__fillSuggestedPackageReasons(const Solution& solution,
 Resolver::UserAnswer::Type NativeResolverImpl::__propose_solution(
 		const Solution& solution, Resolver::CallbackType callback, bool trackReasons)
 {
+	++p_statistics.proposedSolutionCount;
+	p_statistics.proposedScore = solution.score;
+
 	// build "user-frienly" version of solution
 	Resolver::Offer offer;
 	Resolver::SuggestedPackages& suggestedPackages = offer.suggestedPackages;
@@ -723,7 +792,7 @@ Resolver::UserAnswer::Type NativeResolverImpl::__propose_solution(
 		if (vertex)
 		{
 			const string& packageName = vertex->getPackageName();
-			if (!vertex->version && !__initial_packages.count(packageName))
+			if (!vertex->version && !__initial_packages.count(vertex->getPackageNameId()))
 			{
 				continue;
 			}
@@ -733,10 +802,10 @@ Resolver::UserAnswer::Type NativeResolverImpl::__propose_solution(
 
 			if (trackReasons)
 			{
-				__fillSuggestedPackageReasons(solution, packageName, suggestedPackage,
+				__fillSuggestedPackageReasons(solution, vertex->getPackageNameId(), suggestedPackage,
 						elementPtr, reasonProcessingCache);
 			}
-			suggestedPackage.automaticallyInstalledFlag = p_computeTargetAutoStatus(packageName, solution, elementPtr);
+			suggestedPackage.automaticallyInstalledFlag = p_computeTargetAutoStatus(solution, vertex);
 		}
 		else
 		{
@@ -814,91 +883,362 @@ void NativeResolverImpl::__final_verify_solution(const Solution& solution)
 	}
 }
 
-BrokenPair __get_broken_pair(const SolutionStorage& solutionStorage,
-		const Solution& solution, const map< const dg::Element*, size_t >& failCounts)
+// how many times the elements were chosen as problems of not finished solutions
+class FailCounts
 {
-	auto failValue = [&failCounts](const dg::Element* e) -> size_t
+	vector< size_t > p_counts; // by element ids
+ public:
+	size_t get(const dg::Element* elementPtr) const
 	{
-		auto it = failCounts.find(e);
-		return it != failCounts.end() ? it->second : 0u;
-	};
-	auto compareBrokenSuccessors = [&failValue](const BrokenSuccessor& left, const BrokenSuccessor& right)
+		return elementPtr->id < p_counts.size() ? p_counts[elementPtr->id] : 0u;
+	}
+	void increment(const dg::Element* elementPtr)
 	{
-		auto leftTypePriority = left.elementPtr->getTypePriority();
-		auto rightTypePriority = right.elementPtr->getTypePriority();
-		if (leftTypePriority < rightTypePriority)
+		if (elementPtr->id >= p_counts.size())
 		{
-			return true;
+			p_counts.resize(elementPtr->id + 1);
 		}
-		if (leftTypePriority > rightTypePriority)
+		++p_counts[elementPtr->id];
+	}
+};
+
+BrokenPair __get_broken_pair(const SolutionStorage& solutionStorage,
+		const Solution& solution, const FailCounts& failCounts)
+{
+	/* of the broken successors with the greatest type priority and priority,
+	   the one failed most times, and then the one with the greatest id */
+	const BrokenSuccessor* bestBrokenSuccessorPtr = nullptr;
+	size_t bestFailCount = 0;
+	solution.getBrokenSuccessors().foreachGreatest(
+			[&bestBrokenSuccessorPtr, &bestFailCount, &failCounts](const BrokenSuccessor& brokenSuccessor)
+			{
+				auto failCount = failCounts.get(brokenSuccessor.elementPtr);
+				if (!bestBrokenSuccessorPtr || bestFailCount < failCount ||
+						(bestFailCount == failCount &&
+						bestBrokenSuccessorPtr->elementPtr->id < brokenSuccessor.elementPtr->id))
+				{
+					bestBrokenSuccessorPtr = &brokenSuccessor;
+					bestFailCount = failCount;
+				}
+			});
+	if (!bestBrokenSuccessorPtr)
+	{
+		return BrokenPair{ nullptr, { nullptr, 0 } };
+	}
+	BrokenPair result = { nullptr, *bestBrokenSuccessorPtr };
+	for (auto reverseDependencyPtr: solutionStorage.getPredecessorElements(bestBrokenSuccessorPtr->elementPtr))
+	{
+		if (solution.getPackageEntry(reverseDependencyPtr))
 		{
-			return false;
+			if (!result.versionElementPtr || (result.versionElementPtr->id < reverseDependencyPtr->id))
+			{
+				result.versionElementPtr = reverseDependencyPtr;
+			}
 		}
+	}
+	if (!result.versionElementPtr)
+	{
+		fatal2i("__get_broken_pair: no existing in the solution predecessors for the broken successor '%s'",
+				bestBrokenSuccessorPtr->elementPtr->toString());
+	}
+
+	return result;
+}
 
-		if (left.priority < right.priority)
+struct SolutionExpansion
+{
+	shared_ptr< Solution > solution;
+	bool applied;
+	bool reachesNewState; // i.e. has an action to apply
+	BrokenPair brokenPair;
+	vector< unique_ptr< Solution::Action > > possibleActions;
+
+	bool deferred;
+	dg::DeferredChange deferredChange;
+	std::exception_ptr error;
+
+	SolutionExpansion(const shared_ptr< Solution >& solution_)
+		: solution(solution_), applied(false),
+		reachesNewState(solution_->pendingAction != nullptr), deferred(false)
+	{}
+};
+
+vector< SolutionExpansion > __select_solutions(SolutionContainer& solutions,
+		const SolutionChooser& chooser, size_t batchSize)
+{
+	vector< SolutionExpansion > result;
+	while (result.size() < batchSize && !solutions.empty())
+	{
+		auto solutionIt = chooser(solutions);
+		if ((*solutionIt)->finished && !result.empty())
 		{
-			return true;
+			break; // finished solutions are proposed one by one
 		}
-		if (left.priority > right.priority)
+		result.emplace_back(*solutionIt);
+		solutions.erase(solutionIt);
+		if (result.back().solution->finished)
 		{
-			return false;
+			break;
+		}
+	}
+	return result;
+}
+
+/* different orders of actions often come to the same state: the same set of
+   elements with the same constraints on them; the solutions which came to a
+   state reached already are dropped once their actions are applied */
+bool __is_duplicate_solution(const SolutionExpansion& expansion,
+		std::unordered_set< uint64_t >& reachedStates, bool debugging)
+{
+	if (!expansion.reachesNewState)
+	{
+		return false; // a finished solution picked again
+	}
+	const auto& solution = *expansion.solution;
+	if (reachedStates.insert(solution.hash).second)
+	{
+		return false;
+	}
+	if (debugging)
+	{
+		__mydebug_wrapper(solution, "the state is reached already, dropped");
+	}
+	return true;
+}
+
+/* the limits of the search; once any of them is exceeded, only the solutions
+   finished by then are proposed */
+class ResolvingBudget
+{
+	static const size_t memoryCheckPeriod = 16; // steps
+
+	size_t p_maxSteps;
+	size_t p_maxMemory; // KiB
+	size_t p_startMemory; // KiB
+	size_t p_checkCount;
+	std::chrono::steady_clock::time_point p_deadline;
+	bool p_hasDeadline;
+	const char* p_exhaustedOption;
+
+	// the resident memory now, or the peak one if the current is not known
+	static size_t p_getMemory()
+	{
+		string openError;
+		File file("/proc/self/statm", "r", openError);
+		if (openError.empty())
+		{
+			string line;
+			file.getLine(line);
+			size_t residentPages;
+			if (sscanf(line.c_str(), "%*u %zu", &residentPages) == 1)
+			{
+				return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+			}
 		}
 
-		auto leftFailValue = failValue(left.elementPtr);
-		auto rightFailValue = failValue(right.elementPtr);
-		if (leftFailValue < rightFailValue)
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == -1)
 		{
-			return true;
+			fatal2e(__("%s() failed"), "getrusage");
 		}
-		if (leftFailValue > rightFailValue)
+		return usage.ru_maxrss;
+	}
+ public:
+	ResolvingBudget(const Config& config)
+		: p_startMemory(0), p_checkCount(0), p_exhaustedOption(NULL)
+	{
+		auto getLimit = [&config](const char* optionName)
 		{
-			return false;
+			auto value = config.getInteger(optionName);
+			if (value < 0)
+			{
+				fatal2(__("the option '%s' cannot be negative"), optionName);
+			}
+			return size_t(value);
+		};
+		p_maxSteps = getLimit("cupt::resolver::max-steps");
+		p_maxMemory = getLimit("cupt::resolver::max-memory") * 1024;
+		if (p_maxMemory)
+		{
+			// the cache and earlier resolves are not the resolver's business
+			p_startMemory = p_getMemory();
 		}
+		auto maxTime = getLimit("cupt::resolver::max-time");
+		p_hasDeadline = (maxTime != 0);
+		p_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(maxTime);
+	}
 
-		return left.elementPtr->id < right.elementPtr->id;
-	};
-
-	const auto& brokenSuccessors = solution.getBrokenSuccessors();
-	auto bestBrokenSuccessorIt = std::max_element(
-			brokenSuccessors.begin(), brokenSuccessors.end(), compareBrokenSuccessors);
-	if (bestBrokenSuccessorIt == brokenSuccessors.end())
+	// the time spent outside of the search, like waiting for the answer to a
+	// proposed solution, doesn't count
+	void excludeTime(std::chrono::steady_clock::duration duration)
 	{
-		return BrokenPair{ nullptr, { nullptr, 0 } };
+		p_deadline += duration;
 	}
-	BrokenPair result = { nullptr, *bestBrokenSuccessorIt };
-	for (auto reverseDependencyPtr: solutionStorage.getPredecessorElements(bestBrokenSuccessorIt->elementPtr))
+
+	// returns the name of the option whose limit is exceeded, or NULL
+	const char* check(size_t steps)
 	{
-		if (solution.getPackageEntry(reverseDependencyPtr))
+		if (!p_exhaustedOption)
 		{
-			if (!result.versionElementPtr || (result.versionElementPtr->id < reverseDependencyPtr->id))
+			if (p_maxSteps && steps >= p_maxSteps)
 			{
-				result.versionElementPtr = reverseDependencyPtr;
+				p_exhaustedOption = "cupt::resolver::max-steps";
+			}
+			else if (p_hasDeadline && std::chrono::steady_clock::now() >= p_deadline)
+			{
+				p_exhaustedOption = "cupt::resolver::max-time";
+			}
+			else if (p_maxMemory && (p_checkCount++ % memoryCheckPeriod == 0) &&
+					p_getMemory() >= p_startMemory + p_maxMemory)
+			{
+				p_exhaustedOption = "cupt::resolver::max-memory";
 			}
 		}
+		return p_exhaustedOption;
 	}
-	if (!result.versionElementPtr)
+};
+
+// leaves only the finished solutions in the tree
+void __stop_search(SolutionContainer& solutions, const char* exhaustedOption, bool debugging)
+{
+	warn2(__("the resolver exceeded the limit set by the option '%s', only the solutions found so far are considered"),
+			exhaustedOption);
+	size_t droppedCount = 0;
+	for (auto it = solutions.begin(); it != solutions.end();)
 	{
-		fatal2i("__get_broken_pair: no existing in the solution predecessors for the broken successor '%s'",
-				bestBrokenSuccessorIt->elementPtr->toString());
+		if ((*it)->finished)
+		{
+			++it;
+		}
+		else
+		{
+			it = solutions.erase(it);
+			++droppedCount;
+		}
+	}
+	if (debugging)
+	{
+		debug2("stopped the search, dropped %zu unfinished solutions", droppedCount);
 	}
+}
 
-	return result;
+void NativeResolverImpl::__expand_solution(SolutionExpansion& expansion,
+		const FailCounts& failCounts, bool debugging)
+{
+	auto& solution = *expansion.solution;
+
+	if (!expansion.applied)
+	{
+		if (solution.pendingAction)
+		{
+			auto parent = solution.getParent();
+			try
+			{
+				solution.prepare();
+				__post_apply_action(*__solution_storage, solution);
+			}
+			catch (const dg::DeferredChange&)
+			{
+				solution.unprepare(parent);
+				throw;
+			}
+		}
+		expansion.applied = true;
+	}
+
+	auto& bp = expansion.brokenPair;
+	bp = __get_broken_pair(*__solution_storage, solution, failCounts);
+	if (!bp.versionElementPtr) return;
+
+	if (debugging)
+	{
+		__mydebug_wrapper(solution, "problem (%zu:%zu): %s: %s",
+				bp.brokenSuccessor.elementPtr->getTypePriority(), bp.brokenSuccessor.priority,
+				bp.versionElementPtr->toString(), bp.brokenSuccessor.elementPtr->toString());
+	}
+	expansion.possibleActions.clear();
+	__generate_possible_actions(&expansion.possibleActions, solution, bp, debugging);
 }
 
-shared_ptr< Solution > __get_next_current_solution(
-		SolutionContainer& solutions, SolutionStorage& solutionStorage, const SolutionChooser& chooser)
+size_t NativeResolverImpl::__get_expansion_thread_count(size_t expansionCount) const
 {
-	auto currentSolutionIt = chooser(solutions);
-	shared_ptr< Solution > currentSolution = *currentSolutionIt;
-	solutions.erase(currentSolutionIt);
+	auto result = __config->getInteger("cupt::resolver::threads");
+	if (result <= 0)
+	{
+		result = std::thread::hardware_concurrency();
+	}
+	return std::max< size_t >(1, std::min< size_t >(result, expansionCount));
+}
 
-	if (currentSolution->pendingAction)
+/* the solutions are expanded concurrently against the frozen dependency graph;
+   when some of them need the graph to grow, the changes are made afterwards
+   in the order of solutions and these solutions are expanded again, so the
+   result does not depend on the number of threads */
+void NativeResolverImpl::__expand_solutions(vector< SolutionExpansion >& expansions,
+		const FailCounts& failCounts)
+{
+	vector< SolutionExpansion* > pending;
+	for (auto& expansion: expansions)
 	{
-		currentSolution->prepare();
-		__post_apply_action(solutionStorage, *currentSolution);
+		pending.push_back(&expansion);
 	}
 
-	return currentSolution;
+	while (!pending.empty())
+	{
+		__solution_storage->setGraphFrozen(true);
+
+		std::atomic< size_t > nextIndex(0);
+		auto worker = [this, &pending, &nextIndex, &failCounts]()
+		{
+			size_t index;
+			while ((index = nextIndex++) < pending.size())
+			{
+				auto& expansion = *pending[index];
+				expansion.deferred = false;
+				try
+				{
+					__expand_solution(expansion, failCounts, false);
+				}
+				catch (const dg::DeferredChange& change)
+				{
+					expansion.deferred = true;
+					expansion.deferredChange = change;
+				}
+				catch (...)
+				{
+					expansion.error = std::current_exception();
+				}
+			}
+		};
+		vector< std::thread > threads;
+		auto threadCount = __get_expansion_thread_count(pending.size());
+		for (size_t i = 1; i < threadCount; ++i)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread: threads)
+		{
+			thread.join();
+		}
+
+		__solution_storage->setGraphFrozen(false);
+
+		vector< SolutionExpansion* > deferred;
+		for (auto expansion: pending)
+		{
+			if (expansion->error)
+			{
+				std::rethrow_exception(expansion->error);
+			}
+			if (expansion->deferred)
+			{
+				__solution_storage->applyDeferredChange(expansion->deferredChange);
+				deferred.push_back(expansion);
+			}
+		}
+		pending.swap(deferred);
+	}
 }
 
 void NativeResolverImpl::__fill_and_process_introduced_by(
@@ -908,9 +1248,16 @@ void NativeResolverImpl::__fill_and_process_introduced_by(
 	ourIntroducedBy.versionElementPtr = bp.versionElementPtr;
 	ourIntroducedBy.brokenElementPtr = bp.brokenSuccessor.elementPtr;
 
-	if (actionsPtr->empty() && !__any_solution_was_found)
+	if (actionsPtr->empty())
 	{
-		__decision_fail_tree.addFailedSolution(*__solution_storage, solution, ourIntroducedBy);
+		if (p_learnConflicts)
+		{
+			p_nogoods.addFailedSolution(*__solution_storage, solution, ourIntroducedBy);
+		}
+		if (!__any_solution_was_found)
+		{
+			__decision_fail_tree.addFailedSolution(*__solution_storage, solution, ourIntroducedBy);
+		}
 	}
 	else
 	{
@@ -928,132 +1275,367 @@ bool NativeResolverImpl::resolve(Resolver::CallbackType callback)
 	const bool debugging = __config->getBool("debug::resolver");
 	const bool trackReasons = __config->getBool("cupt::resolver::track-reasons");
 	const size_t maxSolutionCount = __config->getInteger("cupt::resolver::max-solution-count");
+	// solutions of one batch are expanded concurrently, the resolver output
+	// depends only on the batch size; debugging needs the sequential order
+	const size_t batchSize = debugging ? 1 :
+			std::max< ssize_t >(1, __config->getInteger("cupt::resolver::expansion-batch-size"));
 	bool thereWereSolutionsDropped = false;
+	p_learnConflicts = __config->getBool("cupt::resolver::conflict-learning");
+	const bool dropDuplicates = __config->getBool("cupt::resolver::drop-duplicate-states");
 
 	if (debugging) debug2("started resolving");
+	p_dumpProblemIfRequested();
+	p_statistics = { 0, 0, 0 };
 
 	__any_solution_was_found = false;
 	__decision_fail_tree.clear();
+	p_nogoods.clear();
+	std::unordered_set< uint64_t > reachedStates;
+	size_t duplicateCount = 0;
+	auto debugCounters = [this, debugging, dropDuplicates, &duplicateCount]()
+	{
+		if (!debugging)
+		{
+			return;
+		}
+		if (p_learnConflicts)
+		{
+			debug2("learned %zu conflicts, pruned %zu branches by them",
+					p_nogoods.getNogoodCount(), p_nogoods.getPrunedCount());
+		}
+		if (dropDuplicates)
+		{
+			debug2("dropped %zu solutions which came to already reached states", duplicateCount);
+		}
+	};
 
 	shared_ptr< Solution > initialSolution(new Solution);
-	__solution_storage.reset(new SolutionStorage(*__config, *__cache));
-	__solution_storage->prepareForResolving(*initialSolution,
-			__old_packages, __initial_packages, p_userRelationExpressions);
+	p_prepareSolutionStorage(*initialSolution);
 
 	SolutionContainer solutions = { initialSolution };
 
 	// for each package entry 'count' will contain the number of failures
 	// during processing these packages
-	map< const dg::Element*, size_t > failCounts;
+	FailCounts failCounts;
+
+	ResolvingBudget budget(*__config);
+	const char* exhaustedOption = NULL;
 
 	while (!solutions.empty())
 	{
-		vector< unique_ptr< Action > > possibleActions;
+		if (!exhaustedOption)
+		{
+			exhaustedOption = budget.check(p_statistics.expandedSolutionCount);
+			if (exhaustedOption)
+			{
+				__stop_search(solutions, exhaustedOption, debugging);
+				if (solutions.empty())
+				{
+					break;
+				}
+			}
+		}
 
-		auto currentSolution = __get_next_current_solution(solutions, *__solution_storage, solutionChooser);
+		auto expansions = __select_solutions(solutions, solutionChooser, batchSize);
+		p_statistics.expandedSolutionCount += expansions.size();
+		if (expansions.size() == 1)
+		{
+			__expand_solution(expansions.front(), failCounts, debugging);
+		}
+		else
+		{
+			__expand_solutions(expansions, failCounts);
+		}
 
-		auto problemFound = [this, &failCounts, &possibleActions, &currentSolution, debugging]
+		for (auto& expansion: expansions)
 		{
-			auto bp = __get_broken_pair(*__solution_storage, *currentSolution, failCounts);
-			if (!bp.versionElementPtr) return false;
+			auto& currentSolution = expansion.solution;
+			auto& possibleActions = expansion.possibleActions;
+			const auto& bp = expansion.brokenPair;
 
-			if (debugging)
+			if (dropDuplicates && __is_duplicate_solution(expansion, reachedStates, debugging))
 			{
-				__mydebug_wrapper(*currentSolution, "problem (%zu:%zu): %s: %s",
-						bp.brokenSuccessor.elementPtr->getTypePriority(), bp.brokenSuccessor.priority,
-						bp.versionElementPtr->toString(), bp.brokenSuccessor.elementPtr->toString());
+				++duplicateCount;
+				continue;
 			}
-			__generate_possible_actions(&possibleActions, *currentSolution, bp, debugging);
-			__fill_and_process_introduced_by(*currentSolution, bp, &possibleActions);
 
-			// mark package as failed one more time
-			failCounts[bp.brokenSuccessor.elementPtr] += 1;
+			if (!bp.versionElementPtr)
+			{
+				// if the solution was only just finished
+				if (!currentSolution->finished)
+				{
+					if (debugging)
+					{
+						__mydebug_wrapper(*currentSolution, "finished");
+					}
+					currentSolution->finished = 1;
+				}
 
-			return true;
-		};
+				// resolver can refuse the solution
+				solutions.insert(currentSolution);
+				if (&expansion != &expansions.front())
+				{
+					continue; // will be picked up again if it is still the best one
+				}
+				auto newSelectedSolutionIt = solutionChooser(solutions);
+				if (*newSelectedSolutionIt != currentSolution)
+				{
+					continue; // ok, process other solution
+				}
+				solutions.erase(newSelectedSolutionIt);
 
-		if (!problemFound())
-		{
-			// if the solution was only just finished
-			if (!currentSolution->finished)
-			{
-				if (debugging)
+				// clean up automatically installed by resolver and now unneeded packages
+				if (!__clean_automatically_installed(*currentSolution))
 				{
-					__mydebug_wrapper(*currentSolution, "finished");
+					if (debugging)
+					{
+						__mydebug_wrapper(*currentSolution, "auto-discarded");
+					}
+					continue;
 				}
-				currentSolution->finished = 1;
-			}
 
-			// resolver can refuse the solution
-			solutions.insert(currentSolution);
-			auto newSelectedSolutionIt = solutionChooser(solutions);
-			if (*newSelectedSolutionIt != currentSolution)
-			{
-				continue; // ok, process other solution
-			}
-			solutions.erase(newSelectedSolutionIt);
+				if (!__any_solution_was_found)
+				{
+					__any_solution_was_found = true;
+					__decision_fail_tree.clear(); // no need to store this tree anymore
+				}
 
-			// clean up automatically installed by resolver and now unneeded packages
-			if (!__clean_automatically_installed(*currentSolution))
-			{
-				if (debugging)
+				__final_verify_solution(*currentSolution);
+
+				auto proposalStart = std::chrono::steady_clock::now();
+				auto userAnswer = __propose_solution(*currentSolution, callback, trackReasons);
+				budget.excludeTime(std::chrono::steady_clock::now() - proposalStart);
+				switch (userAnswer)
 				{
-					__mydebug_wrapper(*currentSolution, "auto-discarded");
+					case Resolver::UserAnswer::Accept:
+						// yeah, this is end of our tortures
+						debugCounters();
+						return true;
+					case Resolver::UserAnswer::Abandon:
+						// user has selected abandoning all further efforts
+						debugCounters();
+						return false;
+					case Resolver::UserAnswer::Decline:
+						; // caller hasn't accepted this solution, well, go next...
 				}
-				continue;
 			}
-
-			if (!__any_solution_was_found)
+			else
 			{
-				__any_solution_was_found = true;
-				__decision_fail_tree.clear(); // no need to store this tree anymore
+				__fill_and_process_introduced_by(*currentSolution, bp, &possibleActions);
+
+				// mark package as failed one more time
+				failCounts.increment(bp.brokenSuccessor.elementPtr);
+
+				__prepare_reject_requests(possibleActions);
+
+				if (possibleActions.empty())
+				{
+					if (debugging)
+					{
+						__mydebug_wrapper(*currentSolution, "no solutions");
+					}
+				}
+				else
+				{
+					__calculate_profits(possibleActions);
+
+					auto callback = [&solutions](const shared_ptr< Solution >& solution)
+					{
+						solutions.insert(solution);
+					};
+					__pre_apply_actions_to_solution_tree(callback, currentSolution, possibleActions,
+							batchSize > 1);
+
+					__erase_worst_solutions(solutions, maxSolutionCount, debugging, thereWereSolutionsDropped);
+				}
 			}
+		}
+	}
+	debugCounters();
+	if (!__any_solution_was_found)
+	{
+		if (exhaustedOption)
+		{
+			fatal2(__("unable to resolve dependencies within the limit set by the option '%s', the failures met so far:\n\n%s"),
+					exhaustedOption, __decision_fail_tree.toString());
+		}
+		// no solutions pending, we have a great fail
+		fatal2(__("unable to resolve dependencies, because of:\n\n%s"),
+				__decision_fail_tree.toString());
+	}
+	return false;
+}
 
-			__final_verify_solution(*currentSolution);
+void NativeResolverImpl::p_dumpProblemIfRequested() const
+{
+	auto directory = __config->getString("cupt::resolver::problem-dump-directory");
+	if (directory.empty())
+	{
+		return;
+	}
+	dumpResolverProblem(directory, *__config, *__cache,
+			{ p_upgradeRequested, p_userRelationExpressions, __auto_status_overrides });
+	if (__config->getBool("debug::resolver"))
+	{
+		debug2("dumped the problem to '%s'", directory);
+	}
+}
 
-			auto userAnswer = __propose_solution(*currentSolution, callback, trackReasons);
-			switch (userAnswer)
+const system::NativeResolver::Statistics& NativeResolverImpl::getStatistics() const
+{
+	return p_statistics;
+}
+
+/* the SAT model has no history, so the changes are put to the solution one by
+   one, each after an element which it could be introduced by */
+shared_ptr< Solution > NativeResolverImpl::p_buildSatSolution(
+		const shared_ptr< Solution >& initialSolution,
+		const vector< const dg::Element* >& changedElementPtrs)
+{
+	set< const dg::Element* > finalElementPtrs;
+	for (auto elementPtr: initialSolution->getElements())
+	{
+		finalElementPtrs.insert(elementPtr);
+	}
+	map< const dg::Element*, const dg::Element* > replacedElementPtrs;
+	for (auto elementPtr: changedElementPtrs)
+	{
+		for (auto conflictingElementPtr: SolutionStorage::getConflictingElements(elementPtr))
+		{
+			if (conflictingElementPtr != elementPtr && finalElementPtrs.erase(conflictingElementPtr))
 			{
-				case Resolver::UserAnswer::Accept:
-					// yeah, this is end of our tortures
-					return true;
-				case Resolver::UserAnswer::Abandon:
-					// user has selected abandoning all further efforts
-					return false;
-				case Resolver::UserAnswer::Decline:
-					; // caller hasn't accepted this solution, well, go next...
+				replacedElementPtrs[elementPtr] = conflictingElementPtr;
 			}
 		}
-		else
-		{
-			__prepare_reject_requests(possibleActions);
+	}
+	auto introducedElementPtrs = finalElementPtrs; // unchanged ones
+	for (auto elementPtr: changedElementPtrs)
+	{
+		finalElementPtrs.insert(elementPtr);
+	}
 
-			if (possibleActions.empty())
+	auto findIntroducedBy = [this](const dg::Element* elementPtr,
+			const set< const dg::Element* >& candidateElementPtrs)
+	{
+		IntroducedBy result;
+		for (auto relationElementPtr: __solution_storage->getPredecessorElements(elementPtr))
+		{
+			for (auto versionElementPtr: __solution_storage->getPredecessorElements(relationElementPtr))
 			{
-				if (debugging)
+				if (candidateElementPtrs.count(versionElementPtr))
 				{
-					__mydebug_wrapper(*currentSolution, "no solutions");
+					result.versionElementPtr = versionElementPtr;
+					result.brokenElementPtr = relationElementPtr;
+					return result;
 				}
 			}
-			else
+		}
+		return result;
+	};
+
+	vector< pair< const dg::Element*, IntroducedBy > > orderedChanges;
+	auto pendingElementPtrs = changedElementPtrs;
+	bool progress = true;
+	while (progress)
+	{
+		progress = false;
+		for (auto& elementPtr: pendingElementPtrs)
+		{
+			if (!elementPtr) continue;
+			auto introducedBy = findIntroducedBy(elementPtr, introducedElementPtrs);
+			if (!introducedBy.empty())
 			{
-				__calculate_profits(possibleActions);
+				orderedChanges.push_back({ elementPtr, introducedBy });
+				introducedElementPtrs.insert(elementPtr);
+				elementPtr = nullptr;
+				progress = true;
+			}
+		}
+	}
+	for (auto elementPtr: pendingElementPtrs)
+	{
+		if (elementPtr)
+		{
+			orderedChanges.push_back({ elementPtr, findIntroducedBy(elementPtr, finalElementPtrs) });
+		}
+	}
 
-				auto callback = [&solutions](const shared_ptr< Solution >& solution)
-				{
-					solutions.insert(solution);
-				};
-				__pre_apply_actions_to_solution_tree(callback, currentSolution, possibleActions);
+	auto solution = initialSolution;
+	for (const auto& change: orderedChanges)
+	{
+		auto newSolution = __solution_storage->cloneSolution(solution);
+		newSolution->prepare();
 
-				__erase_worst_solutions(solutions, maxSolutionCount, debugging, thereWereSolutionsDropped);
-			}
+		PackageEntry packageEntry;
+		packageEntry.sticked = true;
+		packageEntry.introducedBy = change.second;
+		auto replacedIt = replacedElementPtrs.find(change.first);
+		__solution_storage->setPackageEntry(*newSolution, change.first, std::move(packageEntry),
+				replacedIt != replacedElementPtrs.end() ? replacedIt->second : nullptr, 0);
+
+		solution = newSolution;
+	}
+	solution->finished = true;
+	return solution;
+}
+
+bool NativeResolverImpl::resolveBySat(Resolver::CallbackType callback)
+{
+	const bool debugging = __config->getBool("debug::resolver");
+	const bool trackReasons = __config->getBool("cupt::resolver::track-reasons");
+
+	if (debugging) debug2("started resolving by the SAT backend");
+	p_dumpProblemIfRequested();
+	p_statistics = { 0, 0, 0 };
+
+	shared_ptr< Solution > initialSolution(new Solution);
+	p_prepareSolutionStorage(*initialSolution);
+
+	auto getProfit = [this](const dg::Element* oldElementPtr, const dg::Element* newElementPtr)
+	{
+		return __score_manager.getScoreChangeValue(p_getProfit(oldElementPtr, newElementPtr));
+	};
+	SatProblem problem(*__solution_storage, *initialSolution, getProfit,
+			__config->getInteger("cupt::resolver::sat::max-improvement-conflicts"));
+
+	bool anySolutionWasFound = false;
+	vector< const dg::Element* > changedElementPtrs;
+	while (problem.solve(&changedElementPtrs))
+	{
+		anySolutionWasFound = true;
+		p_statistics.expandedSolutionCount = problem.getStatistics().models;
+		if (debugging)
+		{
+			debug2("sat: %s", problem.getStatisticsString());
+		}
+
+		auto solution = p_buildSatSolution(initialSolution, changedElementPtrs);
+		solution->score = problem.getScore();
+		if (debugging)
+		{
+			__mydebug_wrapper(*solution, "finished");
+		}
+
+		__clean_automatically_installed(*solution);
+		__final_verify_solution(*solution);
+
+		switch (__propose_solution(*solution, callback, trackReasons))
+		{
+			case Resolver::UserAnswer::Accept:
+				return true;
+			case Resolver::UserAnswer::Abandon:
+				return false;
+			case Resolver::UserAnswer::Decline:
+				problem.forbid(changedElementPtrs);
 		}
 	}
-	if (!__any_solution_was_found)
+	if (debugging)
 	{
-		// no solutions pending, we have a great fail
-		fatal2(__("unable to resolve dependencies, because of:\n\n%s"),
-				__decision_fail_tree.toString());
+		debug2("sat: %s", problem.getStatisticsString());
+	}
+	if (!anySolutionWasFound)
+	{
+		fatal2(__("unable to resolve dependencies: no set of package versions satisfies them"));
 	}
 	return false;
 }
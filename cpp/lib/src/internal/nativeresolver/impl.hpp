@@ -23,10 +23,12 @@
 
 #include <cupt/fwd.hpp>
 #include <cupt/system/resolver.hpp>
+#include <cupt/system/resolvers/native.hpp>
 
 #include <internal/nativeresolver/solution.hpp>
 #include <internal/nativeresolver/score.hpp>
 #include <internal/nativeresolver/decisionfailtree.hpp>
+#include <internal/nativeresolver/nogoodstore.hpp>
 #include <internal/nativeresolver/autoremovalpossibility.hpp>
 
 namespace cupt {
@@ -38,6 +40,8 @@ using std::unique_ptr;
 using std::set;
 
 struct BrokenPair;
+struct SolutionExpansion;
+class FailCounts;
 
 class NativeResolverImpl
 {
@@ -52,34 +56,42 @@ class NativeResolverImpl
 	shared_ptr< const Config > __config;
 	shared_ptr< const Cache > __cache;
 	map< string, bool > __auto_status_overrides;
+	shared_ptr< dg::DependencyGraph > p_dependencyGraph;
 	unique_ptr< SolutionStorage > __solution_storage;
 	ScoreManager __score_manager;
 	AutoRemovalPossibility __auto_removal_possibility;
 
-	map< string, const BinaryVersion* > __old_packages;
-	map< string, dg::InitialPackageEntry > __initial_packages;
+	dg::OldPackages __old_packages;
+	dg::InitialPackages __initial_packages;
 
 	vector< dg::UserRelationExpression > p_userRelationExpressions;
+	bool p_upgradeRequested;
+	system::NativeResolver::Statistics p_statistics;
 
 	DecisionFailTree __decision_fail_tree;
 	bool __any_solution_was_found;
+	bool p_learnConflicts;
+	NogoodStore p_nogoods;
 
 	void __import_installed_versions();
+	void p_dumpProblemIfRequested() const;
+	void p_prepareSolutionStorage(Solution&);
 	void __import_packages_to_reinstall();
 	bool __prepare_version_no_stick(const BinaryVersion*,
 			dg::InitialPackageEntry&);
 	float __get_version_weight(const BinaryVersion*) const;
 	float __get_action_profit(const BinaryVersion*, const BinaryVersion*) const;
 
-	bool p_computeTargetAutoStatus(const string&, const Solution&, const dg::Element*) const;
+	bool p_computeTargetAutoStatus(const Solution&, const dg::VersionVertex*) const;
 	AutoRemovalPossibility::Allow p_isCandidateForAutoRemoval(const Solution&, const dg::Element*);
 	bool __clean_automatically_installed(Solution&);
 
 	void __pre_apply_action(const Solution&, Solution&, unique_ptr< Action > &&, size_t);
+	ScoreChange p_getProfit(const dg::Element*, const dg::Element*) const;
 	void __calculate_profits(vector< unique_ptr< Action > >& actions) const;
 	void __pre_apply_actions_to_solution_tree(
 			std::function< void (const shared_ptr< Solution >&) > callback,
-			const shared_ptr< Solution >&, vector< unique_ptr< Action > >&);
+			const shared_ptr< Solution >&, vector< unique_ptr< Action > >&, bool);
 
 	void __final_verify_solution(const Solution&);
 
@@ -91,21 +103,31 @@ class NativeResolverImpl
 	void __add_actions_to_fix_dependency(vector< unique_ptr< Action > >&, const Solution&,
 			const dg::Element*);
 	void __prepare_reject_requests(vector< unique_ptr< Action > >& actions) const;
-	void __fillSuggestedPackageReasons(const Solution&, const string&,
+	void __fillSuggestedPackageReasons(const Solution&, nametable::Id,
 			Resolver::SuggestedPackage&, const dg::Element*, map< const dg::Element*, size_t >&) const;
 	Resolver::UserAnswer::Type __propose_solution(
 			const Solution&, Resolver::CallbackType, bool);
 
 	void __fill_and_process_introduced_by(const Solution&, const BrokenPair&, ActionContainer* actionsPtr);
 	void __generate_possible_actions(vector< unique_ptr< Action > >*, const Solution&, const BrokenPair&, bool);
+	void __expand_solution(SolutionExpansion&, const FailCounts&, bool);
+	size_t __get_expansion_thread_count(size_t) const;
+	void __expand_solutions(vector< SolutionExpansion >&, const FailCounts&);
+
+	shared_ptr< Solution > p_buildSatSolution(const shared_ptr< Solution >&,
+			const vector< const dg::Element* >&);
  public:
 	NativeResolverImpl(const shared_ptr< const Config >&, const shared_ptr< const Cache >&);
+	~NativeResolverImpl();
 
 	void satisfyRelationExpression(const RelationExpression&, bool, const string&, RequestImportance, bool);
 	void upgrade();
 	void setAutomaticallyInstalledFlag(const string& packageName, bool flagValue);
 
 	bool resolve(Resolver::CallbackType);
+	// same requests and offers, but the solutions are searched by SatProblem
+	bool resolveBySat(Resolver::CallbackType);
+	const system::NativeResolver::Statistics& getStatistics() const;
 };
 
 }
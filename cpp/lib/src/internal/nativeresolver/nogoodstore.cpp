@@ -0,0 +1,179 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <algorithm>
+
+#include <internal/nativeresolver/nogoodstore.hpp>
+
+namespace cupt {
+namespace internal {
+
+NogoodStore::NogoodStore()
+	: p_prunedCount(0)
+{}
+
+void NogoodStore::addFailedSolution(const SolutionStorage& solutionStorage,
+		const Solution& solution, const IntroducedBy& introducedBy)
+{
+	Nogood nogood;
+
+	// the version element stays as it is...
+	auto versionElementPtr = introducedBy.versionElementPtr;
+	auto versionPackageEntryPtr = solution.getPackageEntry(versionElementPtr);
+	if (!versionPackageEntryPtr)
+	{
+		return;
+	}
+	nogood.push_back(Fact { versionElementPtr, NULL });
+	for (auto conflictingElementPtr: SolutionStorage::getConflictingElements(versionElementPtr))
+	{
+		if (conflictingElementPtr == versionElementPtr)
+		{
+			continue;
+		}
+		if (versionPackageEntryPtr->sticked ||
+				!versionPackageEntryPtr->isModificationAllowed(conflictingElementPtr))
+		{
+			nogood.push_back(Fact { versionElementPtr, conflictingElementPtr });
+		}
+		// other alternatives don't make sense regardless of the solution
+	}
+
+	// ...and every element which could satisfy the broken one is blocked
+	for (auto successorElementPtr: solutionStorage.getSuccessorElements(introducedBy.brokenElementPtr))
+	{
+		const dg::Element* conflictingElementPtr;
+		if (solutionStorage.simulateSetPackageEntry(solution, successorElementPtr, &conflictingElementPtr))
+		{
+			return; // not a dead end really
+		}
+		nogood.push_back(Fact { conflictingElementPtr, successorElementPtr });
+	}
+
+	std::sort(nogood.begin(), nogood.end());
+	nogood.erase(std::unique(nogood.begin(), nogood.end()), nogood.end());
+
+	auto insertResult = p_nogoods.insert(std::move(nogood));
+	if (!insertResult.second)
+	{
+		return; // rediscovered
+	}
+	const Nogood* nogoodPtr = &*insertResult.first;
+	for (const auto& fact: *nogoodPtr)
+	{
+		for (auto elementPtr: { fact.elementPtr, fact.blockedElementPtr })
+		{
+			if (!elementPtr)
+			{
+				continue;
+			}
+			auto& indexed = p_index[elementPtr];
+			if (indexed.empty() || indexed.back() != nogoodPtr)
+			{
+				indexed.push_back(nogoodPtr);
+			}
+		}
+	}
+}
+
+// whether the fact holds for the solution after the action is applied to it
+bool NogoodStore::p_holds(const Fact& fact, const Solution& solution, const Solution::Action& action)
+{
+	if (fact.elementPtr == action.newElementPtr)
+	{
+		return true; // will be there sticked
+	}
+	if (fact.elementPtr == action.oldElementPtr)
+	{
+		return false; // will be replaced
+	}
+	auto packageEntryPtr = solution.getPackageEntry(fact.elementPtr);
+	if (!packageEntryPtr)
+	{
+		return false;
+	}
+	if (!fact.blockedElementPtr || packageEntryPtr->sticked ||
+			!packageEntryPtr->isModificationAllowed(fact.blockedElementPtr))
+	{
+		return true;
+	}
+	// the element is the only one of its package in the solution, so it will
+	// receive the rejection
+	const auto& elementsToReject = action.elementsToReject;
+	return std::find(elementsToReject.begin(), elementsToReject.end(),
+			fact.blockedElementPtr) != elementsToReject.end();
+}
+
+bool NogoodStore::isHopeless(const Solution& solution, const Solution::Action& action)
+{
+	if (p_nogoods.empty())
+	{
+		return false;
+	}
+
+	/* only nogoods involving the changes of the action are looked at, the
+	   solution itself was checked against the rest when it was made */
+	auto isHopelessBy = [this, &solution, &action](const dg::Element* elementPtr)
+	{
+		auto indexIt = p_index.find(elementPtr);
+		if (indexIt == p_index.end())
+		{
+			return false;
+		}
+		for (auto nogoodPtr: indexIt->second)
+		{
+			auto factHolds = [&solution, &action](const Fact& fact)
+			{
+				return p_holds(fact, solution, action);
+			};
+			if (std::all_of(nogoodPtr->begin(), nogoodPtr->end(), factHolds))
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	bool result = isHopelessBy(action.newElementPtr) ||
+			std::any_of(action.elementsToReject.begin(), action.elementsToReject.end(), isHopelessBy);
+	if (result)
+	{
+		++p_prunedCount;
+	}
+	return result;
+}
+
+void NogoodStore::clear()
+{
+	p_nogoods.clear();
+	p_index.clear();
+	p_prunedCount = 0;
+}
+
+size_t NogoodStore::getNogoodCount() const
+{
+	return p_nogoods.size();
+}
+
+size_t NogoodStore::getPrunedCount() const
+{
+	return p_prunedCount;
+}
+
+}
+}
+
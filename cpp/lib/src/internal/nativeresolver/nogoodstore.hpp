@@ -0,0 +1,76 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NATIVERESOLVER_NOGOODSTORE_SEEN
+#define CUPT_INTERNAL_NATIVERESOLVER_NOGOODSTORE_SEEN
+
+#include <set>
+
+#include <internal/nativeresolver/solution.hpp>
+
+namespace cupt {
+namespace internal {
+
+using std::set;
+
+/* learned combinations of solution facts ("nogoods") which leave some broken
+   element without any way to fix it; since sticked entries and rejections only
+   accumulate in a solution subtree, any solution having all facts of a nogood
+   can never be finished */
+class NogoodStore
+{
+	struct Fact
+	{
+		const dg::Element* elementPtr; // is in the solution
+		// if not NULL, the entry of 'elementPtr' can't be changed to it
+		const dg::Element* blockedElementPtr;
+
+		bool operator<(const Fact& other) const
+		{
+			return std::make_pair(elementPtr, blockedElementPtr) <
+					std::make_pair(other.elementPtr, other.blockedElementPtr);
+		}
+		bool operator==(const Fact& other) const
+		{
+			return elementPtr == other.elementPtr && blockedElementPtr == other.blockedElementPtr;
+		}
+	};
+	typedef vector< Fact > Nogood;
+
+	set< Nogood > p_nogoods;
+	// nogoods by elements of their facts, both present and blocked ones
+	map< const dg::Element*, vector< const Nogood* > > p_index;
+	size_t p_prunedCount;
+
+	static bool p_holds(const Fact&, const Solution&, const Solution::Action&);
+ public:
+	NogoodStore();
+
+	void addFailedSolution(const SolutionStorage&, const Solution&, const IntroducedBy&);
+	// whether the solution made from the given one by the action would be hopeless
+	bool isHopeless(const Solution&, const Solution::Action&);
+	void clear();
+
+	size_t getNogoodCount() const;
+	size_t getPrunedCount() const;
+};
+
+}
+}
+
+#endif
+
@@ -0,0 +1,535 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NATIVERESOLVER_PERSISTENTMAP_SEEN
+#define CUPT_INTERNAL_NATIVERESOLVER_PERSISTENTMAP_SEEN
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#include <cupt/common.hpp>
+
+namespace cupt {
+namespace internal {
+
+/* map from dense integer keys with structural sharing, implemented as a
+   bitmap-compressed 32-ary trie: a copy shares all the nodes with the
+   original, a change copies only the nodes on the path to the key (nodes
+   which are not shared are changed in place); copies may be read and changed
+   from different threads; if 'LessT' is given, every node also points to the
+   greatest value below it, so the greatest values are found without a scan */
+template < class ValueT, class LessT = void >
+class PersistentMap
+{
+ public:
+	typedef uint32_t KeyT;
+	typedef ValueT ValueType;
+ private:
+	static const unsigned bitsPerLevel = 5;
+	static const uint32_t levelMask = (1u << bitsPerLevel) - 1;
+	static const size_t noIndex = size_t(-1);
+
+	typedef typename std::is_void< LessT >::type IsUnordered;
+	struct NoSummary
+	{};
+	struct Summary
+	{
+		const ValueT* greatest;
+	};
+
+	// followed by the slots: child node pointers or, on the last level, values
+	struct Node: public std::conditional< IsUnordered::value, NoSummary, Summary >::type
+	{
+		std::atomic< uint32_t > referenceCount;
+		uint32_t bitmap;
+
+		explicit Node(uint32_t bitmap_)
+			: referenceCount(1), bitmap(bitmap_)
+		{}
+	};
+
+	Node* p_root;
+	unsigned p_shift; // of the root level
+	size_t p_size;
+
+	template < class SlotT >
+	static size_t p_getSlotOffset()
+	{
+		return (sizeof(Node) + alignof(SlotT) - 1) / alignof(SlotT) * alignof(SlotT);
+	}
+	template < class SlotT >
+	static SlotT* p_getSlots(const Node* node)
+	{
+		return reinterpret_cast< SlotT* >(reinterpret_cast< char* >(
+				const_cast< Node* >(node)) + p_getSlotOffset< SlotT >());
+	}
+	template < class SlotT >
+	static Node* p_allocateNode(uint32_t bitmap)
+	{
+		auto memory = ::operator new(p_getSlotOffset< SlotT >() +
+				__builtin_popcount(bitmap) * sizeof(SlotT));
+		return new (memory) Node(bitmap);
+	}
+	static void p_freeNode(Node* node)
+	{
+		node->~Node();
+		::operator delete(node);
+	}
+
+	static size_t p_getSize(const Node* node)
+	{
+		return __builtin_popcount(node->bitmap);
+	}
+	static uint32_t p_getBit(KeyT key, unsigned shift)
+	{
+		return 1u << ((key >> shift) & levelMask);
+	}
+	static size_t p_getIndex(const Node* node, uint32_t bit)
+	{
+		return __builtin_popcount(node->bitmap & (bit - 1));
+	}
+	static bool p_fits(KeyT key, unsigned shift)
+	{
+		return !(uint64_t(key) >> (shift + bitsPerLevel));
+	}
+
+	static bool p_isShared(const Node* node)
+	{
+		return node->referenceCount.load(std::memory_order_acquire) != 1;
+	}
+	static void p_addReference(Node* node)
+	{
+		node->referenceCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	static void p_release(Node* node, unsigned shift)
+	{
+		if (node->referenceCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return;
+		}
+		auto size = p_getSize(node);
+		if (shift)
+		{
+			auto children = p_getSlots< Node* >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				p_release(children[i], shift - bitsPerLevel);
+			}
+		}
+		else
+		{
+			auto values = p_getSlots< ValueT >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				values[i].~ValueT();
+			}
+		}
+		p_freeNode(node);
+	}
+
+	static void p_copySlot(Node** to, Node* const* from)
+	{
+		*to = *from;
+		p_addReference(*to);
+	}
+	static void p_copySlot(ValueT* to, const ValueT* from)
+	{
+		new (to) ValueT(*from);
+	}
+	static void p_moveSlot(Node** to, Node** from)
+	{
+		*to = *from;
+	}
+	static void p_moveSlot(ValueT* to, ValueT* from)
+	{
+		new (to) ValueT(std::move(*from));
+		from->~ValueT();
+	}
+	// a removed child is already released by the caller
+	static void p_dropSlot(Node**)
+	{}
+	static void p_dropSlot(ValueT* value)
+	{
+		value->~ValueT();
+	}
+
+	/* consumes the node and returns its copy with the new bitmap, the slot
+	   'removedIndex' is left out and the slot 'insertedIndex' (in the new
+	   numbering) is left uninitialized */
+	template < class SlotT >
+	static Node* p_reshapeSlots(Node* node, unsigned shift, uint32_t bitmap,
+			size_t insertedIndex, size_t removedIndex)
+	{
+		auto result = p_allocateNode< SlotT >(bitmap);
+		auto from = p_getSlots< SlotT >(node);
+		auto to = p_getSlots< SlotT >(result);
+		bool shared = p_isShared(node);
+		auto size = p_getSize(node);
+		for (size_t i = 0, j = 0; i < size; ++i)
+		{
+			if (i == removedIndex)
+			{
+				if (!shared)
+				{
+					p_dropSlot(&from[i]);
+				}
+				continue;
+			}
+			if (j == insertedIndex)
+			{
+				++j;
+			}
+			if (shared)
+			{
+				p_copySlot(&to[j], &from[i]);
+			}
+			else
+			{
+				p_moveSlot(&to[j], &from[i]);
+			}
+			++j;
+		}
+		if (shared)
+		{
+			p_release(node, shift);
+		}
+		else
+		{
+			p_freeNode(node);
+		}
+		return result;
+	}
+	static Node* p_reshape(Node* node, unsigned shift, uint32_t bitmap,
+			size_t insertedIndex, size_t removedIndex)
+	{
+		return shift ?
+				p_reshapeSlots< Node* >(node, shift, bitmap, insertedIndex, removedIndex) :
+				p_reshapeSlots< ValueT >(node, shift, bitmap, insertedIndex, removedIndex);
+	}
+
+	static void p_updateSummary(Node*, unsigned, std::true_type)
+	{}
+	static void p_updateSummary(Node* node, unsigned shift, std::false_type)
+	{
+		LessT less;
+		auto size = p_getSize(node);
+		const ValueT* greatest;
+		if (shift)
+		{
+			auto children = p_getSlots< Node* >(node);
+			greatest = children[0]->greatest;
+			for (size_t i = 1; i < size; ++i)
+			{
+				if (less(*greatest, *children[i]->greatest))
+				{
+					greatest = children[i]->greatest;
+				}
+			}
+		}
+		else
+		{
+			auto values = p_getSlots< ValueT >(node);
+			greatest = &values[0];
+			for (size_t i = 1; i < size; ++i)
+			{
+				if (less(*greatest, values[i]))
+				{
+					greatest = &values[i];
+				}
+			}
+		}
+		node->greatest = greatest;
+	}
+	// to be called after any change of the node or its children
+	static Node* p_updateSummary(Node* node, unsigned shift)
+	{
+		p_updateSummary(node, shift, IsUnordered());
+		return node;
+	}
+
+	static Node* p_createPath(KeyT key, unsigned shift, const ValueT& value)
+	{
+		auto bit = p_getBit(key, shift);
+		if (!shift)
+		{
+			auto node = p_allocateNode< ValueT >(bit);
+			new (p_getSlots< ValueT >(node)) ValueT(value);
+			return p_updateSummary(node, shift);
+		}
+		auto node = p_allocateNode< Node* >(bit);
+		*p_getSlots< Node* >(node) = p_createPath(key, shift - bitsPerLevel, value);
+		return p_updateSummary(node, shift);
+	}
+
+	// consume the node and return the changed one
+	static Node* p_set(Node* node, unsigned shift, KeyT key, const ValueT& value)
+	{
+		auto bit = p_getBit(key, shift);
+		auto index = p_getIndex(node, bit);
+		if (!(node->bitmap & bit))
+		{
+			node = p_reshape(node, shift, node->bitmap | bit, index, noIndex);
+			if (shift)
+			{
+				p_getSlots< Node* >(node)[index] = p_createPath(key, shift - bitsPerLevel, value);
+			}
+			else
+			{
+				new (&p_getSlots< ValueT >(node)[index]) ValueT(value);
+			}
+			return p_updateSummary(node, shift);
+		}
+
+		if (p_isShared(node))
+		{
+			node = p_reshape(node, shift, node->bitmap, noIndex, noIndex);
+		}
+		if (shift)
+		{
+			auto& child = p_getSlots< Node* >(node)[index];
+			child = p_set(child, shift - bitsPerLevel, key, value);
+		}
+		else
+		{
+			p_getSlots< ValueT >(node)[index] = value;
+		}
+		return p_updateSummary(node, shift);
+	}
+
+	// the key must exist; returns nullptr if the node became empty
+	static Node* p_erase(Node* node, unsigned shift, KeyT key)
+	{
+		if (p_isShared(node))
+		{
+			node = p_reshape(node, shift, node->bitmap, noIndex, noIndex);
+		}
+		auto bit = p_getBit(key, shift);
+		auto index = p_getIndex(node, bit);
+		if (shift)
+		{
+			auto& child = p_getSlots< Node* >(node)[index];
+			child = p_erase(child, shift - bitsPerLevel, key);
+			if (child)
+			{
+				return p_updateSummary(node, shift);
+			}
+		}
+
+		if (p_getSize(node) == 1)
+		{
+			if (!shift)
+			{
+				p_getSlots< ValueT >(node)->~ValueT();
+			}
+			p_freeNode(node);
+			return nullptr;
+		}
+		return p_updateSummary(p_reshape(node, shift, node->bitmap & ~bit, noIndex, index), shift);
+	}
+
+	template < class CallbackT >
+	static void p_foreach(const Node* node, unsigned shift, const CallbackT& callback)
+	{
+		auto size = p_getSize(node);
+		if (shift)
+		{
+			auto children = p_getSlots< Node* >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				p_foreach(children[i], shift - bitsPerLevel, callback);
+			}
+		}
+		else
+		{
+			auto values = p_getSlots< ValueT >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				callback(values[i]);
+			}
+		}
+	}
+
+	template < class CallbackT >
+	static void p_foreachGreatest(const Node* node, unsigned shift, const ValueT& greatest,
+			const CallbackT& callback)
+	{
+		LessT less;
+		if (less(*node->greatest, greatest))
+		{
+			return;
+		}
+		auto size = p_getSize(node);
+		if (shift)
+		{
+			auto children = p_getSlots< Node* >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				p_foreachGreatest(children[i], shift - bitsPerLevel, greatest, callback);
+			}
+		}
+		else
+		{
+			auto values = p_getSlots< ValueT >(node);
+			for (size_t i = 0; i < size; ++i)
+			{
+				if (!less(values[i], greatest))
+				{
+					callback(values[i]);
+				}
+			}
+		}
+	}
+ public:
+	PersistentMap()
+		: p_root(nullptr), p_shift(0), p_size(0)
+	{}
+	PersistentMap(const PersistentMap& other)
+		: p_root(other.p_root), p_shift(other.p_shift), p_size(other.p_size)
+	{
+		if (p_root)
+		{
+			p_addReference(p_root);
+		}
+	}
+	PersistentMap& operator=(const PersistentMap& other)
+	{
+		PersistentMap copy(other);
+		std::swap(p_root, copy.p_root);
+		std::swap(p_shift, copy.p_shift);
+		std::swap(p_size, copy.p_size);
+		return *this;
+	}
+	~PersistentMap()
+	{
+		clear();
+	}
+
+	size_t size() const
+	{
+		return p_size;
+	}
+	void clear()
+	{
+		if (p_root)
+		{
+			p_release(p_root, p_shift);
+			p_root = nullptr;
+			p_shift = 0;
+			p_size = 0;
+		}
+	}
+
+	const ValueT* find(KeyT key) const
+	{
+		if (!p_root || !p_fits(key, p_shift))
+		{
+			return nullptr;
+		}
+		const Node* node = p_root;
+		auto shift = p_shift;
+		while (true)
+		{
+			auto bit = p_getBit(key, shift);
+			if (!(node->bitmap & bit))
+			{
+				return nullptr;
+			}
+			auto index = p_getIndex(node, bit);
+			if (!shift)
+			{
+				return &p_getSlots< ValueT >(node)[index];
+			}
+			node = p_getSlots< Node* >(node)[index];
+			shift -= bitsPerLevel;
+		}
+	}
+
+	// inserts or replaces
+	void set(KeyT key, const ValueT& value)
+	{
+		if (!p_root)
+		{
+			while (!p_fits(key, p_shift))
+			{
+				p_shift += bitsPerLevel;
+			}
+			p_root = p_createPath(key, p_shift, value);
+			p_size = 1;
+			return;
+		}
+		while (!p_fits(key, p_shift))
+		{
+			auto newRoot = p_allocateNode< Node* >(1u);
+			*p_getSlots< Node* >(newRoot) = p_root;
+			p_root = newRoot;
+			p_shift += bitsPerLevel;
+			p_updateSummary(p_root, p_shift);
+		}
+		if (!find(key))
+		{
+			++p_size;
+		}
+		p_root = p_set(p_root, p_shift, key, value);
+	}
+
+	bool erase(KeyT key)
+	{
+		if (!find(key))
+		{
+			return false;
+		}
+		p_root = p_erase(p_root, p_shift, key);
+		--p_size;
+		if (!p_root)
+		{
+			p_shift = 0;
+		}
+		return true;
+	}
+
+	// in the order of keys
+	template < class CallbackT >
+	void foreach(const CallbackT& callback) const
+	{
+		if (p_root)
+		{
+			p_foreach(p_root, p_shift, callback);
+		}
+	}
+
+	// the greatest value by LessT, nullptr if the map is empty
+	const ValueT* getGreatest() const
+	{
+		return p_root ? p_root->greatest : nullptr;
+	}
+	// the values which are not less than the greatest one, in the order of keys
+	template < class CallbackT >
+	void foreachGreatest(const CallbackT& callback) const
+	{
+		if (p_root)
+		{
+			p_foreachGreatest(p_root, p_shift, *p_root->greatest, callback);
+		}
+	}
+};
+
+}
+}
+
+#endif
+
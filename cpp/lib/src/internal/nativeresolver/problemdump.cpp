@@ -0,0 +1,223 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <algorithm>
+
+#include <cupt/config.hpp>
+#include <cupt/cache.hpp>
+#include <cupt/file.hpp>
+
+#include <internal/nativeresolver/problemdump.hpp>
+#include <internal/cachefiles.hpp>
+#include <internal/filesystem.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+void writeFile(const string& path, const string& content)
+{
+	fs::mkpath(fs::dirname(path));
+	RequiredFile file(path, "w");
+	if (!content.empty())
+	{
+		file.put(content);
+	}
+}
+
+void copyFile(const string& sourcePath, const string& targetPath)
+{
+	if (!fs::fileExists(sourcePath))
+	{
+		return;
+	}
+	string content;
+	RequiredFile(sourcePath, "r").getFile(content);
+	writeFile(targetPath, content);
+}
+
+// these point outside of the dump, the reader sets them to the dump ones
+bool isPathOption(const string& name)
+{
+	return name == "dir" || name.compare(0, 5, "dir::") == 0 ||
+			name.compare(0, 15, "cupt::directory") == 0 ||
+			name == "gpgv::trustedkeyring" ||
+			name == "cupt::resolver::problem-dump-directory";
+}
+
+// the dump is meant to be passed around, so user names and passwords of
+// URIs don't go to it; proxies don't matter for resolving at all
+bool isProxyOption(const string& name)
+{
+	return name.find("::proxy") != string::npos;
+}
+
+string removeCredentials(string uri)
+{
+	auto schemeEnd = uri.find("://");
+	if (schemeEnd == string::npos)
+	{
+		return uri;
+	}
+	auto authorityBegin = schemeEnd + 3;
+	auto authorityEnd = std::min(uri.find('/', authorityBegin), uri.size());
+	auto credentialsEnd = uri.rfind('@', authorityEnd);
+	if (credentialsEnd != string::npos && credentialsEnd >= authorityBegin && credentialsEnd < authorityEnd)
+	{
+		uri.erase(authorityBegin, credentialsEnd + 1 - authorityBegin);
+	}
+	return uri;
+}
+
+string getImportanceString(system::Resolver::RequestImportance importance)
+{
+	if (importance == system::Resolver::RequestImportance::Must)
+	{
+		return "must";
+	}
+	else if (importance == system::Resolver::RequestImportance::Try)
+	{
+		return "try";
+	}
+	else if (importance == system::Resolver::RequestImportance::Wish)
+	{
+		return "wish";
+	}
+	else
+	{
+		return format2("%u", uint32_t(importance));
+	}
+}
+
+void writeSources(const Config& config, const Config& targetConfig, const Cache& cache)
+{
+	string sourcesList;
+	for (const auto& entry: cache.getIndexEntries())
+	{
+		if (entry.category != Cache::IndexEntry::Binary)
+		{
+			continue;
+		}
+		// list paths are made from the URI, so the dump ones from the cleaned one
+		auto targetEntry = entry;
+		targetEntry.uri = removeCredentials(entry.uri);
+
+		string options;
+		for (const auto& option: entry.options)
+		{
+			options += format2(" %s=%s", option.first, option.second);
+		}
+		sourcesList += format2("deb%s %s %s%s\n", options.empty() ? "" : " [" + options + " ]",
+				targetEntry.uri, entry.distribution, entry.component.empty() ? "" : " " + entry.component);
+
+		auto releasePath = cachefiles::getPathOfMasterReleaseLikeList(config, entry);
+		if (!releasePath.empty())
+		{
+			auto targetPath = fs::dirname(cachefiles::getPathOfReleaseList(targetConfig, targetEntry)) +
+					'/' + fs::filename(releasePath);
+			copyFile(releasePath, targetPath);
+			copyFile(releasePath + ".gpg", targetPath + ".gpg");
+		}
+		copyFile(cachefiles::getPathOfIndexList(config, entry),
+				cachefiles::getPathOfIndexList(targetConfig, targetEntry));
+	}
+
+	writeFile(targetConfig.getPath("dir::etc::sourcelist"), sourcesList);
+}
+
+void writePreferences(const Config& config, const Config& targetConfig)
+{
+	copyFile(config.getPath("dir::etc::preferences"), targetConfig.getPath("dir::etc::preferences"));
+	auto targetPartsDirectory = targetConfig.getPath("dir::etc::preferencesparts");
+	for (const auto& path: fs::glob(config.getPath("dir::etc::preferencesparts") + "/*"))
+	{
+		copyFile(path, targetPartsDirectory + '/' + fs::filename(path));
+	}
+}
+
+void writeConfig(const Config& config, const Config& targetConfig)
+{
+	string content;
+	for (const auto& name: config.getScalarOptionNames())
+	{
+		auto value = config.getString(name);
+		if (!value.empty() && !isPathOption(name) && !isProxyOption(name))
+		{
+			content += format2("%s \"%s\";\n", name, removeCredentials(value));
+		}
+	}
+	for (const auto& name: config.getListOptionNames())
+	{
+		if (isPathOption(name) || isProxyOption(name))
+		{
+			continue;
+		}
+		content += format2("%s {};\n", name);
+		for (const auto& value: config.getList(name))
+		{
+			content += format2("%s { \"%s\"; };\n", name, removeCredentials(value));
+		}
+	}
+
+	writeFile(targetConfig.getPath("cupt::directory::configuration::main"), content);
+}
+
+void writeRequests(const string& path, const ResolverRequests& requests)
+{
+	string content;
+	if (requests.upgrade)
+	{
+		content += "Request: upgrade\n\n";
+	}
+	for (const auto& item: requests.relationExpressions)
+	{
+		content += format2("Request: %s\nRelation: %s\nImportance: %s\nAutomatic: %s\nAnnotation: %s\n\n",
+				item.invert ? "unsatisfy" : "satisfy", item.expression.toString(),
+				getImportanceString(item.importance), item.asAuto ? "yes" : "no", item.annotation);
+	}
+	for (const auto& item: requests.autoStatusOverrides)
+	{
+		content += format2("Request: set-automatic\nPackage: %s\nAutomatic: %s\n\n",
+				item.first, item.second ? "yes" : "no");
+	}
+	writeFile(path, content);
+}
+
+}
+
+void dumpResolverProblem(const string& directory, const Config& config, const Cache& cache,
+		const ResolverRequests& requests)
+{
+	Config targetConfig(config);
+	targetConfig.setScalar("dir", directory);
+	targetConfig.setScalar("cupt::directory", directory);
+	targetConfig.setScalar("dir::state::status", directory + "/var/lib/dpkg/status");
+	targetConfig.setScalar("gpgv::trustedkeyring", directory + "/var/lib/cupt/trusted.gpg");
+	fs::mkpath(directory);
+
+	writeSources(config, targetConfig, cache);
+	copyFile(config.getPath("dir::state::status"), targetConfig.getPath("dir::state::status"));
+	copyFile(cachefiles::getPathOfExtendedStates(config), cachefiles::getPathOfExtendedStates(targetConfig));
+	copyFile(config.getPath("gpgv::trustedkeyring"), targetConfig.getPath("gpgv::trustedkeyring"));
+	writePreferences(config, targetConfig);
+	writeConfig(config, targetConfig);
+	writeRequests(directory + "/request", requests);
+}
+
+}
+}
@@ -0,0 +1,48 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NATIVERESOLVER_PROBLEMDUMP_SEEN
+#define CUPT_INTERNAL_NATIVERESOLVER_PROBLEMDUMP_SEEN
+
+#include <cupt/fwd.hpp>
+
+#include <internal/nativeresolver/dependencygraph.hpp>
+
+namespace cupt {
+namespace internal {
+
+struct ResolverRequests
+{
+	bool upgrade;
+	const vector< dependencygraph::UserRelationExpression >& relationExpressions;
+	const map< string, bool >& autoStatusOverrides;
+};
+
+/* writes everything the resolver depends on to the directory, which is laid
+   out as a root directory usable with the 'dir', 'cupt::directory',
+   'dir::state::status' and 'gpgv::trustedkeyring' options pointed into it:
+   the sources list, the release and binary index lists, the dpkg status,
+   extended states, preferences, the configuration (as 'config-dump' prints
+   it, without path options) and the file 'request' with the requests in
+   the control file format */
+void dumpResolverProblem(const string& directory, const Config&, const Cache&,
+		const ResolverRequests&);
+
+}
+}
+
+#endif
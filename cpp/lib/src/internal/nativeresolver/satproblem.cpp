@@ -0,0 +1,375 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <unordered_set>
+
+#include <internal/nativeresolver/satproblem.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+// the at-most-one constraint gets auxiliary variables above this size
+const size_t maxPairwiseGroupSize = 6;
+
+}
+
+// unfolds everything reachable from the initial solution
+void SatProblem::p_collectElements(const Solution& initialSolution,
+		vector< const dg::Element* >* versionElementPtrs,
+		vector< const dg::Element* >* relationElementPtrs)
+{
+	std::unordered_set< const dg::Element* > known;
+	auto addVersionElement = [&known, versionElementPtrs](const dg::Element* elementPtr)
+	{
+		if (elementPtr && known.insert(elementPtr).second)
+		{
+			versionElementPtrs->push_back(elementPtr);
+		}
+	};
+
+	for (auto elementPtr: initialSolution.getElements())
+	{
+		if (dynamic_cast< const dg::VersionVertex* >(elementPtr))
+		{
+			addVersionElement(elementPtr);
+		}
+	}
+	for (size_t i = 0; i < versionElementPtrs->size(); ++i)
+	{
+		auto elementPtr = (*versionElementPtrs)[i];
+		p_solutionStorage.unfoldElement(elementPtr);
+		addVersionElement(p_solutionStorage.getCorrespondingEmptyElement(elementPtr));
+		for (auto relatedElementPtr: SolutionStorage::getConflictingElements(elementPtr))
+		{
+			addVersionElement(relatedElementPtr);
+		}
+
+		for (auto relationElementPtr: p_solutionStorage.getSuccessorElements(elementPtr))
+		{
+			if (!known.insert(relationElementPtr).second)
+			{
+				continue;
+			}
+			relationElementPtrs->push_back(relationElementPtr);
+			for (auto successorElementPtr: p_solutionStorage.getSuccessorElements(relationElementPtr))
+			{
+				if (dynamic_cast< const dg::VersionVertex* >(successorElementPtr))
+				{
+					addVersionElement(successorElementPtr);
+				}
+				else if (known.insert(successorElementPtr).second)
+				{
+					p_unsatisfiedElementPtrs.push_back(successorElementPtr);
+				}
+			}
+		}
+	}
+}
+
+SatSolver::Literal SatProblem::p_getLiteral(const dg::Element* elementPtr, bool positive) const
+{
+	return SatSolver::getLiteral(p_variables.find(elementPtr)->second, positive);
+}
+
+void SatProblem::p_addAtMostOne(const vector< SatSolver::Literal >& literals)
+{
+	if (literals.size() <= maxPairwiseGroupSize)
+	{
+		for (size_t i = 0; i < literals.size(); ++i)
+		{
+			for (size_t j = i+1; j < literals.size(); ++j)
+			{
+				p_solver.addClause({ literals[i] ^ 1, literals[j] ^ 1 });
+			}
+		}
+		return;
+	}
+
+	// sequential counter: 'previous' is true if any of the literals before is
+	SatSolver::Literal previous = 0;
+	for (size_t i = 0; i < literals.size(); ++i)
+	{
+		auto negated = literals[i] ^ 1;
+		if (i)
+		{
+			p_solver.addClause({ negated, previous ^ 1 });
+		}
+		if (i + 1 == literals.size())
+		{
+			break;
+		}
+		auto current = SatSolver::getLiteral(p_solver.addVariable(0, false, true), true);
+		p_solver.addClause({ negated, current });
+		if (i)
+		{
+			p_solver.addClause({ previous ^ 1, current });
+		}
+		previous = current;
+	}
+}
+
+SatProblem::SatProblem(SolutionStorage& solutionStorage, const Solution& initialSolution,
+		const ProfitGetter& getProfit, size_t improvementConflictLimit)
+	: p_solutionStorage(solutionStorage), p_score(0)
+{
+	p_solver.setImprovementConflictLimit(improvementConflictLimit);
+
+	vector< const dg::Element* > versionElementPtrs;
+	vector< const dg::Element* > relationElementPtrs;
+	p_collectElements(initialSolution, &versionElementPtrs, &relationElementPtrs);
+
+	{ // grouping by packages
+		std::unordered_map< nametable::Id, size_t > packageIndexes;
+		for (auto elementPtr: versionElementPtrs)
+		{
+			auto packageNameId = static_cast< const dg::VersionVertex* >(elementPtr)->getPackageNameId();
+			auto insertResult = packageIndexes.insert({ packageNameId, p_packages.size() });
+			if (insertResult.second)
+			{
+				p_packages.push_back(Package{ {}, nullptr, false });
+			}
+			auto& package = p_packages[insertResult.first->second];
+			package.elementPtrs.push_back(elementPtr);
+			if (initialSolution.getPackageEntry(elementPtr))
+			{
+				package.initialElementPtr = elementPtr;
+				package.isInitiallyPresent = true;
+			}
+		}
+		for (auto& package: p_packages)
+		{
+			if (package.initialElementPtr)
+			{
+				continue;
+			}
+			for (auto elementPtr: package.elementPtrs)
+			{
+				if (!static_cast< const dg::VersionVertex* >(elementPtr)->version)
+				{
+					package.initialElementPtr = elementPtr; // not installed is the same as removed
+				}
+			}
+		}
+	}
+
+	ssize_t maxProfit = 0;
+	for (const auto& package: p_packages)
+	{
+		for (auto elementPtr: package.elementPtrs)
+		{
+			if (elementPtr != package.initialElementPtr)
+			{
+				auto profit = getProfit(package.initialElementPtr, elementPtr);
+				p_profits[elementPtr] = profit;
+				maxProfit = std::max(maxProfit, profit);
+			}
+		}
+	}
+	for (auto elementPtr: p_unsatisfiedElementPtrs)
+	{
+		auto profit = getProfit(nullptr, elementPtr);
+		p_profits[elementPtr] = profit;
+		maxProfit = std::max(maxProfit, profit);
+	}
+
+	auto addVariable = [this, maxProfit](const dg::Element* elementPtr, bool initial)
+	{
+		size_t cost = initial ? 0 : (maxProfit + 1 - p_profits[elementPtr]);
+		p_variables[elementPtr] = p_solver.addVariable(cost, initial);
+	};
+	for (const auto& package: p_packages)
+	{
+		for (auto elementPtr: package.elementPtrs)
+		{
+			addVariable(elementPtr, elementPtr == package.initialElementPtr);
+		}
+	}
+	for (auto elementPtr: p_unsatisfiedElementPtrs)
+	{
+		addVariable(elementPtr, false);
+	}
+	for (auto elementPtr: relationElementPtrs)
+	{
+		p_variables[elementPtr] = p_solver.addVariable(0, false, true);
+	}
+
+	// one element per package
+	for (const auto& package: p_packages)
+	{
+		vector< SatSolver::Literal > literals;
+		for (auto elementPtr: package.elementPtrs)
+		{
+			literals.push_back(p_getLiteral(elementPtr, true));
+		}
+		p_addAtMostOne(literals);
+		if (package.initialElementPtr)
+		{
+			p_solver.addClause(std::move(literals));
+
+			vector< SatSolver::Variable > variables;
+			for (auto elementPtr: package.elementPtrs)
+			{
+				variables.push_back(p_variables[elementPtr]);
+			}
+			p_solver.addCostGroup(std::move(variables));
+		}
+	}
+
+	// relations of chosen versions are satisfied...
+	for (auto elementPtr: versionElementPtrs)
+	{
+		for (auto relationElementPtr: p_solutionStorage.getSuccessorElements(elementPtr))
+		{
+			p_solver.addClause({ p_getLiteral(elementPtr, false), p_getLiteral(relationElementPtr, true) });
+		}
+	}
+	for (auto relationElementPtr: relationElementPtrs)
+	{
+		vector< SatSolver::Literal > literals = { p_getLiteral(relationElementPtr, false) };
+		for (auto successorElementPtr: p_solutionStorage.getSuccessorElements(relationElementPtr))
+		{
+			literals.push_back(p_getLiteral(successorElementPtr, true));
+		}
+		p_solver.addClause(std::move(literals));
+
+		// ...and only they are the relations to satisfy
+		literals = { p_getLiteral(relationElementPtr, false) };
+		for (auto predecessorElementPtr: p_solutionStorage.getPredecessorElements(relationElementPtr))
+		{
+			if (p_variables.count(predecessorElementPtr))
+			{
+				literals.push_back(p_getLiteral(predecessorElementPtr, true));
+			}
+		}
+		p_solver.addClause(std::move(literals));
+	}
+
+	// new packages are installed only to satisfy something
+	for (const auto& package: p_packages)
+	{
+		if (package.isInitiallyPresent)
+		{
+			continue;
+		}
+		for (auto elementPtr: package.elementPtrs)
+		{
+			if (elementPtr == package.initialElementPtr)
+			{
+				continue;
+			}
+			vector< SatSolver::Literal > literals = { p_getLiteral(elementPtr, false) };
+			for (auto predecessorElementPtr: p_solutionStorage.getPredecessorElements(elementPtr))
+			{
+				if (p_variables.count(predecessorElementPtr))
+				{
+					literals.push_back(p_getLiteral(predecessorElementPtr, true));
+				}
+			}
+			p_solver.addClause(std::move(literals));
+		}
+	}
+}
+
+bool SatProblem::solve(vector< const dg::Element* >* changedElementPtrs)
+{
+	changedElementPtrs->clear();
+	if (!p_solver.solve())
+	{
+		return false;
+	}
+
+	p_score = 0;
+	auto isChosen = [this](const dg::Element* elementPtr)
+	{
+		return p_solver.getValue(p_variables.find(elementPtr)->second);
+	};
+	for (const auto& package: p_packages)
+	{
+		for (auto elementPtr: package.elementPtrs)
+		{
+			if (elementPtr != package.initialElementPtr && isChosen(elementPtr))
+			{
+				changedElementPtrs->push_back(elementPtr);
+			}
+		}
+	}
+	for (auto elementPtr: p_unsatisfiedElementPtrs)
+	{
+		if (isChosen(elementPtr))
+		{
+			changedElementPtrs->push_back(elementPtr);
+		}
+	}
+	for (auto elementPtr: *changedElementPtrs)
+	{
+		p_score += p_profits[elementPtr];
+	}
+	return true;
+}
+
+ssize_t SatProblem::getScore() const
+{
+	return p_score;
+}
+
+void SatProblem::forbid(const vector< const dg::Element* >& changedElementPtrs)
+{
+	vector< SatSolver::Literal > literals;
+	if (changedElementPtrs.empty())
+	{
+		// leaving everything as it is was declined, so something has to change
+		for (const auto& package: p_packages)
+		{
+			for (auto elementPtr: package.elementPtrs)
+			{
+				if (elementPtr != package.initialElementPtr)
+				{
+					literals.push_back(p_getLiteral(elementPtr, true));
+				}
+			}
+		}
+		for (auto elementPtr: p_unsatisfiedElementPtrs)
+		{
+			literals.push_back(p_getLiteral(elementPtr, true));
+		}
+	}
+	for (auto elementPtr: changedElementPtrs)
+	{
+		literals.push_back(p_getLiteral(elementPtr, false));
+	}
+	p_solver.addClause(std::move(literals));
+}
+
+const SatSolver::Statistics& SatProblem::getStatistics() const
+{
+	return p_solver.getStatistics();
+}
+
+string SatProblem::getStatisticsString() const
+{
+	const auto& statistics = p_solver.getStatistics();
+	return format2("%zu variables, %zu clauses, %zu decisions, %zu conflicts, %zu restarts, %zu models%s",
+			p_solver.getVariableCount(), p_solver.getClauseCount(), statistics.decisions,
+			statistics.conflicts, statistics.restarts, statistics.models,
+			p_solver.isOptimal() ? ", optimal" : "");
+}
+
+}
+}
+
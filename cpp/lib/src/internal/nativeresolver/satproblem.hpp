@@ -0,0 +1,80 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NATIVERESOLVER_SATPROBLEM_SEEN
+#define CUPT_INTERNAL_NATIVERESOLVER_SATPROBLEM_SEEN
+
+#include <functional>
+#include <unordered_map>
+
+#include <internal/nativeresolver/solution.hpp>
+#include <internal/nativeresolver/satsolver.hpp>
+
+namespace cupt {
+namespace internal {
+
+/* the whole dependency graph reachable from the initial solution as CNF:
+   every package has exactly one of its elements (or none, if it wasn't there
+   and cannot be removed), every relation vertex of a chosen version has one
+   of its successors chosen, and new versions are chosen only for some
+   relation vertex of a chosen element; the cost of a change is its profit
+   subtracted from the profit of the best possible change plus one, so that no
+   change which is not needed is made */
+class SatProblem
+{
+ public:
+	typedef std::function< ssize_t (const dg::Element*, const dg::Element*) > ProfitGetter;
+ private:
+	struct Package
+	{
+		vector< const dg::Element* > elementPtrs;
+		const dg::Element* initialElementPtr; // may be NULL
+		bool isInitiallyPresent;
+	};
+
+	SolutionStorage& p_solutionStorage;
+	SatSolver p_solver;
+	std::unordered_map< const dg::Element*, SatSolver::Variable > p_variables;
+	vector< Package > p_packages;
+	vector< const dg::Element* > p_unsatisfiedElementPtrs;
+	std::unordered_map< const dg::Element*, ssize_t > p_profits;
+	ssize_t p_score;
+
+	void p_collectElements(const Solution&, vector< const dg::Element* >*,
+			vector< const dg::Element* >*);
+	void p_addAtMostOne(const vector< SatSolver::Literal >&);
+	SatSolver::Literal p_getLiteral(const dg::Element*, bool) const;
+ public:
+	SatProblem(SolutionStorage&, const Solution& initialSolution, const ProfitGetter&,
+			size_t improvementConflictLimit);
+
+	// fills the elements to put to the initial solution, returns false if
+	// there is no (more) solutions
+	bool solve(vector< const dg::Element* >* changedElementPtrs);
+	ssize_t getScore() const; // of the last solution
+	// no further solution will have all these changes; if there are none,
+	// every further solution will change something
+	void forbid(const vector< const dg::Element* >& changedElementPtrs);
+	const SatSolver::Statistics& getStatistics() const;
+	string getStatisticsString() const;
+};
+
+}
+}
+
+#endif
+
@@ -0,0 +1,853 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#include <algorithm>
+
+#include <internal/nativeresolver/satsolver.hpp>
+
+namespace cupt {
+namespace internal {
+
+namespace {
+
+SatSolver::Variable getVariable(SatSolver::Literal literal)
+{
+	return literal >> 1;
+}
+
+SatSolver::Literal negate(SatSolver::Literal literal)
+{
+	return literal ^ 1;
+}
+
+bool isPositive(SatSolver::Literal literal)
+{
+	return !(literal & 1);
+}
+
+// 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, ...
+size_t getLubyValue(size_t index)
+{
+	size_t size = 1;
+	size_t power = 1;
+	while (size < index + 1)
+	{
+		size = 2*size + 1;
+		power *= 2;
+	}
+	while (size - 1 != index)
+	{
+		size = (size - 1) / 2;
+		power /= 2;
+		index %= size;
+	}
+	return power;
+}
+
+const size_t restartUnit = 100;
+const double activityDecay = 0.95;
+const double clauseActivityDecay = 0.999;
+
+}
+
+struct SatSolver::Clause
+{
+	vector< Literal > literals;
+	double activity;
+	bool learned;
+	bool boundDependent; // derived using the bound of the best model
+
+	Clause(vector< Literal >&& literals_, bool learned_, bool boundDependent_ = false)
+		: literals(std::move(literals_)), activity(0), learned(learned_),
+		boundDependent(boundDependent_)
+	{}
+};
+
+// binary max-heap of unassigned variables, non-auxiliary first, by activity
+class SatSolver::VariableHeap
+{
+	const vector< double >& p_activities;
+	const vector< bool >& p_auxiliaries;
+	vector< Variable > p_heap;
+	vector< size_t > p_positions; // noPosition if not in the heap
+
+	static const size_t noPosition = size_t(-1);
+
+	bool p_less(Variable left, Variable right) const
+	{
+		if (p_auxiliaries[left] != p_auxiliaries[right])
+		{
+			return p_auxiliaries[left];
+		}
+		return p_activities[left] < p_activities[right];
+	}
+	void p_place(size_t position, Variable variable)
+	{
+		p_heap[position] = variable;
+		p_positions[variable] = position;
+	}
+	void p_siftUp(size_t position)
+	{
+		auto variable = p_heap[position];
+		while (position)
+		{
+			auto parentPosition = (position - 1) / 2;
+			if (!p_less(p_heap[parentPosition], variable))
+			{
+				break;
+			}
+			p_place(position, p_heap[parentPosition]);
+			position = parentPosition;
+		}
+		p_place(position, variable);
+	}
+	void p_siftDown(size_t position)
+	{
+		auto variable = p_heap[position];
+		while (true)
+		{
+			auto childPosition = 2*position + 1;
+			if (childPosition >= p_heap.size())
+			{
+				break;
+			}
+			if (childPosition + 1 < p_heap.size() &&
+					p_less(p_heap[childPosition], p_heap[childPosition+1]))
+			{
+				++childPosition;
+			}
+			if (!p_less(variable, p_heap[childPosition]))
+			{
+				break;
+			}
+			p_place(position, p_heap[childPosition]);
+			position = childPosition;
+		}
+		p_place(position, variable);
+	}
+ public:
+	VariableHeap(const vector< double >& activities, const vector< bool >& auxiliaries)
+		: p_activities(activities), p_auxiliaries(auxiliaries), p_positions(activities.size(), noPosition)
+	{}
+
+	bool empty() const
+	{
+		return p_heap.empty();
+	}
+	bool contains(Variable variable) const
+	{
+		return p_positions[variable] != noPosition;
+	}
+	void insert(Variable variable)
+	{
+		if (contains(variable))
+		{
+			return;
+		}
+		p_heap.push_back(variable);
+		p_siftUp(p_heap.size() - 1);
+	}
+	// after the activity of the variable was increased
+	void increase(Variable variable)
+	{
+		if (contains(variable))
+		{
+			p_siftUp(p_positions[variable]);
+		}
+	}
+	Variable pop()
+	{
+		auto result = p_heap.front();
+		p_positions[result] = noPosition;
+		auto last = p_heap.back();
+		p_heap.pop_back();
+		if (!p_heap.empty())
+		{
+			p_place(0, last);
+			p_siftDown(0);
+		}
+		return result;
+	}
+};
+const size_t SatSolver::VariableHeap::noPosition;
+const uint32_t SatSolver::noGroup;
+
+SatSolver::SatSolver()
+	: p_activityIncrement(1), p_clauseActivityIncrement(1), p_maxLearnedCount(0),
+	p_modelCost(0), p_optimal(false), p_improvementConflictLimit(0), p_statistics()
+{}
+
+SatSolver::~SatSolver()
+{}
+
+SatSolver::Variable SatSolver::addVariable(size_t cost, bool preferredValue, bool auxiliary)
+{
+	p_costs.push_back(cost);
+	p_preferredPhases.push_back(preferredValue);
+	p_auxiliaries.push_back(auxiliary);
+	p_groupIndexes.push_back(noGroup);
+	return p_costs.size() - 1;
+}
+
+void SatSolver::addCostGroup(vector< Variable > variables)
+{
+	std::stable_sort(variables.begin(), variables.end(),
+			[this](Variable left, Variable right) { return p_costs[left] < p_costs[right]; });
+	for (auto variable: variables)
+	{
+		p_groupIndexes[variable] = p_costGroups.size();
+	}
+	p_costGroups.push_back(std::move(variables));
+}
+
+void SatSolver::addClause(vector< Literal > literals)
+{
+	std::sort(literals.begin(), literals.end());
+	literals.erase(std::unique(literals.begin(), literals.end()), literals.end());
+	for (size_t i = 1; i < literals.size(); ++i)
+	{
+		if (literals[i] == negate(literals[i-1]))
+		{
+			return; // always satisfied
+		}
+	}
+	p_originalClauses.push_back(std::move(literals));
+}
+
+void SatSolver::setImprovementConflictLimit(size_t limit)
+{
+	p_improvementConflictLimit = limit;
+}
+
+size_t SatSolver::getVariableCount() const
+{
+	return p_costs.size();
+}
+
+size_t SatSolver::getClauseCount() const
+{
+	return p_originalClauses.size();
+}
+
+SatSolver::Value SatSolver::p_getValue(Literal literal) const
+{
+	auto value = p_values[getVariable(literal)];
+	return value == Undefined ? Undefined : Value(value ^ (literal & 1));
+}
+
+uint32_t SatSolver::p_getLevel() const
+{
+	return p_trailLimits.size();
+}
+
+void SatSolver::p_assign(Literal literal, Clause* reason)
+{
+	auto variable = getVariable(literal);
+	p_values[variable] = isPositive(literal) ? True : False;
+	p_levels[variable] = p_getLevel();
+	p_reasons[variable] = reason;
+	p_trail.push_back(literal);
+	if (!p_getLevel())
+	{
+		p_boundDependentFacts[variable] = p_isBoundDependent(reason, literal);
+	}
+
+	auto groupIndex = p_groupIndexes[variable];
+	if (groupIndex == noGroup)
+	{
+		if (isPositive(literal))
+		{
+			p_cost += p_costs[variable];
+		}
+	}
+	else if (!isPositive(literal) && p_costs[variable] == p_groupCosts[groupIndex])
+	{
+		p_updateGroupCost(groupIndex);
+	}
+}
+
+// the cost of the cheapest variable which is not false, if all of them are
+// false, the group is going to be a conflict anyway
+void SatSolver::p_updateGroupCost(uint32_t groupIndex)
+{
+	const auto& variables = p_costGroups[groupIndex];
+	size_t newCost = p_costs[variables.back()];
+	for (auto variable: variables)
+	{
+		if (p_values[variable] != False)
+		{
+			newCost = p_costs[variable];
+			break;
+		}
+	}
+	auto& groupCost = p_groupCosts[groupIndex];
+	p_cost = p_cost - groupCost + newCost;
+	groupCost = newCost;
+}
+
+void SatSolver::p_backtrack(uint32_t level)
+{
+	if (p_getLevel() <= level)
+	{
+		return;
+	}
+	auto limit = p_trailLimits[level];
+	for (size_t i = p_trail.size(); i > limit; --i)
+	{
+		auto literal = p_trail[i-1];
+		auto variable = getVariable(literal);
+		auto groupIndex = p_groupIndexes[variable];
+		if (groupIndex == noGroup)
+		{
+			if (isPositive(literal))
+			{
+				p_cost -= p_costs[variable];
+			}
+		}
+		else if (!isPositive(literal) && p_costs[variable] < p_groupCosts[groupIndex])
+		{
+			p_cost -= p_groupCosts[groupIndex] - p_costs[variable];
+			p_groupCosts[groupIndex] = p_costs[variable];
+		}
+		p_phases[variable] = isPositive(literal);
+		p_values[variable] = Undefined;
+		p_reasons[variable] = nullptr;
+		p_heap->insert(variable);
+	}
+	p_trail.resize(limit);
+	p_trailLimits.resize(level);
+	p_propagationHead = limit;
+}
+
+void SatSolver::p_attach(Clause* clause)
+{
+	p_watches[clause->literals[0]].push_back(clause);
+	p_watches[clause->literals[1]].push_back(clause);
+}
+
+bool SatSolver::p_reset()
+{
+	auto variableCount = p_costs.size();
+
+	// what the previous bound implied may be wrong for models which are
+	// allowed now
+	p_learnedClauses.erase(std::remove_if(p_learnedClauses.begin(), p_learnedClauses.end(),
+			[](const std::unique_ptr< Clause >& clause) { return clause->boundDependent; }),
+			p_learnedClauses.end());
+
+	p_clauses.clear();
+	p_watches.assign(2*variableCount, {});
+	p_values.assign(variableCount, Undefined);
+	p_levels.assign(variableCount, 0);
+	p_reasons.assign(variableCount, nullptr);
+	p_boundDependentFacts.assign(variableCount, false);
+	for (auto variable = p_phases.size(); variable < variableCount; ++variable)
+	{
+		p_phases.push_back(p_preferredPhases[variable]);
+	}
+	p_activities.resize(variableCount, 0);
+	p_heap.reset(new VariableHeap(p_activities, p_auxiliaries));
+	for (Variable variable = 0; variable < variableCount; ++variable)
+	{
+		p_heap->insert(variable);
+	}
+	p_trail.clear();
+	p_trailLimits.clear();
+	p_propagationHead = 0;
+	p_cost = 0;
+	p_groupCosts.clear();
+	for (const auto& variables: p_costGroups)
+	{
+		p_groupCosts.push_back(variables.empty() ? 0 : p_costs[variables.front()]);
+		p_cost += p_groupCosts.back();
+	}
+	p_bound = size_t(-1);
+	p_boundClause.reset(new Clause({}, true, true));
+	p_seen.assign(variableCount, 0);
+	p_model.clear();
+
+	p_maxLearnedCount = std::max< size_t >(p_maxLearnedCount,
+			std::max< size_t >(p_originalClauses.size() / 3, 2000));
+
+	auto addUnit = [this](Literal literal)
+	{
+		switch (p_getValue(literal))
+		{
+			case False:
+				return false;
+			case Undefined:
+				p_assign(literal, nullptr);
+			case True:
+				;
+		}
+		return true;
+	};
+	for (const auto& literals: p_originalClauses)
+	{
+		if (literals.empty())
+		{
+			return false;
+		}
+		if (literals.size() == 1)
+		{
+			if (!addUnit(literals[0]))
+			{
+				return false;
+			}
+			continue;
+		}
+		p_clauses.emplace_back(new Clause(vector< Literal >(literals), false));
+		p_attach(p_clauses.back().get());
+	}
+	for (auto literal: p_learnedUnits)
+	{
+		if (!addUnit(literal))
+		{
+			return false;
+		}
+	}
+	for (const auto& clause: p_learnedClauses)
+	{
+		p_attach(clause.get());
+	}
+	return true;
+}
+
+SatSolver::Clause* SatSolver::p_propagate()
+{
+	while (p_propagationHead < p_trail.size())
+	{
+		auto falseLiteral = negate(p_trail[p_propagationHead++]);
+		++p_statistics.propagations;
+
+		auto& watches = p_watches[falseLiteral];
+		size_t keptCount = 0;
+		for (size_t i = 0; i < watches.size(); ++i)
+		{
+			auto clause = watches[i];
+			auto& literals = clause->literals;
+			if (literals[0] == falseLiteral)
+			{
+				std::swap(literals[0], literals[1]);
+			}
+			if (p_getValue(literals[0]) == True)
+			{
+				watches[keptCount++] = clause;
+				continue;
+			}
+
+			bool moved = false;
+			for (size_t k = 2; k < literals.size(); ++k)
+			{
+				if (p_getValue(literals[k]) != False)
+				{
+					std::swap(literals[1], literals[k]);
+					p_watches[literals[1]].push_back(clause);
+					moved = true;
+					break;
+				}
+			}
+			if (moved)
+			{
+				continue;
+			}
+
+			watches[keptCount++] = clause;
+			if (p_getValue(literals[0]) == False)
+			{
+				for (++i; i < watches.size(); ++i)
+				{
+					watches[keptCount++] = watches[i];
+				}
+				watches.resize(keptCount);
+				p_propagationHead = p_trail.size();
+				return clause;
+			}
+			p_assign(literals[0], clause);
+		}
+		watches.resize(keptCount);
+	}
+	return p_checkBound();
+}
+
+// returns the conflict if the assignment is not cheaper than the best model
+SatSolver::Clause* SatSolver::p_checkBound()
+{
+	if (p_cost < p_bound)
+	{
+		return nullptr;
+	}
+
+	// the costliest parts are enough to explain it: a group costs its current
+	// cost unless some cheaper variable of it becomes true
+	struct Part
+	{
+		size_t cost;
+		Variable variable; // if not in a group
+		uint32_t groupIndex;
+	};
+	vector< Part > parts;
+	for (uint32_t groupIndex = 0; groupIndex < p_costGroups.size(); ++groupIndex)
+	{
+		if (p_groupCosts[groupIndex])
+		{
+			parts.push_back({ p_groupCosts[groupIndex], 0, groupIndex });
+		}
+	}
+	for (auto literal: p_trail)
+	{
+		auto variable = getVariable(literal);
+		if (isPositive(literal) && p_costs[variable] && p_groupIndexes[variable] == noGroup)
+		{
+			parts.push_back({ p_costs[variable], variable, noGroup });
+		}
+	}
+	std::stable_sort(parts.begin(), parts.end(),
+			[](const Part& left, const Part& right) { return left.cost > right.cost; });
+
+	auto& literals = p_boundClause->literals;
+	literals.clear();
+	size_t cost = 0;
+	for (const auto& part: parts)
+	{
+		if (cost >= p_bound)
+		{
+			break;
+		}
+		if (part.groupIndex == noGroup)
+		{
+			literals.push_back(getLiteral(part.variable, false));
+		}
+		else
+		{
+			for (auto variable: p_costGroups[part.groupIndex])
+			{
+				if (p_costs[variable] >= part.cost)
+				{
+					break;
+				}
+				literals.push_back(getLiteral(variable, true));
+			}
+		}
+		cost += part.cost;
+	}
+	return p_boundClause.get();
+}
+
+void SatSolver::p_bumpVariable(Variable variable)
+{
+	if ((p_activities[variable] += p_activityIncrement) > 1e100)
+	{
+		for (auto& activity: p_activities)
+		{
+			activity *= 1e-100;
+		}
+		p_activityIncrement *= 1e-100;
+	}
+	p_heap->increase(variable);
+}
+
+void SatSolver::p_bumpClause(Clause* clause)
+{
+	if ((clause->activity += p_clauseActivityIncrement) > 1e20)
+	{
+		for (const auto& learnedClause: p_learnedClauses)
+		{
+			learnedClause->activity *= 1e-20;
+		}
+		p_clauseActivityIncrement *= 1e-20;
+	}
+}
+
+// whether the level 0 assignment of the literal by the clause relies on the
+// bound, directly or through other level 0 assignments
+bool SatSolver::p_isBoundDependent(const Clause* reason, Literal literal) const
+{
+	if (!reason)
+	{
+		return false; // units set it themselves
+	}
+	if (reason->boundDependent)
+	{
+		return true;
+	}
+	for (auto otherLiteral: reason->literals)
+	{
+		if (otherLiteral != literal && p_boundDependentFacts[getVariable(otherLiteral)])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// the conflict must have at least one literal on the current level
+void SatSolver::p_analyze(const Clause* conflict, vector< Literal >* learned,
+		uint32_t* backjumpLevel, bool* boundDependent)
+{
+	*boundDependent = false;
+	learned->assign(1, 0); // placeholder for the asserting literal
+	size_t pathCount = 0;
+	Literal uip = 0;
+	bool uipFound = false;
+	size_t trailIndex = p_trail.size();
+
+	auto clause = conflict;
+	do
+	{
+		if (clause->learned && clause != p_boundClause.get())
+		{
+			p_bumpClause(const_cast< Clause* >(clause));
+		}
+		*boundDependent |= clause->boundDependent;
+		for (size_t i = uipFound ? 1 : 0; i < clause->literals.size(); ++i)
+		{
+			auto literal = clause->literals[i];
+			auto variable = getVariable(literal);
+			if (!p_levels[variable])
+			{
+				*boundDependent |= p_boundDependentFacts[variable];
+				continue;
+			}
+			if (p_seen[variable])
+			{
+				continue;
+			}
+			p_seen[variable] = 1;
+			p_bumpVariable(variable);
+			if (p_levels[variable] == p_getLevel())
+			{
+				++pathCount;
+			}
+			else
+			{
+				learned->push_back(literal);
+			}
+		}
+
+		do
+		{
+			--trailIndex;
+		}
+		while (!p_seen[getVariable(p_trail[trailIndex])]);
+		uip = p_trail[trailIndex];
+		uipFound = true;
+		clause = p_reasons[getVariable(uip)];
+		p_seen[getVariable(uip)] = 0;
+		--pathCount;
+	}
+	while (pathCount);
+	(*learned)[0] = negate(uip);
+
+	*backjumpLevel = 0;
+	size_t maxIndex = 1;
+	for (size_t i = 1; i < learned->size(); ++i)
+	{
+		auto variable = getVariable((*learned)[i]);
+		p_seen[variable] = 0;
+		if (p_levels[variable] > *backjumpLevel)
+		{
+			*backjumpLevel = p_levels[variable];
+			maxIndex = i;
+		}
+	}
+	if (learned->size() > 1)
+	{
+		std::swap((*learned)[1], (*learned)[maxIndex]);
+	}
+}
+
+bool SatSolver::p_isLocked(const Clause* clause) const
+{
+	auto variable = getVariable(clause->literals[0]);
+	return p_reasons[variable] == clause && p_getValue(clause->literals[0]) == True;
+}
+
+void SatSolver::p_reduceLearnedClauses()
+{
+	std::sort(p_learnedClauses.begin(), p_learnedClauses.end(),
+			[](const std::unique_ptr< Clause >& left, const std::unique_ptr< Clause >& right)
+			{
+				return left->activity < right->activity;
+			});
+
+	// the less active half goes, except the clauses which are reasons now
+	vector< const Clause* > removedClauses;
+	auto half = p_learnedClauses.size() / 2;
+	for (size_t i = 0; i < half; ++i)
+	{
+		const auto& clause = p_learnedClauses[i];
+		if (clause->literals.size() > 2 && !p_isLocked(clause.get()))
+		{
+			removedClauses.push_back(clause.get());
+		}
+	}
+	if (removedClauses.empty())
+	{
+		return;
+	}
+	std::sort(removedClauses.begin(), removedClauses.end());
+	auto isRemoved = [&removedClauses](const Clause* clause)
+	{
+		return std::binary_search(removedClauses.begin(), removedClauses.end(), clause);
+	};
+
+	for (auto& watches: p_watches)
+	{
+		watches.erase(std::remove_if(watches.begin(), watches.end(), isRemoved), watches.end());
+	}
+	p_learnedClauses.erase(std::remove_if(p_learnedClauses.begin(), p_learnedClauses.end(),
+			[&isRemoved](const std::unique_ptr< Clause >& clause) { return isRemoved(clause.get()); }),
+			p_learnedClauses.end());
+}
+
+bool SatSolver::solve()
+{
+	p_modelCost = 0;
+	p_optimal = false;
+	if (!p_reset())
+	{
+		return false;
+	}
+
+	size_t restartCount = 0;
+	size_t conflictsSinceModel = 0;
+	size_t conflictsUntilRestart = restartUnit;
+	vector< Literal > learned;
+
+	while (true)
+	{
+		auto conflict = p_propagate();
+		if (conflict)
+		{
+			++p_statistics.conflicts;
+
+			// a bound conflict may be caused by assignments of earlier levels only
+			uint32_t conflictLevel = 0;
+			for (auto literal: conflict->literals)
+			{
+				conflictLevel = std::max(conflictLevel, p_levels[getVariable(literal)]);
+			}
+			if (!conflictLevel)
+			{
+				p_optimal = true; // nothing to search any more
+				break;
+			}
+			if (!p_model.empty() && ++conflictsSinceModel == p_improvementConflictLimit)
+			{
+				break; // good enough
+			}
+			p_backtrack(conflictLevel);
+
+			uint32_t backjumpLevel;
+			bool boundDependent;
+			p_analyze(conflict, &learned, &backjumpLevel, &boundDependent);
+			p_backtrack(backjumpLevel);
+			if (learned.size() == 1)
+			{
+				p_assign(learned[0], nullptr);
+				p_boundDependentFacts[getVariable(learned[0])] = boundDependent;
+				if (!boundDependent)
+				{
+					p_learnedUnits.push_back(learned[0]);
+				}
+			}
+			else
+			{
+				p_learnedClauses.emplace_back(new Clause(vector< Literal >(learned), true, boundDependent));
+				auto clause = p_learnedClauses.back().get();
+				p_attach(clause);
+				p_bumpClause(clause);
+				p_assign(learned[0], clause);
+			}
+			p_activityIncrement /= activityDecay;
+			p_clauseActivityIncrement /= clauseActivityDecay;
+
+			if (!--conflictsUntilRestart)
+			{
+				++restartCount;
+				++p_statistics.restarts;
+				conflictsUntilRestart = restartUnit * getLubyValue(restartCount);
+				p_backtrack(0);
+			}
+			if (p_learnedClauses.size() >= p_maxLearnedCount + p_trail.size())
+			{
+				p_reduceLearnedClauses();
+				p_maxLearnedCount += p_maxLearnedCount / 10;
+			}
+			continue;
+		}
+
+		Variable decision = 0;
+		bool found = false;
+		while (!p_heap->empty())
+		{
+			decision = p_heap->pop();
+			if (p_values[decision] == Undefined)
+			{
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+		{
+			// a model, and a cheaper one than all previous
+			++p_statistics.models;
+			p_model = p_values;
+			p_modelCost = p_cost;
+			p_bound = p_cost;
+			conflictsSinceModel = 0;
+			if (!p_bound)
+			{
+				p_optimal = true;
+				break;
+			}
+			p_backtrack(0);
+			continue;
+		}
+
+		++p_statistics.decisions;
+		p_trailLimits.push_back(p_trail.size());
+		p_assign(getLiteral(decision, p_phases[decision]), nullptr);
+	}
+
+	return !p_model.empty();
+}
+
+bool SatSolver::getValue(Variable variable) const
+{
+	return p_model[variable] == True;
+}
+
+size_t SatSolver::getCost() const
+{
+	return p_modelCost;
+}
+
+bool SatSolver::isOptimal() const
+{
+	return p_optimal;
+}
+
+const SatSolver::Statistics& SatSolver::getStatistics() const
+{
+	return p_statistics;
+}
+
+}
+}
+
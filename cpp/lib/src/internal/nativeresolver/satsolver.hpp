@@ -0,0 +1,147 @@
+/**************************************************************************
+*   Copyright (C) 2013 by Eugene V. Lyubimkin                             *
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License                  *
+*   (version 3 or above) as published by the Free Software Foundation.    *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU GPL                        *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
+**************************************************************************/
+#ifndef CUPT_INTERNAL_NATIVERESOLVER_SATSOLVER_SEEN
+#define CUPT_INTERNAL_NATIVERESOLVER_SATSOLVER_SEEN
+
+#include <memory>
+
+#include <cupt/common.hpp>
+
+namespace cupt {
+namespace internal {
+
+/* conflict-driven clause learning SAT solver (two watched literals, first UIP
+   learning, VSIDS decisions with phase saving, Luby restarts) which searches
+   for the model with the minimal total cost of true variables by branch and
+   bound: every found model tightens the bound, and a partial assignment which
+   already costs as much as the best model is a conflict; the variables of a
+   cost group cost at least as much as the cheapest of them not yet false */
+class SatSolver
+{
+ public:
+	typedef uint32_t Variable;
+	typedef uint32_t Literal;
+
+	static Literal getLiteral(Variable variable, bool positive)
+	{
+		return (variable << 1) | !positive;
+	}
+
+	struct Statistics
+	{
+		size_t decisions;
+		size_t propagations;
+		size_t conflicts;
+		size_t restarts;
+		size_t models;
+	};
+ private:
+	enum Value: uint8_t { False = 0, True = 1, Undefined = 2 };
+	struct Clause;
+	class VariableHeap;
+
+	static const uint32_t noGroup = uint32_t(-1);
+
+	vector< vector< Literal > > p_originalClauses;
+	vector< size_t > p_costs;
+	vector< bool > p_preferredPhases;
+	vector< bool > p_auxiliaries;
+	vector< vector< Variable > > p_costGroups; // sorted by cost
+	vector< uint32_t > p_groupIndexes; // by variable
+
+	// search state, the assignment is rebuilt by each solve(); learned clauses,
+	// activities and phases are kept unless they depend on a previous bound
+	vector< std::unique_ptr< Clause > > p_clauses;
+	vector< std::unique_ptr< Clause > > p_learnedClauses;
+	vector< Literal > p_learnedUnits;
+	vector< vector< Clause* > > p_watches; // by literal
+	vector< Value > p_values;
+	vector< uint32_t > p_levels;
+	vector< Clause* > p_reasons;
+	vector< bool > p_boundDependentFacts; // for level 0 assignments
+	vector< bool > p_phases;
+	vector< double > p_activities;
+	std::unique_ptr< VariableHeap > p_heap;
+	vector< Literal > p_trail;
+	vector< size_t > p_trailLimits;
+	size_t p_propagationHead;
+	double p_activityIncrement;
+	double p_clauseActivityIncrement;
+	size_t p_maxLearnedCount;
+	vector< size_t > p_groupCosts;
+	size_t p_cost; // the lower bound of the current assignment
+	size_t p_bound; // the cost of the best model found
+	std::unique_ptr< Clause > p_boundClause;
+	vector< char > p_seen;
+
+	vector< Value > p_model;
+	size_t p_modelCost;
+	bool p_optimal;
+	size_t p_improvementConflictLimit;
+	Statistics p_statistics;
+
+	Value p_getValue(Literal) const;
+	uint32_t p_getLevel() const;
+	void p_assign(Literal, Clause*);
+	void p_updateGroupCost(uint32_t);
+	void p_backtrack(uint32_t level);
+	void p_attach(Clause*);
+	bool p_reset();
+	Clause* p_propagate();
+	Clause* p_checkBound();
+	bool p_isBoundDependent(const Clause*, Literal) const;
+	void p_analyze(const Clause*, vector< Literal >*, uint32_t*, bool*);
+	void p_bumpVariable(Variable);
+	void p_bumpClause(Clause*);
+	void p_reduceLearnedClauses();
+	bool p_isLocked(const Clause*) const;
+ public:
+	SatSolver();
+	~SatSolver();
+	SatSolver(const SatSolver&) = delete;
+	SatSolver& operator=(const SatSolver&) = delete;
+
+	// 'cost' is paid when the variable is true; auxiliary variables are
+	// decided only after all other ones
+	Variable addVariable(size_t cost, bool preferredValue, bool auxiliary = false);
+	void addClause(vector< Literal >);
+	// exactly one of the variables must be true in any model (the clauses
+	// have to ensure it), each variable may belong to only one group
+	void addCostGroup(vector< Variable >);
+	size_t getVariableCount() const;
+	size_t getClauseCount() const;
+
+	// after a model is found, give up searching for a cheaper one after this
+	// number of conflicts in a row; 0 means no limit
+	void setImprovementConflictLimit(size_t);
+
+	// searches for the model of the minimal cost, returns false if the
+	// clauses have no model; clauses may be added between the calls, what the
+	// previous calls learned without relying on their bounds is reused
+	bool solve();
+	bool getValue(Variable) const; // in the model
+	size_t getCost() const; // of the model
+	bool isOptimal() const; // whether no model is cheaper
+	const Statistics& getStatistics() const; // of all solve() calls
+};
+
+}
+}
+
+#endif
+
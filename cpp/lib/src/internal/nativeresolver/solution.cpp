@@ -38,103 +38,14 @@ bool PackageEntry::isModificationAllowed(const dg::Element* elementPtr) const
 	return (findResult == rejectedConflictors.end());
 }
 
-template < class data_t, class KeyGetter >
-class VectorBasedMap
-{
- public:
-	typedef const dg::Element* key_t;
-	typedef data_t value_type; // for set_union
-	typedef vector< data_t > container_t;
-	typedef data_t* iterator_t;
-	typedef const data_t* const_iterator_t;
- private:
-	container_t __container;
-	typename container_t::iterator __position_to_iterator(const_iterator_t position)
-	{
-		return static_cast< typename container_t::iterator >(const_cast< iterator_t >(position));
-	}
-	struct __comparator
-	{
-		bool operator()(const data_t& data, const key_t& key) const
-		{
-			return KeyGetter()(data) < key;
-		}
-	};
- public:
-	void init(container_t&& container) { __container.swap(container); }
-	size_t size() const { return __container.size(); }
-	void reserve(size_t size) { __container.reserve(size); }
-	const_iterator_t begin() const { return &*__container.begin(); }
-	const_iterator_t end() const { return &*__container.end(); }
-	const_iterator_t lower_bound(const key_t& key) const
-	{
-		return std::lower_bound(begin(), end(), key, __comparator());
-	}
-	iterator_t lower_bound(const key_t& key)
-	{
-		return const_cast< iterator_t >(((const VectorBasedMap*)this)->lower_bound(key));
-	}
-	const_iterator_t find(const key_t& key) const
-	{
-		auto result = lower_bound(key);
-		if (result != end() && KeyGetter()(*result) != key)
-		{
-			result = end();
-		}
-		return result;
-	}
-	// this insert() is called only for unexisting elements
-	iterator_t insert(const_iterator_t position, data_t&& data)
-	{
-		auto distance = position - begin();
-		__container.insert(__position_to_iterator(position), std::move(data));
-		return const_cast< iterator_t >(begin()) + distance;
-	}
-	void erase(const_iterator_t position)
-	{
-		__container.erase(__position_to_iterator(position));
-	}
-	void push_back(const data_t& data)
-	{
-		__container.push_back(data);
-	}
-	const container_t& getContainer() const
-	{
-		return __container;
-	}
-};
-
 typedef shared_ptr< const PackageEntry > SPPE;
 
-struct PackageEntryMapKeyGetter
-{
-	const dg::Element* operator()(const pair< const dg::Element*, SPPE >& data)
-	{ return data.first; }
-};
-class PackageEntryMap: public VectorBasedMap<
-		pair< const dg::Element*, SPPE >, PackageEntryMapKeyGetter >
-{
- public:
-	mutable size_t forkedCount;
-
-	PackageEntryMap()
-		: forkedCount(0)
-	{}
-};
-
-struct BrokenSuccessorMapKeyGetter
-{
-	const dg::Element* operator()(const BrokenSuccessor& data) { return data.elementPtr; }
-};
-class BrokenSuccessorMap: public VectorBasedMap< BrokenSuccessor, BrokenSuccessorMapKeyGetter >
-{};
-
 SolutionStorage::Change::Change(size_t parentSolutionId_)
 	: parentSolutionId(parentSolutionId_)
 {}
 
-SolutionStorage::SolutionStorage(const Config& config, const Cache& cache)
-	: __next_free_id(1), __dependency_graph(config, cache)
+SolutionStorage::SolutionStorage(dg::DependencyGraph& dependencyGraph)
+	: __next_free_id(1), __dependency_graph(dependencyGraph)
 {}
 
 size_t SolutionStorage::__get_new_solution_id(const Solution& parent)
@@ -153,6 +64,7 @@ shared_ptr< Solution > SolutionStorage::cloneSolution(const shared_ptr< Solution
 {
 	auto cloned = std::make_shared< Solution >();
 	cloned->score = source->score;
+	cloned->hash = source->hash;
 	cloned->level = source->level + 1;
 	cloned->id = __get_new_solution_id(*source);
 	cloned->finished = false;
@@ -164,12 +76,12 @@ shared_ptr< Solution > SolutionStorage::cloneSolution(const shared_ptr< Solution
 	return cloned;
 }
 
-const GraphCessorListType& SolutionStorage::getSuccessorElements(const dg::Element* elementPtr) const
+GraphCessorListType SolutionStorage::getSuccessorElements(const dg::Element* elementPtr) const
 {
 	return __dependency_graph.getSuccessorsFromPointer(elementPtr);
 }
 
-const GraphCessorListType& SolutionStorage::getPredecessorElements(const dg::Element* elementPtr) const
+GraphCessorListType SolutionStorage::getPredecessorElements(const dg::Element* elementPtr) const
 {
 	return __dependency_graph.getPredecessorsFromPointer(elementPtr);
 }
@@ -182,6 +94,48 @@ const forward_list< const dg::Element* >& SolutionStorage::getConflictingElement
 	return relatedElementPtrsPtr? *relatedElementPtrsPtr : nullList;
 }
 
+namespace {
+
+// splitmix64 finalizer
+uint64_t mixHash(uint64_t value)
+{
+	uint64_t result = value + 0x9e3779b97f4a7c15ull;
+	result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ull;
+	result = (result ^ (result >> 27)) * 0x94d049bb133111ebull;
+	return result ^ (result >> 31);
+}
+
+}
+
+uint64_t SolutionStorage::getElementHash(const dg::Element* elementPtr)
+{
+	auto versionElementPtr = dynamic_cast< const dg::VersionElement* >(elementPtr);
+	if (versionElementPtr && !versionElementPtr->version)
+	{
+		return 0;
+	}
+	return mixHash(elementPtr->id);
+}
+
+uint64_t SolutionStorage::getPackageEntryHash(const dg::Element* elementPtr, const PackageEntry& packageEntry)
+{
+	uint64_t result = 0;
+	if (packageEntry.sticked)
+	{
+		result ^= mixHash(~uint64_t(elementPtr->id));
+	}
+	const auto& rejected = packageEntry.rejectedConflictors;
+	for (auto it = rejected.begin(); it != rejected.end(); ++it)
+	{
+		if (std::find(rejected.begin(), it, *it) != it)
+		{
+			continue; // counted already
+		}
+		result ^= mixHash((uint64_t(elementPtr->id) << 32) ^ (*it)->id ^ 0x5a5a5a5aull);
+	}
+	return result;
+}
+
 bool SolutionStorage::simulateSetPackageEntry(const Solution& solution,
 		const dg::Element* elementPtr, const dg::Element** conflictingElementPtrPtr) const
 {
@@ -242,7 +196,7 @@ void SolutionStorage::__update_broken_successors(Solution& solution,
 		return;
 	}
 
-	auto& bss = *solution.__broken_successors;
+	auto& bss = solution.p_brokenSuccessors;
 
 	auto reverseDependencyExists = [this, &solution](const dg::Element* elementPtr)
 	{
@@ -269,12 +223,11 @@ void SolutionStorage::__update_broken_successors(Solution& solution,
 	{
 		if (isPresent(successorsOfNew, successorPtr)) continue;
 
-		auto it = bss.find(successorPtr);
-		if (it != bss.end())
+		if (bss.find(successorPtr->id))
 		{
 			if (!reverseDependencyExists(successorPtr))
 			{
-				bss.erase(it);
+				bss.erase(successorPtr->id);
 			}
 		}
 	}
@@ -283,17 +236,17 @@ void SolutionStorage::__update_broken_successors(Solution& solution,
 	{
 		if (isPresent(successorsOfOld, successorPtr)) continue;
 
-		auto it = bss.lower_bound(successorPtr);
-		if (it == bss.end() || it->elementPtr != successorPtr)
+		auto existing = bss.find(successorPtr->id);
+		if (!existing)
 		{
 			if (!verifyElement(solution, successorPtr))
 			{
-				bss.insert(it, BrokenSuccessor { successorPtr, priority });
+				bss.set(successorPtr->id, BrokenSuccessor { successorPtr, priority });
 			}
 		}
-		else
+		else if (existing->priority < priority)
 		{
-			it->priority = std::max(it->priority, priority);
+			bss.set(successorPtr->id, BrokenSuccessor { successorPtr, priority });
 		}
 	}
 
@@ -312,7 +265,7 @@ void SolutionStorage::__update_broken_successors(Solution& solution,
 				// here we assume brokenSuccessors didn't
 				// contain predecessorElementPtr, since as old element was
 				// present, predecessorElementPtr was not broken
-				bss.insert(bss.lower_bound(predecessorElementPtr),
+				bss.set(predecessorElementPtr->id,
 						BrokenSuccessor { predecessorElementPtr, priority });
 			}
 		}
@@ -322,11 +275,7 @@ void SolutionStorage::__update_broken_successors(Solution& solution,
 	{
 		if (isPresent(predecessorsOfOld, predecessorElementPtr)) continue;
 
-		auto it = bss.find(predecessorElementPtr);
-		if (it != bss.end())
-		{
-			bss.erase(it);
-		}
+		bss.erase(predecessorElementPtr->id);
 	}
 }
 
@@ -348,33 +297,34 @@ void SolutionStorage::setPackageEntry(Solution& solution,
 	__dependency_graph.unfoldElement(elementPtr);
 	__update_change_index(solution.id, elementPtr, packageEntry);
 
-	auto it = solution.__added_entries->lower_bound(elementPtr);
-	if (it == solution.__added_entries->end() || it->first != elementPtr)
-	{
-		// there is no modifiable element in this solution
-		solution.__added_entries->insert(it,
-				make_pair(elementPtr, std::make_shared< const PackageEntry >(std::move(packageEntry))));
-	}
-	else
+	auto& entries = solution.p_entries;
+	bool isPresent = entries.find(elementPtr->id);
+	if (conflictingElementPtr)
 	{
-		if (conflictingElementPtr && it->second)
+		if (isPresent)
 		{
-			fatal2i("conflicting elements in __added_entries: solution '%u', in '%s', out '%s'",
+			fatal2i("conflicting elements in the solution: solution '%u', in '%s', out '%s'",
 					solution.id, elementPtr->toString(), conflictingElementPtr->toString());
 		}
-		it->second = std::make_shared< const PackageEntry >(std::move(packageEntry));
 	}
+	if (isPresent)
+	{
+		solution.hash ^= getPackageEntryHash(elementPtr, *solution.getPackageEntry(elementPtr));
+	}
+	else
+	{
+		solution.hash ^= getElementHash(elementPtr);
+	}
+	solution.hash ^= getPackageEntryHash(elementPtr, packageEntry);
+	entries.set(elementPtr->id, { elementPtr, std::make_shared< const PackageEntry >(std::move(packageEntry)) });
 
 	if (conflictingElementPtr)
 	{
-		auto forRemovalIt = solution.__added_entries->lower_bound(conflictingElementPtr);
-		if (forRemovalIt != solution.__added_entries->end() && forRemovalIt->first == conflictingElementPtr)
-		{
-			forRemovalIt->second.reset();
-		}
-		else
+		if (auto conflictingPackageEntryPtr = solution.getPackageEntry(conflictingElementPtr))
 		{
-			solution.__added_entries->insert(forRemovalIt, { conflictingElementPtr, {} });
+			solution.hash ^= getElementHash(conflictingElementPtr) ^
+					getPackageEntryHash(conflictingElementPtr, *conflictingPackageEntryPtr);
+			entries.erase(conflictingElementPtr->id);
 		}
 	}
 
@@ -382,17 +332,11 @@ void SolutionStorage::setPackageEntry(Solution& solution,
 }
 
 void SolutionStorage::prepareForResolving(Solution& initialSolution,
-			const map< string, const BinaryVersion* >& oldPackages,
-			const map< string, dg::InitialPackageEntry >& initialPackages,
+			const dg::OldPackages& oldPackages,
+			const dg::InitialPackages& initialPackages,
 			const vector< dg::UserRelationExpression >& userRelationExpressions)
 {
-	auto source = __dependency_graph.fill(oldPackages, initialPackages);
-	/* User relation expressions must be processed before any unfoldElement() calls
-	   to early override version checks (if needed) for all explicitly required versions. */
-	for (const auto& userRelationExpression: userRelationExpressions)
-	{
-		__dependency_graph.addUserRelationExpression(userRelationExpression);
-	}
+	auto source = __dependency_graph.fill(oldPackages, initialPackages, userRelationExpressions);
 	for (const auto& record: source)
 	{
 		__dependency_graph.unfoldElement(record.first);
@@ -405,9 +349,12 @@ void SolutionStorage::prepareForResolving(Solution& initialSolution,
 	};
 	std::sort(source.begin(), source.end(), comparator);
 
-	initialSolution.p_initNonSharedStructures();
-	initialSolution.__added_entries->init(std::move(source));
-	for (const auto& entry: *initialSolution.__added_entries)
+	for (const auto& entry: source)
+	{
+		initialSolution.p_entries.set(entry.first->id, entry);
+		initialSolution.hash ^= getElementHash(entry.first) ^ getPackageEntryHash(entry.first, *entry.second);
+	}
+	for (const auto& entry: source)
 	{
 		__update_broken_successors(initialSolution, NULL, entry.first, 0);
 	}
@@ -457,6 +404,16 @@ void SolutionStorage::unfoldElement(const dg::Element* elementPtr)
 	__dependency_graph.unfoldElement(elementPtr);
 }
 
+void SolutionStorage::setGraphFrozen(bool value)
+{
+	__dependency_graph.setFrozen(value);
+}
+
+void SolutionStorage::applyDeferredChange(const dg::DeferredChange& change)
+{
+	__dependency_graph.applyDeferredChange(change);
+}
+
 size_t SolutionStorage::__getInsertPosition(size_t solutionId, const dg::Element* elementPtr) const
 {
 	while (solutionId != 0)
@@ -549,148 +506,51 @@ pair< const dg::Element*, const dg::Element* > SolutionStorage::getDiversedEleme
 }
 
 Solution::Solution()
-	: id(0), level(0), finished(false), score(0)
+	: id(0), level(0), finished(false), score(0), hash(0)
 {
 }
 
 Solution::~Solution()
 {}
 
-void Solution::p_initNonSharedStructures()
-{
-	__added_entries.reset(new PackageEntryMap);
-	__broken_successors.reset(new BrokenSuccessorMap);
-}
-
-template < typename CallbackType >
-void __foreach_solution_element(const PackageEntryMap& masterEntries, const PackageEntryMap& addedEntries,
-		CallbackType callback)
-{
-	class RepackInsertIterator: public std::iterator< std::output_iterator_tag, PackageEntryMap::value_type >
-	{
-		const CallbackType& __callback;
-	 public:
-		RepackInsertIterator(const CallbackType& callback_)
-			: __callback(callback_) {}
-		RepackInsertIterator& operator++() { return *this; }
-		RepackInsertIterator& operator*() { return *this; }
-		void operator=(const PackageEntryMap::value_type& data)
-		{
-			__callback(data);
-		}
-	};
-	struct Comparator
-	{
-		bool operator()(const PackageEntryMap::value_type& left, const PackageEntryMap::value_type& right)
-		{ return left.first < right.first; }
-	};
-	// it's important that parent's __added_entries come first,
-	// if two elements are present in both (i.e. an element is overriden)
-	// the new version of an element will be considered
-	std::set_union(addedEntries.begin(), addedEntries.end(),
-			masterEntries.begin(), masterEntries.end(),
-			RepackInsertIterator(callback), Comparator());
-}
-
 void Solution::prepare()
 {
 	if (!__parent) return; // prepared already
 
-	p_initNonSharedStructures();
+	p_entries = __parent->p_entries;
+	p_brokenSuccessors = __parent->p_brokenSuccessors;
+	__parent.reset();
+}
 
-	if (!__parent->__initial_entries)
-	{
-		// parent is initial (top-level) solution
-		__initial_entries = __parent->__added_entries;
-	}
-	else
+void Solution::unprepare(const shared_ptr< const Solution >& parent)
+{
+	__parent = parent;
+	if (parent)
 	{
-		__initial_entries = __parent->__initial_entries;
-
-		if (!__parent->__master_entries)
-		{
-			// parent solution is a master solution, build a slave on top of it
-			__master_entries = __parent->__added_entries;
-		}
-		else
-		{
-			// this a slave solution
-			size_t& forkedCount = __parent->__master_entries->forkedCount;
-			forkedCount += __parent->__added_entries->size();
-			if (forkedCount > __parent->__master_entries->size())
-			{
-				forkedCount = 0;
-
-				// master solution is overdiverted, build new master one
-				__added_entries->reserve(__parent->__added_entries->size() +
-						__parent->__master_entries->size());
-
-				__foreach_solution_element(*__parent->__master_entries, *__parent->__added_entries,
-						[this](const PackageEntryMap::value_type& data) { this->__added_entries->push_back(data); });
-			}
-			else
-			{
-				// build new slave solution from current
-				__master_entries = __parent->__master_entries;
-				*__added_entries = *(__parent->__added_entries);
-			}
-		}
+		hash = parent->hash;
 	}
-
-	*__broken_successors = *__parent->__broken_successors;
-	__parent.reset();
+	p_entries.clear();
+	p_brokenSuccessors.clear();
 }
 
 vector< const dg::Element* > Solution::getElements() const
 {
 	vector< const dg::Element* > result;
-
-	static const PackageEntryMap nullPackageEntryMap;
-	const auto& initialEntries = __initial_entries ? *__initial_entries : nullPackageEntryMap;
-	const auto& masterEntries = __master_entries ? *__master_entries : nullPackageEntryMap;
-
-	PackageEntryMap intermediateMap;
-	__foreach_solution_element(initialEntries, masterEntries,
-			[&intermediateMap](const PackageEntryMap::value_type& data) { intermediateMap.push_back(data); });
-
-	__foreach_solution_element(intermediateMap, *__added_entries,
-			[&result](const PackageEntryMap::value_type& data) { if (data.second) result.push_back(data.first); });
-
+	result.reserve(p_entries.size());
+	p_entries.foreach([&result](const PackageEntryMap::ValueType& data) { result.push_back(data.first); });
 	return result;
 }
 
-const vector< BrokenSuccessor >& Solution::getBrokenSuccessors() const
+const BrokenSuccessorMap& Solution::getBrokenSuccessors() const
 {
-	return __broken_successors->getContainer();
+	return p_brokenSuccessors;
 }
 
 const PackageEntry* Solution::getPackageEntry(const dg::Element* elementPtr) const
 {
-	auto it = __added_entries->find(elementPtr);
-	if (it != __added_entries->end())
-	{
-		return it->second.get();
-	}
-	if (__master_entries)
-	{
-		it = __master_entries->find(elementPtr);
-		if (it != __master_entries->end())
-		{
-			return it->second.get();
-		}
-	}
-	if (__initial_entries)
-	{
-		it = __initial_entries->find(elementPtr);
-		if (it != __initial_entries->end())
-		{
-			return it->second.get();
-		}
-	}
-
-	return nullptr; // not found
+	auto data = p_entries.find(elementPtr->id);
+	return data ? data->second.get() : nullptr;
 }
 
 }
 }
-
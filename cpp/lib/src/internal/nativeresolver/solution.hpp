@@ -28,6 +28,7 @@
 
 #include <internal/nativeresolver/score.hpp>
 #include <internal/nativeresolver/dependencygraph.hpp>
+#include <internal/nativeresolver/persistentmap.hpp>
 
 namespace cupt {
 namespace internal {
@@ -75,26 +76,37 @@ struct PackageEntry
 	bool isModificationAllowed(const dg::Element*) const;
 };
 
-class PackageEntryMap;
-class BrokenSuccessorMap;
-
 struct BrokenSuccessor
 {
 	const dg::Element* elementPtr;
 	size_t priority;
 };
+// by the type priority of the element, then by the priority
+struct BrokenSuccessorLess
+{
+	bool operator()(const BrokenSuccessor& left, const BrokenSuccessor& right) const
+	{
+		auto leftTypePriority = left.elementPtr->getTypePriority();
+		auto rightTypePriority = right.elementPtr->getTypePriority();
+		if (leftTypePriority != rightTypePriority)
+		{
+			return leftTypePriority < rightTypePriority;
+		}
+		return left.priority < right.priority;
+	}
+};
+
+// both are keyed by element ids
+typedef PersistentMap< pair< const dg::Element*, shared_ptr< const PackageEntry > > > PackageEntryMap;
+typedef PersistentMap< BrokenSuccessor, BrokenSuccessorLess > BrokenSuccessorMap;
 
 class Solution
 {
 	friend class SolutionStorage;
 
 	shared_ptr< const Solution > __parent;
-	shared_ptr< const PackageEntryMap > __initial_entries;
-	shared_ptr< const PackageEntryMap > __master_entries;
-	shared_ptr< PackageEntryMap > __added_entries;
-	unique_ptr< BrokenSuccessorMap > __broken_successors;
-
-	void p_initNonSharedStructures();
+	PackageEntryMap p_entries;
+	BrokenSuccessorMap p_brokenSuccessors;
  public:
 	struct Action
 	{
@@ -111,6 +123,7 @@ class Solution
 	size_t level;
 	bool finished;
 	ssize_t score;
+	uint64_t hash; // of the elements and their package entries, see SolutionStorage
 	std::unique_ptr< const Action > pendingAction;
 
 	Solution();
@@ -119,9 +132,13 @@ class Solution
 	~Solution();
 
 	void prepare();
+	// returns a prepared solution, whose pending action was not applied, to
+	// the unprepared state
+	void unprepare(const shared_ptr< const Solution >& parent);
+	const shared_ptr< const Solution >& getParent() const { return __parent; }
 	vector< const dg::Element* > getElements() const;
 
-	const vector< BrokenSuccessor >& getBrokenSuccessors() const;
+	const BrokenSuccessorMap& getBrokenSuccessors() const;
 	// result becomes invalid after any setPackageEntry
 	const PackageEntry* getPackageEntry(const dg::Element*) const;
 };
@@ -131,7 +148,7 @@ class SolutionStorage
 	size_t __next_free_id;
 	size_t __get_new_solution_id(const Solution& parent);
 
-	dg::DependencyGraph __dependency_graph;
+	dg::DependencyGraph& __dependency_graph;
 
 	void __update_broken_successors(Solution&,
 			const dg::Element*, const dg::Element*, size_t priority);
@@ -147,29 +164,38 @@ class SolutionStorage
 	void __update_change_index(size_t, const dg::Element*, const PackageEntry&);
 	size_t __getInsertPosition(size_t solutionId, const dg::Element*) const;
  public:
-	SolutionStorage(const Config&, const Cache& cache);
+	SolutionStorage(dg::DependencyGraph&);
 
 	shared_ptr< Solution > cloneSolution(const shared_ptr< Solution >&);
 	shared_ptr< Solution > fakeCloneSolution(const shared_ptr< Solution >&);
 
 	void prepareForResolving(Solution&,
-			const map< string, const BinaryVersion* >&,
-			const map< string, dg::InitialPackageEntry >&,
+			const dg::OldPackages&, const dg::InitialPackages&,
 			const vector< dg::UserRelationExpression >&);
 	const dg::Element* getCorrespondingEmptyElement(const dg::Element*);
-	const GraphCessorListType& getSuccessorElements(const dg::Element*) const;
-	const GraphCessorListType& getPredecessorElements(const dg::Element*) const;
+	GraphCessorListType getSuccessorElements(const dg::Element*) const;
+	GraphCessorListType getPredecessorElements(const dg::Element*) const;
 	bool verifyElement(const Solution&, const dg::Element*) const;
 
 	// may include parameter itself
 	static const forward_list< const dg::Element* >&
 			getConflictingElements(const dg::Element*);
+	// random-like key of the element for the solution hash, zero for empty
+	// versions, so that the hash tells which versions are chosen
+	static uint64_t getElementHash(const dg::Element*);
+	// key of the constraints the entry puts on the element: whether it is
+	// sticked and which conflictors it rejects
+	static uint64_t getPackageEntryHash(const dg::Element*, const PackageEntry&);
 	bool simulateSetPackageEntry(const Solution& solution,
 			const dg::Element*, const dg::Element**) const;
 	void setRejection(Solution&, const dg::Element*, const dg::Element*);
 	void setPackageEntry(Solution&, const dg::Element*,
 			PackageEntry&&, const dg::Element*, size_t);
 	void unfoldElement(const dg::Element*);
+	// while the graph is frozen, solutions may be processed concurrently;
+	// graph changes needed are thrown as dg::DeferredChange
+	void setGraphFrozen(bool);
+	void applyDeferredChange(const dg::DeferredChange&);
 
 	void processReasonElements(const Solution&, map< const dg::Element*, size_t >&,
 			const IntroducedBy&, const dg::Element*,
@@ -26,6 +26,9 @@ template < typename IterT, typename CallbackT >
 void processSpaceCharSpaceDelimitedStrings(IterT begin, IterT end,
 		char delimiter, const CallbackT&);
 
+// throws the same errors as parsing the relation line would, without building it
+void checkRelationLine(const char* begin, const char* end);
+
 }
 }
 }
@@ -177,14 +177,14 @@ unique_ptr< BinaryVersion > parseBinaryVersion(const VersionParseParameters& ini
 
 			if (Version::parseRelations)
 			{
-				TAG(Pre-Depends, v->relations[RelationTypes::PreDepends] = RelationLine(tagValue);)
-				TAG(Depends, v->relations[RelationTypes::Depends] = RelationLine(tagValue);)
-				TAG(Recommends, v->relations[RelationTypes::Recommends] = RelationLine(tagValue);)
-				TAG(Suggests, v->relations[RelationTypes::Suggests] = RelationLine(tagValue);)
-				TAG(Conflicts, v->relations[RelationTypes::Conflicts] = RelationLine(tagValue);)
-				TAG(Breaks, v->relations[RelationTypes::Breaks] = RelationLine(tagValue);)
-				TAG(Replaces, v->relations[RelationTypes::Replaces] = RelationLine(tagValue);)
-				TAG(Enhances, v->relations[RelationTypes::Enhances] = RelationLine(tagValue);)
+				TAG(Pre-Depends, v->relations.setRaw(RelationTypes::PreDepends, tagValue.first, tagValue.second);)
+				TAG(Depends, v->relations.setRaw(RelationTypes::Depends, tagValue.first, tagValue.second);)
+				TAG(Recommends, v->relations.setRaw(RelationTypes::Recommends, tagValue.first, tagValue.second);)
+				TAG(Suggests, v->relations.setRaw(RelationTypes::Suggests, tagValue.first, tagValue.second);)
+				TAG(Conflicts, v->relations.setRaw(RelationTypes::Conflicts, tagValue.first, tagValue.second);)
+				TAG(Breaks, v->relations.setRaw(RelationTypes::Breaks, tagValue.first, tagValue.second);)
+				TAG(Replaces, v->relations.setRaw(RelationTypes::Replaces, tagValue.first, tagValue.second);)
+				TAG(Enhances, v->relations.setRaw(RelationTypes::Enhances, tagValue.first, tagValue.second);)
 				TAG(Provides,
 				{
 					auto callback = [&v](const char* begin, const char* end)
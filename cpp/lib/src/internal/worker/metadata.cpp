@@ -25,6 +25,7 @@
 #include <cupt/config.hpp>
 #include <cupt/download/uri.hpp>
 #include <cupt/download/manager.hpp>
+#include <cupt/cache/releaseinfo.hpp>
 #include <cupt/file.hpp>
 
 #include <internal/filesystem.hpp>
@@ -32,6 +33,7 @@
 #include <internal/tagparser.hpp>
 #include <internal/common.hpp>
 #include <internal/indexofindex.hpp>
+#include <internal/binaryindex.hpp>
 
 #include <internal/worker/metadata.hpp>
 
@@ -95,6 +97,7 @@ std::function< string () > generateMovingSub(const string& downloadPath, const s
 	return [downloadPath, targetPath]() -> string
 	{
 		ioi::removeIndexOfIndex(targetPath);
+		binaryindex::remove(targetPath);
 		if (fs::move(downloadPath, targetPath))
 		{
 			return "";
@@ -978,6 +981,7 @@ void MetadataWorker::__list_cleanup(const string& lockPath)
 		if (includeIoi)
 		{
 			addUsedPattern(ioi::getIndexOfIndexPath(pathOfIndexList));
+			addUsedPattern(binaryindex::getPath(pathOfIndexList));
 		}
 
 		auto translationsPossiblePaths =
@@ -988,6 +992,7 @@ void MetadataWorker::__list_cleanup(const string& lockPath)
 			if (includeIoi)
 			{
 				addUsedPattern(ioi::getIndexOfIndexPath(pathIt->second));
+				addUsedPattern(binaryindex::getPath(pathIt->second));
 			}
 		}
 	}
@@ -1029,13 +1034,46 @@ void MetadataWorker::p_generateIndexesOfIndexes(const cachefiles::IndexEntry& in
 		if (!fs::fileExists(path)) return;
 		auto generator = (isMainIndex ? ioi::ps::generate : ioi::tr::generate);
 		generator(path, getIoiTemporaryPath(path));
+		if (!isMainIndex)
+		{
+			try
+			{
+				binaryindex::generateForTranslation(path, getDownloadPath(path) + ".cache");
+			}
+			catch (Exception&)
+			{
+				warn2(__("unable to generate the binary index for '%s'"), path);
+			}
+		}
 	};
 
-	generateForPath(cachefiles::getPathOfIndexList(*_config, indexEntry), true);
+	auto indexPath = cachefiles::getPathOfIndexList(*_config, indexEntry);
+	generateForPath(indexPath, true);
 	for (const auto& item: cachefiles::getPathsOfLocalizedDescriptions(*_config, indexEntry))
 	{
 		generateForPath(item.second, false);
 	}
+
+	p_generateBinaryIndex(indexEntry, indexPath);
+}
+
+void MetadataWorker::p_generateBinaryIndex(const cachefiles::IndexEntry& indexEntry, const string& indexPath)
+{
+	auto releasePath = cachefiles::getPathOfMasterReleaseLikeList(*_config, indexEntry);
+	if (!fs::fileExists(indexPath) || releasePath.empty()) return;
+
+	auto alias = indexEntry.uri + ' ' + indexEntry.distribution;
+	try
+	{
+		auto releaseInfo = cachefiles::getReleaseInfo(*_config, releasePath, alias);
+		auto keyringStamp = cachefiles::getKeyringStamp(*_config);
+		releaseInfo->verified = cachefiles::verifySignature(*_config, releasePath, alias);
+		binaryindex::generate(indexPath, getDownloadPath(indexPath) + ".cache", *releaseInfo, keyringStamp);
+	}
+	catch (Exception&)
+	{
+		warn2(__("unable to generate the binary index for '%s'"), indexPath);
+	}
 }
 
 bool MetadataWorker::p_metadataUpdateThread(download::Manager& downloadManager, const cachefiles::IndexEntry& indexEntry)
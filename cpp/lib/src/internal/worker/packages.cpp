@@ -776,7 +776,9 @@ void __expand_linked_actions(const Cache& cache, GraphAndAttributes& gaa, bool d
 					return; // this chain is not fully linked
 				}
 
-				const GraphCessorListType predecessors = gaa.graph.getPredecessorsFromPointer(fromPtr); // copying
+				const GraphCessorListType predecessorsView = gaa.graph.getPredecessorsFromPointer(fromPtr);
+				const vector< const InnerAction* > predecessors(
+						predecessorsView.begin(), predecessorsView.end()); // copying
 				FORIT(predecessorPtrIt, predecessors)
 				{
 					if (*predecessorPtrIt == toPtr)
@@ -790,7 +792,9 @@ void __expand_linked_actions(const Cache& cache, GraphAndAttributes& gaa, bool d
 					}
 				}
 
-				const GraphCessorListType successors = gaa.graph.getSuccessorsFromPointer(toPtr);
+				const GraphCessorListType successorsView = gaa.graph.getSuccessorsFromPointer(toPtr);
+				const vector< const InnerAction* > successors(
+						successorsView.begin(), successorsView.end()); // copying
 				FORIT(successorPtrIt, successors)
 				{
 					if (*successorPtrIt == fromPtr)
@@ -53,6 +53,11 @@ bool NativeResolver::resolve(Resolver::CallbackType callback)
 	return __impl->resolve(callback);
 }
 
+const NativeResolver::Statistics& NativeResolver::getStatistics() const
+{
+	return __impl->getStatistics();
+}
+
 }
 }
 
@@ -16,6 +16,9 @@
 *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA               *
 **************************************************************************/
 #include <map>
+#include <cstring>
+
+#include <sys/stat.h>
 
 #include <cupt/file.hpp>
 #include <cupt/system/state.hpp>
@@ -28,6 +31,7 @@
 #include <internal/tagparser.hpp>
 #include <internal/cacheimpl.hpp>
 #include <internal/common.hpp>
+#include <internal/filesystem.hpp>
 
 namespace cupt {
 
@@ -36,6 +40,7 @@ namespace internal {
 using std::map;
 
 typedef system::State::InstalledRecord InstalledRecord;
+typedef pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > > VersionSource;
 
 struct StateData
 {
@@ -44,6 +49,14 @@ struct StateData
 	map< string, shared_ptr< const InstalledRecord > > installedInfo;
 
 	void parseDpkgStatus();
+ private:
+	const VersionSource* installedSource;
+	const VersionSource* improperlyInstalledSource;
+
+	void addRecord(uint32_t offset, string&& packageName,
+			const shared_ptr< InstalledRecord >&, const char*, const char*);
+	uint32_t parseStatusFile(File*, string*);
+	bool useStatusIndex(const string&, const string&);
 };
 
 void parseStatusSubstrings(const string& packageName, const string& input,
@@ -123,9 +136,7 @@ static bool packageHasFullEntryInfo(const InstalledRecord& record)
 			record.status != InstalledRecord::Status::ConfigFiles;
 }
 
-typedef pair< shared_ptr< const ReleaseInfo >, shared_ptr< File > > VersionSource;
-
-VersionSource* createVersionSource(internal::CacheImpl* cacheImpl,
+const VersionSource* createVersionSource(internal::CacheImpl* cacheImpl,
 		const string& archiveName, const shared_ptr< File >& file)
 {
 	// filling release info
@@ -138,15 +149,257 @@ VersionSource* createVersionSource(internal::CacheImpl* cacheImpl,
 
 	cacheImpl->binaryReleaseData.push_back(releaseInfo);
 
-	cacheImpl->releaseInfoAndFileStorage.push_back(make_pair(releaseInfo, file));
-	return &*(cacheImpl->releaseInfoAndFileStorage.rbegin());
+	return cacheImpl->addIndexSlot(Cache::IndexEntry::Binary, releaseInfo, file);
+}
+
+// the status index holds everything which is read from the dpkg status file
+// on each run; it is valid while the status file has the same identity, size
+// and modification time
+namespace statusindex {
+
+const char magic[8] = "cuptsti";
+const uint32_t version = 1;
+
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordCount;
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	int64_t modifySeconds;
+	int64_t modifyNanoseconds;
+};
+
+// records: offset, want, flag, status, package name, provides
+void putUint32(string* output, uint32_t value)
+{
+	output->append(reinterpret_cast< const char* >(&value), sizeof(value));
+}
+
+void putString(string* output, const char* begin, const char* end)
+{
+	putUint32(output, end - begin);
+	output->append(begin, end);
+}
+
+void putRecord(string* output, uint32_t offset, const string& packageName,
+		const InstalledRecord& installedRecord, const string& provides)
+{
+	putUint32(output, offset);
+	*output += char(installedRecord.want);
+	*output += char(installedRecord.flag);
+	*output += char(installedRecord.status);
+	putString(output, packageName.data(), packageName.data() + packageName.size());
+	putString(output, provides.data(), provides.data() + provides.size());
+}
+
+class Cursor
+{
+	const char* p_current;
+	const char* p_end;
+ public:
+	Cursor(const char* begin, const char* end)
+		: p_current(begin), p_end(end)
+	{}
+	bool get(void* target, size_t size)
+	{
+		if (size_t(p_end - p_current) < size) return false;
+		memcpy(target, p_current, size);
+		p_current += size;
+		return true;
+	}
+	bool getString(const char** begin, const char** end)
+	{
+		uint32_t size;
+		if (!get(&size, sizeof(size)) || size_t(p_end - p_current) < size) return false;
+		*begin = p_current;
+		*end = p_current += size;
+		return true;
+	}
+	bool atEnd() const { return p_current == p_end; }
+};
+
+bool fillHeader(const string& statusPath, Header* header)
+{
+	struct stat st;
+	if (stat(statusPath.c_str(), &st) == -1) return false;
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, magic, sizeof(magic));
+	header->version = version;
+	header->device = st.st_dev;
+	header->inode = st.st_ino;
+	header->size = st.st_size;
+	header->modifySeconds = st.st_mtim.tv_sec;
+	header->modifyNanoseconds = st.st_mtim.tv_nsec;
+	return true;
+}
+
+void write(const string& path, Header header, uint32_t recordCount, const string& records)
+{
+	header.recordCount = recordCount;
+	writeFileAtomically(path, [&header, &records](File& file)
+	{
+		file.put(reinterpret_cast< const char* >(&header), sizeof(header));
+		file.put(records);
+	});
+}
+
+}
+
+void StateData::addRecord(uint32_t offset, string&& packageName,
+		const shared_ptr< InstalledRecord >& installedRecord,
+		const char* providesBegin, const char* providesEnd)
+{
+	if (packageHasFullEntryInfo(*installedRecord))
+	{
+		// this conditions mean that package is installed or
+		// semi-installed, regardless it has full entry info, so add it
+		// (info) to cache
+		internal::CacheImpl::PrePackageRecord prePackageRecord;
+		prePackageRecord.offset = offset;
+		prePackageRecord.releaseInfoAndFile = installedRecord->isBroken() ?
+				improperlyInstalledSource : installedSource;
+
+		auto it = cacheImpl->preBinaryPackages.insert({ packageName, {} }).first;
+		it->second.push_back(prePackageRecord);
+
+		if (providesBegin != providesEnd)
+		{
+			cacheImpl->processProvides(&it->first, providesBegin, providesEnd);
+		}
+	}
+
+	// add parsed info to installed_info
+	installedInfo.insert(pair< const string, shared_ptr< const InstalledRecord > >(
+			std::move(packageName), installedRecord));
+}
+
+bool StateData::useStatusIndex(const string& indexPath, const string& statusPath)
+{
+	if (!fs::fileExists(indexPath)) return false;
+
+	statusindex::Header expectedHeader;
+	if (!statusindex::fillHeader(statusPath, &expectedHeader)) return false;
+
+	string openError;
+	File file(indexPath, "rm", openError);
+	if (!openError.empty()) return false;
+	auto data = file.getBlock(fs::fileSize(indexPath));
+
+	statusindex::Cursor cursor(data.data, data.data + data.size);
+	statusindex::Header header;
+	if (!cursor.get(&header, sizeof(header))) return false;
+	auto recordCount = header.recordCount;
+	header.recordCount = 0;
+	if (memcmp(&header, &expectedHeader, sizeof(header))) return false;
+
+	// checking the whole index before adding anything
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		statusindex::Cursor recordCursor = cursor;
+		for (uint32_t i = 0; i < recordCount; ++i)
+		{
+			uint32_t offset;
+			uint8_t triplet[3];
+			const char* nameBegin;
+			const char* nameEnd;
+			const char* providesBegin;
+			const char* providesEnd;
+			if (!recordCursor.get(&offset, sizeof(offset)) || !recordCursor.get(triplet, sizeof(triplet)) ||
+					!recordCursor.getString(&nameBegin, &nameEnd) ||
+					!recordCursor.getString(&providesBegin, &providesEnd) ||
+					triplet[0] >= InstalledRecord::Want::Count ||
+					triplet[1] >= InstalledRecord::Flag::Count ||
+					triplet[2] >= InstalledRecord::Status::Count)
+			{
+				return false;
+			}
+			if (pass == 1)
+			{
+				auto installedRecord = std::make_shared< InstalledRecord >();
+				installedRecord->want = InstalledRecord::Want::Type(triplet[0]);
+				installedRecord->flag = InstalledRecord::Flag::Type(triplet[1]);
+				installedRecord->status = InstalledRecord::Status::Type(triplet[2]);
+				addRecord(offset, string(nameBegin, nameEnd), installedRecord,
+						providesBegin, providesEnd);
+			}
+		}
+		if (!recordCursor.atEnd()) return false;
+	}
+	return true;
+}
+
+uint32_t StateData::parseStatusFile(File* file, string* indexRecords)
+{
+	uint32_t recordCount = 0;
+
+	internal::TagParser parser(file);
+	internal::TagParser::StringRange tagName, tagValue;
+
+	string packageName;
+	uint32_t offset;
+
+	while ((offset = file->tell()), (parser.parseNextLine(tagName, tagValue) && !file->eof()))
+	{
+		string status;
+		string provides;
+		bool parsedTagsByIndex[4] = {0};
+		bool& packageNameIsPresent = parsedTagsByIndex[0];
+		bool& versionIsPresent = parsedTagsByIndex[2];
+		do
+		{
+#define TAG(str, index, code) \
+			if (!parsedTagsByIndex[index] && tagName.equal(BUFFER_AND_SIZE(str))) \
+			{ \
+				code; \
+				parsedTagsByIndex[index] = true; \
+				continue; \
+			} \
+
+			TAG("Package", 0, packageName = tagValue.toString())
+			TAG("Status", 1, status = tagValue.toString())
+			TAG("Version", 2, ;)
+			TAG("Provides", 3, provides = tagValue.toString())
+#undef TAG
+		} while (parser.parseNextLine(tagName, tagValue));
+
+		if (!versionIsPresent)
+		{
+			continue;
+		}
+		// we don't check package name for correctness - even if it's incorrent, we can't decline installed packages :(
+
+		if (!packageNameIsPresent)
+		{
+			fatal2(__("no package name in the record"));
+		}
+		auto installedRecord = std::make_shared< InstalledRecord >();
+		parseStatusSubstrings(packageName, status, installedRecord);
+
+		statusindex::putRecord(indexRecords, offset, packageName, *installedRecord, provides);
+		++recordCount;
+
+		addRecord(offset, std::move(packageName), installedRecord,
+				provides.data(), provides.data() + provides.size());
+	}
+
+	return recordCount;
 }
 
 void StateData::parseDpkgStatus()
 {
 	string path = config->getPath("dir::state::status");
+
+	// taken before the status file is read, so a concurrent change of the file
+	// invalidates the index
+	statusindex::Header indexHeader;
+	bool indexable = statusindex::fillHeader(path, &indexHeader);
+
 	string openError;
-	shared_ptr< File > file(new File(path, "r", openError));
+	shared_ptr< File > file(new File(path, "rm", openError));
 	if (!openError.empty())
 	{
 		fatal2(__("unable to open the dpkg status file '%s': %s"), path, openError);
@@ -159,85 +412,30 @@ void StateData::parseDpkgStatus()
 	    and 'Section' fields.
 	*/
 
-	auto installedSource = createVersionSource(cacheImpl, "installed", file);
-	auto improperlyInstalledSource = createVersionSource(cacheImpl, "improperly-installed", file);
+	installedSource = createVersionSource(cacheImpl, "installed", file);
+	improperlyInstalledSource = createVersionSource(cacheImpl, "improperly-installed", file);
 
-	auto preBinaryPackages = &(cacheImpl->preBinaryPackages);
-
-	internal::CacheImpl::PrePackageRecord prePackageRecord;
+	auto indexPath = config->getPath("cupt::directory::state::status-index");
+	if (useStatusIndex(indexPath, path))
+	{
+		return;
+	}
 
+	string indexRecords;
+	uint32_t recordCount;
 	try
 	{
-		internal::TagParser parser(file.get());
-		internal::TagParser::StringRange tagName, tagValue;
-
-		pair< const string, vector< internal::CacheImpl::PrePackageRecord > > pairForInsertion;
-		string& packageName = const_cast< string& >(pairForInsertion.first);
-
-		while ((prePackageRecord.offset = file->tell()), (parser.parseNextLine(tagName, tagValue) && !file->eof()))
-		{
-			string status;
-			string provides;
-			bool parsedTagsByIndex[4] = {0};
-			bool& packageNameIsPresent = parsedTagsByIndex[0];
-			bool& versionIsPresent = parsedTagsByIndex[2];
-			do
-			{
-#define TAG(str, index, code) \
-				if (!parsedTagsByIndex[index] && tagName.equal(BUFFER_AND_SIZE(str))) \
-				{ \
-					code; \
-					parsedTagsByIndex[index] = true; \
-					continue; \
-				} \
-
-				TAG("Package", 0, packageName = tagValue.toString())
-				TAG("Status", 1, status = tagValue.toString())
-				TAG("Version", 2, ;)
-				TAG("Provides", 3, provides = tagValue.toString())
-#undef TAG
-			} while (parser.parseNextLine(tagName, tagValue));
-
-			if (!versionIsPresent)
-			{
-				continue;
-			}
-			// we don't check package name for correctness - even if it's incorrent, we can't decline installed packages :(
-
-			if (!packageNameIsPresent)
-			{
-				fatal2(__("no package name in the record"));
-			}
-			auto installedRecord = std::make_shared< InstalledRecord >();
-			parseStatusSubstrings(packageName, status, installedRecord);
-
-			if (packageHasFullEntryInfo(*installedRecord))
-			{
-				// this conditions mean that package is installed or
-				// semi-installed, regardless it has full entry info, so add it
-				// (info) to cache
-				prePackageRecord.releaseInfoAndFile = installedRecord->isBroken() ?
-						improperlyInstalledSource : installedSource;
-
-				auto it = preBinaryPackages->insert(pairForInsertion).first;
-				it->second.push_back(prePackageRecord);
-
-				if (!provides.empty())
-				{
-					cacheImpl->processProvides(&it->first,
-							&*(provides.begin()), &*(provides.end()));
-				}
-			}
-
-			// add parsed info to installed_info
-			installedInfo.insert(pair< const string, shared_ptr< const InstalledRecord > >(
-					std::move(packageName), std::move(installedRecord)));
-		}
+		recordCount = parseStatusFile(file.get(), &indexRecords);
 	}
 	catch (Exception&)
 	{
 		fatal2(__("error parsing the dpkg status file '%s'"), path);
 	}
+
+	if (indexable)
+	{
+		statusindex::write(indexPath, indexHeader, recordCount, indexRecords);
+	}
 }
 
 }